@@ -0,0 +1,62 @@
+#include "camera_path.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <iostream>
+#include <numbers>
+#include <sstream>
+#include <string>
+
+std::optional<std::vector<CameraKeyframe>> readCameraPath(const std::filesystem::path& file)
+{
+    std::ifstream stream { file };
+    if (!stream) {
+        std::cerr << "Could not open camera path " << file << std::endl;
+        return {};
+    }
+
+    std::vector<CameraKeyframe> path;
+    std::string line;
+    for (int lineNumber = 1; std::getline(stream, line); lineNumber++) {
+        std::istringstream lineStream { line };
+        CameraKeyframe keyframe;
+        if (std::string first; !(lineStream >> first) || first[0] == '#')
+            continue;
+        lineStream.seekg(0);
+        if (!(lineStream >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.lookAt.x >> keyframe.lookAt.y >> keyframe.lookAt.z)) {
+            std::cerr << "Invalid camera keyframe on line " << lineNumber << " of " << file << std::endl;
+            return {};
+        }
+        path.push_back(keyframe);
+    }
+    if (path.empty()) {
+        std::cerr << "Camera path " << file << " has no keyframes" << std::endl;
+        return {};
+    }
+    return path;
+}
+
+// The camera looks down at the center from 20 percent of the distance above it.
+std::vector<CameraKeyframe> createOrbitCameraPath(const glm::vec3& center, float distance, int numKeyframes)
+{
+    std::vector<CameraKeyframe> path;
+    for (int i = 0; i < numKeyframes; i++) {
+        const float angle = 2.0f * std::numbers::pi_v<float> * float(i) / float(numKeyframes);
+        const glm::vec3 direction = glm::normalize(glm::vec3(std::cos(angle), 0.2f, std::sin(angle)));
+        path.push_back({ center + distance * direction, center });
+    }
+    return path;
+}
+
+CameraKeyframe sampleCameraPath(gsl::span<const CameraKeyframe> path, int frame, int numFrames)
+{
+    if (path.size() == 1 || numFrames <= 1)
+        return path[0];
+
+    const float position = float(frame) / float(numFrames - 1) * float(path.size() - 1);
+    const size_t key = std::min(static_cast<size_t>(position), path.size() - 2);
+    const float t = position - float(key);
+    return { glm::mix(path[key].position, path[key + 1].position, t), glm::mix(path[key].lookAt, path[key + 1].lookAt, t) };
+}
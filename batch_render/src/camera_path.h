@@ -0,0 +1,21 @@
+#pragma once
+#include <filesystem>
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <optional>
+#include <vector>
+
+struct CameraKeyframe {
+    glm::vec3 position;
+    glm::vec3 lookAt;
+};
+
+// Reads a camera path with one keyframe per line: "position.x position.y position.z lookAt.x lookAt.y lookAt.z".
+// Empty lines and lines starting with # are skipped. Returns an empty optional if the file cannot be read.
+std::optional<std::vector<CameraKeyframe>> readCameraPath(const std::filesystem::path& file);
+// Keyframes on a circle around center (slightly above it) that all look at center.
+std::vector<CameraKeyframe> createOrbitCameraPath(const glm::vec3& center, float distance, int numKeyframes);
+
+// Camera of frame (0 to numFrames - 1) when the path is resampled to numFrames frames: the keyframes are spread
+// uniformly over the frames and the frames in between are interpolated linearly.
+CameraKeyframe sampleCameraPath(gsl::span<const CameraKeyframe> path, int frame, int numFrames);
@@ -0,0 +1,190 @@
+#include "image_writer.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+// Appends integers in little (OpenEXR) or big (PNG) endian byte order.
+static void appendLittleEndian(std::vector<uint8_t>& bytes, uint64_t value, int numBytes)
+{
+    for (int i = 0; i < numBytes; i++)
+        bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+static void appendBigEndian(std::vector<uint8_t>& bytes, uint32_t value)
+{
+    for (int i = 3; i >= 0; i--)
+        bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+static void appendFloat(std::vector<uint8_t>& bytes, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    appendLittleEndian(bytes, bits, 4);
+}
+
+static void appendString(std::vector<uint8_t>& bytes, std::string_view string)
+{
+    bytes.insert(std::end(bytes), std::begin(string), std::end(string));
+    bytes.push_back(0);
+}
+
+static bool writeFile(const std::filesystem::path& file, const std::vector<uint8_t>& bytes)
+{
+    std::ofstream stream { file, std::ios::binary };
+    stream.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!stream) {
+        std::cerr << "Could not write " << file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Pixel (x, row) of the image, counting rows from the top.
+static glm::vec4 imagePixel(gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution, int x, int row)
+{
+    return frameBuffer[static_cast<size_t>(x + resolution.x * (resolution.y - 1 - row))];
+}
+
+static uint32_t crc32(gsl::span<const uint8_t> bytes)
+{
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> result;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            result[i] = c;
+        }
+        return result;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (uint8_t byte : bytes)
+        crc = table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static uint32_t adler32(gsl::span<const uint8_t> bytes)
+{
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : bytes) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+// Chunk: length, type, data and the CRC of type and data.
+static void appendPNGChunk(std::vector<uint8_t>& bytes, std::string_view type, const std::vector<uint8_t>& data)
+{
+    appendBigEndian(bytes, static_cast<uint32_t>(data.size()));
+    const size_t typeStart = bytes.size();
+    bytes.insert(std::end(bytes), std::begin(type), std::end(type));
+    bytes.insert(std::end(bytes), std::begin(data), std::end(data));
+    appendBigEndian(bytes, crc32(gsl::span(bytes).subspan(typeStart)));
+}
+
+bool writePNG(const std::filesystem::path& file, gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution)
+{
+    // Every row starts with filter type 0 (none).
+    std::vector<uint8_t> scanLines;
+    for (int row = 0; row < resolution.y; row++) {
+        scanLines.push_back(0);
+        for (int x = 0; x < resolution.x; x++) {
+            glm::vec4 pixel = imagePixel(frameBuffer, resolution, x, row);
+            if (pixel.a > 0.0f)
+                pixel = glm::vec4(glm::vec3(pixel) / pixel.a, pixel.a);
+            for (int c = 0; c < 4; c++)
+                scanLines.push_back(static_cast<uint8_t>(std::clamp(pixel[c], 0.0f, 1.0f) * 255.0f + 0.5f));
+        }
+    }
+
+    // zlib stream of stored (uncompressed) deflate blocks of at most 65535 bytes.
+    std::vector<uint8_t> imageData { 0x78, 0x01 };
+    for (size_t offset = 0; offset < scanLines.size() || offset == 0; offset += 65535) {
+        const size_t blockSize = std::min<size_t>(65535, scanLines.size() - offset);
+        const bool lastBlock = offset + blockSize == scanLines.size();
+        imageData.push_back(lastBlock ? 1 : 0);
+        appendLittleEndian(imageData, blockSize, 2);
+        appendLittleEndian(imageData, ~blockSize & 0xFFFF, 2);
+        imageData.insert(std::end(imageData), std::begin(scanLines) + std::ptrdiff_t(offset), std::begin(scanLines) + std::ptrdiff_t(offset + blockSize));
+    }
+    appendBigEndian(imageData, adler32(scanLines));
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, static_cast<uint32_t>(resolution.x));
+    appendBigEndian(header, static_cast<uint32_t>(resolution.y));
+    header.insert(std::end(header), { 8, 6, 0, 0, 0 }); // 8 bits per channel, RGBA, deflate, no filtering, no interlacing
+
+    std::vector<uint8_t> bytes { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    appendPNGChunk(bytes, "IHDR", header);
+    appendPNGChunk(bytes, "IDAT", imageData);
+    appendPNGChunk(bytes, "IEND", {});
+    return writeFile(file, bytes);
+}
+
+// Header attribute: name, type name, size of the value and the value.
+static void appendEXRAttribute(std::vector<uint8_t>& bytes, std::string_view name, std::string_view type, const std::vector<uint8_t>& value)
+{
+    appendString(bytes, name);
+    appendString(bytes, type);
+    appendLittleEndian(bytes, value.size(), 4);
+    bytes.insert(std::end(bytes), std::begin(value), std::end(value));
+}
+
+bool writeEXR(const std::filesystem::path& file, gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution)
+{
+    // The channels must be sorted by name; channel (A, B, G, R) is component (3, 2, 1, 0) of a pixel.
+    static constexpr std::array<int, 4> components { 3, 2, 1, 0 };
+    std::vector<uint8_t> channels;
+    for (std::string_view name : { "A", "B", "G", "R" }) {
+        appendString(channels, name);
+        appendLittleEndian(channels, 2, 4); // FLOAT
+        appendLittleEndian(channels, 0, 4); // linear (1 byte) and reserved
+        appendLittleEndian(channels, 1, 4); // x sampling
+        appendLittleEndian(channels, 1, 4); // y sampling
+    }
+    channels.push_back(0);
+
+    std::vector<uint8_t> window;
+    for (uint32_t value : { 0u, 0u, uint32_t(resolution.x - 1), uint32_t(resolution.y - 1) })
+        appendLittleEndian(window, value, 4);
+    std::vector<uint8_t> one, center;
+    appendFloat(one, 1.0f);
+    appendFloat(center, 0.0f);
+    appendFloat(center, 0.0f);
+
+    std::vector<uint8_t> bytes;
+    appendLittleEndian(bytes, 20000630, 4); // magic number
+    appendLittleEndian(bytes, 2, 4); // version 2, single part scan line file
+    appendEXRAttribute(bytes, "channels", "chlist", channels);
+    appendEXRAttribute(bytes, "compression", "compression", { 0 });
+    appendEXRAttribute(bytes, "dataWindow", "box2i", window);
+    appendEXRAttribute(bytes, "displayWindow", "box2i", window);
+    appendEXRAttribute(bytes, "lineOrder", "lineOrder", { 0 }); // increasing y
+    appendEXRAttribute(bytes, "pixelAspectRatio", "float", one);
+    appendEXRAttribute(bytes, "screenWindowCenter", "v2f", center);
+    appendEXRAttribute(bytes, "screenWindowWidth", "float", one);
+    bytes.push_back(0);
+
+    // Offset table followed by one block per scan line: y, data size and the channels one after the other.
+    const size_t lineDataSize = size_t(resolution.x) * components.size() * sizeof(float);
+    const size_t firstBlock = bytes.size() + size_t(resolution.y) * sizeof(uint64_t);
+    for (int row = 0; row < resolution.y; row++)
+        appendLittleEndian(bytes, firstBlock + size_t(row) * (8 + lineDataSize), 8);
+    for (int row = 0; row < resolution.y; row++) {
+        appendLittleEndian(bytes, uint32_t(row), 4);
+        appendLittleEndian(bytes, lineDataSize, 4);
+        for (int component : components) {
+            for (int x = 0; x < resolution.x; x++)
+                appendFloat(bytes, imagePixel(frameBuffer, resolution, x, row)[component]);
+        }
+    }
+    return writeFile(file, bytes);
+}
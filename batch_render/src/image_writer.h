@@ -0,0 +1,13 @@
+#pragma once
+#include <filesystem>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <gsl/span>
+
+// Write a frame buffer of render::Renderer (pre-multiplied RGBA, first row at the bottom) to an image file with the
+// first row at the top. Return false (and report the error) if the file cannot be written.
+
+// 8-bit RGBA PNG with straight (not pre-multiplied) alpha. The image data is stored without compression.
+bool writePNG(const std::filesystem::path& file, gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution);
+// 32-bit float RGBA OpenEXR (scan lines without compression) with pre-multiplied alpha, as OpenEXR expects.
+bool writeEXR(const std::filesystem::path& file, gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution);
@@ -0,0 +1,312 @@
+// Renders a volume from the command line without a window, for example to produce the frames of an animation on a
+// machine without a display. See printUsage for the arguments.
+#include "camera_path.h"
+#include "image_writer.h"
+#include "render/look_at_camera.h"
+#include "render/render_config.h"
+#include "render/renderer.h"
+#include "render/sort_last.h"
+#include "volume/execution_policy.h"
+#include "volume/gradient_volume.h"
+#include "volume/volume.h"
+#include "volume/volume_blocks.h"
+#include "volume/volume_pyramid.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <glm/gtx/component_wise.hpp>
+#include <glm/trigonometric.hpp>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tbb/parallel_for.h>
+#include <vector>
+
+struct Options {
+    std::filesystem::path volumeFile;
+    std::filesystem::path configFile;
+    std::optional<std::filesystem::path> optCameraPathFile;
+    // Number of frames of an orbit around the volume (used when there is no camera path).
+    int orbitFrames { 1 };
+    // Number of frames that the camera path is resampled to (default: one frame per keyframe).
+    std::optional<int> optNumFrames;
+    // Render the frames in [firstFrame, lastFrame] only, to split an animation over multiple processes.
+    int firstFrame { 0 };
+    std::optional<int> optLastFrame;
+    std::optional<glm::ivec2> optResolution;
+    float fovyDegrees { 60.0f };
+    volume::InterpolationMode interpolationMode { volume::InterpolationMode::Linear };
+    volume::VoxelLayout voxelLayout { volume::VoxelLayout::Linear };
+    volume::GradientStorage gradientStorage { volume::GradientStorage::Full };
+    // Number of blocks that the volume is split into for sort-last rendering (a power of two; 1 renders the volume as a
+    // whole).
+    size_t numBlocks { 1 };
+    // Threads of the process (0 for one per core) and whether to use a task arena per NUMA node.
+    int numThreads { 0 };
+    bool numaArenas { false };
+    std::filesystem::path outputDirectory { "." };
+    std::string format { "png" };
+};
+
+static void printUsage()
+{
+    std::cerr << "Usage: BatchRender <volume.fld> --config <file> [options]\n"
+                 "  --config <file>          render settings as saved by the viewer (Load tab)\n"
+                 "  --camera-path <file>     one keyframe per line: position.xyz lookAt.xyz\n"
+                 "  --orbit <frames>         orbit around the volume (when there is no camera path)\n"
+                 "  --frames <n>             resample the camera path to n frames\n"
+                 "  --first <frame>          first frame to render (default 0)\n"
+                 "  --last <frame>           last frame to render (default: the last frame)\n"
+                 "  --resolution <w>x<h>     overrides the resolution of the config\n"
+                 "  --fov <degrees>          vertical field of view (default 60)\n"
+                 "  --interpolation <mode>   nearest, linear (default) or cubic\n"
+                 "  --layout <layout>        linear (default) or bricked\n"
+                 "  --gradients <storage>    full (default), compact, on-the-fly or cached\n"
+                 "  --blocks <n>             render n blocks of the volume and composite them (n a power of two)\n"
+                 "  --threads <n>            number of threads (default: one per core)\n"
+                 "  --numa <on|off>          a task arena per NUMA node, and the volume spread over the nodes (default off)\n"
+                 "  --output <directory>     where the frames are written as frame_<number>.<format>\n"
+                 "  --format <format>        png (default) or exr\n";
+}
+
+template <typename T>
+static bool parseChoice(std::string_view value, const std::map<std::string_view, T>& choices, T& result)
+{
+    const auto iter = choices.find(value);
+    if (iter == std::end(choices))
+        return false;
+    result = iter->second;
+    return true;
+}
+
+static std::optional<Options> parseOptions(int argc, char** argv)
+{
+    Options options;
+    bool hasVolume = false, hasConfig = false;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view argument = argv[i];
+        if (argument.substr(0, 2) != "--") {
+            options.volumeFile = argument;
+            hasVolume = true;
+            continue;
+        }
+        if (i + 1 == argc) {
+            std::cerr << "Missing value for " << argument << std::endl;
+            return {};
+        }
+
+        const std::string value = argv[++i];
+        bool valid = true;
+        try {
+            if (argument == "--config") {
+                options.configFile = value;
+                hasConfig = true;
+            } else if (argument == "--camera-path") {
+                options.optCameraPathFile = value;
+            } else if (argument == "--orbit") {
+                options.orbitFrames = std::stoi(value);
+                valid = options.orbitFrames > 0;
+            } else if (argument == "--frames") {
+                options.optNumFrames = std::stoi(value);
+                valid = *options.optNumFrames > 0;
+            } else if (argument == "--first") {
+                options.firstFrame = std::stoi(value);
+            } else if (argument == "--last") {
+                options.optLastFrame = std::stoi(value);
+            } else if (argument == "--resolution") {
+                const size_t separator = value.find('x');
+                options.optResolution = glm::ivec2(std::stoi(value.substr(0, separator)), std::stoi(value.substr(separator + 1)));
+                valid = separator != std::string::npos && glm::all(glm::greaterThan(*options.optResolution, glm::ivec2(0)));
+            } else if (argument == "--fov") {
+                options.fovyDegrees = std::stof(value);
+            } else if (argument == "--interpolation") {
+                valid = parseChoice(value, { { "nearest", volume::InterpolationMode::NearestNeighbour }, { "linear", volume::InterpolationMode::Linear }, { "cubic", volume::InterpolationMode::Cubic } }, options.interpolationMode);
+            } else if (argument == "--layout") {
+                valid = parseChoice(value, { { "linear", volume::VoxelLayout::Linear }, { "bricked", volume::VoxelLayout::Bricked } }, options.voxelLayout);
+            } else if (argument == "--gradients") {
+                valid = parseChoice(value,
+                    { { "full", volume::GradientStorage::Full }, { "compact", volume::GradientStorage::Compact }, { "on-the-fly", volume::GradientStorage::OnTheFly }, { "cached", volume::GradientStorage::Cached } },
+                    options.gradientStorage);
+            } else if (argument == "--blocks") {
+                const int numBlocks = std::stoi(value);
+                valid = numBlocks > 0 && std::has_single_bit(static_cast<unsigned>(numBlocks));
+                options.numBlocks = static_cast<size_t>(numBlocks);
+            } else if (argument == "--threads") {
+                options.numThreads = std::stoi(value);
+                valid = options.numThreads > 0;
+            } else if (argument == "--numa") {
+                options.numaArenas = value == "on";
+                valid = value == "on" || value == "off";
+            } else if (argument == "--output") {
+                options.outputDirectory = value;
+            } else if (argument == "--format") {
+                options.format = value;
+                valid = value == "png" || value == "exr";
+            } else {
+                std::cerr << "Unknown option " << argument << std::endl;
+                return {};
+            }
+        } catch (const std::exception&) {
+            valid = false;
+        }
+        if (!valid) {
+            std::cerr << "Invalid value " << value << " for " << argument << std::endl;
+            return {};
+        }
+    }
+
+    if (!hasVolume || !hasConfig) {
+        std::cerr << "A volume and a render config are required" << std::endl;
+        return {};
+    }
+    return options;
+}
+
+// A block of the volume with its own copy of the voxels (see volume::extractBlock) and gradients.
+struct BlockVolume {
+    volume::VolumeBlock block;
+    std::unique_ptr<volume::Volume> pVolume;
+    std::unique_ptr<volume::GradientVolume> pGradientVolume;
+};
+
+int main(int argc, char** argv)
+{
+    const std::optional<Options> optOptions = parseOptions(argc, argv);
+    if (!optOptions) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+    const Options& options = *optOptions;
+
+    std::ifstream configStream { options.configFile };
+    if (!configStream) {
+        std::cerr << "Could not open render config " << options.configFile << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::optional<render::RenderConfig> optConfig = render::readRenderConfig(configStream);
+    if (!optConfig)
+        return EXIT_FAILURE;
+    render::RenderConfig config = *optConfig;
+    // There is no window (and no OpenGL context) and the camera changes every frame.
+    config.renderBackend = render::RenderBackend::CPU;
+    config.sampleCache = false;
+    if (options.optResolution)
+        config.renderResolution = *options.optResolution;
+
+    if (!std::filesystem::exists(options.volumeFile)) {
+        std::cerr << "Volume " << options.volumeFile << " does not exist" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (options.numBlocks > 1 && config.levelOfDetail) {
+        std::cerr << "Levels of detail are not supported with --blocks" << std::endl;
+        return EXIT_FAILURE;
+    }
+    // Before loading the volume, whose voxels and gradients are initialized by the threads of the policy.
+    volume::ExecutionConfig executionConfig;
+    executionConfig.numThreads = options.numThreads;
+    executionConfig.numaArenas = options.numaArenas;
+    volume::ExecutionPolicy::setGlobal(executionConfig);
+
+    volume::Volume volume { options.volumeFile, options.voxelLayout };
+    volume.interpolationMode = options.interpolationMode;
+    // The gradients of the whole volume are only needed when it is rendered as a whole.
+    std::optional<volume::GradientVolume> optGradientVolume;
+    std::vector<BlockVolume> blockVolumes;
+    float gradientMaxMagnitude = 0.0f;
+    if (options.numBlocks == 1) {
+        optGradientVolume.emplace(volume, options.gradientStorage);
+        optGradientVolume->interpolationMode = options.interpolationMode;
+    } else {
+        for (const volume::VolumeBlock& block : volume::partitionVolume(volume.dims(), options.numBlocks)) {
+            BlockVolume& blockVolume = blockVolumes.emplace_back(BlockVolume { block, std::make_unique<volume::Volume>(volume::extractBlock(volume, block)), nullptr });
+            blockVolume.pVolume->interpolationMode = options.interpolationMode;
+            blockVolume.pGradientVolume = std::make_unique<volume::GradientVolume>(*blockVolume.pVolume, options.gradientStorage);
+            blockVolume.pGradientVolume->interpolationMode = options.interpolationMode;
+            gradientMaxMagnitude = std::max(gradientMaxMagnitude, blockVolume.pGradientVolume->maxMagnitude());
+        }
+    }
+    // Only built if the render config samples the levels of detail.
+    std::optional<volume::VolumePyramid> optVolumePyramid;
+    if (config.levelOfDetail)
+        optVolumePyramid.emplace(volume, *optGradientVolume);
+
+    // Without a camera path the camera orbits the volume at the distance at which the viewer starts.
+    std::vector<CameraKeyframe> cameraPath;
+    if (options.optCameraPathFile) {
+        auto optCameraPath = readCameraPath(*options.optCameraPathFile);
+        if (!optCameraPath)
+            return EXIT_FAILURE;
+        cameraPath = std::move(*optCameraPath);
+    } else {
+        const float maxDimension = float(glm::compMax(volume.dims()));
+        cameraPath = createOrbitCameraPath(glm::vec3(volume.dims()) / 2.0f, maxDimension, options.orbitFrames);
+    }
+    const int numFrames = options.optNumFrames.value_or(int(cameraPath.size()));
+    const int firstFrame = std::max(options.firstFrame, 0);
+    const int lastFrame = std::min(options.optLastFrame.value_or(numFrames - 1), numFrames - 1);
+    if (firstFrame > lastFrame) {
+        std::cerr << "No frames in [" << firstFrame << ", " << lastFrame << "]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(options.outputDirectory, error);
+    if (error) {
+        std::cerr << "Could not create " << options.outputDirectory << ": " << error.message() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Every frame has its own renderer, so that frames render in parallel; each renderer also parallelizes over the
+    // tiles of its frame, which keeps all cores busy at the start and end of the range.
+    const float fovy = glm::radians(options.fovyDegrees);
+    const float aspectRatio = float(config.renderResolution.x) / float(config.renderResolution.y);
+    std::mutex outputMutex;
+    bool success = true;
+    tbb::parallel_for(firstFrame, lastFrame + 1, [&](int frame) {
+        const CameraKeyframe keyframe = sampleCameraPath(cameraPath, frame, numFrames);
+        const render::LookAtCamera camera { keyframe.position, keyframe.lookAt, fovy, aspectRatio };
+
+        using clock = std::chrono::steady_clock;
+        const auto start = clock::now();
+        std::vector<glm::vec4> image;
+        if (blockVolumes.empty()) {
+            render::Renderer renderer { &volume, &optGradientVolume.value(), &camera, config };
+            if (optVolumePyramid)
+                renderer.setVolumePyramid(&optVolumePyramid.value());
+            renderer.render();
+            image.assign(std::begin(renderer.frameBuffer()), std::end(renderer.frameBuffer()));
+        } else {
+            // Every block is rendered like a node of a cluster would, after which the images are composited.
+            std::vector<render::BlockImage> blockImages;
+            for (const BlockVolume& blockVolume : blockVolumes) {
+                const render::BlockCamera blockCamera { &camera, blockVolume.block };
+                render::Renderer renderer { blockVolume.pVolume.get(), blockVolume.pGradientVolume.get(), &blockCamera, config };
+                renderer.setBlock(render::createRenderBlock(blockVolume.block, volume.dims(), volume.maximum(), gradientMaxMagnitude));
+                renderer.render();
+                blockImages.push_back(render::createBlockImage(renderer.frameBuffer(), config.renderResolution, camera, blockVolume.block));
+            }
+            render::compositeBlockImages(blockImages, config.renderMode);
+            image = std::move(blockImages[0].colors);
+        }
+        const std::chrono::duration<double, std::milli> renderTime = clock::now() - start;
+
+        const std::filesystem::path file = options.outputDirectory / fmt::format("frame_{:05}.{}", frame, options.format);
+        const bool written = options.format == "exr"
+            ? writeEXR(file, image, config.renderResolution)
+            : writePNG(file, image, config.renderResolution);
+
+        std::lock_guard lock { outputMutex };
+        success = success && written;
+        std::cout << fmt::format("frame {} rendered in {:.1f}ms: {}", frame, renderTime.count(), file.string()) << std::endl;
+    });
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
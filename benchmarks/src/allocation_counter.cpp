@@ -0,0 +1,32 @@
+#include "allocation_counter.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> s_numAllocations { 0 };
+
+uint64_t numAllocations()
+{
+    return s_numAllocations.load();
+}
+
+// The array and nothrow versions call these, which also covers the allocations of the standard library containers.
+void* operator new(size_t size)
+{
+    s_numAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(std::max(size, size_t(1))))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <cstdint>
+
+// Number of calls to the global operator new so far. The executable that links allocation_counter.cpp replaces the
+// global operator new and delete with versions that count the allocations.
+uint64_t numAllocations();
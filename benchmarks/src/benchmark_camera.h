@@ -0,0 +1,5 @@
+#pragma once
+#include "render/look_at_camera.h"
+
+// Camera at a fixed position looking at a fixed point. Rays are generated the same way as in ui::Trackball.
+using BenchmarkCamera = render::LookAtCamera;
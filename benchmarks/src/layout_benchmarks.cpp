@@ -0,0 +1,77 @@
+#include "benchmark_camera.h"
+#include "render/render_config.h"
+#include "render/renderer.h"
+#include "synthetic_volumes.h"
+#include "volume/gradient_volume.h"
+#include "volume/volume.h"
+#include <catch2/catch.hpp>
+#include <glm/geometric.hpp>
+#include <string>
+
+// Compare the linear and bricked voxel layouts. Axis-aligned rays walk along x, which is the fast axis of the
+// linear layout, while oblique rays cross slices at every step and touch a new cache line for most samples.
+
+static const glm::ivec3 volumeDim { 192 };
+static const glm::ivec2 resolution { 256 };
+
+static render::RenderConfig createConfig(render::RenderMode renderMode)
+{
+    render::RenderConfig config {};
+    config.renderMode = renderMode;
+    config.renderResolution = resolution;
+    // Measure the cost of sampling, not how much of the volume can be skipped.
+    config.emptySpaceSkipping = false;
+    config.frontToBackCompositing = false;
+    for (size_t i = 0; i < config.tfColorMap.size(); i++) {
+        const float v = float(i) / float(config.tfColorMap.size());
+        config.tfColorMap[i] = glm::vec4(v, 1.0f - v, 0.5f, 0.02f * v);
+    }
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = 250.0f;
+    return config;
+}
+
+static void benchmarkLayout(volume::VoxelLayout layout, const std::string& layoutName)
+{
+    volume::Volume volume { createShellsVolume(volumeDim), volumeDim, layout };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    const volume::GradientVolume gradientVolume { volume };
+
+    const glm::vec3 center = glm::vec3(volumeDim) / 2.0f;
+    const float distance = 2.0f * float(volumeDim.x);
+    const BenchmarkCamera axisAlignedCamera { center - glm::vec3(distance, 0, 0), center };
+    const BenchmarkCamera obliqueCamera { center + distance * glm::normalize(glm::vec3(0.6f, -0.8f, 1.0f)), center };
+
+    for (const auto& [pCamera, viewName] : { std::pair { &axisAlignedCamera, "axis-aligned" }, std::pair { &obliqueCamera, "oblique" } }) {
+        render::Renderer mipRenderer { &volume, &gradientVolume, pCamera, createConfig(render::RenderMode::RenderMIP) };
+        BENCHMARK("MIP " + layoutName + " " + viewName)
+        {
+            mipRenderer.render();
+            return mipRenderer.frameBuffer()[0];
+        };
+
+        render::Renderer compositeRenderer { &volume, &gradientVolume, pCamera, createConfig(render::RenderMode::RenderComposite) };
+        BENCHMARK("Composite " + layoutName + " " + viewName)
+        {
+            compositeRenderer.render();
+            return compositeRenderer.frameBuffer()[0];
+        };
+    }
+
+    // Gradient lookups go to a separate (larger) array, so they see the same effect.
+    BENCHMARK("Gradient samples " + layoutName)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < 100000; i++) {
+            const glm::vec3 pos = center + float(i % 97 - 48) * glm::vec3(0.9f, 0.7f, 0.5f);
+            sum += gradientVolume.getGradientVoxel(pos).magnitude;
+        }
+        return sum;
+    };
+}
+
+TEST_CASE("Voxel Layout Benchmarks", "[benchmark]")
+{
+    benchmarkLayout(volume::VoxelLayout::Linear, "linear");
+    benchmarkLayout(volume::VoxelLayout::Bricked, "bricked");
+}
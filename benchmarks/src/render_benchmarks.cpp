@@ -0,0 +1,309 @@
+// Measures the render throughput on the bundled datasets (or the volumes on the command line) in every render mode and
+// interpolation mode, with and without volume shading, for a range of thread counts. The results are printed and
+// written as JSON with one measurement per line, so that the files of two builds can be compared with a plain diff.
+//
+// Every measurement also reports the heap allocations per frame (see allocation_counter.h), which should be zero once a
+// renderer has rendered its first frame.
+//
+// Unlike the Catch2 benchmarks this is a separate executable: the full matrix takes a while, and Catch2 cannot write
+// the results in a format that is easy to compare between builds.
+#include "allocation_counter.h"
+#include "benchmark_camera.h"
+#include "render/render_config.h"
+#include "render/renderer.h"
+#include "volume/execution_policy.h"
+#include "volume/gradient_volume.h"
+#include "volume/volume.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <glm/geometric.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <tbb/task_arena.h>
+#include <utility>
+#include <vector>
+
+static constexpr std::pair<render::RenderMode, std::string_view> renderModes[] {
+    { render::RenderMode::RenderSlicer, "slicer" },
+    { render::RenderMode::RenderMIP, "mip" },
+    { render::RenderMode::RenderIso, "iso" },
+    { render::RenderMode::RenderComposite, "composite" },
+    { render::RenderMode::RenderTF2D, "tf2d" },
+    { render::RenderMode::RenderTF2DV2, "tf2dv2" }
+};
+static constexpr std::pair<volume::InterpolationMode, std::string_view> interpolationModes[] {
+    { volume::InterpolationMode::NearestNeighbour, "nearest" },
+    { volume::InterpolationMode::Linear, "linear" },
+    { volume::InterpolationMode::Cubic, "cubic" }
+};
+
+struct Options {
+    std::vector<std::filesystem::path> volumeFiles;
+    std::filesystem::path jsonFile { "render_benchmarks.json" };
+    glm::ivec2 resolution { 256 };
+    int repetitions { 5 };
+    std::vector<int> threadCounts;
+    // Render with a task arena per NUMA node (see volume::ExecutionConfig::numaArenas).
+    bool numaArenas { false };
+};
+
+struct Measurement {
+    std::string dataset, camera;
+    std::string_view renderMode, interpolationMode;
+    bool volumeShading;
+    int threads;
+    double millisecondsPerFrame;
+    double samplesPerSecond;
+    double allocationsPerFrame;
+};
+
+static void printUsage()
+{
+    std::cerr << "Usage: RenderBenchmarks [volume.fld...] [options]\n"
+                 "  Without volumes all .fld files in the resources directory are measured.\n"
+                 "  --json <file>            where the results are written (default render_benchmarks.json)\n"
+                 "  --resolution <w>x<h>     render resolution (default 256x256)\n"
+                 "  --repetitions <n>        frames per measurement, of which the median is reported (default 5)\n"
+                 "  --threads <n,n,...>      thread counts (default 1, 2, 4, ... up to the number of cores)\n"
+                 "  --numa <on|off>          render with a task arena per NUMA node (default off)\n";
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+    try {
+        for (int i = 1; i < argc; i++) {
+            const std::string_view argument = argv[i];
+            if (argument.substr(0, 2) != "--") {
+                options.volumeFiles.emplace_back(argument);
+                continue;
+            }
+            if (i + 1 == argc)
+                return false;
+
+            const std::string value = argv[++i];
+            if (argument == "--json") {
+                options.jsonFile = value;
+            } else if (argument == "--resolution") {
+                const size_t separator = value.find('x');
+                if (separator == std::string::npos)
+                    return false;
+                options.resolution = glm::ivec2(std::stoi(value.substr(0, separator)), std::stoi(value.substr(separator + 1)));
+            } else if (argument == "--repetitions") {
+                options.repetitions = std::stoi(value);
+            } else if (argument == "--threads") {
+                for (size_t start = 0; start < value.size();) {
+                    const size_t end = std::min(value.find(',', start), value.size());
+                    options.threadCounts.push_back(std::stoi(value.substr(start, end - start)));
+                    start = end + 1;
+                }
+            } else if (argument == "--numa") {
+                if (value != "on" && value != "off")
+                    return false;
+                options.numaArenas = value == "on";
+            } else {
+                return false;
+            }
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    if (options.volumeFiles.empty()) {
+        for (const auto& entry : std::filesystem::directory_iterator(VOLVIS_RESOURCES_DIR)) {
+            if (entry.path().extension() == ".fld")
+                options.volumeFiles.push_back(entry.path());
+        }
+        std::sort(std::begin(options.volumeFiles), std::end(options.volumeFiles));
+    }
+    if (options.threadCounts.empty()) {
+        const int maxThreads = tbb::this_task_arena::max_concurrency();
+        for (int threads = 1; threads < maxThreads; threads *= 2)
+            options.threadCounts.push_back(threads);
+        options.threadCounts.push_back(maxThreads);
+    }
+    const bool validThreadCounts = std::all_of(std::begin(options.threadCounts), std::end(options.threadCounts), [](int threads) { return threads > 0; });
+    return validThreadCounts && options.repetitions > 0 && glm::all(glm::greaterThan(options.resolution, glm::ivec2(0)));
+}
+
+static render::RenderConfig createConfig(const volume::Volume& volume, const glm::ivec2& resolution)
+{
+    render::RenderConfig config {};
+    config.renderResolution = resolution;
+    // A ramp over the value range of the volume, such that every dataset has visible (and partially opaque) content.
+    for (size_t i = 0; i < config.tfColorMap.size(); i++) {
+        const float v = float(i) / float(config.tfColorMap.size());
+        config.tfColorMap[i] = glm::vec4(v, 1.0f - v, 0.5f, 0.05f * v);
+    }
+    config.tfColorMapIndexStart = volume.minimum();
+    config.tfColorMapIndexRange = volume.maximum() - volume.minimum();
+    config.isoValue = volume.minimum() + 0.3f * (volume.maximum() - volume.minimum());
+    return config;
+}
+
+// The number of samples that a ray marcher without empty space skipping and early ray termination would take, such that
+// samples/s is comparable between modes and grows when skipping or termination save work.
+static double countNominalSamples(const volume::Volume& volume, const render::RayTraceCamera& camera, const render::RenderConfig& config)
+{
+    const glm::vec3 lower { 0.0f }, upper = glm::vec3(volume.dims() - glm::ivec3(1));
+    double samples = 0.0;
+    for (int y = 0; y < config.renderResolution.y; y++) {
+        for (int x = 0; x < config.renderResolution.x; x++) {
+            const glm::vec2 pixelPos = glm::vec2(x, y) / glm::vec2(config.renderResolution);
+            const render::Ray ray = camera.generateRay(pixelPos * 2.0f - 1.0f);
+            const glm::vec3 t0 = (lower - ray.origin) / ray.direction, t1 = (upper - ray.origin) / ray.direction;
+            const float tmin = glm::compMax(glm::min(t0, t1)), tmax = glm::compMin(glm::max(t0, t1));
+            if (tmin > tmax)
+                continue;
+            if (config.renderMode == render::RenderMode::RenderSlicer)
+                samples += 1.0;
+            else
+                samples += std::floor(double(tmax - tmin) / double(config.sampleStep)) + 1.0;
+        }
+    }
+    return samples;
+}
+
+struct FrameTimes {
+    double medianMilliseconds;
+    double allocationsPerFrame;
+};
+
+static FrameTimes measureFrames(render::Renderer& renderer, int repetitions)
+{
+    using clock = std::chrono::steady_clock;
+    renderer.render(); // Warm up the caches (and the gradient cache of lazy gradient volumes).
+    std::vector<double> times(static_cast<size_t>(repetitions));
+    const uint64_t allocationsBefore = numAllocations();
+    for (double& time : times) {
+        const auto start = clock::now();
+        renderer.render();
+        time = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    }
+    const uint64_t allocations = numAllocations() - allocationsBefore;
+    std::sort(std::begin(times), std::end(times));
+    return FrameTimes { times[times.size() / 2], double(allocations) / double(repetitions) };
+}
+
+// Render (and load) with numThreads threads, or with all threads for 0. Debug builds are measured in parallel as well.
+static void setExecutionPolicy(const Options& options, int numThreads)
+{
+    volume::ExecutionConfig config;
+    config.parallel = true;
+    config.numThreads = numThreads;
+    config.numaArenas = options.numaArenas;
+    volume::ExecutionPolicy::setGlobal(config);
+}
+
+static void benchmarkVolume(const std::filesystem::path& file, const Options& options, std::vector<Measurement>& measurements)
+{
+    setExecutionPolicy(options, 0);
+    volume::Volume volume { file };
+    volume::GradientVolume gradientVolume { volume };
+
+    // A view along the fast (x) axis of the voxels and an oblique one, at the distance at which the viewer starts.
+    const glm::vec3 center = glm::vec3(volume.dims()) / 2.0f;
+    const float distance = 2.0f * float(glm::compMax(volume.dims()));
+    const BenchmarkCamera axisAlignedCamera { center - glm::vec3(distance, 0, 0), center };
+    const BenchmarkCamera obliqueCamera { center + distance * glm::normalize(glm::vec3(0.6f, -0.8f, 1.0f)), center };
+    const std::pair<const BenchmarkCamera*, std::string_view> cameras[] { { &axisAlignedCamera, "axis-aligned" }, { &obliqueCamera, "oblique" } };
+
+    const std::string dataset = file.stem().string();
+    render::RenderConfig config = createConfig(volume, options.resolution);
+    for (const int threads : options.threadCounts) {
+        setExecutionPolicy(options, threads);
+        for (const auto& [pCamera, cameraName] : cameras) {
+            for (const auto& [renderMode, renderModeName] : renderModes) {
+                config.renderMode = renderMode;
+                const double samples = countNominalSamples(volume, *pCamera, config);
+                // The slicer, MIP and the second 2D transfer function do not shade, so they are only measured once.
+                const bool shades = renderMode == render::RenderMode::RenderIso || renderMode == render::RenderMode::RenderComposite || renderMode == render::RenderMode::RenderTF2D;
+                for (const auto& [interpolationMode, interpolationModeName] : interpolationModes) {
+                    volume.interpolationMode = gradientVolume.interpolationMode = interpolationMode;
+                    for (const bool volumeShading : { false, true }) {
+                        if (volumeShading && !shades)
+                            continue;
+                        config.volumeShading = volumeShading;
+
+                        render::Renderer renderer { &volume, &gradientVolume, pCamera, config };
+                        const auto [milliseconds, allocationsPerFrame] = measureFrames(renderer, options.repetitions);
+                        const Measurement& measurement = measurements.emplace_back(Measurement {
+                            dataset, std::string(cameraName), renderModeName, interpolationModeName, volumeShading, threads, milliseconds, samples / (milliseconds / 1000.0), allocationsPerFrame });
+                        std::cout << fmt::format("{:<16} {:<13} {:<10} {:<8} {:<10} {:>3} threads: {:9.2f} ms/frame {:8.1f} Msamples/s {:6.1f} allocations/frame\n",
+                            measurement.dataset, measurement.camera, measurement.renderMode, measurement.interpolationMode,
+                            volumeShading ? "shaded" : "unshaded", threads, milliseconds, measurement.samplesPerSecond / 1e6, allocationsPerFrame);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static bool writeJSON(const std::filesystem::path& file, const Options& options, const std::vector<Measurement>& measurements)
+{
+    std::ofstream stream { file };
+    stream << "{\n";
+    stream << fmt::format("  \"resolution\": [{}, {}],\n", options.resolution.x, options.resolution.y);
+    stream << fmt::format("  \"repetitions\": {},\n", options.repetitions);
+    stream << fmt::format("  \"numaArenas\": {},\n", options.numaArenas);
+    stream << "  \"results\": [\n";
+    for (size_t i = 0; i < measurements.size(); i++) {
+        const Measurement& m = measurements[i];
+        stream << fmt::format(
+            "    {{ \"dataset\": \"{}\", \"camera\": \"{}\", \"renderMode\": \"{}\", \"interpolationMode\": \"{}\", \"volumeShading\": {}, "
+            "\"threads\": {}, \"msPerFrame\": {:.3f}, \"samplesPerSecond\": {:.4e}, \"allocationsPerFrame\": {:.1f} }}{}\n",
+            m.dataset, m.camera, m.renderMode, m.interpolationMode, m.volumeShading, m.threads, m.millisecondsPerFrame,
+            m.samplesPerSecond, m.allocationsPerFrame, i + 1 < measurements.size() ? "," : "");
+    }
+    stream << "  ]\n}\n";
+    return bool(stream);
+}
+
+// Speedup of every thread count over the first one, summed over all measurements of that thread count.
+static void printScaling(const Options& options, const std::vector<Measurement>& measurements)
+{
+    const auto totalTime = [&](int threads) {
+        double total = 0.0;
+        for (const Measurement& measurement : measurements) {
+            if (measurement.threads == threads)
+                total += measurement.millisecondsPerFrame;
+        }
+        return total;
+    };
+    const double baseTime = totalTime(options.threadCounts.front());
+    for (const int threads : options.threadCounts)
+        std::cout << fmt::format("{:>3} threads: {:.2f}x speedup over {} thread(s)\n", threads, baseTime / totalTime(threads), options.threadCounts.front());
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Measurement> measurements;
+    for (const auto& file : options.volumeFiles) {
+        if (!std::filesystem::exists(file)) {
+            std::cerr << "Volume " << file << " does not exist" << std::endl;
+            return EXIT_FAILURE;
+        }
+        benchmarkVolume(file, options, measurements);
+    }
+    printScaling(options, measurements);
+
+    if (!writeJSON(options.jsonFile, options, measurements)) {
+        std::cerr << "Could not write " << options.jsonFile << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Results written to " << options.jsonFile.string() << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+#include <vector>
+
+// Nested spherical shells that fill most of the volume. Every ray through the volume hits data so the
+// benchmarks measure sampling and not empty space skipping.
+inline std::vector<uint16_t> createShellsVolume(const glm::ivec3& dim)
+{
+    std::vector<uint16_t> data(static_cast<size_t>(dim.x) * static_cast<size_t>(dim.y) * static_cast<size_t>(dim.z));
+    const glm::vec3 center = glm::vec3(dim) / 2.0f;
+    const float radius = float(std::min(dim.x, std::min(dim.y, dim.z))) / 2.0f;
+    size_t i = 0;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                const float r = glm::length(glm::vec3(x, y, z) - center) / radius;
+                const float shell = r < 1.0f ? 0.5f + 0.5f * std::cos(r * 40.0f) : 0.0f;
+                data[i++] = static_cast<uint16_t>(shell * 250.0f * (1.0f - 0.5f * r));
+            }
+        }
+    }
+    return data;
+}
@@ -0,0 +1,56 @@
+// Converts a .fld volume into a .fld file whose voxels are stored in the given layout. Files in the bricked layout can
+// be streamed from disk by the viewer (see volume::BrickPager), which renders volumes that do not fit in main memory.
+#include "volume/volume.h"
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string_view>
+
+static void printUsage()
+{
+    std::cerr << "Usage: ConvertVolume <input.fld> <output.fld> [--layout <layout>]\n"
+                 "  --layout <layout>        bricked (default) or linear\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::filesystem::path inputFile, outputFile;
+    volume::VoxelLayout layout = volume::VoxelLayout::Bricked;
+    int numFiles = 0;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view argument = argv[i];
+        if (argument == "--layout" && i + 1 < argc) {
+            const std::string_view value = argv[++i];
+            if (value == "bricked") {
+                layout = volume::VoxelLayout::Bricked;
+            } else if (value == "linear") {
+                layout = volume::VoxelLayout::Linear;
+            } else {
+                std::cerr << "Invalid value " << value << " for " << argument << std::endl;
+                printUsage();
+                return EXIT_FAILURE;
+            }
+        } else if (argument.substr(0, 2) != "--" && numFiles < 2) {
+            (numFiles++ == 0 ? inputFile : outputFile) = argument;
+        } else {
+            std::cerr << "Unknown option " << argument << std::endl;
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (numFiles != 2) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    if (!std::filesystem::exists(inputFile)) {
+        std::cerr << "Volume " << inputFile << " does not exist" << std::endl;
+        return EXIT_FAILURE;
+    }
+    // The input is mapped, so it does not need to fit in memory either.
+    const volume::Volume volume { inputFile };
+    if (!volume.write(outputFile, layout))
+        return EXIT_FAILURE;
+    std::cout << "Wrote " << outputFile << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,406 @@
+// Performance regression tests, which fail when an optimization stops paying off instead of letting it rot silently.
+//
+// The renderer counts the work that it does (see render::RenderStatistics): the samples that empty space skipping and
+// early ray termination save, the rays that tile culling saves and the iterations of the iso surface refinement. These
+// counts are deterministic, so the work tests run with the other integrity tests. They compare the counts against the
+// baselines in integrity_tests/performance_baselines.txt, which is kept with the sources, and against bounds that hold
+// without a baseline.
+//
+// Timings depend on the machine and its load, so the timing tests are hidden; run them with IntegrityTests [timing].
+// They compare against the baselines in timing_baselines.txt in the build directory of the integrity tests, which
+// have to be recorded on each machine first.
+//
+// A measurement without a baseline fails. Run the tests with the environment variable VOLVIS_RECORD_BASELINES=1 to
+// record the measured values as the baselines instead, both to add measurements and to accept a change in performance:
+//     VOLVIS_RECORD_BASELINES=1 IntegrityTests [performance]
+#include "render/look_at_camera.h"
+#include "render/render_config.h"
+#include "render/render_statistics.h"
+#include "render/renderer.h"
+#include "test_classes.h"
+#include "volume/gradient_volume.h"
+#include "volume/volume.h"
+#include <algorithm>
+#include <array>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <glm/geometric.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Counts may grow by this fraction (for example when a change moves a sample across a cell border) before the tests fail.
+static constexpr double workTolerance = 0.01;
+static constexpr double timingTolerance = 0.3;
+
+// Values that the measurements are compared against, stored as one "name value" line each. In record mode (see the
+// top of this file) the measured values replace the baselines, and the file is written when the object is destroyed.
+class Baselines {
+public:
+    explicit Baselines(std::filesystem::path file)
+        : m_file(std::move(file))
+    {
+        std::ifstream stream { m_file };
+        std::string name;
+        double value;
+        while (stream >> name >> value)
+            m_values[name] = value;
+    }
+    Baselines(const Baselines&) = delete;
+    Baselines& operator=(const Baselines&) = delete;
+
+    ~Baselines()
+    {
+        if (m_numRecorded == 0)
+            return;
+        std::ofstream stream { m_file };
+        stream << std::setprecision(std::numeric_limits<double>::max_digits10);
+        for (const auto& [name, value] : m_values)
+            stream << name << ' ' << value << '\n';
+        if (!stream)
+            std::cerr << "Could not write the baselines to " << m_file.string() << std::endl;
+    }
+
+    // Fails if name has no baseline, or if value exceeds it by more than the tolerance (a fraction of the baseline). A
+    // value that is lower by more than the tolerance passes, with a reminder to record the improvement.
+    void check(const std::string& name, double value, double tolerance)
+    {
+        if (s_record) {
+            m_values[name] = value;
+            if (m_numRecorded++ == 0)
+                WARN("Recording the baselines in " << m_file.string());
+            return;
+        }
+
+        const auto iter = m_values.find(name);
+        if (iter == std::end(m_values)) {
+            FAIL_CHECK("There is no baseline for " << name << " in " << m_file.string() << "; run the tests with VOLVIS_RECORD_BASELINES=1 to record it");
+            return;
+        }
+
+        const double baseline = iter->second;
+        INFO(name << " is " << value << ", its baseline is " << baseline);
+        CHECK(value <= baseline * (1.0 + tolerance));
+        if (value < baseline * (1.0 - tolerance))
+            WARN(name << " improved from " << baseline << " to " << value << "; run the tests with VOLVIS_RECORD_BASELINES=1 to record it");
+    }
+
+private:
+    static bool recordRequested()
+    {
+        const char* pValue = std::getenv("VOLVIS_RECORD_BASELINES");
+        return pValue && std::string_view(pValue) != "" && std::string_view(pValue) != "0";
+    }
+
+    static inline const bool s_record = recordRequested();
+
+    std::filesystem::path m_file;
+    std::map<std::string, double> m_values;
+    size_t m_numRecorded { 0 };
+};
+
+enum class SyntheticShape {
+    Sphere,
+    Noise,
+    Blobs
+};
+static constexpr std::pair<SyntheticShape, const char*> syntheticShapes[] {
+    { SyntheticShape::Sphere, "sphere" },
+    { SyntheticShape::Noise, "noise" },
+    { SyntheticShape::Blobs, "blobs" }
+};
+static constexpr std::pair<render::RenderMode, const char*> renderModes[] {
+    { render::RenderMode::RenderMIP, "mip" },
+    { render::RenderMode::RenderIso, "iso" },
+    { render::RenderMode::RenderComposite, "composite" },
+    { render::RenderMode::RenderTF2D, "tf2d" }
+};
+static constexpr std::pair<volume::InterpolationMode, const char*> interpolationModes[] {
+    { volume::InterpolationMode::NearestNeighbour, "nearest" },
+    { volume::InterpolationMode::Linear, "linear" },
+    { volume::InterpolationMode::Cubic, "cubic" }
+};
+
+// Value 250 at the center of a sphere that falls off linearly to 0 at its radius.
+static uint16_t radialFalloff(const glm::vec3& position, const glm::vec3& center, float radius)
+{
+    return static_cast<uint16_t>(250.0f * std::max(1.0f - glm::length(position - center) / radius, 0.0f));
+}
+
+// A single sphere, which leaves the corners empty; uniform noise, through which every ray takes all of its samples;
+// and eight small blobs in an otherwise empty volume, which is mostly skipped. std::mt19937 produces the same numbers
+// on every platform (unlike the standard distributions), so the volumes and the work they cause are the same as well.
+static std::vector<uint16_t> createSyntheticVolume(SyntheticShape shape, const glm::ivec3& dim)
+{
+    std::mt19937 random { 42 };
+    std::vector<glm::vec3> blobCenters;
+    for (int i = 0; i < 8; i++)
+        blobCenters.emplace_back(float(random() % uint32_t(dim.x)), float(random() % uint32_t(dim.y)), float(random() % uint32_t(dim.z)));
+    const glm::vec3 center = glm::vec3(dim - 1) / 2.0f;
+    const float minDimension = float(glm::compMin(dim));
+
+    std::vector<uint16_t> data;
+    data.reserve(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                const glm::vec3 position { float(x), float(y), float(z) };
+                if (shape == SyntheticShape::Sphere) {
+                    data.push_back(radialFalloff(position, center, 0.4f * minDimension));
+                } else if (shape == SyntheticShape::Noise) {
+                    data.push_back(static_cast<uint16_t>(random() % 251));
+                } else {
+                    uint16_t value = 0;
+                    for (const glm::vec3& blobCenter : blobCenters)
+                        value = std::max(value, radialFalloff(position, blobCenter, minDimension / 16.0f));
+                    data.push_back(value);
+                }
+            }
+        }
+    }
+    return data;
+}
+
+// An oblique view, so that the rays cross the slices of the volume and the macro cells at every angle.
+static render::LookAtCamera createCamera(const glm::ivec3& dim)
+{
+    const glm::vec3 center = glm::vec3(dim) / 2.0f;
+    return render::LookAtCamera { center + 2.0f * float(glm::compMax(dim)) * glm::normalize(glm::vec3(0.6f, -0.8f, 1.0f)), center };
+}
+
+static render::RenderConfig createConfig(render::RenderMode renderMode, const glm::ivec2& resolution)
+{
+    render::RenderConfig config {};
+    config.renderMode = renderMode;
+    config.renderResolution = resolution;
+    config.sampleStep = 0.5f;
+    config.isoValue = 100.0f;
+    config.volumeShading = renderMode == render::RenderMode::RenderIso || renderMode == render::RenderMode::RenderComposite;
+    // Values below 50 are transparent, so that empty space skipping applies to the outside of the shapes.
+    for (size_t i = 0; i < config.tfColorMap.size(); i++) {
+        const float v = float(i) / float(config.tfColorMap.size());
+        config.tfColorMap[i] = glm::vec4(v, 1.0f - v, 0.5f, i < 50 ? 0.0f : 0.05f);
+    }
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = float(config.tfColorMap.size());
+    config.TF2DIntensity = 150.0f;
+    config.TF2DRadius = 50.0f;
+    config.TF2DColor = glm::vec4(1.0f, 0.5f, 0.2f, 0.1f);
+    return config;
+}
+
+static render::RenderStatistics renderStatistics(const volume::Volume& volume, const volume::GradientVolume& gradientVolume, const render::RenderConfig& config)
+{
+    const render::LookAtCamera camera = createCamera(volume.dims());
+    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+    renderer.render();
+    return renderer.statistics();
+}
+
+// Shortest time of a few runs of f, which is the one that is least affected by the other processes on the machine.
+template <typename F>
+static double minimumMilliseconds(int repetitions, F&& f)
+{
+    using clock = std::chrono::steady_clock;
+    double minimum = std::numeric_limits<double>::max();
+    for (int i = 0; i < repetitions; i++) {
+        const auto start = clock::now();
+        f();
+        minimum = std::min(minimum, std::chrono::duration<double, std::milli>(clock::now() - start).count());
+    }
+    return minimum;
+}
+
+// Written by the timed code so that the compiler cannot remove it.
+static volatile float s_sink = 0.0f;
+
+TEST_CASE("Render Work Regression Tests", "[performance]")
+{
+    Baselines baselines { VOLVIS_PERFORMANCE_BASELINES };
+    for (const int size : { 32, 64 }) {
+        for (const auto& [shape, shapeName] : syntheticShapes) {
+            const glm::ivec3 dim { size };
+            volume::Volume volume { createSyntheticVolume(shape, dim), dim };
+            volume.interpolationMode = volume::InterpolationMode::Linear;
+            const volume::GradientVolume gradientVolume { volume };
+            for (const auto& [renderMode, renderModeName] : renderModes) {
+                const render::RenderStatistics statistics = renderStatistics(volume, gradientVolume, createConfig(renderMode, glm::ivec2(64)));
+                const std::string name = std::string(shapeName) + std::to_string(size) + "/" + renderModeName + "/";
+                baselines.check(name + "raysCast", double(statistics.raysCast), workTolerance);
+                baselines.check(name + "samples", double(statistics.samples), workTolerance);
+                baselines.check(name + "shadedSamples", double(statistics.shadedSamples), workTolerance);
+                baselines.check(name + "refinementIterations", double(statistics.refinementIterations), workTolerance);
+            }
+        }
+    }
+}
+
+TEST_CASE("Render Work Bounds Tests", "[performance]")
+{
+    const glm::ivec3 dim { 64 };
+    const glm::ivec2 resolution { 64 };
+
+    // Most of the volume around the blobs is skipped.
+    {
+        volume::Volume volume { createSyntheticVolume(SyntheticShape::Blobs, dim), dim };
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        const volume::GradientVolume gradientVolume { volume };
+        render::RenderConfig config = createConfig(render::RenderMode::RenderComposite, resolution);
+        const render::RenderStatistics skipping = renderStatistics(volume, gradientVolume, config);
+        config.emptySpaceSkipping = false;
+        const render::RenderStatistics marching = renderStatistics(volume, gradientVolume, config);
+        REQUIRE(skipping.samplesSkipped > 0);
+        REQUIRE(skipping.samples * 4 < marching.samples);
+    }
+
+    // Rays stop at the surface of an opaque sphere instead of sampling it all the way through.
+    {
+        volume::Volume volume { createSyntheticVolume(SyntheticShape::Sphere, dim), dim };
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        const volume::GradientVolume gradientVolume { volume };
+        render::RenderConfig config = createConfig(render::RenderMode::RenderComposite, resolution);
+        config.volumeShading = false;
+        for (size_t i = 50; i < config.tfColorMap.size(); i++)
+            config.tfColorMap[i].a = 1.0f;
+        const render::RenderStatistics terminated = renderStatistics(volume, gradientVolume, config);
+        config.earlyRayTerminationThreshold = 2.0f;
+        const render::RenderStatistics unterminated = renderStatistics(volume, gradientVolume, config);
+        REQUIRE(terminated.earlyTerminations > 0);
+        REQUIRE(unterminated.earlyTerminations == 0);
+        REQUIRE(terminated.samples * 2 < unterminated.samples);
+    }
+
+    // The bricked layout only changes where the voxels are stored, not the work or the image.
+    {
+        const std::vector<uint16_t> data = createSyntheticVolume(SyntheticShape::Noise, dim);
+        volume::Volume linear { data, dim, volume::VoxelLayout::Linear };
+        volume::Volume bricked { data, dim, volume::VoxelLayout::Bricked };
+        linear.interpolationMode = bricked.interpolationMode = volume::InterpolationMode::Linear;
+        const volume::GradientVolume linearGradients { linear }, brickedGradients { bricked };
+        const render::LookAtCamera camera = createCamera(dim);
+        for (const auto& [renderMode, renderModeName] : renderModes) {
+            INFO(renderModeName);
+            const render::RenderConfig config = createConfig(renderMode, resolution);
+            render::Renderer linearRenderer { &linear, &linearGradients, &camera, config };
+            render::Renderer brickedRenderer { &bricked, &brickedGradients, &camera, config };
+            linearRenderer.render();
+            brickedRenderer.render();
+            REQUIRE(linearRenderer.statistics() == brickedRenderer.statistics());
+            REQUIRE(std::equal(std::begin(linearRenderer.frameBuffer()), std::end(linearRenderer.frameBuffer()), std::begin(brickedRenderer.frameBuffer())));
+        }
+    }
+}
+
+TEST_CASE("Iso Surface Refinement Work Tests", "[performance]")
+{
+    // Ramp along the x axis: value 4 * x, which crosses the iso value 100 at x = 25.
+    const glm::ivec3 dim { 64, 4, 4 };
+    std::vector<uint16_t> data;
+    for (int i = 0; i < dim.x * dim.y * dim.z; i++)
+        data.push_back(static_cast<uint16_t>(4 * (i % dim.x)));
+    volume::Volume volume { std::move(data), dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    const volume::GradientVolume gradientVolume { volume };
+    TestRenderer renderer { &volume, &gradientVolume, nullptr, render::RenderConfig {} };
+    const render::Ray ray { glm::vec3(0.0f, 1.5f, 1.5f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f, 63.0f };
+
+    Baselines baselines { VOLVIS_PERFORMANCE_BASELINES };
+    for (const float width : { 0.25f, 1.0f, 4.0f }) {
+        const float t0 = 25.0f - 0.3f * width, t1 = t0 + width;
+        INFO("interval width " << width);
+
+        // Bisection halves the interval every iteration, so it converges before the interval is as small as the
+        // spacing of the floats around the iso surface (and long before the iteration limit).
+        const uint64_t before = render::threadRenderStatistics().refinementIterations;
+        REQUIRE(renderer.test_bisectionAccuracy(ray, t0, t1, 100.0f) == Approx(25.0f).margin(0.001f));
+        const uint64_t bisectionIterations = render::threadRenderStatistics().refinementIterations - before;
+        const float floatSpacing = std::nextafter(t1, std::numeric_limits<float>::max()) - t1;
+        REQUIRE(double(bisectionIterations) <= std::ceil(std::log2(double(width) / double(floatSpacing))) + 1.0);
+        baselines.check("bisection/width" + std::to_string(width) + "/iterations", double(bisectionIterations), 0.0);
+
+        // Linear interpolation along the ramp is linear, so the secant method finds the surface in one iteration.
+        const uint64_t secantBefore = render::threadRenderStatistics().refinementIterations;
+        REQUIRE(renderer.test_secantAccuracy(ray, t0, t1, 100.0f) == Approx(25.0f).margin(0.001f));
+        REQUIRE(render::threadRenderStatistics().refinementIterations - secantBefore <= 2u);
+    }
+}
+
+TEST_CASE("Sampler Throughput Regression Tests", "[.timing]")
+{
+    // Samples along oblique rays through the volume, like the renderer takes them.
+    const glm::ivec3 dim { 128 };
+    std::vector<glm::vec3> positions;
+    const glm::vec3 direction = glm::normalize(glm::vec3(0.6f, -0.8f, 1.0f));
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            const glm::vec3 start { 2.0f * float(x), 127.0f, 2.0f * float(y) };
+            for (int step = 0; step < 64; step++)
+                positions.push_back(glm::clamp(start + 0.5f * float(step) * direction, glm::vec3(0.0f), glm::vec3(dim - 1)));
+        }
+    }
+
+    Baselines baselines { VOLVIS_TIMING_BASELINES };
+    const std::vector<uint16_t> data = createSyntheticVolume(SyntheticShape::Noise, dim);
+    for (const auto& [layout, layoutName] : { std::pair { volume::VoxelLayout::Linear, "linear" }, std::pair { volume::VoxelLayout::Bricked, "bricked" } }) {
+        volume::Volume volume { data, dim, layout };
+        for (const auto& [interpolationMode, interpolationModeName] : interpolationModes) {
+            volume.interpolationMode = interpolationMode;
+            const double milliseconds = minimumMilliseconds(5, [&]() {
+                volume.visitSampler([&](const auto& sampler) {
+                    float sum = 0.0f;
+                    for (const glm::vec3& position : positions)
+                        sum += sampler(position);
+                    s_sink = sum;
+                });
+            });
+            const double nanosecondsPerSample = milliseconds * 1e6 / double(positions.size());
+            baselines.check(std::string("sampler/noise128/") + layoutName + "/" + interpolationModeName + "/nsPerSample", nanosecondsPerSample, timingTolerance);
+        }
+    }
+}
+
+TEST_CASE("Gradient Construction Regression Tests", "[.timing]")
+{
+    Baselines baselines { VOLVIS_TIMING_BASELINES };
+    for (const int size : { 64, 128 }) {
+        const glm::ivec3 dim { size };
+        const volume::Volume volume { createSyntheticVolume(SyntheticShape::Sphere, dim), dim };
+        for (const auto& [storage, storageName] : { std::pair { volume::GradientStorage::Full, "full" }, std::pair { volume::GradientStorage::Compact, "compact" } }) {
+            const double milliseconds = minimumMilliseconds(3, [&]() {
+                const volume::GradientVolume gradientVolume { volume, storage };
+                s_sink = gradientVolume.maxMagnitude();
+            });
+            baselines.check("gradients/sphere" + std::to_string(size) + "/" + storageName + "/ms", milliseconds, timingTolerance);
+        }
+    }
+}
+
+TEST_CASE("Render Time Regression Tests", "[.timing]")
+{
+    Baselines baselines { VOLVIS_TIMING_BASELINES };
+    const glm::ivec3 dim { 128 };
+    for (const auto& [shape, shapeName] : syntheticShapes) {
+        volume::Volume volume { createSyntheticVolume(shape, dim), dim };
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        const volume::GradientVolume gradientVolume { volume };
+        const render::LookAtCamera camera = createCamera(dim);
+        for (const auto& [renderMode, renderModeName] : renderModes) {
+            render::Renderer renderer { &volume, &gradientVolume, &camera, createConfig(renderMode, glm::ivec2(128)) };
+            renderer.render(); // Warm up the caches.
+            const double milliseconds = minimumMilliseconds(3, [&]() { renderer.render(); });
+            baselines.check(std::string("render/") + shapeName + "128/" + renderModeName + "/ms", milliseconds, timingTolerance);
+        }
+    }
+}
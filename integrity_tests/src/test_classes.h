@@ -36,6 +36,7 @@ public:
     provide_static_member_function_access(cubicInterpolate)
     provide_const_member_function_access(bicubicInterpolateXY)
     provide_const_member_function_access(getVoxelTriCubicInterpolate)
+    provide_static_member_function_access(cubicWeights)
 };
 
 class TestGradientVolume : public volume::GradientVolume {
@@ -57,5 +58,7 @@ public:
     provide_member_function_access(traceRayTF2D)
 
     provide_member_function_access(bisectionAccuracy)
+    provide_member_function_access(secantAccuracy)
     provide_member_function_access(computePhongShading)
-};
\ No newline at end of file
+    provide_member_function_access(computeFastPhongShading)
+};
\ No newline at end of file
@@ -1,9 +1,39 @@
 // Can access the header files from the viewer...
 #include "test_classes.h"
 #include "ui/window.h"
+#include "render/look_at_camera.h"
+#include "render/phong_shader.h"
+#include "render/pinhole_camera.h"
+#include "render/pre_integration_table.h"
+#include "render/render_config.h"
+#include "render/render_statistics.h"
+#include "render/renderer.h"
+#include "render/sample_cache.h"
+#include "render/sort_last.h"
+#include "render/tf2d_lookup_table.h"
+#include "render/tile_scheduler.h"
+#include "volume/brick_pager.h"
+#include "volume/compressed_volume.h"
+#include "volume/derived_data_cache.h"
+#include "volume/execution_policy.h"
+#include "volume/histogram_2d.h"
+#include "volume/macro_cell_grid.h"
+#include "volume/volume_blocks.h"
+#include "volume/volume_loader.h"
+#include "volume/volume_pyramid.h"
+#include "volume/volume_series.h"
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <catch2/catch.hpp>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <numeric>
+#include <sstream>
+#include <thread>
 
 /*
 GradientVolume:
@@ -46,3 +76,1149 @@ TEST_CASE("Gradient Volume Tests")
     const TestGradientVolume gradient { volume };
     REQUIRE_NOTHROW(gradient.test_getGradientVoxelLinearInterpolate(glm::vec3(100.f)));
 }
+
+TEST_CASE("Macro Cell Grid Tests")
+{
+    std::vector<uint16_t> data(16 * 16 * 16, 0);
+    data[static_cast<size_t>(12 + 16 * (12 + 16 * 12))] = 100;
+    const volume::Volume volume { std::move(data), glm::ivec3(16) };
+    const volume::MacroCellGrid grid { volume, 8 };
+
+    REQUIRE(grid.dims() == glm::ivec3(2));
+    REQUIRE(grid.valueRange(glm::ivec3(0)) == glm::vec2(0.0f, 0.0f));
+    REQUIRE(grid.valueRange(glm::ivec3(1)) == glm::vec2(0.0f, 100.0f));
+}
+
+TEST_CASE("Voxel Layout Tests")
+{
+    // Non-multiple of the brick size so the padding of the bricked layout is exercised.
+    const glm::ivec3 dim { 11, 9, 13 };
+    std::vector<uint16_t> data(static_cast<size_t>(dim.x * dim.y * dim.z));
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<uint16_t>(i);
+    const volume::Volume linear { data, dim, volume::VoxelLayout::Linear };
+    const volume::Volume bricked { data, dim, volume::VoxelLayout::Bricked };
+
+    bool equal = true;
+    for (int z = -1; z <= dim.z; z++) {
+        for (int y = -1; y <= dim.y; y++) {
+            for (int x = -1; x <= dim.x; x++)
+                equal &= linear.getVoxel(x, y, z) == bricked.getVoxel(x, y, z);
+        }
+    }
+    REQUIRE(equal);
+    REQUIRE(bricked.getVoxel(dim.x, 0, 0) == 0.0f);
+    REQUIRE(bricked.minimum() == linear.minimum());
+    REQUIRE(bricked.maximum() == linear.maximum());
+}
+
+TEST_CASE("Volume Loading Tests")
+{
+    // Small 2x2x2 files in both supported data types, loaded in both voxel layouts.
+    const auto writeFile = [](const std::filesystem::path& file, const char* dataType, const std::vector<char>& payload) {
+        std::ofstream ofs(file, std::ios::binary);
+        ofs << "ndim=3\ndim1=2\ndim2=2\ndim3=2\nveclen=1\ndata=" << dataType << "\nfield=uniform\n\f\f";
+        ofs.write(payload.data(), std::streamsize(payload.size()));
+    };
+    const auto byteFile = std::filesystem::temp_directory_path() / "volvis_test_byte.fld";
+    const auto shortFile = std::filesystem::temp_directory_path() / "volvis_test_short.fld";
+    writeFile(byteFile, "byte", { 0, 1, 2, 3, 4, 5, 6, char(200) });
+    writeFile(shortFile, "short", { 0, 0, 1, 0, 2, 0, 3, 0, 4, 0, 5, 0, 6, 0, char(0x2c), 1 });
+
+    for (const auto layout : { volume::VoxelLayout::Linear, volume::VoxelLayout::Bricked }) {
+        const volume::Volume byteVolume { byteFile, layout };
+        REQUIRE(byteVolume.elementSize() == 1);
+        REQUIRE(byteVolume.dims() == glm::ivec3(2));
+        REQUIRE(byteVolume.getVoxel(1, 0, 1) == 5.0f);
+        REQUIRE(byteVolume.maximum() == 200.0f);
+
+        const volume::Volume shortVolume { shortFile, layout };
+        REQUIRE(shortVolume.elementSize() == 2);
+        REQUIRE(shortVolume.getVoxel(1, 0, 1) == 5.0f);
+        REQUIRE(shortVolume.getVoxel(1, 1, 1) == 300.0f);
+    }
+    std::filesystem::remove(byteFile);
+    std::filesystem::remove(shortFile);
+}
+
+TEST_CASE("Compact Gradient Volume Tests")
+{
+    // Distance to the center, so the gradients point in every direction.
+    const glm::ivec3 dim { 24 };
+    std::vector<uint16_t> data;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data.push_back(static_cast<uint16_t>(10.0f * glm::length(glm::vec3(x, y, z) - 11.3f)));
+        }
+    }
+    const volume::Volume volume { data, dim };
+    const volume::GradientVolume full { volume, volume::GradientStorage::Full };
+    const volume::GradientVolume compact { volume, volume::GradientStorage::Compact };
+    REQUIRE(compact.maxMagnitude() == full.maxMagnitude());
+    REQUIRE(compact.minMagnitude() == full.minMagnitude());
+
+    float maxMagnitudeError = 0.0f, minDirectionDot = 1.0f;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                const auto expected = full.getGradientVoxel(x, y, z);
+                const auto actual = compact.getGradientVoxel(x, y, z);
+                maxMagnitudeError = std::max(maxMagnitudeError, std::abs(expected.magnitude - actual.magnitude));
+                if (expected.magnitude > 0.0f)
+                    minDirectionDot = std::min(minDirectionDot, glm::dot(expected.dir / expected.magnitude, actual.dir / actual.magnitude));
+            }
+        }
+    }
+    REQUIRE(maxMagnitudeError <= full.maxMagnitude() / 65535.0f);
+    // Within 1 degree.
+    REQUIRE(minDirectionDot > 0.99985f);
+}
+
+// Voxels with pseudo-random values in [0, 250], so that the gradients point in every direction.
+static std::vector<uint16_t> createPseudoRandomVolume(const glm::ivec3& dim)
+{
+    std::vector<uint16_t> data;
+    for (int i = 0; i < dim.x * dim.y * dim.z; i++)
+        data.push_back(static_cast<uint16_t>((i * 7919) % 251));
+    return data;
+}
+
+TEST_CASE("Lazy Gradient Volume Tests")
+{
+    const glm::ivec3 dim { 19, 10, 13 };
+    const volume::Volume volume { createPseudoRandomVolume(dim), dim };
+    const volume::GradientVolume full { volume, volume::GradientStorage::Full };
+    const volume::GradientVolume onTheFly { volume, volume::GradientStorage::OnTheFly };
+    volume::GradientVolume cached { volume, volume::GradientStorage::Cached };
+    REQUIRE(onTheFly.maxMagnitude() >= full.maxMagnitude());
+
+    bool equal = true;
+    for (int z = -1; z <= dim.z; z++) {
+        for (int y = -1; y <= dim.y; y++) {
+            for (int x = -1; x <= dim.x; x++) {
+                const auto expected = full.getGradientVoxel(x, y, z);
+                for (const volume::GradientVolume* pGradientVolume : { &onTheFly, static_cast<const volume::GradientVolume*>(&cached) }) {
+                    const auto actual = pGradientVolume->getGradientVoxel(x, y, z);
+                    equal &= actual.dir == expected.dir && actual.magnitude == expected.magnitude;
+                }
+            }
+        }
+    }
+    REQUIRE(equal);
+
+    cached.interpolationMode = volume::InterpolationMode::Linear;
+    const auto interpolated = cached.getGradientVoxel(glm::vec3(7.5f, 3.25f, 8.75f));
+    REQUIRE(interpolated.magnitude > 0.0f);
+}
+
+TEST_CASE("Histogram 2D Tests")
+{
+    const glm::ivec3 dim { 12, 9, 11 };
+    const volume::Volume volume { createPseudoRandomVolume(dim), dim };
+    const volume::GradientVolume gradientVolume { volume };
+    const volume::Histogram2D histogram = volume::computeHistogram2D(volume, gradientVolume);
+
+    REQUIRE(histogram.resolution == glm::ivec2(int(volume.maximum()) + 1, int(gradientVolume.maxMagnitude()) + 1));
+    REQUIRE(std::accumulate(std::begin(histogram.bins), std::end(histogram.bins), 0) == dim.x * dim.y * dim.z);
+    // Border voxels have a zero gradient.
+    const int valueBin = int(volume.getVoxel(0, 0, 0));
+    REQUIRE(histogram.bins[size_t(valueBin)] > 0);
+}
+
+TEST_CASE("Packet Sampling Tests")
+{
+    const glm::ivec3 dim { 11, 8, 9 };
+    volume::Volume volume { createPseudoRandomVolume(dim), dim, volume::VoxelLayout::Bricked };
+
+    // Positions inside, on the border of and outside of the volume.
+    volume::CoordinatePacket<8> coords;
+    for (size_t i = 0; i < 8; i++) {
+        coords.x[i] = -1.0f + 1.7f * float(i);
+        coords.y[i] = 7.5f - 1.1f * float(i);
+        coords.z[i] = 0.3f + 1.3f * float(i);
+    }
+    for (auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear, volume::InterpolationMode::Cubic }) {
+        volume.interpolationMode = mode;
+        volume.visitSampler([&](const auto& sampler) {
+            const std::array<float, 8> values = sampler(coords);
+            for (size_t i = 0; i < 8; i++)
+                REQUIRE(values[i] == sampler(glm::vec3(coords.x[i], coords.y[i], coords.z[i])));
+        });
+    }
+}
+
+TEST_CASE("Cubic Sampling Tests")
+{
+    for (float f : { 0.0f, 0.25f, 0.5f, 0.9f }) {
+        const glm::vec4 weights = TestVolume::test_cubicWeights(f);
+        REQUIRE(weights[0] == Approx(TestVolume::test_weight(1 + f)).margin(1e-6f));
+        REQUIRE(weights[1] == Approx(TestVolume::test_weight(f)).margin(1e-6f));
+        REQUIRE(weights[2] == Approx(TestVolume::test_weight(1 - f)).margin(1e-6f));
+        REQUIRE(weights[3] == Approx(TestVolume::test_weight(2 - f)).margin(1e-6f));
+    }
+
+    // The sampler matches the reference implementation everywhere, including the border of the volume.
+    const glm::ivec3 dim { 11, 8, 9 };
+    const std::vector<uint16_t> data = createPseudoRandomVolume(dim);
+    for (auto layout : { volume::VoxelLayout::Linear, volume::VoxelLayout::Bricked }) {
+        TestVolume volume { data, dim, layout };
+        volume.interpolationMode = volume::InterpolationMode::Cubic;
+        volume.visitSampler([&](const auto& sampler) {
+            for (int i = 0; i < 500; i++) {
+                const glm::vec3 coord { std::fmod(0.37f * float(i), 11.0f), std::fmod(0.53f * float(i), 8.0f), std::fmod(0.71f * float(i), 9.0f) };
+                REQUIRE(sampler(coord) == Approx(volume.test_getVoxelTriCubicInterpolate(coord)).margin(1e-3f));
+            }
+        });
+    }
+}
+
+TEST_CASE("Volume Pyramid Tests")
+{
+    // A ramp along x is reproduced by every level (the levels average pairs of voxels).
+    const glm::ivec3 dim { 35, 33, 32 };
+    std::vector<uint8_t> data;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data.push_back(static_cast<uint8_t>(2 * x));
+        }
+    }
+    volume::Volume volume { std::move(data), dim, volume::VoxelLayout::Bricked };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    volume::GradientVolume gradientVolume { volume };
+    gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+    volume::VolumePyramid pyramid { volume, gradientVolume };
+    pyramid.setInterpolationMode(volume::InterpolationMode::Linear);
+    REQUIRE(pyramid.numLevels() == 3);
+    REQUIRE(pyramid.level(1).dims() == glm::ivec3(18, 17, 16));
+    REQUIRE(pyramid.level(2).dims() == glm::ivec3(9, 9, 8));
+    REQUIRE(pyramid.level(1).getVoxel(3, 5, 7) == 2 * 2 * 3 + 1);
+
+    // With the eye at the origin a sample at distance d covers d / 8 voxels.
+    const volume::PyramidSampler<uint8_t, volume::InterpolationMode::Linear> sampler { &pyramid, glm::vec3(0.0f), 1.0f / 8.0f };
+    REQUIRE(sampler.level(glm::vec3(0.0f)) == 0);
+    REQUIRE(sampler.level(glm::vec3(12.0f, 0.0f, 0.0f)) == 0);
+    REQUIRE(sampler.level(glm::vec3(0.0f, 20.0f, 0.0f)) == 1);
+    REQUIRE(sampler.level(glm::vec3(20.0f, 20.0f, 20.0f)) == 2);
+    for (const glm::vec3 coord : { glm::vec3(10.3f, 2.0f, 3.0f), glm::vec3(12.0f, 14.5f, 3.0f), glm::vec3(20.7f, 20.0f, 21.0f) }) {
+        REQUIRE(sampler(coord) == Approx(2.0f * coord.x).margin(1e-3f));
+        REQUIRE(sampler.gradient(coord).magnitude == Approx(2.0f).margin(1e-3f));
+    }
+
+    // A packet samples the finest level of its lanes.
+    volume::CoordinatePacket<2> packet { { 10.0f, 22.0f }, { 0.0f, 22.0f }, { 0.0f, 22.0f } };
+    const auto values = sampler(packet);
+    REQUIRE(values[0] == Approx(20.0f).margin(1e-3f));
+    REQUIRE(values[1] == Approx(44.0f).margin(1e-3f));
+}
+
+TEST_CASE("Brick Streaming Tests")
+{
+    // The values do not include 0, so the padding of the bricks must not show up in the statistics.
+    const glm::ivec3 dim { 20, 18, 17 };
+    std::vector<uint16_t> data;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data.push_back(static_cast<uint16_t>(5 + x + 20 * y + z));
+        }
+    }
+    const volume::Volume volume { std::move(data), dim };
+    REQUIRE(!volume::BrickPager::isSupported(volume));
+
+    const auto file = std::filesystem::temp_directory_path() / "volvis_test_bricked.fld";
+    REQUIRE(volume.write(file, volume::VoxelLayout::Bricked));
+    {
+        // Bricked files are loaded in the bricked layout whatever layout is asked for.
+        const volume::Volume bricked { file, volume::VoxelLayout::Linear };
+        REQUIRE(bricked.indexer().layout() == volume::VoxelLayout::Bricked);
+        REQUIRE(bricked.dims() == dim);
+        REQUIRE(bricked.minimum() == volume.minimum());
+        REQUIRE(bricked.maximum() == volume.maximum());
+        REQUIRE(bricked.histogram() == volume.histogram());
+        REQUIRE(bricked.getVoxel(19, 17, 16) == volume.getVoxel(19, 17, 16));
+        REQUIRE(bricked.getVoxel(3, 9, 8) == volume.getVoxel(3, 9, 8));
+        REQUIRE(volume::BrickPager::isSupported(bricked));
+
+        // One brick per page and room for two pages.
+        const size_t brickBytes = 8 * 8 * 8 * sizeof(uint16_t);
+        volume::BrickPager pager { bricked, 2 * brickBytes, brickBytes };
+        const auto waitForLoads = [&]() {
+            for (int i = 0; i < 1000 && pager.hasPendingRequests(); i++)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        };
+        REQUIRE(!pager.acquire(glm::vec3(1.0f)));
+        waitForLoads();
+        REQUIRE(pager.loadedGeneration() == 1);
+        REQUIRE(pager.acquire(glm::vec3(1.0f)));
+        REQUIRE(pager.acquire(glm::vec3(7.4f)));
+
+        // Pages of the current frame are not evicted: the third page does not fit.
+        REQUIRE(!pager.acquire(glm::vec3(8.0f, 1.0f, 1.0f)));
+        REQUIRE(!pager.acquire(glm::vec3(1.0f, 1.0f, 8.0f)));
+        waitForLoads();
+        REQUIRE(pager.residentBytes() == 2 * brickBytes);
+        REQUIRE(!pager.acquire(glm::vec3(1.0f, 1.0f, 8.0f)));
+
+        // In the next frame the least recently used page makes room for it.
+        pager.beginFrame();
+        REQUIRE(pager.acquire(glm::vec3(8.0f, 1.0f, 1.0f)));
+        REQUIRE(!pager.acquire(glm::vec3(1.0f, 1.0f, 8.0f)));
+        waitForLoads();
+        REQUIRE(pager.acquire(glm::vec3(1.0f, 1.0f, 8.0f)));
+        REQUIRE(pager.acquire(glm::vec3(8.0f, 1.0f, 1.0f)));
+        REQUIRE(pager.residentBytes() <= pager.memoryBudget());
+
+        pager.evictAll();
+        REQUIRE(pager.residentBytes() == 0);
+        REQUIRE(!pager.acquire(glm::vec3(1.0f)));
+    }
+    std::filesystem::remove(file);
+}
+
+TEST_CASE("Compressed Volume Tests")
+{
+    // Half of the volume is constant, the other half varies over the full 16 bit range.
+    const glm::ivec3 dim { 21, 19, 18 };
+    std::vector<uint16_t> data;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data.push_back(static_cast<uint16_t>(z < 8 ? 1000 : (x * 7919 + y * 104729 + z * 31) % 65536));
+        }
+    }
+    volume::Volume volume { std::move(data), dim, volume::VoxelLayout::Bricked };
+    const volume::CompressedVolume compressed { volume };
+    REQUIRE(compressed.dims() == dim);
+    REQUIRE(compressed.compressedBytes() < volume.indexer().storageSize() * sizeof(uint16_t));
+    for (int z = 0; z < dim.z; z += 3) {
+        for (int y = 0; y < dim.y; y += 2) {
+            for (int x = 0; x < dim.x; x++)
+                REQUIRE(compressed.getVoxelUnchecked(x, y, z) == volume.getVoxel(x, y, z));
+        }
+    }
+
+    // The samplers interpolate in the same way as those of the volume.
+    const std::vector<glm::vec3> coords { glm::vec3(0.0f), glm::vec3(3.3f, 7.9f, 7.5f), glm::vec3(19.5f, 17.2f, 16.9f), glm::vec3(12.0f, 0.4f, 9.1f), glm::vec3(-1.0f, 2.0f, 3.0f) };
+    for (const auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear, volume::InterpolationMode::Cubic }) {
+        volume.interpolationMode = mode;
+        volume.visitSampler([&](const auto& volumeSampler) {
+            compressed.visitSampler(mode, [&](const auto& compressedSampler) {
+                for (const glm::vec3& coord : coords)
+                    REQUIRE(compressedSampler(coord) == volumeSampler(coord));
+            });
+        });
+    }
+}
+
+TEST_CASE("Volume Series Tests")
+{
+    // Five timesteps whose voxels are offset by the timestep.
+    const glm::ivec3 dim { 9, 8, 7 };
+    const auto directory = std::filesystem::temp_directory_path() / "volvis_test_series";
+    std::filesystem::create_directories(directory);
+    for (int step = 4; step >= 0; step--) {
+        std::vector<uint16_t> data;
+        for (int i = 0; i < dim.x * dim.y * dim.z; i++)
+            data.push_back(static_cast<uint16_t>(step + i % 13));
+        const volume::Volume volume { std::move(data), dim };
+        REQUIRE(volume.write(directory / ("step" + std::to_string(step) + ".fld"), volume::VoxelLayout::Linear));
+    }
+    const auto files = volume::VolumeSeries::listFiles(directory);
+    REQUIRE(files.size() == 5);
+    REQUIRE(files[0].filename() == "step0.fld");
+    REQUIRE(files[4].filename() == "step4.fld");
+
+    {
+        volume::VolumeSeries series { files, volume::VoxelLayout::Linear, volume::GradientStorage::Full, volume::InterpolationMode::Linear };
+        REQUIRE(series.numTimesteps() == 5);
+        const auto& first = series.acquire(0);
+        REQUIRE(first.step == 0);
+        REQUIRE(first.pVolume->getVoxel(1, 0, 0) == 1.0f);
+        REQUIRE(first.pVolume->interpolationMode == volume::InterpolationMode::Linear);
+
+        // The neighbours of the current timestep are loaded in the background (the previous one wraps around).
+        for (int i = 0; i < 1000 && !(series.isLoaded(1) && series.isLoaded(4)); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(series.isLoaded(1));
+        REQUIRE(series.isLoaded(4));
+        REQUIRE(!series.isLoaded(2));
+
+        // Moving on reuses the slots of the timesteps that are no longer needed.
+        series.setInterpolationMode(volume::InterpolationMode::Cubic);
+        for (const size_t step : { size_t(1), size_t(2), size_t(3) }) {
+            const auto& timestep = series.acquire(step);
+            REQUIRE(timestep.step == step);
+            REQUIRE(timestep.pVolume->getVoxel(1, 0, 0) == float(step + 1));
+            REQUIRE(timestep.pVolume->interpolationMode == volume::InterpolationMode::Cubic);
+
+            const volume::GradientVolume gradientVolume { *timestep.pVolume };
+            REQUIRE(timestep.pGradientVolume->getGradientVoxel(4, 4, 3).dir == gradientVolume.getGradientVoxel(4, 4, 3).dir);
+            REQUIRE(timestep.pGradientVolume->maxMagnitude() == gradientVolume.maxMagnitude());
+            REQUIRE(timestep.optMacroCellGrid->valueRange(glm::ivec3(0)) == volume::MacroCellGrid(*timestep.pVolume).valueRange(glm::ivec3(0)));
+            REQUIRE(timestep.histogram.bins == volume::computeHistogram2D(*timestep.pVolume, gradientVolume).bins);
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Derived Data Cache Tests")
+{
+    // A linear file that is loaded in the bricked layout with compact gradients.
+    const glm::ivec3 dim { 34, 33, 32 };
+    std::vector<uint16_t> data;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data.push_back(static_cast<uint16_t>(3 * x + y + 7 * (z % 5)));
+        }
+    }
+    const auto file = std::filesystem::temp_directory_path() / "volvis_test_cache.fld";
+    const auto cacheFile = volume::DerivedDataCache::cacheFile(file);
+    REQUIRE(volume::Volume(std::move(data), dim).write(file, volume::VoxelLayout::Linear));
+    std::filesystem::remove(cacheFile);
+    REQUIRE(!volume::DerivedDataCache(file, volume::VoxelLayout::Bricked).isValid());
+
+    const volume::Volume volume { file, volume::VoxelLayout::Bricked };
+    const volume::GradientVolume gradientVolume { volume, volume::GradientStorage::Compact };
+    const volume::VolumePyramid pyramid { volume, gradientVolume };
+    const volume::MacroCellGrid macroCellGrid { volume };
+    const volume::Histogram2D histogram = volume::computeHistogram2D(volume, gradientVolume);
+    REQUIRE(volume::DerivedDataCache::write(file, volume::VoxelLayout::Bricked, pyramid, macroCellGrid, histogram));
+    REQUIRE(!volume::DerivedDataCache(file, volume::VoxelLayout::Linear).isValid());
+
+    {
+        // Everything that is derived from the cache matches what the cache was written from.
+        const volume::DerivedDataCache cache { file, volume::VoxelLayout::Bricked };
+        REQUIRE(cache.isValid());
+        REQUIRE(cache.gradientStorage() == volume::GradientStorage::Compact);
+        const volume::Volume cachedVolume { file, volume::VoxelLayout::Bricked, cache.statistics() };
+        REQUIRE(cachedVolume.minimum() == volume.minimum());
+        REQUIRE(cachedVolume.maximum() == volume.maximum());
+        REQUIRE(cachedVolume.histogram() == volume.histogram());
+        const volume::GradientVolume cachedGradientVolume { cachedVolume, cache.gradientStorage(), cache.storedGradients(), cache.maxMagnitude() };
+        REQUIRE(cachedGradientVolume.maxMagnitude() == gradientVolume.maxMagnitude());
+
+        const volume::VolumePyramid cachedPyramid = cache.pyramid(cachedVolume, cachedGradientVolume);
+        REQUIRE(cachedPyramid.numLevels() == 3);
+        for (size_t level = 0; level < cachedPyramid.numLevels(); level++) {
+            const volume::Volume& cachedLevel = cachedPyramid.level(level);
+            REQUIRE(cachedLevel.dims() == pyramid.level(level).dims());
+            REQUIRE(cachedLevel.histogram() == pyramid.level(level).histogram());
+            for (const glm::ivec3 voxel : { glm::ivec3(0), glm::ivec3(3, 5, 7), cachedLevel.dims() - 2 }) {
+                REQUIRE(cachedLevel.getVoxel(voxel.x, voxel.y, voxel.z) == pyramid.level(level).getVoxel(voxel.x, voxel.y, voxel.z));
+                const volume::GradientVoxel gradient = cachedPyramid.gradientLevel(level).getGradientVoxel(voxel.x, voxel.y, voxel.z);
+                REQUIRE(gradient.dir == pyramid.gradientLevel(level).getGradientVoxel(voxel.x, voxel.y, voxel.z).dir);
+                REQUIRE(gradient.magnitude == pyramid.gradientLevel(level).getGradientVoxel(voxel.x, voxel.y, voxel.z).magnitude);
+            }
+        }
+        REQUIRE(cache.macroCellGrid().dims() == macroCellGrid.dims());
+        REQUIRE(cache.macroCellGrid().valueRanges() == macroCellGrid.valueRanges());
+        REQUIRE(cache.histogram2D().resolution == histogram.resolution);
+        REQUIRE(cache.histogram2D().bins == histogram.bins);
+    }
+
+    // Modifying the file invalidates its cache.
+    std::filesystem::last_write_time(file, std::filesystem::last_write_time(file) + std::chrono::seconds(1));
+    REQUIRE(!volume::DerivedDataCache(file, volume::VoxelLayout::Bricked).isValid());
+    std::filesystem::remove(file);
+    std::filesystem::remove(cacheFile);
+}
+
+TEST_CASE("Volume Loader Tests")
+{
+    const glm::ivec3 dim { 21, 19, 17 };
+    std::vector<uint16_t> data;
+    for (int i = 0; i < dim.x * dim.y * dim.z; i++)
+        data.push_back(static_cast<uint16_t>((i * 7) % 101));
+    const auto file = std::filesystem::temp_directory_path() / "volvis_test_loader.fld";
+    const auto cacheFile = volume::DerivedDataCache::cacheFile(file);
+    REQUIRE(volume::Volume(std::move(data), dim).write(file, volume::VoxelLayout::Linear));
+    std::filesystem::remove(cacheFile);
+
+    const volume::Volume volume { file, volume::VoxelLayout::Linear };
+    const volume::GradientVolume gradientVolume { volume, volume::GradientStorage::Compact };
+    const volume::Histogram2D histogram = volume::computeHistogram2D(volume, gradientVolume);
+
+    volume::VolumeLoadOptions options;
+    options.gradientStorage = volume::GradientStorage::Compact;
+    options.interpolationMode = volume::InterpolationMode::Linear;
+    options.compressVoxels = true;
+    options.cacheDerivedData = true;
+    // The second load reads the derived data from the cache that the first one wrote.
+    for (const bool cached : { false, true }) {
+        volume::VolumeLoader loader { file, options };
+        loader.waitFor(volume::VolumeLoader::Stage::Preview);
+        const volume::VolumeLoader::LoadedVolume& loaded = loader.loaded();
+        REQUIRE(loaded.optVolume->minimum() == volume.minimum());
+        REQUIRE(loaded.optVolume->maximum() == volume.maximum());
+        REQUIRE(loaded.optVolume->histogram() == volume.histogram());
+        REQUIRE(loaded.optVolume->interpolationMode == volume::InterpolationMode::Linear);
+        REQUIRE(loaded.optMacroCellGrid->valueRanges() == volume::MacroCellGrid(volume).valueRanges());
+        REQUIRE(loaded.optPreviewGradientVolume->getGradientVoxel(5, 6, 7).dir == volume::GradientVolume(volume).getGradientVoxel(5, 6, 7).dir);
+
+        loader.waitFor(volume::VolumeLoader::Stage::Complete);
+        REQUIRE(loader.stage() == volume::VolumeLoader::Stage::Complete);
+        REQUIRE(loader.progress() == 1.0f);
+        REQUIRE(loader.currentStep().empty());
+        REQUIRE(loaded.optGradientVolume->maxMagnitude() == gradientVolume.maxMagnitude());
+        REQUIRE(loaded.optVolumePyramid->numLevels() == volume::VolumePyramid(volume, gradientVolume).numLevels());
+        REQUIRE(loaded.histogram.bins == histogram.bins);
+        REQUIRE(loaded.optCompressedVolume.has_value());
+        REQUIRE(!loaded.streamBricks);
+        REQUIRE(loaded.optDerivedDataCache.has_value() == cached);
+        REQUIRE(volume::DerivedDataCache(file, volume::VoxelLayout::Linear).isValid());
+    }
+    std::filesystem::remove(file);
+    std::filesystem::remove(cacheFile);
+}
+
+TEST_CASE("Execution Policy Tests")
+{
+    volume::ExecutionConfig config;
+    config.parallel = true;
+    config.numThreads = 2;
+    config.numaArenas = true;
+    const volume::ExecutionPolicy policy { config };
+    REQUIRE(policy.numArenas() >= 1);
+
+    // Every element of the range is visited exactly once, also when the range is split over multiple arenas.
+    std::vector<std::atomic<int>> visits(1000);
+    std::atomic<int> maxThreadIndex { 0 };
+    policy.parallelFor(tbb::blocked_range<size_t>(0, visits.size()), [&](const tbb::blocked_range<size_t>& range) {
+        maxThreadIndex = std::max(maxThreadIndex.load(), volume::ExecutionPolicy::currentThreadIndex());
+        for (size_t i = range.begin(); i != range.end(); i++)
+            visits[i]++;
+    });
+    REQUIRE(std::all_of(std::begin(visits), std::end(visits), [](const std::atomic<int>& count) { return count == 1; }));
+    REQUIRE(maxThreadIndex < policy.concurrency());
+    std::atomic<int> cells { 0 };
+    policy.parallelFor(tbb::blocked_range2d<int>(0, 30, 0, 20), [&](const tbb::blocked_range2d<int>& range) {
+        cells += int(range.rows().size() * range.cols().size());
+    });
+    REQUIRE(cells == 30 * 20);
+
+    volume::FirstTouchVector<uint16_t> buffer(100);
+    policy.fill(gsl::span<uint16_t>(buffer), uint16_t(7));
+    REQUIRE(std::all_of(std::begin(buffer), std::end(buffer), [](uint16_t v) { return v == 7; }));
+
+    // A sequential policy calls the body once with the whole range.
+    config.parallel = false;
+    const volume::ExecutionPolicy sequential { config };
+    int calls = 0;
+    sequential.parallelFor(tbb::blocked_range<int>(0, 100, 1), [&](const tbb::blocked_range<int>& range) {
+        REQUIRE(range.size() == 100);
+        calls++;
+    });
+    REQUIRE(calls == 1);
+}
+
+TEST_CASE("Tile Scheduler Tests")
+{
+    const render::ScreenRect area { glm::ivec2(3, 5), glm::ivec2(70, 41) };
+    const auto tiles = render::createTiles(area, 16);
+    // 5 x 3 tiles, clipped to the area, that cover every pixel once.
+    REQUIRE(tiles.size() == 15);
+    std::vector<int> coverage(size_t(70 * 41), 0);
+    for (const auto& tile : tiles) {
+        for (int y = tile.begin.y; y < tile.end.y; y++) {
+            for (int x = tile.begin.x; x < tile.end.x; x++)
+                coverage[size_t(x + 70 * y)]++;
+        }
+    }
+    bool exact = true;
+    for (int y = 0; y < 41; y++) {
+        for (int x = 0; x < 70; x++) {
+            const bool inside = x >= area.begin.x && y >= area.begin.y;
+            exact &= coverage[size_t(x + 70 * y)] == (inside ? 1 : 0);
+        }
+    }
+    REQUIRE(exact);
+    // Morton order: the four tiles of the top left 2x2 block come first.
+    REQUIRE(tiles[1].begin == glm::ivec2(16, 5));
+    REQUIRE(tiles[2].begin == glm::ivec2(3, 16));
+    REQUIRE(tiles[3].begin == glm::ivec2(16, 16));
+
+    // The tiles of the next image reuse the vector.
+    std::vector<render::ScreenRect> reused = tiles;
+    const auto* pTiles = reused.data();
+    render::createTiles(render::ScreenRect { glm::ivec2(0), glm::ivec2(32) }, 16, reused);
+    REQUIRE(reused.size() == 4);
+    REQUIRE(reused.data() == pTiles);
+    REQUIRE(reused[3].begin == glm::ivec2(16, 16));
+}
+
+// Camera with rays through an image plane at distance 1 (perspective) or parallel rays (orthographic).
+class TestCamera : public render::RayTraceCamera {
+public:
+    explicit TestCamera(bool perspective)
+        : m_perspective(perspective)
+    {
+    }
+
+    glm::vec3 position() const override { return glm::vec3(4.0f, -2.0f, 7.0f); }
+    glm::vec3 forward() const override { return glm::normalize(glm::vec3(1.0f, 2.0f, -1.0f)); }
+    render::Ray generateRay(const glm::vec2& pixel) const override
+    {
+        const glm::vec3 right = 0.8f * glm::normalize(glm::cross(forward(), glm::vec3(0.0f, 0.0f, 1.0f)));
+        const glm::vec3 up = 0.6f * glm::normalize(glm::cross(right, forward()));
+        render::Ray ray;
+        ray.origin = m_perspective ? position() : position() + pixel.x * right + pixel.y * up;
+        ray.direction = m_perspective ? glm::normalize(forward() + pixel.x * right + pixel.y * up) : forward();
+        return ray;
+    }
+
+private:
+    bool m_perspective;
+};
+
+// A sphere in an otherwise empty 32^3 volume, seen from the front. The gradient volume refers to the volume, so a scene
+// is only ever constructed in place by createSphereScene.
+struct SphereScene {
+    volume::Volume volume;
+    volume::GradientVolume gradientVolume { volume };
+    render::LookAtCamera camera { glm::vec3(15.5f, 15.5f, -60.0f), glm::vec3(15.5f) };
+};
+
+static SphereScene createSphereScene()
+{
+    const glm::ivec3 dim { 32 };
+    std::vector<uint16_t> data;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data.push_back(glm::length(glm::vec3(x, y, z) - 15.5f) < 6.0f ? 200 : 0);
+        }
+    }
+    volume::Volume volume { std::move(data), dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    return SphereScene { std::move(volume) };
+}
+
+TEST_CASE("Render Statistics Tests")
+{
+    const SphereScene scene = createSphereScene();
+
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(32);
+    config.renderMode = render::RenderMode::RenderIso;
+    config.isoValue = 100.0f;
+    config.volumeShading = true;
+    render::Renderer renderer { &scene.volume, &scene.gradientVolume, &scene.camera, config };
+    renderer.render();
+    const render::RenderStatistics iso = renderer.statistics();
+    // Every pixel of the tiles is traced once.
+    uint64_t tilePixels = 0;
+    for (const render::TileTiming& timing : renderer.tileTimings())
+        tilePixels += uint64_t((timing.tile.end.x - timing.tile.begin.x) * (timing.tile.end.y - timing.tile.begin.y));
+    REQUIRE(iso.raysCast == tilePixels);
+    REQUIRE(iso.raysMissed < iso.raysCast);
+    REQUIRE(iso.samplesSkipped > 0);
+    REQUIRE(iso.shadedSamples > 0);
+    REQUIRE(iso.refinementIterations > 0);
+
+    // Rays through the (opaque) sphere terminate early; the statistics only count the current image.
+    config.renderMode = render::RenderMode::RenderComposite;
+    config.volumeShading = false;
+    for (size_t i = 0; i < config.tfColorMap.size(); i++)
+        config.tfColorMap[i] = glm::vec4(1.0f, 1.0f, 1.0f, i >= 100 ? 1.0f : 0.0f);
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = float(config.tfColorMap.size());
+    renderer.setConfig(config);
+    renderer.render();
+    const render::RenderStatistics composite = renderer.statistics();
+    REQUIRE(composite.raysCast == iso.raysCast);
+    REQUIRE(composite.earlyTerminations > 0);
+    REQUIRE(composite.shadedSamples == 0);
+
+    // A progressive image traces every pixel once, over any number of calls.
+    renderer.restartProgressive();
+    while (!renderer.renderProgressive(std::chrono::microseconds(1))) { }
+    REQUIRE(renderer.statistics().raysCast == 32 * 32);
+
+    // From further away the volume covers fewer tiles; the pixels of the previous image outside of them are cleared.
+    const render::LookAtCamera farCamera { glm::vec3(15.5f, 15.5f, -200.0f), glm::vec3(15.5f) };
+    renderer.setCamera(&farCamera);
+    renderer.render();
+    REQUIRE(renderer.statistics().raysCast < iso.raysCast);
+    render::Renderer reference { &scene.volume, &scene.gradientVolume, &farCamera, config };
+    reference.render();
+    REQUIRE(std::equal(std::begin(renderer.frameBuffer()), std::end(renderer.frameBuffer()), std::begin(reference.frameBuffer())));
+}
+
+TEST_CASE("Render Modes Batch Tests")
+{
+    const SphereScene scene = createSphereScene();
+
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(32);
+    config.renderMode = render::RenderMode::RenderMIP;
+    config.sampleStep = 0.1f;
+    config.isoValue = 100.0f;
+    config.volumeShading = true;
+    for (size_t i = 0; i < config.tfColorMap.size(); i++)
+        config.tfColorMap[i] = glm::vec4(1.0f, 1.0f, 1.0f, i >= 100 ? 0.2f : 0.0f);
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = float(config.tfColorMap.size());
+
+    const std::array modes { render::RenderMode::RenderMIP, render::RenderMode::RenderIso, render::RenderMode::RenderComposite, render::RenderMode::RenderSlicer };
+    render::Renderer batch { &scene.volume, &scene.gradientVolume, &scene.camera, config };
+    REQUIRE(batch.renderModes(modes));
+    const render::RenderStatistics batchStatistics = batch.statistics();
+    REQUIRE(batchStatistics.raysCast <= 32 * 32);
+
+    // The shared sample walk takes (slightly) shifted samples for MIP and iso, which only changes pixels at the edge of
+    // the sphere; the slicer traces its rays on its own and gives the same image.
+    uint64_t singleSamples = 0;
+    for (size_t i = 0; i < modes.size(); i++) {
+        config.renderMode = modes[i];
+        render::Renderer renderer { &scene.volume, &scene.gradientVolume, &scene.camera, config };
+        renderer.render();
+        singleSamples += renderer.statistics().samples;
+        const auto reference = renderer.frameBuffer();
+        const auto image = batch.modeFrameBuffer(i);
+        REQUIRE(image.size() == reference.size());
+        size_t numDifferent = 0;
+        for (size_t pixel = 0; pixel < image.size(); pixel++)
+            numDifferent += glm::any(glm::greaterThan(glm::abs(image[pixel] - reference[pixel]), glm::vec4(0.05f)));
+        if (modes[i] == render::RenderMode::RenderSlicer)
+            REQUIRE(std::equal(std::begin(image), std::end(image), std::begin(reference)));
+        else
+            REQUIRE(numDifferent < image.size() / 32);
+    }
+    REQUIRE(batchStatistics.samples < singleSamples);
+    // The frame buffer of render() is not touched.
+    REQUIRE(std::all_of(std::begin(batch.frameBuffer()), std::end(batch.frameBuffer()), [](const glm::vec4& color) { return color == glm::vec4(0.0f); }));
+
+    // The 2D transfer function is only baked for the render mode of the config.
+    const std::array tf2DModes { render::RenderMode::RenderMIP, render::RenderMode::RenderTF2D };
+    REQUIRE(!batch.renderModes(tf2DModes));
+}
+
+TEST_CASE("Adaptive Sample Step Tests")
+{
+    // A uniform, semi-transparent volume: the adaptive step grows up to maxSampleStep along the whole ray.
+    const glm::ivec3 dim { 32 };
+    volume::Volume volume { std::vector<uint16_t>(size_t(dim.x * dim.y * dim.z), 100), dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    const volume::GradientVolume gradientVolume { volume };
+    const TestCamera camera { true };
+
+    render::RenderConfig config {};
+    config.volumeShading = false;
+    config.tfColorMap.fill(glm::vec4(1.0f, 0.5f, 0.25f, 0.02f));
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = float(config.tfColorMap.size());
+    TestRenderer reference { &volume, &gradientVolume, &camera, config };
+    config.adaptiveSampleStep = true;
+    config.maxSampleStep = 8.0f;
+    TestRenderer adaptive { &volume, &gradientVolume, &camera, config };
+
+    // Every part of the ray is composited once, however far the step grew, so the color is the same as with the fixed step.
+    for (const float length : { 5.0f, 17.3f, 31.0f }) {
+        INFO("ray length " << length);
+        const render::Ray ray { glm::vec3(0.0f, 15.5f, 15.5f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f, length };
+        const glm::vec4 expected = reference.test_traceRayComposite(ray, 1.0f);
+        const glm::vec4 color = adaptive.test_traceRayComposite(ray, 1.0f);
+        REQUIRE(expected.r > 0.05f);
+        REQUIRE(!glm::any(glm::greaterThan(glm::abs(color - expected), glm::vec4(0.001f))));
+    }
+}
+
+TEST_CASE("Region Of Interest Tests")
+{
+    const SphereScene scene = createSphereScene();
+
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(32);
+    config.renderMode = render::RenderMode::RenderMIP;
+    render::Renderer reference { &scene.volume, &scene.gradientVolume, &scene.camera, config };
+    reference.render();
+
+    // Only the tiles of the projected region are traced. The rays through the center of the screen stay inside the
+    // region (which spans the volume along the view direction), so they see the same samples.
+    config.roiLower = glm::vec3(0.25f, 0.25f, 0.0f);
+    config.roiUpper = glm::vec3(0.75f, 0.75f, 1.0f);
+    render::Renderer renderer { &scene.volume, &scene.gradientVolume, &scene.camera, config };
+    renderer.render();
+    REQUIRE(renderer.statistics().raysCast < reference.statistics().raysCast);
+    const size_t center = 16 * 32 + 16;
+    REQUIRE(renderer.frameBuffer()[center] == reference.frameBuffer()[center]);
+    REQUIRE(renderer.frameBuffer()[center].r > 0.0f);
+    REQUIRE(renderer.frameBuffer()[0] == glm::vec4(0.0f));
+
+    // A clip plane (with a normal that is not normalized) that keeps only the back of the volume, z >= 28, hides the sphere.
+    // MIP rays are opaque, so the pixel is black.
+    config.roiLower = glm::vec3(0.0f);
+    config.roiUpper = glm::vec3(1.0f);
+    config.clipPlanes[0] = glm::vec4(0.0f, 0.0f, -2.0f, -12.0f);
+    renderer.setConfig(config);
+    renderer.render();
+    REQUIRE(glm::vec3(renderer.frameBuffer()[center]) == glm::vec3(0.0f));
+
+    // A plane that keeps nothing: every ray misses.
+    config.clipPlanes[0] = glm::vec4(0.0f, 0.0f, 1.0f, -100.0f);
+    renderer.setConfig(config);
+    renderer.render();
+    REQUIRE(renderer.statistics().raysMissed == renderer.statistics().raysCast);
+
+    // The clip region of a config in voxel coordinates.
+    const render::ClipRegion region = render::clipRegion(config, glm::vec3(0.0f), glm::vec3(scene.volume.dims()));
+    REQUIRE(region.upper == glm::vec3(31.0f));
+    REQUIRE(region.numPlanes == 1);
+    REQUIRE(region.planes[0] == glm::vec4(0.0f, 0.0f, 1.0f, -84.0f));
+    REQUIRE(region.clipped);
+}
+
+TEST_CASE("Pinhole Camera Tests")
+{
+    const auto optPinhole = render::fitPinholeCamera(TestCamera(true));
+    REQUIRE(optPinhole.has_value());
+    for (const glm::vec2 pixel : { glm::vec2(0.3f, -0.7f), glm::vec2(-1.0f, 0.9f), glm::vec2(0.5f, 0.5f) }) {
+        const render::Ray ray = TestCamera(true).generateRay(pixel);
+        const glm::vec3 direction = glm::normalize(optPinhole->forward + pixel.x * optPinhole->right + pixel.y * optPinhole->up);
+        REQUIRE(optPinhole->origin == ray.origin);
+        REQUIRE(glm::dot(direction, ray.direction) == Approx(1.0f));
+    }
+
+    REQUIRE(!render::fitPinholeCamera(TestCamera(false)).has_value());
+}
+
+// Moves the origins of the rays of a camera a little along them, which renders the same image (up to the positions of
+// the samples) but is not a pinhole camera, since the rays no longer share their origin.
+class OffsetOriginCamera : public render::RayTraceCamera {
+public:
+    explicit OffsetOriginCamera(const render::RayTraceCamera& camera)
+        : m_camera(camera)
+    {
+    }
+
+    glm::vec3 position() const override { return m_camera.position(); }
+    glm::vec3 forward() const override { return m_camera.forward(); }
+    render::Ray generateRay(const glm::vec2& pixel) const override
+    {
+        render::Ray ray = m_camera.generateRay(pixel);
+        ray.origin += 1e-3f * ray.direction;
+        return ray;
+    }
+
+private:
+    const render::RayTraceCamera& m_camera;
+};
+
+TEST_CASE("Pixel Ray Tests")
+{
+    // The sphere scene, seen at an angle.
+    const SphereScene scene = createSphereScene();
+    const render::LookAtCamera camera { glm::vec3(40.0f, 25.0f, -50.0f), glm::vec3(15.5f) };
+    const OffsetOriginCamera offsetCamera { camera };
+    REQUIRE(render::fitPinholeCamera(camera).has_value());
+    REQUIRE(!render::fitPinholeCamera(offsetCamera).has_value());
+
+    // The rays of the pinhole camera are generated from its basis and clipped with the offsets computed for the frame,
+    // the rays of the other camera by the camera and clipped per ray. The images match, also with a clip plane.
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(32);
+    config.renderMode = render::RenderMode::RenderMIP;
+    for (const glm::vec4& clipPlane : { glm::vec4(0.0f), glm::vec4(1.0f, 0.0f, 0.0f, 2.0f) }) {
+        config.clipPlanes[0] = clipPlane;
+        render::Renderer renderer { &scene.volume, &scene.gradientVolume, &camera, config };
+        render::Renderer reference { &scene.volume, &scene.gradientVolume, &offsetCamera, config };
+        renderer.render();
+        reference.render();
+        // Only the reference traces the tiles that the projected volume does not cover.
+        REQUIRE(renderer.statistics().raysCast < reference.statistics().raysCast);
+        for (size_t i = 0; i < renderer.frameBuffer().size(); i++)
+            REQUIRE(renderer.frameBuffer()[i].r == Approx(reference.frameBuffer()[i].r).margin(0.02f));
+    }
+}
+
+TEST_CASE("Temporal Reprojection Tests")
+{
+    const SphereScene scene = createSphereScene();
+
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(64);
+    config.renderMode = render::RenderMode::RenderIso;
+    config.isoValue = 100.0f;
+    config.volumeShading = true;
+    config.temporalReprojection = true;
+    // The camera moves a little to the side of that of the scene.
+    const render::LookAtCamera camera { glm::vec3(18.0f, 15.5f, -60.0f), glm::vec3(15.5f) };
+    render::Renderer renderer { &scene.volume, &scene.gradientVolume, &scene.camera, config };
+    while (!renderer.renderProgressive(std::chrono::microseconds(1))) { }
+
+    // After a small camera move the first call returns a complete image that traced only part of the pixels.
+    renderer.setCamera(&camera);
+    REQUIRE(!renderer.renderProgressive(std::chrono::microseconds(0)));
+    const uint64_t reprojectedRays = renderer.statistics().raysCast;
+    REQUIRE(reprojectedRays < 64 * 64 / 16);
+    render::Renderer reference { &scene.volume, &scene.gradientVolume, &camera, config };
+    reference.render();
+    size_t wrongPixels = 0;
+    for (size_t i = 0; i < reference.frameBuffer().size(); i++)
+        wrongPixels += glm::length(renderer.frameBuffer()[i] - reference.frameBuffer()[i]) > 0.1f ? size_t(1) : size_t(0);
+    REQUIRE(wrongPixels < 64 * 64 / 50);
+
+    // The refinement then traces the reprojected pixels, which gives the same image as rendering from scratch.
+    while (!renderer.renderProgressive(std::chrono::microseconds(1))) { }
+    REQUIRE(renderer.statistics().raysCast > reprojectedRays);
+    REQUIRE(std::equal(std::begin(renderer.frameBuffer()), std::end(renderer.frameBuffer()), std::begin(reference.frameBuffer())));
+}
+
+TEST_CASE("Sort-Last Rendering Tests")
+{
+    // Two smooth blobs of different values, so that the blocks overlap along the rays.
+    const glm::ivec3 dim { 40, 32, 32 };
+    std::vector<uint16_t> data;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                const float first = 1.0f - glm::length(glm::vec3(x, y, z) - glm::vec3(14.0f, 15.5f, 12.0f)) / 10.0f;
+                const float second = 1.0f - glm::length(glm::vec3(x, y, z) - glm::vec3(25.0f, 15.5f, 20.0f)) / 10.0f;
+                data.push_back(static_cast<uint16_t>(std::max({ 150.0f * first, 250.0f * second, 0.0f })));
+            }
+        }
+    }
+    volume::Volume volume { std::move(data), dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    const volume::GradientVolume gradientVolume { volume };
+
+    const auto blocks = volume::partitionVolume(dim, 4);
+    REQUIRE(blocks.size() == 4);
+    // The first split halves x, the second split halves the halves along their longest axis (y).
+    REQUIRE(blocks[0].upper == glm::ivec3(19, 15, 31));
+    REQUIRE(blocks[1].lower == glm::ivec3(0, 15, 0));
+    REQUIRE(blocks[2].lower == glm::ivec3(19, 0, 0));
+    REQUIRE(blocks[3].upper == dim - 1);
+    REQUIRE(blocks[1].origin == glm::ivec3(0, 12, 0));
+    REQUIRE(blocks[1].dims == glm::ivec3(23, 20, 32));
+    const volume::Volume lastBlockVolume = volume::extractBlock(volume, blocks[3]);
+    REQUIRE(lastBlockVolume.dims() == blocks[3].dims);
+    REQUIRE(lastBlockVolume.getVoxel(25 - blocks[3].origin.x, 15 - blocks[3].origin.y, 20) == volume.getVoxel(25, 15, 20));
+
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(48);
+    for (size_t i = 0; i < config.tfColorMap.size(); i++)
+        config.tfColorMap[i] = glm::vec4(i < 150 ? 1.0f : 0.0f, 0.5f, i >= 150 ? 1.0f : 0.0f, std::min(float(i) / 1000.0f, 0.2f));
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = float(config.tfColorMap.size());
+    const render::LookAtCamera camera { glm::vec3(-30.0f, 40.0f, -50.0f), glm::vec3(20.0f, 15.5f, 15.5f) };
+
+    for (const render::RenderMode mode : { render::RenderMode::RenderComposite, render::RenderMode::RenderMIP }) {
+        config.renderMode = mode;
+        render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+        renderer.render();
+
+        std::vector<render::BlockImage> images;
+        for (const auto& block : blocks) {
+            const volume::Volume blockVolume = volume::extractBlock(volume, block);
+            const volume::GradientVolume blockGradientVolume { blockVolume };
+            const render::BlockCamera blockCamera { &camera, block };
+            render::Renderer blockRenderer { &blockVolume, &blockGradientVolume, &blockCamera, config };
+            blockRenderer.setBlock(render::createRenderBlock(block, dim, volume.maximum(), gradientVolume.maxMagnitude()));
+            blockRenderer.render();
+            images.push_back(render::createBlockImage(blockRenderer.frameBuffer(), config.renderResolution, camera, block));
+        }
+        render::compositeBlockImages(images, mode);
+
+        // The blocks take their samples at other positions along the rays than the whole volume, which changes the
+        // colors slightly (mostly at the silhouettes).
+        float maxDifference = 0.0f, sumDifference = 0.0f;
+        for (size_t i = 0; i < renderer.frameBuffer().size(); i++) {
+            const float difference = glm::compMax(glm::abs(images[0].colors[i] - renderer.frameBuffer()[i]));
+            maxDifference = std::max(maxDifference, difference);
+            sumDifference += difference;
+        }
+        REQUIRE(maxDifference < 0.1f);
+        REQUIRE(sumDifference / float(renderer.frameBuffer().size()) < 0.005f);
+    }
+}
+
+TEST_CASE("2D Transfer Function Table Tests")
+{
+    // Opaque red for intensities in [20, 40], transparent elsewhere; the green channel depends on the gradient magnitude.
+    const auto classify = [](float intensity, float magnitude) {
+        const bool inside = intensity >= 20.0f && intensity <= 40.0f;
+        return glm::vec4(1.0f, magnitude / 100.0f, 0.0f, inside ? 0.5f : 0.0f);
+    };
+    render::TF2DLookupTable table;
+    table.bake(255.0f, 100.0f, classify);
+
+    const glm::vec4 inside = table.lookup(30.0f, 50.0f);
+    REQUIRE(inside.r == Approx(1.0f));
+    REQUIRE(inside.g == Approx(0.5f).margin(0.01f));
+    REQUIRE(inside.a == Approx(0.5f));
+    // Interpolating with a transparent entry lowers the opacity but keeps the color.
+    const glm::vec4 edge = table.lookup(40.1f, 50.0f);
+    REQUIRE(edge.a > 0.0f);
+    REQUIRE(edge.a < 0.5f);
+    REQUIRE(edge.r == Approx(1.0f));
+    REQUIRE(table.lookup(100.0f, 50.0f) == glm::vec4(0.0f));
+
+    REQUIRE(table.isTransparent(0.0f, 19.0f));
+    REQUIRE(table.isTransparent(41.0f, 255.0f));
+    REQUIRE(!table.isTransparent(0.0f, 20.0f));
+    REQUIRE(!table.isTransparent(35.0f, 36.0f));
+    REQUIRE(!table.isTransparent(40.1f, 60.0f));
+}
+
+TEST_CASE("Pre-Integration Table Tests")
+{
+    // Transparent except for a single red entry.
+    std::array<glm::vec4, 16> transferFunction;
+    transferFunction.fill(glm::vec4(0.0f));
+    transferFunction[8] = glm::vec4(1.0f, 0.0f, 0.0f, 0.5f);
+
+    render::PreIntegrationTable table;
+    table.bake(transferFunction, 1.0f);
+    // A segment of constant value has the opacity of a single sample.
+    REQUIRE(table.lookup(8, 8).a == Approx(0.5f));
+    REQUIRE(table.lookup(2, 2).a == 0.0f);
+    // A segment that passes the entry picks it up even though both ends are transparent.
+    const glm::vec4 segment = table.lookup(4, 12);
+    REQUIRE(segment.a > 0.0f);
+    REQUIRE(segment.a < 0.5f);
+    REQUIRE(segment.r == Approx(1.0f));
+    REQUIRE(table.lookup(12, 4) == segment);
+
+    table.bake(transferFunction, 2.0f);
+    REQUIRE(table.lookup(8, 8).a == Approx(0.75f));
+}
+
+TEST_CASE("Sample Cache Tests")
+{
+    const render::SampleRun run { 10.0f, 2.0f, 0.5f, 3 };
+    const std::array<render::SampleRun, 2> runs { run, run };
+    render::SampleCache cache;
+    cache.reset(4, 3 * sizeof(render::SampleRun));
+    REQUIRE(!cache.isRecorded(0));
+
+    REQUIRE(cache.record(0, runs));
+    REQUIRE(cache.isRecorded(0));
+    REQUIRE(cache.samples(0).size() == 2);
+    REQUIRE(cache.samples(0)[1].count == 3);
+    // A ray that misses the volume is recorded without samples.
+    REQUIRE(cache.record(1, {}));
+    REQUIRE(cache.isRecorded(1));
+    // Over budget: the pixel stays unrecorded.
+    REQUIRE(!cache.record(2, runs));
+    REQUIRE(!cache.isRecorded(2));
+    REQUIRE(cache.record(3, gsl::span<const render::SampleRun>(runs).first(1)));
+
+    // The next image records its samples in the memory of the previous one.
+    const render::SampleRun* pSamples = cache.samples(0).data();
+    cache.reset(4, 3 * sizeof(render::SampleRun));
+    REQUIRE(!cache.isRecorded(0));
+    REQUIRE(cache.record(0, runs));
+    REQUIRE(cache.samples(0).data() == pSamples);
+}
+
+TEST_CASE("Render Config Section Tests")
+{
+    using render::RenderConfigSection;
+    const render::RenderConfig config {};
+    REQUIRE(!render::changedSections(config, config).any());
+
+    const auto changes = [&](auto&& modify) {
+        render::RenderConfig modified = config;
+        modify(modified);
+        REQUIRE(modified != config);
+        return render::changedSections(config, modified);
+    };
+    const auto onlyChanged = [](const render::RenderConfigChanges& c, RenderConfigSection section) {
+        for (size_t i = 0; i < render::numRenderConfigSections; i++) {
+            if (c.test(RenderConfigSection(i)) != (RenderConfigSection(i) == section))
+                return false;
+        }
+        return true;
+    };
+    REQUIRE(onlyChanged(changes([](auto& c) { c.renderMode = render::RenderMode::RenderMIP; }), RenderConfigSection::Mode));
+    REQUIRE(onlyChanged(changes([](auto& c) { c.renderResolution.x++; }), RenderConfigSection::Resolution));
+    REQUIRE(onlyChanged(changes([](auto& c) { c.sampleStep = 0.5f; }), RenderConfigSection::Sampling));
+    REQUIRE(onlyChanged(changes([](auto& c) { c.clipPlanes[1].x = 1.0f; }), RenderConfigSection::Sampling));
+    REQUIRE(onlyChanged(changes([](auto& c) { c.volumeShading = true; }), RenderConfigSection::Compositing));
+    REQUIRE(onlyChanged(changes([](auto& c) { c.isoValue++; }), RenderConfigSection::IsoValue));
+    REQUIRE(onlyChanged(changes([](auto& c) { c.tfColorMap[100].a = 0.5f; }), RenderConfigSection::TransferFunction));
+    REQUIRE(onlyChanged(changes([](auto& c) { c.TF2DV2Color_1.r = 0.5f; }), RenderConfigSection::TransferFunction2D));
+
+    const render::RenderConfigChanges tiling = changes([](auto& c) { c.tileSize++; });
+    REQUIRE(onlyChanged(tiling, RenderConfigSection::Performance));
+    REQUIRE(!tiling.affectsImage());
+}
+
+TEST_CASE("Render Config IO Tests")
+{
+    render::RenderConfig config {};
+    config.renderMode = render::RenderMode::RenderComposite;
+    config.renderResolution = glm::ivec2(320, 200);
+    config.shadingModel = render::ShadingModel::BlinnPhong;
+    config.sampleStep = 0.1f;
+    config.tfColorMap[42] = glm::vec4(0.1f, 0.2f, 0.3f, 0.4f);
+    config.TF2DV2Color_1 = glm::vec4(1.0f / 3.0f);
+    config.roiLower = glm::vec3(0.1f, 0.2f, 0.3f);
+    config.clipPlanes[2] = glm::vec4(0.0f, 1.0f, 0.0f, -4.5f);
+
+    std::stringstream stream;
+    render::writeRenderConfig(stream, config);
+    const auto optRead = render::readRenderConfig(stream);
+    REQUIRE(optRead);
+    REQUIRE(*optRead == config);
+
+    // Settings that are missing from the file keep their default; invalid values are rejected.
+    std::istringstream partial { "# comment\nisoValue 50\n" };
+    const auto optPartial = render::readRenderConfig(partial, config);
+    REQUIRE(optPartial);
+    REQUIRE(optPartial->isoValue == 50.0f);
+    REQUIRE(optPartial->renderResolution == config.renderResolution);
+    std::istringstream invalid { "renderResolution 320\n" };
+    REQUIRE(!render::readRenderConfig(invalid));
+}
+
+TEST_CASE("Iso Surface Refinement Tests")
+{
+    // Ramp along the x axis: value 10 * x.
+    std::vector<uint8_t> voxels;
+    for (int i = 0; i < 8 * 2 * 2; i++)
+        voxels.push_back(uint8_t(10 * (i % 8)));
+    volume::Volume volume { std::move(voxels), glm::ivec3(8, 2, 2) };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    const volume::GradientVolume gradientVolume { volume };
+    TestRenderer renderer { &volume, &gradientVolume, nullptr, render::RenderConfig {} };
+
+    const render::Ray ray { glm::vec3(0.0f, 0.5f, 0.5f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f, 7.0f };
+    REQUIRE(renderer.test_secantAccuracy(ray, 2.0f, 3.0f, 25.0f) == Approx(2.5f));
+    REQUIRE(renderer.test_secantAccuracy(ray, 1.0f, 4.0f, 37.0f) == Approx(renderer.test_bisectionAccuracy(ray, 1.0f, 4.0f, 37.0f)).margin(0.001f));
+
+    // The fast shading kernel matches the reference within float precision.
+    const glm::vec3 color { 0.8f, 0.8f, 0.2f };
+    const glm::vec3 light { 3.0f, -1.0f, 2.0f };
+    for (const glm::vec3& dir : { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-0.3f, 0.9f, 0.1f), glm::vec3(0.0f), glm::vec3(-2.0f, 1.0f, -1.0f) }) {
+        const volume::GradientVoxel gradient { dir, glm::length(dir) };
+        const glm::vec3 view = glm::normalize(glm::vec3(-0.5f, 0.2f, -1.0f));
+        const glm::vec3 exact = renderer.test_computePhongShading(color, gradient, light, view);
+        const glm::vec3 fast = renderer.test_computeFastPhongShading(color, gradient, light, view);
+        for (int c = 0; c < 3; c++)
+            REQUIRE(fast[c] == Approx(exact[c]).margin(1e-5f));
+    }
+}
+
+TEST_CASE("Phong Shader Tests")
+{
+    const glm::vec3 L { 0.0f, 0.0f, -5.0f };
+    const glm::vec3 V = glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f));
+    const render::PhongShader phong { render::ShadingModel::Phong, L, V };
+    const render::PhongShader blinnPhong { render::ShadingModel::BlinnPhong, L, V };
+
+    // A gradient along the half vector gets the full highlight in both models.
+    const glm::vec3 halfVector = glm::normalize(glm::normalize(-L) + V);
+    const volume::GradientVoxel highlight { 100.0f * halfVector, 100.0f };
+    const float diffuse = glm::dot(halfVector, glm::normalize(-L));
+    REQUIRE(blinnPhong.factor(highlight) == Approx(0.1f + 0.7f * diffuse + 0.2f).epsilon(1e-3f));
+    REQUIRE(phong.factor(highlight) == Approx(0.1f + 0.7f * diffuse + 0.2f).epsilon(1e-3f));
+    // Away from the highlight only the ambient and diffuse terms remain.
+    const volume::GradientVoxel side { glm::vec3(0.0f, 1.0f, 0.0f), 1.0f };
+    REQUIRE(blinnPhong.factor(side) == Approx(0.1f).margin(1e-4f));
+    REQUIRE(blinnPhong.shade(glm::vec3(2.0f), side).x == Approx(2.0f * blinnPhong.factor(side)));
+}
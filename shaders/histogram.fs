@@ -0,0 +1,56 @@
+#version 330
+layout(location = 0) out vec4 o_fragColor;
+
+uniform isampler2D u_counts;
+uniform sampler2D u_colorMap;
+
+uniform vec2 u_imageSize;
+// Density plot of a 2D histogram, otherwise a bar chart of a 1D histogram (a single row of bins).
+uniform bool u_densityPlot;
+uniform bool u_useColorMap;
+uniform bool u_logScale;
+uniform float u_maxCount;
+uniform float u_opacity;
+
+// Fraction of the image height above the highest bar.
+const float headroom = 1.1;
+
+float scaledCount(int count)
+{
+	if (u_maxCount <= 0.0)
+		return 0.0;
+	return u_logScale ? log(1.0 + float(count)) / log(1.0 + u_maxCount) : float(count) / u_maxCount;
+}
+
+void main()
+{
+	// Pixel relative to the bottom left of the image. ImGui shows the first row of a texture at the top, so the
+	// image is rendered upside down.
+	vec2 pixel = vec2(gl_FragCoord.x - 0.5, u_imageSize.y - 0.5 - gl_FragCoord.y);
+
+	// The largest count of the bins that the pixel covers, so that narrow peaks do not disappear.
+	ivec2 numBins = textureSize(u_counts, 0);
+	ivec2 firstBin = ivec2(floor(pixel / u_imageSize * vec2(numBins)));
+	ivec2 lastBin = min(max(firstBin + 1, ivec2(ceil((pixel + 1.0) / u_imageSize * vec2(numBins)))), numBins);
+	int count = 0;
+	for (int y = firstBin.y; y < lastBin.y; y++) {
+		for (int x = firstBin.x; x < lastBin.x; x++)
+			count = max(count, texelFetch(u_counts, ivec2(x, y), 0).r);
+	}
+
+	if (u_densityPlot) {
+		o_fragColor = vec4(1.0, 1.0, 1.0, scaledCount(count) * u_opacity);
+		return;
+	}
+
+	float height = (pixel.y + 0.5) / u_imageSize.y;
+	if (height * headroom >= scaledCount(count)) {
+		o_fragColor = vec4(0.0);
+		return;
+	}
+	// The bars are tinted (rather than colored) by the color map so that dark colors remain visible.
+	vec3 color = vec3(1.0);
+	if (u_useColorMap)
+		color = 0.5 + 0.5 * texture(u_colorMap, vec2((pixel.x + 0.5) / u_imageSize.x, 0.5)).rgb;
+	o_fragColor = vec4(color, u_opacity);
+}
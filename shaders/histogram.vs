@@ -0,0 +1,8 @@
+#version 330
+
+void main()
+{
+	// A triangle with corners (-1, -1), (3, -1) and (-1, 3) covers the whole image.
+	vec2 position = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);
+	gl_Position = vec4(position, 0.0, 1.0);
+}
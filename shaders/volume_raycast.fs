@@ -0,0 +1,406 @@
+#version 330
+// GPU version of render::Renderer: every fragment traces the ray of one pixel.
+in vec2 v_screenPos;
+
+layout(location = 0) out vec4 o_fragColor;
+
+// Values of render::RenderMode and volume::InterpolationMode.
+const int RenderSlicer = 0;
+const int RenderMIP = 1;
+const int RenderIso = 2;
+const int RenderComposite = 3;
+const int RenderTF2D = 4;
+const int RenderTF2DV2 = 5;
+const int NearestNeighbour = 0;
+const int Linear = 1;
+const int Cubic = 2;
+
+uniform sampler3D u_volume;
+uniform sampler3D u_gradients; // (direction, magnitude)
+uniform sampler1D u_tfColorMap;
+uniform ivec3 u_dims;
+uniform float u_valueScale;
+uniform float u_volumeMaximum;
+uniform int u_interpolationMode;
+
+// Pinhole camera (see render::PinholeCamera).
+uniform vec3 u_cameraOrigin;
+uniform vec3 u_cameraForward;
+uniform vec3 u_cameraRight;
+uniform vec3 u_cameraUp;
+
+uniform int u_renderMode;
+uniform bool u_volumeShading;
+// See render::ShadingModel: 0 is Phong, 1 is Blinn-Phong.
+uniform int u_shadingModel;
+uniform float u_isoValue;
+uniform bool u_frontToBackCompositing;
+uniform float u_earlyRayTerminationThreshold;
+// See render::RenderConfig::sampleStep and adaptiveSampleStep.
+uniform float u_sampleStep;
+uniform bool u_adaptiveSampleStep;
+uniform float u_maxSampleStep;
+// See render::ClipRegion: the region of interest in voxel coordinates and the enabled clip planes (normal, w) that keep
+// the points p with dot(normal, p) <= w.
+uniform vec3 u_roiLower;
+uniform vec3 u_roiUpper;
+uniform vec4 u_clipPlanes[4]; // render::maxClipPlanes
+uniform int u_numClipPlanes;
+uniform bool u_clipped;
+
+uniform float u_tfColorMapIndexStart;
+uniform float u_tfColorMapIndexRange;
+uniform float u_tf2DIntensity;
+uniform float u_tf2DRadius;
+uniform vec4 u_tf2DColor;
+uniform vec2 u_tf2DV2Intensity;
+uniform vec2 u_tf2DV2Radius;
+uniform vec4 u_tf2DV2Color0;
+uniform vec4 u_tf2DV2Color1;
+
+bool outsideInterpolationBounds(vec3 coord)
+{
+	return any(lessThan(coord, vec3(0.0))) || any(greaterThanEqual(coord, vec3(u_dims - 1)));
+}
+
+float getVoxel(ivec3 voxel)
+{
+	if (any(lessThan(voxel, ivec3(0))) || any(greaterThanEqual(voxel, u_dims)))
+		return 0.0;
+	return texelFetch(u_volume, voxel, 0).r * u_valueScale;
+}
+
+// Weight of the cubic interpolation kernel (see volume::Volume::weight).
+float cubicWeight(float x)
+{
+	float a = -0.75;
+	x = abs(x);
+	if (x < 1.0)
+		return (a + 2.0) * x * x * x - (a + 3.0) * x * x + 1.0;
+	else if (x < 2.0)
+		return a * x * x * x - 5.0 * a * x * x + 8.0 * a * x - 4.0 * a;
+	return 0.0;
+}
+
+vec4 cubicWeights(float factor)
+{
+	return vec4(cubicWeight(1.0 + factor), cubicWeight(factor), cubicWeight(1.0 - factor), cubicWeight(2.0 - factor));
+}
+
+float getVoxelTriCubicInterpolate(vec3 coord)
+{
+	if (outsideInterpolationBounds(coord))
+		return 0.0;
+
+	ivec3 base = ivec3(coord);
+	vec3 factor = coord - vec3(base);
+	vec4 weightsX = cubicWeights(factor.x);
+	vec4 weightsY = cubicWeights(factor.y);
+	vec4 weightsZ = cubicWeights(factor.z);
+
+	float value = 0.0;
+	for (int z = 0; z < 4; z++) {
+		float valueY = 0.0;
+		for (int y = 0; y < 4; y++) {
+			ivec3 row = base + ivec3(-1, y - 1, z - 1);
+			vec4 values = vec4(getVoxel(row), getVoxel(row + ivec3(1, 0, 0)), getVoxel(row + ivec3(2, 0, 0)), getVoxel(row + ivec3(3, 0, 0)));
+			valueY += weightsY[y] * dot(weightsX, values);
+		}
+		value += weightsZ[z] * valueY;
+	}
+	return max(value, 0.0);
+}
+
+// Nearest neighbour and trilinear interpolation are done by the texture unit; the zero border of the texture
+// returns 0 outside of the volume like volume::Volume does.
+float sampleVolume(vec3 coord)
+{
+	if (u_interpolationMode == Cubic)
+		return getVoxelTriCubicInterpolate(coord);
+	if (u_interpolationMode == Linear && outsideInterpolationBounds(coord))
+		return 0.0;
+	return texture(u_volume, (coord + 0.5) / vec3(u_dims)).r * u_valueScale;
+}
+
+vec4 sampleGradient(vec3 coord)
+{
+	return texture(u_gradients, (coord + 0.5) / vec3(u_dims));
+}
+
+// Same (unusual) inputs as render::Renderer::computePhongShading: L is the camera position and V the ray direction.
+vec3 computePhongShading(vec3 color, vec4 gradient, vec3 L, vec3 V)
+{
+	float ka = 0.1;
+	float kd = 0.7;
+	float ks = 0.2;
+	float n = 100.0;
+	float eps = 0.0001;
+
+	if (u_shadingModel == 1) {
+		// Blinn-Phong as in render::PhongShader, with four times the exponent for a highlight of about the same size.
+		vec3 halfVector = -L / max(length(L), eps) + V / max(length(V), eps);
+		halfVector = length(halfVector) > eps ? normalize(halfVector) : vec3(0.0);
+		float cosTheta = dot(gradient.xyz, -L) / (gradient.w * length(L) + eps);
+		float cosHalf = dot(gradient.xyz, halfVector) / (gradient.w + eps);
+		return (ka + kd * cosTheta + ks * pow(abs(cosHalf), 4.0 * n)) * color;
+	}
+
+	float theta = acos(clamp(dot(gradient.xyz, -L) / (gradient.w * length(L) + eps), -1.0, 1.0));
+	float phi = acos(clamp(dot(gradient.xyz, V) / (gradient.w * length(V) + eps), -1.0, 1.0)) - theta;
+	// The exponent is even, so pow of the absolute value equals the power of the (possibly negative) cosine.
+	return (ka + kd * cos(theta) + ks * pow(abs(cos(phi)), n)) * color;
+}
+
+vec4 getTFValue(float value)
+{
+	float range01 = (value - u_tfColorMapIndexStart) / u_tfColorMapIndexRange;
+	int size = textureSize(u_tfColorMap, 0);
+	return texelFetch(u_tfColorMap, clamp(int(range01 * float(size)), 0, size - 1), 0);
+}
+
+vec4 classifyTF(vec3 samplePos, vec3 rayDirection)
+{
+	vec4 tfValue = getTFValue(sampleVolume(samplePos));
+	if (tfValue.a > 0.0 && u_volumeShading)
+		tfValue.rgb = computePhongShading(tfValue.rgb, sampleGradient(samplePos), u_cameraOrigin, rayDirection);
+	return tfValue;
+}
+
+// Whether (intensity, magnitude) lies in the triangle with its apex at (midIntensity, 0) and its base at magnitude 255.
+bool inTriangle(float leftIntensity, float midIntensity, float rightIntensity, float intensity, float magnitude)
+{
+	if (intensity <= leftIntensity || intensity >= rightIntensity || magnitude <= 0.0)
+		return false;
+
+	if (intensity == midIntensity)
+		return true;
+	else if (intensity < midIntensity)
+		return magnitude > (255.0 * ((midIntensity - intensity) / (midIntensity - leftIntensity)));
+	else
+		return magnitude > (255.0 * ((intensity - midIntensity) / (rightIntensity - midIntensity)));
+}
+
+float linearOpacity(float intensityCenter, float radius, float intensity, float magnitude)
+{
+	float horizontalWidth = radius * (magnitude / 255.0);
+	return 1.0 - (abs(intensityCenter - intensity) / horizontalWidth);
+}
+
+float triangleOpacity(float intensityCenter, float radius, float intensity, float magnitude)
+{
+	if (!inTriangle(intensityCenter - radius, intensityCenter, intensityCenter + radius, intensity, magnitude))
+		return 0.0;
+	return linearOpacity(intensityCenter, radius, intensity, magnitude);
+}
+
+vec4 classifyTF2D(vec3 samplePos, vec3 rayDirection)
+{
+	float intensity = sampleVolume(samplePos);
+	vec4 gradient = sampleGradient(samplePos);
+	float opacity = triangleOpacity(u_tf2DIntensity, u_tf2DRadius, intensity, gradient.w) * u_tf2DColor.a;
+
+	vec3 color = u_tf2DColor.rgb;
+	if (opacity > 0.0 && u_volumeShading)
+		color = computePhongShading(color, gradient, u_cameraOrigin, rayDirection);
+	return vec4(color, opacity);
+}
+
+// The first triangle takes precedence where the two triangles overlap (as in render::Renderer::getTF2DV2Opacity).
+vec4 classifyTF2DV2(vec3 samplePos)
+{
+	float intensity = sampleVolume(samplePos);
+	float magnitude = sampleGradient(samplePos).w;
+	if (inTriangle(u_tf2DV2Intensity[0] - u_tf2DV2Radius[0], u_tf2DV2Intensity[0], u_tf2DV2Intensity[0] + u_tf2DV2Radius[0], intensity, magnitude))
+		return vec4(u_tf2DV2Color0.rgb, linearOpacity(u_tf2DV2Intensity[0], u_tf2DV2Radius[0], intensity, magnitude) * u_tf2DV2Color0.a);
+	if (inTriangle(u_tf2DV2Intensity[1] - u_tf2DV2Radius[1], u_tf2DV2Intensity[1], u_tf2DV2Intensity[1] + u_tf2DV2Radius[1], intensity, magnitude))
+		return vec4(u_tf2DV2Color1.rgb, linearOpacity(u_tf2DV2Intensity[1], u_tf2DV2Radius[1], intensity, magnitude) * u_tf2DV2Color1.a);
+	return vec4(0.0);
+}
+
+vec4 classify(vec3 samplePos, vec3 rayDirection)
+{
+	if (u_renderMode == RenderComposite)
+		return classifyTF(samplePos, rayDirection);
+	else if (u_renderMode == RenderTF2D)
+		return classifyTF2D(samplePos, rayDirection);
+	else
+		return classifyTF2DV2(samplePos);
+}
+
+vec4 traceRaySlice(vec3 origin, vec3 direction)
+{
+	vec3 planeNormal = -u_cameraForward;
+	vec3 volumeCenter = vec3(u_dims) / 2.0;
+	float t = dot(volumeCenter - origin, planeNormal) / dot(direction, planeNormal);
+	float value = sampleVolume(origin + direction * t);
+	return vec4(vec3(max(value / u_volumeMaximum, 0.0)), 1.0);
+}
+
+vec4 traceRayMIP(vec3 origin, vec3 direction, float tmin, float tmax)
+{
+	float maxValue = 0.0;
+	for (float t = tmin; t <= tmax; t += u_sampleStep)
+		maxValue = max(maxValue, sampleVolume(origin + t * direction));
+	return vec4(vec3(maxValue) / u_volumeMaximum, 1.0);
+}
+
+// Bisection as in render::Renderer::bisectionAccuracy. The loop stops early once the interval cannot shrink
+// anymore, after which the remaining iterations would return the same value.
+float bisectionAccuracy(vec3 origin, vec3 direction, float t0, float t1, float isoValue)
+{
+	float minDifference = 0.0001;
+	float tMiddle = (t0 + t1) / 2.0;
+	for (int i = 0; i < 500; i++) {
+		tMiddle = (t0 + t1) / 2.0;
+		float value = sampleVolume(origin + tMiddle * direction);
+		if (abs(value - isoValue) < minDifference || tMiddle == t0 || tMiddle == t1)
+			return tMiddle;
+		else if (value < isoValue)
+			t0 = tMiddle;
+		else
+			t1 = tMiddle;
+	}
+	return tMiddle;
+}
+
+vec4 traceRayISO(vec3 origin, vec3 direction, float tmin, float tmax)
+{
+	vec4 isoColor = vec4(0.8, 0.8, 0.2, 1.0);
+	for (float t = tmin; t <= tmax; t += u_sampleStep) {
+		if (sampleVolume(origin + t * direction) > u_isoValue) {
+			if (!u_volumeShading)
+				return isoColor;
+
+			float tSurface = t;
+			if (t > tmin)
+				tSurface = bisectionAccuracy(origin, direction, t - u_sampleStep, t, u_isoValue);
+			vec4 gradient = sampleGradient(origin + tSurface * direction);
+			return vec4(computePhongShading(isoColor.rgb, gradient, u_cameraOrigin, direction), 1.0);
+		}
+	}
+	return vec4(0.0);
+}
+
+// Opacity of a sample that stands for a segment of stepSize voxels (see render::Renderer::correctOpacity).
+float correctOpacity(float alpha, float stepSize)
+{
+	return stepSize == 1.0 ? alpha : 1.0 - pow(1.0 - alpha, stepSize);
+}
+
+// See render::Renderer::adaptiveFrontToBackCompositing.
+vec4 traceRayCompositeAdaptive(vec3 origin, vec3 direction, float tmin, float tmax)
+{
+	const float tolerance = 0.01;
+	float maxSampleStep = max(u_maxSampleStep, u_sampleStep);
+
+	vec3 color = vec3(0.0);
+	float opacity = 0.0;
+	// The last sample that was taken but not composited yet: it stands for the part of the ray up to the next
+	// sample that is kept.
+	bool hasPendingSample = false;
+	vec4 pendingSample = vec4(0.0);
+	float pendingT = tmin;
+	float stepSize = u_sampleStep;
+	float t = tmin;
+	while (t <= tmax) {
+		vec4 sampleColor = classify(origin + t * direction, direction);
+		vec4 difference = abs(sampleColor - pendingSample);
+		bool changed = hasPendingSample && max(max(difference.r, difference.g), max(difference.b, difference.a)) > tolerance;
+		if (changed && stepSize > u_sampleStep) {
+			stepSize = u_sampleStep;
+			t = pendingT + stepSize;
+			continue;
+		}
+		if (hasPendingSample) {
+			float weight = (1.0 - opacity) * correctOpacity(pendingSample.a, t - pendingT);
+			color += weight * pendingSample.rgb;
+			opacity += weight;
+			hasPendingSample = false;
+			if (opacity >= u_earlyRayTerminationThreshold)
+				break;
+		}
+		stepSize = changed ? u_sampleStep : min(2.0 * stepSize, maxSampleStep);
+
+		hasPendingSample = true;
+		pendingSample = sampleColor;
+		pendingT = t;
+		t += stepSize;
+	}
+	// The last sample stands for as many samples at u_sampleStep as fit before tmax.
+	if (hasPendingSample) {
+		float weight = (1.0 - opacity) * correctOpacity(pendingSample.a, (floor((tmax - pendingT) / u_sampleStep) + 1.0) * u_sampleStep);
+		color += weight * pendingSample.rgb;
+	}
+	return vec4(color, 1.0);
+}
+
+vec4 traceRayComposite(vec3 origin, vec3 direction, float tmin, float tmax)
+{
+	if (u_adaptiveSampleStep)
+		return traceRayCompositeAdaptive(origin, direction, tmin, tmax);
+
+	vec3 color = vec3(0.0);
+	if (u_frontToBackCompositing) {
+		// Start on the sample grid of back-to-front compositing, which is anchored at tmax.
+		float tStart = tmax - floor((tmax - tmin) / u_sampleStep) * u_sampleStep;
+		float opacity = 0.0;
+		for (float t = tStart; t <= tmax; t += u_sampleStep) {
+			vec4 sampleColor = classify(origin + t * direction, direction);
+			float weight = (1.0 - opacity) * correctOpacity(sampleColor.a, u_sampleStep);
+			color += weight * sampleColor.rgb;
+			opacity += weight;
+			if (opacity >= u_earlyRayTerminationThreshold)
+				break;
+		}
+	} else {
+		for (float t = tmax; t >= tmin; t -= u_sampleStep) {
+			vec4 sampleColor = classify(origin + t * direction, direction);
+			float alpha = correctOpacity(sampleColor.a, u_sampleStep);
+			color = alpha * sampleColor.rgb + (1.0 - alpha) * color;
+		}
+	}
+	return vec4(color, 1.0);
+}
+
+void main()
+{
+	// The CPU frame buffer is displayed mirrored horizontally (see viewer_output.fs), so mirror the rays to match.
+	vec2 ndc = vec2(-v_screenPos.x, v_screenPos.y);
+	vec3 origin = u_cameraOrigin;
+	vec3 direction = normalize(u_cameraForward + ndc.x * u_cameraRight + ndc.y * u_cameraUp);
+
+	// Intersect the ray with the region of interest (by default the bounding box of the volume) and the clip planes;
+	// pixels whose ray misses them are transparent.
+	vec3 invDirection = 1.0 / direction;
+	vec3 t0 = (u_roiLower - origin) * invDirection;
+	vec3 t1 = (u_roiUpper - origin) * invDirection;
+	vec3 tNear = min(t0, t1);
+	vec3 tFar = max(t0, t1);
+	float tmin = max(max(tNear.x, tNear.y), tNear.z);
+	float tmax = min(min(tFar.x, tFar.y), tFar.z);
+	for (int i = 0; i < u_numClipPlanes; i++) {
+		float distance = u_clipPlanes[i].w - dot(u_clipPlanes[i].xyz, origin);
+		float speed = dot(u_clipPlanes[i].xyz, direction);
+		if (speed > 0.0)
+			tmax = min(tmax, distance / speed);
+		else if (speed < 0.0)
+			tmin = max(tmin, distance / speed);
+		else if (distance < 0.0)
+			tmax = tmin - 1.0;
+	}
+	if (tmin > tmax) {
+		o_fragColor = vec4(0.0);
+		return;
+	}
+
+	if (u_renderMode == RenderSlicer) {
+		// The region of interest cuts off the slice plane where it is outside of the region.
+		float t = dot(vec3(u_dims) / 2.0 - origin, -u_cameraForward) / dot(direction, -u_cameraForward);
+		o_fragColor = u_clipped && !(t >= tmin && t <= tmax) ? vec4(0.0) : traceRaySlice(origin, direction);
+	} else if (u_renderMode == RenderMIP)
+		o_fragColor = traceRayMIP(origin, direction, tmin, tmax);
+	else if (u_renderMode == RenderIso)
+		o_fragColor = traceRayISO(origin, direction, tmin, tmax);
+	else
+		o_fragColor = traceRayComposite(origin, direction, tmin, tmax);
+}
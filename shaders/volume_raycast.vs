@@ -0,0 +1,11 @@
+#version 330
+layout(location = 0) in vec2 pos;
+
+out vec2 v_screenPos;
+
+void main()
+{
+	v_screenPos = pos;
+
+	gl_Position = vec4(pos, 0.0, 1.0);
+}
@@ -5,22 +5,33 @@
 #include "imgui/imgui_impl_glfw.h"
 #include "imgui/imgui_impl_opengl3.h"
 
-#include "render/renderer.h"
+#include "render/async_renderer.h"
 #include "ui/full_screen_texture_gl.h"
+#include "ui/gpu_renderer.h"
 #include "ui/menu.h"
 #include "ui/surface_cube.h"
 #include "ui/trackball.h"
 #include "ui/window.h"
 #include "ui/wireframe_cube.h"
+#include "volume/brick_pager.h"
+#include "volume/compressed_volume.h"
 #include "volume/gradient_volume.h"
+#include "volume/histogram_2d.h"
+#include "volume/macro_cell_grid.h"
 #include "volume/volume.h"
+#include "volume/volume_loader.h"
+#include "volume/volume_pyramid.h"
+#include "volume/volume_series.h"
+#include <algorithm>
 #include <chrono>
 #include <cmath> // log2
+#include <glm/common.hpp>
 #include <glm/geometric.hpp>
 #include <glm/gtx/component_wise.hpp>
 #include <glm/vec3.hpp>
 #include <imgui.h>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <ratio>
 #include <vector>
@@ -31,7 +42,6 @@ int main(int argc, char** argv)
     constexpr int menuWidth = 560;
     glm::ivec2 viewportSize { 720, 720 };
     glm::ivec2 windowSize { viewportSize.x + menuWidth, viewportSize.y };
-    constexpr float frameTimeTarget = 1.0f / 60.0f; // Target 60 fps.
 
     // === VIEWER ===
     ui::Window myWindow { "VolVis Viewer", windowSize };
@@ -47,46 +57,194 @@ int main(int argc, char** argv)
     // Render instance contains everything you need to render (volume + renderer). Initially there is
     // nothing to render hence the optional (initially it is empty). The optional is passed to the menu
     // class which is responsible for creating the volume + renderer when the user loads a volume.
-    std::optional<volume::Volume> optVolume;
-    std::optional<volume::GradientVolume> optGradientVolume;
-    std::optional<render::Renderer> optRenderer;
+    // The renderer runs on a worker thread so that the UI stays responsive while a frame is being rendered.
+    // The volume file that is loaded in the background and the data derived from it (see volume::VolumeLoader), and
+    // the stage of the load that is rendered.
+    std::optional<volume::VolumeLoader> optVolumeLoader;
+    volume::VolumeLoader::Stage shownStage = volume::VolumeLoader::Stage::Loading;
+    // Streams the bricks of bricked files from disk if enabled in the menu (see volume::BrickPager).
+    std::optional<volume::BrickPager> optBrickPager;
+    // Time series that is played instead of a single volume if the user loads one, and the timestep that is shown.
+    std::optional<volume::VolumeSeries> optVolumeSeries;
+    size_t shownTimestep = 0;
+    // The volume that is shown: the single volume or the shown timestep of the series.
+    const volume::Volume* pVolume = nullptr;
+    const volume::GradientVolume* pGradientVolume = nullptr;
+    std::optional<render::AsyncRenderer> optRenderer;
+    // The GPU renderer is only created (and the volume uploaded) once the GPU backend is selected.
+    std::optional<ui::GPURenderer> optGPURenderer;
     ui::Menu volVisMenu { viewportSize };
 
-    // Whether to redraw because the user interacted with the application. When this is the reason for the
-    // redraw then dynamic resolution scaling is enabled. After the user interaction, one more render is
-    // performed at the full (selected) resolution. When the application is static no renders are performed.
+    // Whether to redraw because the user interacted with the application. The renderer then starts a new progressive
+    // image: a coarse version is shown immediately and refined in the background until it is complete.
+    // When the application is static and the image is complete no renders are performed.
     bool redrawUserInteraction = false;
-    bool redrawFullResolution = true;
-    auto loadVolume = [&](const std::filesystem::path& filePath) {
-        optVolume.emplace(filePath.string());
-        optVolume->interpolationMode = volVisMenu.interpolationMode();
-        optGradientVolume.emplace(optVolume.value());
-        optRenderer.emplace(&optVolume.value(), &optGradientVolume.value(), &trackballCamera, volVisMenu.renderConfig());
-
-        const float maxDimension = float(glm::compMax(optVolume->dims()));
+    // While the user interacts the images are rendered with the (larger) interactive sample step, and with the coarser
+    // interactive level of detail bias if levels of detail are enabled. Once nothing has changed for
+    // interactionSettleTime the image is rendered again with the regular sample step and bias.
+    using clock = std::chrono::steady_clock;
+    static constexpr std::chrono::duration<double> interactionSettleTime { 0.25 };
+    clock::time_point lastInteraction {};
+    float requestedSampleStep = 0.0f;
+    float requestedLevelOfDetailBias = 0.0f;
+    clock::time_point lastTimestepChange {};
+    auto unloadVolume = [&]() {
+        // Stop the renderer before destroying the volume that it is reading from.
+        optRenderer.reset();
+        optGPURenderer.reset();
+        optBrickPager.reset();
+        optVolumeLoader.reset();
+        optVolumeSeries.reset();
+        pVolume = nullptr;
+        pGradientVolume = nullptr;
+        volVisMenu.setLoadProgress(std::nullopt, "");
+    };
+    auto setupCamera = [&](const glm::ivec3& dims) {
+        const float maxDimension = float(glm::compMax(dims));
         trackballCamera.setDistance(maxDimension);
         trackballCamera.setWorldScale(maxDimension);
-        trackballCamera.setLookAt(glm::vec3(optVolume->dims()) / 2.0f);
-
-        volVisMenu.setLoadedVolume(optVolume.value(), optGradientVolume.value());
-
+        trackballCamera.setLookAt(glm::vec3(dims) / 2.0f);
+    };
+    // The volume is loaded on the loader thread; updateLoadedVolume shows it once there is something to render.
+    auto loadVolume = [&](const std::filesystem::path& filePath) {
+        unloadVolume();
+        volume::VolumeLoadOptions options;
+        options.layout = volVisMenu.voxelLayout();
+        options.gradientStorage = volVisMenu.gradientStorage();
+        options.interpolationMode = volVisMenu.interpolationMode();
+        options.optBrickStreamingBudget = volVisMenu.brickStreamingBudget();
+        options.compressVoxels = volVisMenu.compressVoxels();
+        options.cacheDerivedData = volVisMenu.cacheDerivedData();
+        optVolumeLoader.emplace(filePath, options);
+        shownStage = volume::VolumeLoader::Stage::Loading;
+    };
+    // Renders the preview of the volume that is being loaded (with gradients computed on the fly and without levels of
+    // detail) as soon as the loader publishes it, and renders all of the derived data once the load is complete.
+    auto updateLoadedVolume = [&]() {
+        using Stage = volume::VolumeLoader::Stage;
+        const Stage stage = optVolumeLoader->stage();
+        if (stage != Stage::Complete)
+            volVisMenu.setLoadProgress(optVolumeLoader->progress(), optVolumeLoader->currentStep());
+        if (stage == shownStage)
+            return;
+
+        volume::VolumeLoader::LoadedVolume& loaded = optVolumeLoader->loaded();
+        volume::Volume& volume = loaded.optVolume.value();
+        if (stage == Stage::Preview) {
+            pVolume = &volume;
+            pGradientVolume = &loaded.optPreviewGradientVolume.value();
+            optRenderer.emplace(pVolume, pGradientVolume, volVisMenu.renderConfig(), nullptr, nullptr, nullptr, &loaded.optMacroCellGrid.value());
+            setupCamera(volume.dims());
+            volVisMenu.setLoadedVolume(volume, volume::Histogram2D {});
+        } else {
+            // The renderers of the preview read the preview gradients. The interpolation mode that was chosen while
+            // the volume was loading applies from now on (see the callback).
+            optRenderer.reset();
+            optGPURenderer.reset();
+            const volume::InterpolationMode interpolationMode = volVisMenu.interpolationMode();
+            volume.interpolationMode = interpolationMode;
+            loaded.optGradientVolume->interpolationMode = interpolationMode;
+            loaded.optVolumePyramid->setInterpolationMode(interpolationMode);
+
+            if (loaded.streamBricks)
+                optBrickPager.emplace(volume, *optVolumeLoader->options().optBrickStreamingBudget);
+            optRenderer.emplace(&volume, &loaded.optGradientVolume.value(), volVisMenu.renderConfig(), &loaded.optVolumePyramid.value(),
+                optBrickPager ? &optBrickPager.value() : nullptr, loaded.optCompressedVolume ? &loaded.optCompressedVolume.value() : nullptr,
+                &loaded.optMacroCellGrid.value());
+            pVolume = &volume;
+            pGradientVolume = &loaded.optGradientVolume.value();
+            // A fast load may complete before its preview was shown.
+            if (shownStage == Stage::Loading) {
+                setupCamera(volume.dims());
+                volVisMenu.setLoadedVolume(volume, loaded.histogram);
+            } else {
+                volVisMenu.updateHistograms(volume, loaded.histogram);
+            }
+            volVisMenu.setLoadProgress(std::nullopt, "");
+
+            // Building the pyramid, macro cells and histograms (unless cached) read the whole volume once; start
+            // streaming from scratch.
+            if (optBrickPager)
+                optBrickPager->evictAll();
+            // The rays sample the compressed voxels, so the pages of a mapped volume may go (the slicer and on the fly
+            // gradients still read them back when needed).
+            else if (loaded.optCompressedVolume)
+                volume::MappedFile::evict(volume.mappedVoxels());
+        }
+        shownStage = stage;
+        redrawUserInteraction = true;
+    };
+    // The timesteps are loaded in the background (see volume::VolumeSeries); only the first one is waited for. The
+    // renderer keeps rendering the shown timestep until the next one is loaded.
+    auto loadVolumeSeries = [&](const std::filesystem::path& directory) {
+        auto files = volume::VolumeSeries::listFiles(directory);
+        if (files.empty()) {
+            std::cerr << "No .fld files in " << directory << std::endl;
+            return;
+        }
+        unloadVolume();
+        optVolumeSeries.emplace(std::move(files), volVisMenu.voxelLayout(), volVisMenu.gradientStorage(), volVisMenu.interpolationMode());
+        const volume::VolumeSeries::Timestep& timestep = optVolumeSeries->acquire(0);
+        shownTimestep = 0;
+        pVolume = timestep.pVolume.get();
+        pGradientVolume = timestep.pGradientVolume.get();
+        optRenderer.emplace(pVolume, pGradientVolume, volVisMenu.renderConfig());
+
+        setupCamera(pVolume->dims());
+        volVisMenu.setLoadedVolume(*pVolume, timestep.histogram);
+        volVisMenu.setLoadedVolumeSeries(optVolumeSeries->numTimesteps());
+        redrawUserInteraction = true;
+    };
+    // Swaps the renderer to the timestep that the menu asks for (the next one while playing) once it has been loaded.
+    // A timestep that takes longer to load than the playback rate allows therefore delays playback, but not the UI.
+    auto updateTimestep = [&](clock::time_point now) {
+        size_t step = volVisMenu.timestep();
+        if (volVisMenu.isPlaying() && now - lastTimestepChange >= volVisMenu.timestepDuration())
+            step = (shownTimestep + 1) % optVolumeSeries->numTimesteps();
+        if (step == shownTimestep)
+            return;
+        optVolumeSeries->seek(step);
+        if (!optVolumeSeries->isLoaded(step))
+            return;
+
+        // Acquiring the timestep releases the shown one, so the renderers must stop reading it first.
+        optRenderer->cancel();
+        optGPURenderer.reset();
+        const volume::VolumeSeries::Timestep& timestep = optVolumeSeries->acquire(step);
+        pVolume = timestep.pVolume.get();
+        pGradientVolume = timestep.pGradientVolume.get();
+        optRenderer->setVolume(pVolume, pGradientVolume, &timestep.optMacroCellGrid.value());
+        volVisMenu.setShownTimestep(step, *pVolume, timestep.histogram);
+        shownTimestep = step;
+        lastTimestepChange = now;
         redrawUserInteraction = true;
     };
 
     // Callbacks.
     volVisMenu.setLoadVolumeCallback(loadVolume);
+    volVisMenu.setLoadVolumeSeriesCallback(loadVolumeSeries);
     volVisMenu.setRenderConfigChangedCallback(
         [&](const render::RenderConfig& renderConfig) {
-            if (optRenderer)
-                optRenderer->setConfig(renderConfig);
+            // The CPU renderer has nothing to do while the GPU renders the volume.
+            if (optRenderer && renderConfig.renderBackend == render::RenderBackend::GPU)
+                optRenderer->cancel();
+            // The new config is sent along with the next frame request.
             redrawUserInteraction = true;
         });
     volVisMenu.setInterpolationModeChangedCallback(
         [&](volume::InterpolationMode interpolationMode) {
-            if (optVolume) {
-                optVolume->interpolationMode = interpolationMode;
-                optGradientVolume->interpolationMode = interpolationMode;
+            if (optVolumeSeries) {
+                optRenderer->cancel();
+                optVolumeSeries->setInterpolationMode(interpolationMode);
+            } else if (optVolumeLoader && shownStage == volume::VolumeLoader::Stage::Complete) {
+                // The renderer may be reading the interpolation mode.
+                optRenderer->cancel();
+                volume::VolumeLoader::LoadedVolume& loaded = optVolumeLoader->loaded();
+                loaded.optVolume->interpolationMode = interpolationMode;
+                loaded.optGradientVolume->interpolationMode = interpolationMode;
+                loaded.optVolumePyramid->setInterpolationMode(interpolationMode);
             }
+            // The loader is still reading a volume that is being loaded, which takes the mode over once it is complete.
             redrawUserInteraction = true;
         });
     myWindow.registerWindowResizeCallback(
@@ -106,13 +264,20 @@ int main(int argc, char** argv)
     ui::WireframeCube wireframeCube;
     ui::SurfaceCube surfaceCube;
 
-    // The dynamic resolution scale that was used in previous frame (to keep the frame time below the target).
-    int prevResolutionScale = 1;
-    std::chrono::duration<double> renderTime { 0 };
     while (!myWindow.shouldClose()) {
         myWindow.updateInput();
 
+        if (optVolumeLoader)
+            updateLoadedVolume();
         if (optRenderer.has_value()) {
+            // Before the GPU renderer is created, since swapping the timestep destroys it.
+            if (optVolumeSeries)
+                updateTimestep(clock::now());
+            const render::RenderConfig& renderConfig = volVisMenu.renderConfig();
+            const bool gpuBackend = renderConfig.renderBackend == render::RenderBackend::GPU;
+            if (gpuBackend && !optGPURenderer)
+                optGPURenderer.emplace(*pVolume, *pGradientVolume);
+
             // If camera changed in any way then we need to redraw.
             static glm::mat4 prevViewMatrix = glm::identity<glm::mat4>();
             const glm::mat4 viewMatrix = trackballCamera.viewMatrix();
@@ -120,53 +285,44 @@ int main(int argc, char** argv)
                 prevViewMatrix = viewMatrix;
                 redrawUserInteraction = true;
             }
-            // If previous frame we rendered at a lower resolution (because something changed) then it will request to draw
-            // the next frame in full resolution. If the user is still holding the mouse button then we can reasonably assume
-            // that (s)he is not finished with the interaction (so we should keep rendering at a lower resolution).
-            if (redrawFullResolution && (myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT) || myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_RIGHT)))
-                redrawUserInteraction = true;
 
-            // We draw when either the user has interacted (camera matrix changed or render config changed (see callback)) or if
-            //  last frame we rendered at a lower resolution and we want to now render at the full resolution.
-            if (redrawUserInteraction || redrawFullResolution) {
-                if (redrawUserInteraction) {
-                    // Reduce the resolution if the performance drops below the target frame time.
-                    // Estimated performance when rendering at full resolution (resolution returned from menu).
-                    // This way we can dynamically update the resolution while the user is moving the camera since
-                    // some views may be slower to render than others.
-                    const float estimatedFullResFrameTime = float(renderTime.count()) * float(prevResolutionScale * prevResolutionScale);
-                    const float performanceScale = estimatedFullResFrameTime / float(frameTimeTarget);
-                    // Resolution scale changes the number of pixels quadratically (scales both width and height).
-                    const int resolutionScale = std::max(int(std::sqrt(performanceScale)) + 1, 1);
-
-                    // NOTE(Mathijs): calling setBaseRenderResolution will update the render config and call
-                    //  the associated callback. Make sure that you don't read redrawUserInteraction after
-                    //  this call because it will always be true.
-                    volVisMenu.setBaseRenderResolution(baseRenderResolution / resolutionScale);
-                    redrawFullResolution = true;
-                    prevResolutionScale = resolutionScale;
-                } else {
-                    prevResolutionScale = 1;
-                    volVisMenu.setBaseRenderResolution(baseRenderResolution);
-                    redrawFullResolution = false;
-                }
-                redrawUserInteraction = false;
-
-                using clock = std::chrono::high_resolution_clock;
-                const auto start = clock::now();
-                optRenderer->render();
-                const auto end = clock::now();
-                renderTime = end - start;
-
-                fullScreenTextureGL.update(optRenderer->frameBuffer(), volVisMenu.renderConfig().renderResolution);
+            const auto now = clock::now();
+            if (redrawUserInteraction)
+                lastInteraction = now;
+            render::RenderConfig frameConfig = renderConfig;
+            if (now - lastInteraction < interactionSettleTime) {
+                frameConfig.sampleStep = std::max(renderConfig.sampleStep, renderConfig.interactiveSampleStep);
+                if (renderConfig.levelOfDetail)
+                    frameConfig.levelOfDetailBias = std::max(renderConfig.levelOfDetailBias, renderConfig.interactiveLevelOfDetailBias);
+            }
+
+            // We request a new image when the user has interacted (camera matrix changed or render config changed (see callback))
+            // or when the interaction has settled and the image should be rendered with the final sample step and bias.
+            // The renderer gets its own copy of the camera because the trackball keeps changing while it renders.
+            // The GPU renders a new image every frame; selecting the CPU backend again triggers a new request (see callback).
+            const bool frameSettingsChanged = frameConfig.sampleStep != requestedSampleStep || frameConfig.levelOfDetailBias != requestedLevelOfDetailBias;
+            if (!gpuBackend && (redrawUserInteraction || frameSettingsChanged)) {
+                optRenderer->requestFrame(std::make_unique<ui::Trackball>(trackballCamera), frameConfig);
+                requestedSampleStep = frameConfig.sampleStep;
+                requestedLevelOfDetailBias = frameConfig.levelOfDetailBias;
             }
+            redrawUserInteraction = false;
+
+            // Show the latest (possibly partial) image from the renderer.
+            optRenderer->withLatestFrame([&](gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution) {
+                fullScreenTextureGL.update(frameBuffer, resolution);
+            });
 
             // === Drawing the framebuffer to the screen and adding the wireframe. ===
 
-            // Make the wireframe slightly larger than the volume to prevent z-fighting
+            // The cubes show the region of interest, which is the whole volume by default (see RenderConfig::roiLower).
+            const render::ClipRegion region = render::clipRegion(frameConfig, glm::vec3(0.0f), glm::vec3(pVolume->dims()));
+            const glm::vec3 regionSize = glm::max(region.upper - region.lower + 1.0f, glm::vec3(0.0f));
+
+            // Make the wireframe slightly larger than the region to prevent z-fighting
             constexpr float wireframeMargin = 0.05f;
-            const auto wireframeCubeSize = glm::vec3(optVolume->dims()) * (1.0f + wireframeMargin);
-            const auto wireframeCubeOffset = -glm::vec3(optVolume->dims()) * wireframeMargin * 0.5f;
+            const auto wireframeCubeSize = regionSize * (1.0f + wireframeMargin);
+            const auto wireframeCubeOffset = region.lower - regionSize * wireframeMargin * 0.5f;
             constexpr glm::vec3 wireframeColor { 1.0f };
 
             // Draw on the left side of the screen next to the menu.
@@ -183,7 +339,7 @@ int main(int argc, char** argv)
             glDepthMask(GL_TRUE);
             glDepthFunc(GL_LEQUAL);
             glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-            surfaceCube.draw(trackballCamera, optVolume->dims());
+            surfaceCube.draw(trackballCamera, regionSize, region.lower);
 
             // Enable color writes and depth blending.
             glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
@@ -195,11 +351,14 @@ int main(int argc, char** argv)
             glDepthFunc(GL_GREATER);
             wireframeCube.draw(trackballCamera, wireframeCubeSize, wireframeCubeOffset, wireframeColor);
 
-            // Draw the CPU framebuffer on top of the GPU framebuffer.
+            // Draw the volume (the CPU framebuffer or the output of the GPU ray caster) on top of the GPU framebuffer.
             glDepthFunc(GL_ALWAYS);
             //  Assume that the renderer already multiplied the RGB channels by alpha.
             glBlendFuncSeparate(GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            fullScreenTextureGL.draw();
+            if (gpuBackend)
+                optGPURenderer->draw(trackballCamera, frameConfig, pVolume->interpolationMode);
+            else
+                fullScreenTextureGL.draw();
 
             // Finally, draw the part of the wireframe that is in front of the volume.
             glDepthFunc(GL_LEQUAL);
@@ -221,7 +380,12 @@ int main(int argc, char** argv)
         if (myWindow.isKeyPressed(GLFW_KEY_ESCAPE))
             break;
 
-        volVisMenu.drawMenu(glm::ivec2(windowSize.x - menuWidth, 0), glm::ivec2(menuWidth, windowSize.y), renderTime);
+        render::RenderProfile renderProfile;
+        if (optGPURenderer && volVisMenu.renderConfig().renderBackend == render::RenderBackend::GPU)
+            renderProfile.renderTime = optGPURenderer->renderTime();
+        else if (optRenderer)
+            renderProfile = optRenderer->profile();
+        volVisMenu.drawMenu(glm::ivec2(windowSize.x - menuWidth, 0), glm::ivec2(menuWidth, windowSize.y), renderProfile);
 
         myWindow.swapBuffers();
     }
@@ -0,0 +1,146 @@
+#include "async_renderer.h"
+
+namespace render {
+
+// Time between two publishes of the image in progress; this is also the (approximate) latency of a cancellation.
+static constexpr std::chrono::duration<double> refinementStep { 1.0 / 60.0 };
+
+// The renderer is created without a camera; every request comes with its own copy of the camera. The worker does not
+// touch the renderer before the first request, so it can still be set up after the worker has started.
+AsyncRenderer::AsyncRenderer(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume, const RenderConfig& initialConfig,
+    const volume::VolumePyramid* pVolumePyramid, volume::BrickPager* pBrickPager, const volume::CompressedVolume* pCompressedVolume,
+    const volume::MacroCellGrid* pMacroCellGrid)
+    : m_renderer(pVolume, pGradientVolume, nullptr, initialConfig, pMacroCellGrid)
+    , m_worker([this]() { workerLoop(); })
+{
+    std::lock_guard lock { m_mutex };
+    m_renderer.setVolumePyramid(pVolumePyramid);
+    m_renderer.setBrickPager(pBrickPager);
+    m_renderer.setCompressedVolume(pCompressedVolume);
+}
+
+AsyncRenderer::~AsyncRenderer()
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_stopRequested = true;
+    }
+    m_requestCondition.notify_one();
+    m_worker.join();
+}
+
+void AsyncRenderer::requestFrame(std::unique_ptr<const RayTraceCamera> pCamera, const RenderConfig& config)
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_pendingRequest = Request { std::move(pCamera), config };
+    }
+    m_requestCondition.notify_one();
+}
+
+void AsyncRenderer::cancel()
+{
+    std::unique_lock lock { m_mutex };
+    m_pendingRequest.reset();
+    m_cancelRequested = true;
+    // Wakes up the worker if it waits for streamed bricks.
+    m_requestCondition.notify_one();
+    m_idleCondition.wait(lock, [&]() { return !m_rendering; });
+    m_cancelRequested = false;
+}
+
+// The worker does not touch the renderer once it is cancelled, until the next request.
+void AsyncRenderer::setVolume(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume, const volume::MacroCellGrid* pMacroCellGrid)
+{
+    cancel();
+    std::lock_guard lock { m_mutex };
+    m_renderer.setVolume(pVolume, pGradientVolume, pMacroCellGrid);
+}
+
+std::chrono::duration<double> AsyncRenderer::renderTime() const
+{
+    std::lock_guard lock { m_mutex };
+    return m_frontProfile.renderTime;
+}
+
+RenderProfile AsyncRenderer::profile() const
+{
+    std::lock_guard lock { m_mutex };
+    return m_frontProfile;
+}
+
+// Copy the back buffer to the front buffer. Must be called with m_mutex locked.
+void AsyncRenderer::publishFrame(std::chrono::duration<double> renderTime)
+{
+    const auto backBuffer = m_renderer.frameBuffer();
+    m_frontBuffer.assign(std::begin(backBuffer), std::end(backBuffer));
+    m_frontResolution = m_renderer.config().renderResolution;
+    m_frontProfile.renderTime = renderTime;
+    m_frontProfile.statistics = m_renderer.statistics();
+    const auto tileTimings = m_renderer.tileTimings();
+    m_frontProfile.tileTimings.assign(std::begin(tileTimings), std::end(tileTimings));
+    m_frontVersion++;
+}
+
+// Wait until the brick pager has loaded bricks that the image fell back to a coarser level for and restart the image
+// (see Renderer::refreshStreamedBricks). Returns false if the pager is done or a request arrived. Must be called with
+// m_mutex locked.
+bool AsyncRenderer::waitForStreamedBricks(std::unique_lock<std::mutex>& lock)
+{
+    while (m_renderer.isStreaming()) {
+        m_requestCondition.wait_for(lock, refinementStep, [&]() { return m_pendingRequest || m_cancelRequested || m_stopRequested; });
+        if (m_pendingRequest || m_cancelRequested || m_stopRequested)
+            return false;
+        if (m_renderer.refreshStreamedBricks())
+            return true;
+    }
+    return false;
+}
+
+void AsyncRenderer::workerLoop()
+{
+    std::unique_lock lock { m_mutex };
+    while (true) {
+        m_requestCondition.wait(lock, [&]() { return m_stopRequested || m_pendingRequest; });
+        if (m_stopRequested)
+            return;
+
+        Request request = std::move(*m_pendingRequest);
+        m_pendingRequest.reset();
+        m_rendering = true;
+        lock.unlock();
+
+        m_pCamera = std::move(request.pCamera);
+        m_renderer.setCamera(m_pCamera.get());
+        m_renderer.setConfig(request.config);
+
+        using clock = std::chrono::high_resolution_clock;
+        std::chrono::duration<double> renderTime { 0 };
+        // A refresh with streamed bricks is only published once complete, so that the image does not flash back to
+        // the coarse blocks of the first passes.
+        bool refresh = false;
+        while (true) {
+            const auto start = clock::now();
+            const bool complete = m_renderer.renderProgressive(refinementStep);
+            renderTime += clock::now() - start;
+
+            lock.lock();
+            if (complete || !refresh)
+                publishFrame(renderTime);
+            if (m_pendingRequest || m_cancelRequested || m_stopRequested)
+                break;
+            if (complete) {
+                if (!waitForStreamedBricks(lock))
+                    break;
+                refresh = true;
+                renderTime = {};
+            }
+            lock.unlock();
+        }
+
+        m_rendering = false;
+        m_idleCondition.notify_all();
+    }
+}
+
+}
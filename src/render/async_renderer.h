@@ -0,0 +1,108 @@
+#pragma once
+#include "render/ray_trace_camera.h"
+#include "render/render_config.h"
+#include "render/render_statistics.h"
+#include "render/renderer.h"
+#include "volume/brick_pager.h"
+#include "volume/compressed_volume.h"
+#include "volume/gradient_volume.h"
+#include "volume/macro_cell_grid.h"
+#include "volume/volume.h"
+#include "volume/volume_pyramid.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <gsl/span>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace render {
+
+// Runs a Renderer on a worker thread so that the cost of rendering does not affect the responsiveness of the UI.
+//
+// The worker refines a progressive image (see Renderer::renderProgressive) in small time steps. After every step it
+// copies its frame buffer (the back buffer) to the front buffer, which the UI thread reads with withLatestFrame. A new
+// request cancels the image in progress at the next step. The camera is passed as a copy per request because the UI
+// keeps modifying the original while the worker renders.
+//
+// With a brick pager the worker keeps waiting after an image is complete, and renders it again (publishing only the
+// complete image) whenever the pager has loaded bricks for which the image fell back to a coarser level.
+//
+// The volume, gradient volume, volume pyramid, brick pager and compressed volume must not be modified while the worker may be rendering;
+// call cancel() first.
+class AsyncRenderer {
+public:
+    AsyncRenderer(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume, const RenderConfig& initialConfig,
+        const volume::VolumePyramid* pVolumePyramid = nullptr, volume::BrickPager* pBrickPager = nullptr,
+        const volume::CompressedVolume* pCompressedVolume = nullptr, const volume::MacroCellGrid* pMacroCellGrid = nullptr);
+    ~AsyncRenderer();
+
+    AsyncRenderer(const AsyncRenderer&) = delete;
+    AsyncRenderer& operator=(const AsyncRenderer&) = delete;
+
+    // Start rendering a new image, cancelling the current one.
+    void requestFrame(std::unique_ptr<const RayTraceCamera> pCamera, const RenderConfig& config);
+    // Cancel the current image and any pending request, and wait until the worker has stopped rendering.
+    void cancel();
+    // Cancels the current image and renders another volume from the next request on, see Renderer::setVolume. The
+    // previous volume is no longer read once this returns.
+    void setVolume(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume, const volume::MacroCellGrid* pMacroCellGrid = nullptr);
+
+    // Calls f(frameBuffer, resolution) with the latest published image if it was not passed to f before.
+    template <typename F>
+    bool withLatestFrame(F&& f);
+    // Time spent on the latest published image.
+    std::chrono::duration<double> renderTime() const;
+    // Render time, statistics and tile timings of the latest published image.
+    RenderProfile profile() const;
+
+private:
+    struct Request {
+        std::unique_ptr<const RayTraceCamera> pCamera;
+        RenderConfig config;
+    };
+
+    void workerLoop();
+    bool waitForStreamedBricks(std::unique_lock<std::mutex>& lock);
+    void publishFrame(std::chrono::duration<double> renderTime);
+
+private:
+    // Only accessed by the worker thread (after construction).
+    Renderer m_renderer;
+    std::unique_ptr<const RayTraceCamera> m_pCamera;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_requestCondition;
+    std::condition_variable m_idleCondition;
+    std::optional<Request> m_pendingRequest;
+    bool m_cancelRequested { false };
+    bool m_stopRequested { false };
+    bool m_rendering { false };
+
+    std::vector<glm::vec4> m_frontBuffer;
+    glm::ivec2 m_frontResolution { 0 };
+    RenderProfile m_frontProfile;
+    uint64_t m_frontVersion { 0 };
+    uint64_t m_consumedVersion { 0 };
+
+    std::thread m_worker;
+};
+
+template <typename F>
+bool AsyncRenderer::withLatestFrame(F&& f)
+{
+    std::lock_guard lock { m_mutex };
+    if (m_frontVersion == m_consumedVersion)
+        return false;
+
+    m_consumedVersion = m_frontVersion;
+    f(gsl::span<const glm::vec4>(m_frontBuffer), m_frontResolution);
+    return true;
+}
+
+}
@@ -0,0 +1,61 @@
+#include "empty_space_skipper.h"
+#include <glm/common.hpp>
+
+namespace render {
+
+// Initialize the 3D-DDA at the cell that contains the sample at t0. For every axis m_tMax holds the (u) ray
+// parameter at which the ray crosses the next cell boundary along that axis and m_tDelta the distance between two
+// boundaries.
+EmptySpaceSkipper::EmptySpaceSkipper(const volume::MacroCellGrid* pGrid, float overshoot, const glm::vec3& origin, const glm::vec3& direction, float t0, float sampleStep)
+    : m_pGrid(pGrid)
+    , m_overshoot(overshoot)
+    , m_origin(origin)
+    , m_direction(direction)
+    , m_sign(sampleStep < 0.0f ? -1.0f : 1.0f)
+    , m_u0(m_sign * t0)
+    , m_sampleStep(std::abs(sampleStep))
+{
+    if (!m_pGrid) {
+        m_activeUntil = std::numeric_limits<float>::max();
+        return;
+    }
+
+    const float cellSize = float(m_pGrid->cellSize());
+    const glm::vec3 startPos = origin + t0 * direction;
+    const glm::vec3 walkDirection = m_sign * direction;
+    m_cell = glm::clamp(glm::ivec3(glm::floor(startPos / cellSize)), glm::ivec3(0), m_pGrid->dims() - 1);
+    m_inside = true;
+
+    // Position along the walk direction is: origin + u * walkDirection.
+    for (int axis = 0; axis < 3; axis++) {
+        if (walkDirection[axis] > 0.0f) {
+            m_step[axis] = 1;
+            m_tMax[axis] = (float(m_cell[axis] + 1) * cellSize - origin[axis]) / walkDirection[axis];
+            m_tDelta[axis] = cellSize / walkDirection[axis];
+        } else if (walkDirection[axis] < 0.0f) {
+            m_step[axis] = -1;
+            m_tMax[axis] = (float(m_cell[axis]) * cellSize - origin[axis]) / walkDirection[axis];
+            m_tDelta[axis] = -cellSize / walkDirection[axis];
+        } else {
+            m_step[axis] = 0;
+            m_tMax[axis] = std::numeric_limits<float>::max();
+            m_tDelta[axis] = 0.0f;
+        }
+    }
+}
+
+// Move to the neighbouring cell through the closest cell boundary.
+void EmptySpaceSkipper::stepCell()
+{
+    int axis = 0;
+    if (m_tMax.y < m_tMax[axis])
+        axis = 1;
+    if (m_tMax.z < m_tMax[axis])
+        axis = 2;
+
+    m_cell[axis] += m_step[axis];
+    m_tMax[axis] += m_tDelta[axis];
+    m_inside = m_cell[axis] >= 0 && m_cell[axis] < m_pGrid->dims()[axis];
+}
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "render/render_statistics.h"
+#include "volume/macro_cell_grid.h"
+#include <cmath>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <limits>
+#include <utility>
+
+namespace render {
+
+// Walks the macro cells that a ray passes through with a 3D-DDA (Amanatides & Woo) and moves the ray parameter
+// past cells that cannot contribute to the pixel. The samples that are taken stay on the original sample grid
+// (t0 + k * sampleStep) so the result is the same as without skipping. A negative sampleStep walks the ray
+// backwards (for back-to-front compositing).
+// Constructing the skipper with a null grid disables skipping.
+class EmptySpaceSkipper {
+public:
+    EmptySpaceSkipper(const volume::MacroCellGrid* pGrid, float overshoot, const glm::vec3& origin, const glm::vec3& direction, float t0, float sampleStep);
+
+    // Returns t if the sample at t may contribute, otherwise the first sample after the cells for which
+    // isEmpty(minValue, maxValue) returned true. Successive calls must move t in the direction of sampleStep.
+    template <typename F>
+    float nextSample(float t, F&& isEmpty);
+
+    // Same as nextSample but also moves samplePos (the position at t) along with t, and counts the skipped samples (see
+    // RenderStatistics::samplesSkipped).
+    template <typename F>
+    void skip(float& t, glm::vec3& samplePos, F&& isEmpty);
+
+private:
+    void stepCell();
+
+private:
+    const volume::MacroCellGrid* m_pGrid;
+    float m_overshoot;
+    glm::vec3 m_origin, m_direction;
+    // The DDA runs along u = m_sign * t so that u always increases.
+    float m_sign;
+    float m_u0, m_sampleStep;
+
+    // Samples before this u lie in a cell that has already been found to be non-empty.
+    float m_activeUntil { std::numeric_limits<float>::lowest() };
+
+    bool m_inside { false };
+    glm::ivec3 m_cell { 0 };
+    glm::ivec3 m_step { 0 };
+    glm::vec3 m_tMax { 0.0f };
+    glm::vec3 m_tDelta { 0.0f };
+};
+
+template <typename F>
+float EmptySpaceSkipper::nextSample(float t, F&& isEmpty)
+{
+    float u = m_sign * t;
+    if (u < m_activeUntil)
+        return t;
+
+    while (m_inside) {
+        const float cellExit = std::min(m_tMax.x, std::min(m_tMax.y, m_tMax.z));
+        if (u < cellExit) {
+            const glm::vec2 range = m_pGrid->valueRange(m_cell);
+            const float margin = m_overshoot * (range.y - range.x);
+            if (!isEmpty(range.x - margin, range.y + margin)) {
+                m_activeUntil = cellExit;
+                return m_sign * u;
+            }
+            // Move to the first sample in the next cell.
+            u = m_u0 + std::ceil((cellExit - m_u0) / m_sampleStep) * m_sampleStep;
+        }
+        stepCell();
+    }
+
+    m_activeUntil = std::numeric_limits<float>::max();
+    return m_sign * u;
+}
+
+template <typename F>
+void EmptySpaceSkipper::skip(float& t, glm::vec3& samplePos, F&& isEmpty)
+{
+    const float tNext = nextSample(t, std::forward<F>(isEmpty));
+    if (tNext != t) {
+        threadRenderStatistics().samplesSkipped += static_cast<uint64_t>(std::lround(std::abs(tNext - t) / m_sampleStep));
+        t = tNext;
+        samplePos = m_origin + t * m_direction;
+    }
+}
+
+}
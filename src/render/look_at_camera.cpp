@@ -0,0 +1,40 @@
+#include "look_at_camera.h"
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <limits>
+
+namespace render {
+
+// The up vector is the world y axis (or x when looking along y) made perpendicular to the viewing direction.
+LookAtCamera::LookAtCamera(const glm::vec3& position, const glm::vec3& lookAt, float fovy, float aspectRatio)
+    : m_position(position)
+    , m_forward(glm::normalize(lookAt - position))
+{
+    const float halfScreenPlaneHeight = std::tan(fovy / 2.0f);
+    m_halfScreenPlaneSize = glm::vec2(aspectRatio * halfScreenPlaneHeight, halfScreenPlaneHeight);
+
+    const glm::vec3 worldUp = std::abs(m_forward.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+    m_right = glm::normalize(glm::cross(m_forward, worldUp));
+    m_up = glm::cross(m_right, m_forward);
+}
+
+glm::vec3 LookAtCamera::position() const
+{
+    return m_position;
+}
+
+glm::vec3 LookAtCamera::forward() const
+{
+    return m_forward;
+}
+
+Ray LookAtCamera::generateRay(const glm::vec2& pixel) const
+{
+    Ray ray;
+    ray.origin = m_position;
+    ray.direction = glm::normalize(m_forward + (pixel.x * m_halfScreenPlaneSize.x) * m_right + (pixel.y * m_halfScreenPlaneSize.y) * m_up);
+    ray.tmin = std::numeric_limits<float>::lowest();
+    ray.tmax = std::numeric_limits<float>::max();
+    return ray;
+}
+}
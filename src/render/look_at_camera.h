@@ -0,0 +1,25 @@
+#pragma once
+#include "render/ray.h"
+#include "render/ray_trace_camera.h"
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace render {
+
+// Camera at a fixed position looking at a fixed point, for rendering without a ui::Trackball (benchmarks and the batch
+// renderer). Rays are generated the same way as in ui::Trackball: fovy is the vertical field of view in radians and
+// the screen is aspectRatio times as wide as it is high.
+class LookAtCamera : public RayTraceCamera {
+public:
+    LookAtCamera(const glm::vec3& position, const glm::vec3& lookAt, float fovy = 1.0f, float aspectRatio = 1.0f);
+
+    glm::vec3 position() const override;
+    glm::vec3 forward() const override;
+
+    Ray generateRay(const glm::vec2& pixel) const override;
+
+private:
+    glm::vec3 m_position, m_forward, m_right, m_up;
+    glm::vec2 m_halfScreenPlaneSize;
+};
+}
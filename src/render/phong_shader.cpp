@@ -0,0 +1,18 @@
+#include "phong_shader.h"
+
+namespace render {
+
+// The Blinn-Phong half vector lies between the (normalized) -L and V, the two vectors that computePhongShading measures
+// the angles theta and phi against.
+PhongShader::PhongShader(ShadingModel model, const glm::vec3& L, const glm::vec3& V)
+    : m_model(model)
+    , m_negL(-L)
+    , m_V(V)
+    , m_lengthL(glm::length(L))
+    , m_lengthV(glm::length(V))
+{
+    const glm::vec3 sum = -L / std::max(m_lengthL, eps) + V / std::max(m_lengthV, eps);
+    const float sumLength = glm::length(sum);
+    m_halfVector = sumLength > eps ? sum / sumLength : glm::vec3(0.0f);
+}
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "render/render_config.h"
+#include "volume/gradient_volume.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+namespace render {
+
+// Shades the samples along a single ray (see Renderer::computePhongShading for the lighting model and its unusual
+// inputs: L is the camera position and V the ray direction). The terms that only depend on L and V are computed once
+// in the constructor, so shading a sample costs a few dot products and multiplications: no inverse trigonometric
+// functions and no pow.
+class PhongShader {
+public:
+    PhongShader(ShadingModel model, const glm::vec3& L, const glm::vec3& V);
+
+    // Factor by which shading scales the color of a sample with the given gradient.
+    float factor(const volume::GradientVoxel& gradient) const
+    {
+        const float cosTheta = glm::dot(gradient.dir, m_negL) / (gradient.magnitude * m_lengthL + eps);
+        float cosSpecular;
+        if (m_model == ShadingModel::Phong) {
+            // cos(phi) with phi = acos(cosView) - theta.
+            const float cosView = glm::dot(gradient.dir, m_V) / (gradient.magnitude * m_lengthV + eps);
+            const float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+            const float sinView = std::sqrt(std::max(1.0f - cosView * cosView, 0.0f));
+            cosSpecular = power<phongExponent>(cosView * cosTheta + sinView * sinTheta);
+        } else {
+            cosSpecular = power<blinnPhongExponent>(glm::dot(gradient.dir, m_halfVector) / (gradient.magnitude + eps));
+        }
+        return ka + kd * cosTheta + ks * cosSpecular;
+    }
+    glm::vec3 shade(const glm::vec3& color, const volume::GradientVoxel& gradient) const { return factor(gradient) * color; }
+
+private:
+    static constexpr float ka = 0.1f;
+    static constexpr float kd = 0.7f;
+    static constexpr float ks = 0.2f;
+    static constexpr unsigned phongExponent = 100;
+    // The angle to the half vector is about half the angle phi of the Phong model, so four times the exponent gives
+    // a highlight of about the same size.
+    static constexpr unsigned blinnPhongExponent = 4 * phongExponent;
+    static constexpr float eps = 0.0001f; // avoiding division by 0
+
+    // x^N by repeated squaring (unrolled by the compiler since N is a constant).
+    template <unsigned N>
+    static float power(float x)
+    {
+        float result = 1.0f;
+        for (unsigned n = N; n > 0; n >>= 1, x *= x) {
+            if (n & 1)
+                result *= x;
+        }
+        return result;
+    }
+
+private:
+    ShadingModel m_model;
+    glm::vec3 m_negL, m_V;
+    float m_lengthL, m_lengthV;
+    glm::vec3 m_halfVector;
+};
+}
@@ -0,0 +1,28 @@
+#include "pinhole_camera.h"
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+
+namespace render {
+
+std::optional<PinholeCamera> fitPinholeCamera(const RayTraceCamera& camera)
+{
+    const Ray center = camera.generateRay(glm::vec2(0.0f));
+    const glm::vec3 forward = center.direction;
+    // Offset from forward at which a direction crosses the image plane at distance 1.
+    const auto imagePlaneOffset = [&](const glm::vec3& direction) { return direction / glm::dot(direction, forward) - forward; };
+    const glm::vec3 right = imagePlaneOffset(camera.generateRay(glm::vec2(1.0f, 0.0f)).direction);
+    const glm::vec3 up = imagePlaneOffset(camera.generateRay(glm::vec2(0.0f, 1.0f)).direction);
+
+    static constexpr float tolerance = 1e-4f;
+    if (std::abs(glm::dot(right, up)) > tolerance * glm::length(right) * glm::length(up))
+        return {};
+    for (const glm::vec2 corner : { glm::vec2(-1, -1), glm::vec2(1, -1), glm::vec2(-1, 1), glm::vec2(1, 1) }) {
+        const Ray ray = camera.generateRay(corner);
+        const glm::vec3 expected = glm::normalize(forward + corner.x * right + corner.y * up);
+        if (ray.origin != center.origin || glm::dot(ray.direction, expected) < 1.0f - tolerance)
+            return {};
+    }
+    return PinholeCamera { center.origin, forward, right, up };
+}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "render/ray_trace_camera.h"
+#include <glm/vec3.hpp>
+#include <optional>
+
+namespace render {
+
+// Explicit description of a pinhole camera: the ray through pixel ndc (-1 to +1) starts at origin and has the
+// direction normalize(forward + ndc.x * right + ndc.y * up), with forward a unit vector perpendicular to right and up.
+struct PinholeCamera {
+    glm::vec3 origin;
+    glm::vec3 forward;
+    glm::vec3 right;
+    glm::vec3 up;
+};
+
+// Derives the pinhole model of a camera from the rays that it generates. The model is checked at the corners of the
+// screen; returns an empty optional if the camera does not behave like a pinhole camera.
+std::optional<PinholeCamera> fitPinholeCamera(const RayTraceCamera& camera);
+}
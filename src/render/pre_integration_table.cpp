@@ -0,0 +1,46 @@
+#include "pre_integration_table.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/vec3.hpp>
+
+namespace render {
+
+// An opacity of 1 has an infinite extinction; clamp it so that the integrals stay finite.
+static constexpr float maxOpacity = 0.9999f;
+
+void PreIntegrationTable::bake(gsl::span<const glm::vec4> transferFunction, float segmentLength)
+{
+    m_size = transferFunction.size();
+    m_table.resize(m_size * m_size);
+
+    // Extinction and extinction weighted color of every entry, and their integrals up to the center of every entry
+    // (the value changes linearly between the centers of two entries).
+    std::vector<float> extinction(m_size), extinctionIntegral(m_size);
+    std::vector<glm::vec3> color(m_size), colorIntegral(m_size);
+    float sumExtinction = 0.0f;
+    glm::vec3 sumColor(0.0f);
+    for (size_t i = 0; i < m_size; i++) {
+        const glm::vec4& entry = transferFunction[i];
+        extinction[i] = -std::log(1.0f - std::clamp(entry.a, 0.0f, maxOpacity));
+        color[i] = glm::vec3(entry);
+        extinctionIntegral[i] = sumExtinction + 0.5f * extinction[i];
+        colorIntegral[i] = sumColor + 0.5f * extinction[i] * color[i];
+        sumExtinction += extinction[i];
+        sumColor += extinction[i] * color[i];
+    }
+
+    for (size_t front = 0; front < m_size; front++) {
+        for (size_t back = 0; back < m_size; back++) {
+            // Average extinction and color along the segment.
+            float segmentExtinction = extinction[front];
+            glm::vec3 segmentColor = color[front];
+            if (front != back) {
+                const float totalExtinction = std::abs(extinctionIntegral[back] - extinctionIntegral[front]);
+                segmentExtinction = totalExtinction / std::abs(float(back) - float(front));
+                segmentColor = totalExtinction > 0.0f ? glm::abs(colorIntegral[back] - colorIntegral[front]) / totalExtinction : glm::vec3(0.0f);
+            }
+            m_table[front * m_size + back] = glm::vec4(segmentColor, 1.0f - std::exp(-segmentExtinction * segmentLength));
+        }
+    }
+}
+}
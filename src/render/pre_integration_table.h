@@ -0,0 +1,31 @@
+#pragma once
+#include <glm/vec4.hpp>
+#include <gsl/span>
+#include <vector>
+
+namespace render {
+
+// Pre-integrated 1D transfer function: for every pair of transfer function entries (front, back) the table holds the
+// color and opacity of a ray segment along which the value changes linearly from front to back. Compositing these
+// segments instead of point samples captures features that lie between two samples, so larger steps give about the
+// same image as small ones.
+// The segments are integrated with the integral functions of the extinction (Engel et al., "High-Quality
+// Pre-Integrated Volume Rendering Using Hardware-Accelerated Pixel Shading", 2001), ignoring the attenuation within a
+// segment. That makes a rebuild cost O(n^2) for n entries, cheap enough to redo whenever the transfer function changes.
+class PreIntegrationTable {
+public:
+    // Integrate the transfer function (non pre-multiplied colors, opacities per unit of length) for segments of the
+    // given length.
+    void bake(gsl::span<const glm::vec4> transferFunction, float segmentLength);
+
+    // Non pre-multiplied color and opacity of a segment from entry front to entry back.
+    glm::vec4 lookup(size_t front, size_t back) const
+    {
+        return m_table[front * m_size + back];
+    }
+
+private:
+    size_t m_size { 0 };
+    std::vector<glm::vec4> m_table;
+};
+}
@@ -0,0 +1,197 @@
+#include "render_config.h"
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+namespace render {
+
+// Every setting must be listed in exactly one section.
+RenderConfigChanges changedSections(const RenderConfig& lhs, const RenderConfig& rhs)
+{
+    const auto mode = [](const RenderConfig& c) { return std::tie(c.renderMode, c.renderBackend); };
+    const auto sampling = [](const RenderConfig& c) {
+        return std::tie(c.sampleStep, c.adaptiveSampleStep, c.maxSampleStep, c.preIntegratedTF, c.emptySpaceSkipping,
+            c.levelOfDetail, c.levelOfDetailBias, c.frontToBackCompositing, c.roiLower, c.roiUpper, c.clipPlanes);
+    };
+    const auto compositing = [](const RenderConfig& c) { return std::tie(c.volumeShading, c.shadingModel, c.earlyRayTerminationThreshold); };
+    const auto transferFunction = [](const RenderConfig& c) { return std::tie(c.tfColorMap, c.tfColorMapIndexStart, c.tfColorMapIndexRange); };
+    const auto transferFunction2D = [](const RenderConfig& c) {
+        return std::tie(c.TF2DIntensity, c.TF2DRadius, c.TF2DColor,
+            c.TF2DV2Intensity_0, c.TF2DV2Intensity_1, c.TF2DV2Radius_0, c.TF2DV2Radius_1, c.TF2DV2Color_0, c.TF2DV2Color_1);
+    };
+    const auto performance = [](const RenderConfig& c) { return std::tie(c.interactiveSampleStep, c.interactiveLevelOfDetailBias, c.sampleCache, c.sampleCacheMegabytes, c.temporalReprojection, c.tileSize, c.tileGrainSize); };
+
+    RenderConfigChanges changes;
+    if (mode(lhs) != mode(rhs))
+        changes.set(RenderConfigSection::Mode);
+    if (lhs.renderResolution != rhs.renderResolution)
+        changes.set(RenderConfigSection::Resolution);
+    if (sampling(lhs) != sampling(rhs))
+        changes.set(RenderConfigSection::Sampling);
+    if (compositing(lhs) != compositing(rhs))
+        changes.set(RenderConfigSection::Compositing);
+    if (lhs.isoValue != rhs.isoValue)
+        changes.set(RenderConfigSection::IsoValue);
+    if (transferFunction(lhs) != transferFunction(rhs))
+        changes.set(RenderConfigSection::TransferFunction);
+    if (transferFunction2D(lhs) != transferFunction2D(rhs))
+        changes.set(RenderConfigSection::TransferFunction2D);
+    if (performance(lhs) != performance(rhs))
+        changes.set(RenderConfigSection::Performance);
+    return changes;
+}
+
+// The center of the volume is that of the slicer (see Renderer::frameParameters).
+ClipRegion clipRegion(const RenderConfig& config, const glm::vec3& volumeOrigin, const glm::vec3& volumeDims)
+{
+    const glm::vec3 lower = glm::clamp(config.roiLower, 0.0f, 1.0f);
+    const glm::vec3 upper = glm::clamp(config.roiUpper, 0.0f, 1.0f);
+    ClipRegion region {
+        volumeOrigin + lower * (volumeDims - 1.0f),
+        volumeOrigin + upper * (volumeDims - 1.0f),
+        {},
+        0,
+        lower != glm::vec3(0.0f) || upper != glm::vec3(1.0f)
+    };
+
+    const glm::vec3 center = volumeOrigin + volumeDims / 2.0f;
+    for (const glm::vec4& plane : config.clipPlanes) {
+        const glm::vec3 normal { plane };
+        if (normal == glm::vec3(0.0f))
+            continue;
+        const glm::vec3 unitNormal = glm::normalize(normal);
+        region.planes[region.numPlanes++] = glm::vec4(unitNormal, plane.w + glm::dot(unitNormal, center));
+        region.clipped = true;
+    }
+    return region;
+}
+
+// Calls f(name, setting) for every setting of the config. Every setting must be listed.
+template <typename Config, typename F>
+static void visitSettings(Config& c, F&& f)
+{
+    f("renderMode", c.renderMode);
+    f("renderBackend", c.renderBackend);
+    f("renderResolution", c.renderResolution);
+    f("volumeShading", c.volumeShading);
+    f("shadingModel", c.shadingModel);
+    f("isoValue", c.isoValue);
+    f("sampleStep", c.sampleStep);
+    f("interactiveSampleStep", c.interactiveSampleStep);
+    f("adaptiveSampleStep", c.adaptiveSampleStep);
+    f("maxSampleStep", c.maxSampleStep);
+    f("preIntegratedTF", c.preIntegratedTF);
+    f("sampleCache", c.sampleCache);
+    f("sampleCacheMegabytes", c.sampleCacheMegabytes);
+    f("temporalReprojection", c.temporalReprojection);
+    f("emptySpaceSkipping", c.emptySpaceSkipping);
+    f("levelOfDetail", c.levelOfDetail);
+    f("levelOfDetailBias", c.levelOfDetailBias);
+    f("interactiveLevelOfDetailBias", c.interactiveLevelOfDetailBias);
+    f("roiLower", c.roiLower);
+    f("roiUpper", c.roiUpper);
+    f("clipPlanes", c.clipPlanes);
+    f("frontToBackCompositing", c.frontToBackCompositing);
+    f("earlyRayTerminationThreshold", c.earlyRayTerminationThreshold);
+    f("tileSize", c.tileSize);
+    f("tileGrainSize", c.tileGrainSize);
+    f("tfColorMap", c.tfColorMap);
+    f("tfColorMapIndexStart", c.tfColorMapIndexStart);
+    f("tfColorMapIndexRange", c.tfColorMapIndexRange);
+    f("TF2DIntensity", c.TF2DIntensity);
+    f("TF2DRadius", c.TF2DRadius);
+    f("TF2DColor", c.TF2DColor);
+    f("TF2DV2Intensity_0", c.TF2DV2Intensity_0);
+    f("TF2DV2Intensity_1", c.TF2DV2Intensity_1);
+    f("TF2DV2Radius_0", c.TF2DV2Radius_0);
+    f("TF2DV2Radius_1", c.TF2DV2Radius_1);
+    f("TF2DV2Color_0", c.TF2DV2Color_0);
+    f("TF2DV2Color_1", c.TF2DV2Color_1);
+}
+
+// Scalars are written as numbers (enums as their underlying value), vectors and arrays as their components.
+template <typename T>
+static void writeValue(std::ostream& stream, const T& value)
+{
+    if constexpr (std::is_enum_v<T>) {
+        stream << ' ' << static_cast<std::underlying_type_t<T>>(value);
+    } else if constexpr (std::is_arithmetic_v<T>) {
+        stream << ' ' << value;
+    } else if constexpr (std::is_same_v<T, glm::ivec2> || std::is_same_v<T, glm::vec3> || std::is_same_v<T, glm::vec4>) {
+        for (int i = 0; i < T::length(); i++)
+            writeValue(stream, value[i]);
+    } else {
+        for (const auto& element : value)
+            writeValue(stream, element);
+    }
+}
+
+template <typename T>
+static bool readValue(std::istream& stream, T& value)
+{
+    if constexpr (std::is_enum_v<T>) {
+        std::underlying_type_t<T> underlying;
+        if (!(stream >> underlying))
+            return false;
+        value = static_cast<T>(underlying);
+        return true;
+    } else if constexpr (std::is_arithmetic_v<T>) {
+        return bool(stream >> value);
+    } else if constexpr (std::is_same_v<T, glm::ivec2> || std::is_same_v<T, glm::vec3> || std::is_same_v<T, glm::vec4>) {
+        for (int i = 0; i < T::length(); i++) {
+            if (!readValue(stream, value[i]))
+                return false;
+        }
+        return true;
+    } else {
+        for (auto& element : value) {
+            if (!readValue(stream, element))
+                return false;
+        }
+        return true;
+    }
+}
+
+void writeRenderConfig(std::ostream& stream, const RenderConfig& config)
+{
+    const auto precision = stream.precision(std::numeric_limits<float>::max_digits10);
+    visitSettings(config, [&](const char* name, const auto& value) {
+        stream << name;
+        writeValue(stream, value);
+        stream << '\n';
+    });
+    stream.precision(precision);
+}
+
+std::optional<RenderConfig> readRenderConfig(std::istream& stream, const RenderConfig& defaults)
+{
+    RenderConfig config = defaults;
+    std::string line;
+    for (int lineNumber = 1; std::getline(stream, line); lineNumber++) {
+        std::istringstream lineStream { line };
+        std::string name;
+        if (!(lineStream >> name) || name[0] == '#')
+            continue;
+
+        bool known = false, valid = false;
+        visitSettings(config, [&](const char* settingName, auto& value) {
+            if (name == settingName) {
+                known = true;
+                valid = readValue(lineStream, value);
+            }
+        });
+        if (!known) {
+            std::cerr << "Ignoring unknown render setting " << name << " on line " << lineNumber << std::endl;
+        } else if (!valid) {
+            std::cerr << "Invalid value for render setting " << name << " on line " << lineNumber << std::endl;
+            return {};
+        }
+    }
+    return config;
+}
+}
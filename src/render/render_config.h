@@ -1,8 +1,12 @@
 #pragma once
 #include <array>
-#include <cstring> // memcmp  // macOS change TH
+#include <bitset>
+#include <cstddef>
 #include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <iosfwd>
+#include <optional>
 
 namespace render {
 
@@ -15,13 +19,109 @@ enum class RenderMode {
     RenderTF2DV2
 };
 
+// Renderer that produces the image: the (multi-threaded) CPU ray caster or an OpenGL fragment shader (see ui::GPURenderer).
+enum class RenderBackend {
+    CPU,
+    GPU
+};
+
+// Lighting model of volumeShading. Blinn-Phong measures the specular highlight against the half vector, which is
+// cheaper to evaluate than the Phong reflection angle.
+enum class ShadingModel {
+    Phong,
+    BlinnPhong
+};
+
+// The settings of the render config are grouped into sections by what they affect, so that the renderer only
+// invalidates the caches that depend on the sections that changed (see changedSections).
+enum class RenderConfigSection {
+    Mode, // renderMode, renderBackend
+    Resolution, // renderResolution
+    Sampling, // where the samples along a ray are taken: sampleStep, adaptive stepping, empty space skipping, levels of detail, compositing order, region of interest
+    Compositing, // how the classified samples are combined: volumeShading, shadingModel, earlyRayTerminationThreshold
+    IsoValue, // isoValue
+    TransferFunction, // tfColorMap and its value range
+    TransferFunction2D, // the TF2D and TF2DV2 settings
+    Performance // settings that do not change the image: interactiveSampleStep, interactiveLevelOfDetailBias, sample cache, temporal reprojection, tiling
+};
+static constexpr size_t numRenderConfigSections = size_t(RenderConfigSection::Performance) + 1;
+
+class RenderConfigChanges {
+public:
+    void set(RenderConfigSection section) { m_sections.set(size_t(section)); }
+    bool test(RenderConfigSection section) const { return m_sections.test(size_t(section)); }
+    bool any() const { return m_sections.any(); }
+    // Whether anything but the Performance section changed.
+    bool affectsImage() const
+    {
+        std::bitset<numRenderConfigSections> image = m_sections;
+        return image.reset(size_t(RenderConfigSection::Performance)).any();
+    }
+
+private:
+    std::bitset<numRenderConfigSections> m_sections;
+};
+
+static constexpr size_t maxClipPlanes = 4;
+
 struct RenderConfig {
     RenderMode renderMode { RenderMode::RenderSlicer };
+    RenderBackend renderBackend { RenderBackend::CPU };
     glm::ivec2 renderResolution;
 
     bool volumeShading { false };
+    ShadingModel shadingModel { ShadingModel::Phong };
     float isoValue { 95.0f };
 
+    // Distance between two samples along a ray, in voxels. The opacities of the transfer functions are defined for a
+    // step of one voxel; the composite modes correct the opacity of every sample for the actual step.
+    float sampleStep { 1.0f };
+    // Step of the images that are rendered while the user interacts (see main.cpp); the final image uses sampleStep.
+    float interactiveSampleStep { 2.0f };
+    // Composite modes: let the step grow up to maxSampleStep where the classified samples hardly change along the
+    // ray. Always composites front-to-back.
+    bool adaptiveSampleStep { false };
+    float maxSampleStep { 4.0f };
+    // Composite mode: composite the segments between samples with a pre-integrated transfer function, which allows
+    // larger sample steps for the same image quality. Always composites front-to-back (and overrides adaptiveSampleStep).
+    bool preIntegratedTF { false };
+
+    // Composite and 2D transfer function modes: keep the samples along every ray while the camera stands still, so
+    // that changes to the transfer functions or shading are composited without sampling the volume again.
+    bool sampleCache { false };
+    int sampleCacheMegabytes { 512 };
+    // Progressive images (see Renderer::renderProgressive): start a new image from the previous one, reprojected to the
+    // new camera, and trace only the pixels that the reprojection cannot fill (or that are too old) plus a rotating
+    // subset of the others. The remaining pixels are traced by the refinement, so the image converges to the same result.
+    bool temporalReprojection { false };
+
+    // Jump over macro cells that cannot contribute to the image.
+    bool emptySpaceSkipping { true };
+
+    // Take the samples from the level of detail of the volume (see volume::VolumePyramid) whose voxels match the
+    // footprint of a pixel at the distance of the sample. Every unit of levelOfDetailBias selects a twice as coarse level.
+    bool levelOfDetail { false };
+    float levelOfDetailBias { 0.0f };
+    // Bias of the images that are rendered while the user interacts if levels of detail are enabled (see main.cpp).
+    float interactiveLevelOfDetailBias { 1.0f };
+
+    // Region of interest: only the part of the volume inside the box from roiLower to roiUpper (as fractions of the
+    // size of the volume along each axis) and inside the enabled clip planes is rendered. A clip plane (normal, offset)
+    // keeps the points p with dot(normalize(normal), p - center) <= offset, where p and the center of the volume are in
+    // voxel coordinates; planes with a zero normal are disabled. See clipRegion.
+    glm::vec3 roiLower { 0.0f };
+    glm::vec3 roiUpper { 1.0f };
+    std::array<glm::vec4, maxClipPlanes> clipPlanes {};
+
+    // Composite front-to-back (instead of back-to-front) and stop a ray once its accumulated opacity
+    // reaches the termination threshold. Used by the composite and 2D transfer function modes.
+    bool frontToBackCompositing { true };
+    float earlyRayTerminationThreshold { 0.99f };
+
+    // The screen is rendered in tiles of tileSize x tileSize pixels. A thread takes tileGrainSize tiles at a time.
+    int tileSize { 16 };
+    int tileGrainSize { 1 };
+
     // 1D transfer function.
     std::array<glm::vec4, 256> tfColorMap;
     // Used to convert from a value to an index in the color map.
@@ -38,16 +138,30 @@ struct RenderConfig {
     float TF2DV2Intensity_0, TF2DV2Intensity_1;
     float TF2DV2Radius_0, TF2DV2Radius_1;
     glm::vec4 TF2DV2Color_0, TF2DV2Color_1;
+
+    // Compares the settings member by member (not the padding between them).
+    bool operator==(const RenderConfig&) const = default;
 };
 
-// NOTE(Mathijs): should be replaced by C++20 three-way operator (aka spaceship operator) if we require C++ 20 support from Linux users (GCC10 / Clang10).
-inline bool operator==(const RenderConfig& lhs, const RenderConfig& rhs)
-{
-    return std::memcmp(&lhs, &rhs, sizeof(RenderConfig)) == 0;
-}
-inline bool operator!=(const RenderConfig& lhs, const RenderConfig& rhs)
-{
-    return !(lhs == rhs);
-}
+// The region of interest and the clip planes of a config (see RenderConfig::roiLower) in the voxel coordinates of a
+// volume of the given size whose first voxel is at volumeOrigin: the box is clamped to the volume, and the enabled clip
+// planes are normalized to planes (normal, w) that keep the points p with dot(normal, p) <= w.
+struct ClipRegion {
+    glm::vec3 lower, upper;
+    std::array<glm::vec4, maxClipPlanes> planes;
+    size_t numPlanes;
+    // Whether the region is smaller than the volume.
+    bool clipped;
+};
+ClipRegion clipRegion(const RenderConfig& config, const glm::vec3& volumeOrigin, const glm::vec3& volumeDims);
+
+// Returns the sections (see RenderConfigSection) in which the two configs differ.
+RenderConfigChanges changedSections(const RenderConfig& lhs, const RenderConfig& rhs);
+
+// Text format with one "name values..." line per setting, used to hand the settings of the viewer to the batch
+// renderer. Settings that are missing from the input keep the value of defaults; returns an empty optional (and
+// reports the line) if a setting cannot be parsed.
+void writeRenderConfig(std::ostream& stream, const RenderConfig& config);
+std::optional<RenderConfig> readRenderConfig(std::istream& stream, const RenderConfig& defaults = {});
 
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "render_statistics.h"
+#include <fmt/format.h>
+#include <ostream>
+
+namespace render {
+
+RenderStatistics& RenderStatistics::operator+=(const RenderStatistics& other)
+{
+    raysCast += other.raysCast;
+    raysMissed += other.raysMissed;
+    samples += other.samples;
+    samplesSkipped += other.samplesSkipped;
+    shadedSamples += other.shadedSamples;
+    earlyTerminations += other.earlyTerminations;
+    refinementIterations += other.refinementIterations;
+    return *this;
+}
+
+RenderStatistics RenderStatistics::operator-(const RenderStatistics& other) const
+{
+    return RenderStatistics {
+        raysCast - other.raysCast,
+        raysMissed - other.raysMissed,
+        samples - other.samples,
+        samplesSkipped - other.samplesSkipped,
+        shadedSamples - other.shadedSamples,
+        earlyTerminations - other.earlyTerminations,
+        refinementIterations - other.refinementIterations
+    };
+}
+
+// See https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU for the format. Times are in
+// microseconds.
+void writeChromeTrace(std::ostream& stream, const RenderProfile& profile)
+{
+    const RenderStatistics& s = profile.statistics;
+    stream << "{\"traceEvents\": [\n";
+    stream << fmt::format(
+        "{{\"name\": \"image\", \"ph\": \"X\", \"pid\": 0, \"tid\": -1, \"ts\": 0, \"dur\": {:.3f}, \"args\": {{"
+        "\"raysCast\": {}, \"raysMissed\": {}, \"samples\": {}, \"samplesSkipped\": {}, \"shadedSamples\": {}, "
+        "\"earlyTerminations\": {}, \"refinementIterations\": {}}}}}",
+        profile.renderTime.count() * 1e6, s.raysCast, s.raysMissed, s.samples, s.samplesSkipped, s.shadedSamples,
+        s.earlyTerminations, s.refinementIterations);
+    for (const TileTiming& timing : profile.tileTimings) {
+        stream << fmt::format(
+            ",\n{{\"name\": \"tile\", \"ph\": \"X\", \"pid\": 0, \"tid\": {}, \"ts\": {:.3f}, \"dur\": {:.3f}, \"args\": {{"
+            "\"x\": {}, \"y\": {}, \"width\": {}, \"height\": {}}}}}",
+            timing.threadIndex, double(timing.startSeconds) * 1e6, double(timing.seconds) * 1e6,
+            timing.tile.begin.x, timing.tile.begin.y, timing.tile.end.x - timing.tile.begin.x, timing.tile.end.y - timing.tile.begin.y);
+    }
+    stream << "\n]}\n";
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "render/tile_scheduler.h"
+#include <chrono>
+#include <cstdint>
+#include <gsl/span>
+#include <iosfwd>
+#include <vector>
+
+namespace render {
+
+// Counters of the work done by the ray tracing functions. They separate the cost of sampling (samples and
+// refinementIterations) from the cost of shading (shadedSamples), and show how much work empty space skipping and
+// early ray termination save.
+struct RenderStatistics {
+    uint64_t raysCast { 0 };
+    // Rays that miss the bounding box of the volume and take no samples.
+    uint64_t raysMissed { 0 };
+    // Samples of the volume along the rays, and the samples that empty space skipping moved past.
+    uint64_t samples { 0 };
+    uint64_t samplesSkipped { 0 };
+    // Samples whose gradient was looked up to shade them.
+    uint64_t shadedSamples { 0 };
+    // Rays that stopped because their opacity reached the early ray termination threshold.
+    uint64_t earlyTerminations { 0 };
+    // Iterations of bisectionAccuracy and secantAccuracy; every iteration takes one sample (not included in samples).
+    uint64_t refinementIterations { 0 };
+
+    RenderStatistics& operator+=(const RenderStatistics& other);
+    RenderStatistics operator-(const RenderStatistics& other) const;
+    bool operator==(const RenderStatistics&) const = default;
+};
+
+// The counters of the calling thread, which the ray tracing functions increment. The renderer reads them before and
+// after every tile and adds the difference to the statistics of its image, so threads never write to a shared counter.
+inline RenderStatistics& threadRenderStatistics()
+{
+    static thread_local RenderStatistics statistics;
+    return statistics;
+}
+
+// Everything that the profiler knows about an image.
+struct RenderProfile {
+    std::chrono::duration<double> renderTime { 0 };
+    RenderStatistics statistics;
+    std::vector<TileTiming> tileTimings;
+};
+
+// Writes the tile timings as a trace in the Chrome trace event format (for chrome://tracing or ui.perfetto.dev), with a
+// row per thread. The statistics are attached to an event that spans the whole image.
+void writeChromeTrace(std::ostream& stream, const RenderProfile& profile);
+
+}
@@ -1,13 +1,19 @@
 #include "renderer.h"
+#include "volume/execution_policy.h"
 #include <algorithm>
 #include <algorithm> // std::fill
+#include <atomic>
+#include <bit>
 #include <cmath>
 #include <functional>
 #include <glm/common.hpp>
 #include <glm/gtx/component_wise.hpp>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <tbb/blocked_range.h>
 #include <tbb/blocked_range2d.h>
-#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
 #include <tuple>
 
 namespace render {
@@ -20,22 +26,127 @@ Renderer::Renderer(
     const volume::Volume* pVolume,
     const volume::GradientVolume* pGradientVolume,
     const render::RayTraceCamera* pCamera,
-    const RenderConfig& initialConfig)
+    const RenderConfig& initialConfig,
+    const volume::MacroCellGrid* pMacroCellGrid)
     : m_pVolume(pVolume)
     , m_pGradientVolume(pGradientVolume)
     , m_pCamera(pCamera)
     , m_config(initialConfig)
+    , m_macroCellGrid(pMacroCellGrid ? *pMacroCellGrid : volume::MacroCellGrid(*pVolume))
 {
     resizeImage(initialConfig.renderResolution);
+    updateTFOpacityTable();
+    updateTF2DTable();
+    updatePreIntegrationTable();
+    restartProgressive();
 }
 
-// Set a new render config if the user changed the settings.
+// Set a new render config if the user changed the settings. Only the parts of the renderer that depend on the
+// sections of the config that changed are updated; the image is restarted unless only performance settings changed.
 void Renderer::setConfig(const RenderConfig& config)
 {
-    if (config.renderResolution != m_config.renderResolution)
-        resizeImage(config.renderResolution);
+    const RenderConfigChanges changes = changedSections(m_config, config);
+    if (!changes.any())
+        return;
 
     m_config = config;
+    m_configGeneration++;
+    for (size_t i = 0; i < numRenderConfigSections; i++) {
+        if (changes.test(RenderConfigSection(i)))
+            m_sectionGenerations[i] = m_configGeneration;
+    }
+
+    if (changes.test(RenderConfigSection::Resolution))
+        resizeImage(config.renderResolution);
+    if (changes.test(RenderConfigSection::TransferFunction))
+        updateTFOpacityTable();
+    updateTF2DTable();
+    updatePreIntegrationTable();
+    if (changes.affectsImage())
+        restartProgressive();
+}
+
+// Returns whether any of the sections changed after the given config generation.
+bool Renderer::changedSince(uint64_t generation, std::initializer_list<RenderConfigSection> sections) const
+{
+    return std::any_of(std::begin(sections), std::end(sections),
+        [&](RenderConfigSection section) { return m_sectionGenerations[size_t(section)] > generation; });
+}
+
+const RenderConfig& Renderer::config() const
+{
+    return m_config;
+}
+
+// Point the renderer to a different camera.
+void Renderer::setCamera(const render::RayTraceCamera* pCamera)
+{
+    m_pCamera = pCamera;
+    restartProgressive();
+}
+
+// Render another volume (for example the next timestep of a volume series) without creating a new renderer. The macro
+// cells are copied from pMacroCellGrid if given (which reuses the storage of the current cells when the volumes have the
+// same size), and computed otherwise. The volume pyramid, brick pager and compressed volume belong to the previous
+// volume and are removed.
+void Renderer::setVolume(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume, const volume::MacroCellGrid* pMacroCellGrid)
+{
+    m_pVolume = pVolume;
+    m_pGradientVolume = pGradientVolume;
+    if (pMacroCellGrid)
+        m_macroCellGrid = *pMacroCellGrid;
+    else
+        m_macroCellGrid = volume::MacroCellGrid(*pVolume);
+    m_pVolumePyramid = nullptr;
+    m_pBrickPager = nullptr;
+    m_pCompressedVolume = nullptr;
+
+    // The 2D transfer function is baked for the value and gradient magnitude range of the volume, and the sample cache
+    // and the temporal history hold samples of the previous volume.
+    m_optTF2DTableGeneration.reset();
+    updateTF2DTable();
+    m_optSampleCacheKey.reset();
+    m_optTemporalGeneration.reset();
+    restartProgressive();
+}
+
+// Sample the levels of detail of the pyramid instead of the volume when the render config enables it (see
+// RenderConfig::levelOfDetail). The pyramid must be built from the volume and gradient volume of the renderer.
+void Renderer::setVolumePyramid(const volume::VolumePyramid* pVolumePyramid)
+{
+    m_pVolumePyramid = pVolumePyramid;
+    restartProgressive();
+}
+
+// Stream the bricks of the volume from its file instead of reading the whole volume: samples of bricks that are not
+// loaded yet are taken from level 1 of the volume pyramid (which is required) until the pager has loaded them. The
+// pager must be created for the volume of the renderer.
+void Renderer::setBrickPager(volume::BrickPager* pBrickPager)
+{
+    m_pBrickPager = pBrickPager;
+    restartProgressive();
+}
+
+// Sample the compressed voxels instead of the volume (unless the volume pyramid is sampled), so that the volume itself
+// does not have to stay in memory. The samples are the same. The compressed volume must be created from the volume of
+// the renderer.
+void Renderer::setCompressedVolume(const volume::CompressedVolume* pCompressedVolume)
+{
+    m_pCompressedVolume = pCompressedVolume;
+    restartProgressive();
+}
+
+// Render only the part of the volume that a block of a larger volume owns, normalized to the larger volume (see
+// RenderBlock), or the whole volume for an empty optional.
+void Renderer::setBlock(const std::optional<RenderBlock>& optBlock)
+{
+    m_optBlock = optBlock;
+    // The 2D transfer function is baked for the value and gradient magnitude range.
+    m_optTF2DTableGeneration.reset();
+    updateTF2DTable();
+    m_optSampleCacheKey.reset();
+    m_optTemporalGeneration.reset();
+    restartProgressive();
 }
 
 // Resize the framebuffer and fill it with black pixels.
@@ -44,10 +155,25 @@ void Renderer::resizeImage(const glm::ivec2& resolution)
     m_frameBuffer.resize(size_t(resolution.x) * size_t(resolution.y), glm::vec4(0.0f));
 }
 
-// Clear the framebuffer by setting all pixels to black.
-void Renderer::resetImage()
+// Set the pixels of the frame buffer outside of rect to black. The pixels inside are all traced, so they do not need to
+// be cleared.
+void Renderer::clearOutside(const ScreenRect& rect, gsl::span<glm::vec4> frameBuffer) const
 {
-    std::fill(std::begin(m_frameBuffer), std::end(m_frameBuffer), glm::vec4(0.0f));
+    const glm::ivec2 resolution = m_config.renderResolution;
+    const glm::ivec2 begin = glm::clamp(rect.begin, glm::ivec2(0), resolution);
+    const glm::ivec2 end = glm::clamp(rect.end, begin, resolution);
+    const auto clear = [&](int y, int beginX, int endX) {
+        const auto row = std::begin(frameBuffer) + std::ptrdiff_t(y) * resolution.x;
+        std::fill(row + beginX, row + endX, glm::vec4(0.0f));
+    };
+    for (int y = 0; y < resolution.y; y++) {
+        if (y < begin.y || y >= end.y) {
+            clear(y, 0, resolution.x);
+        } else {
+            clear(y, 0, begin.x);
+            clear(y, end.x, resolution.x);
+        }
+    }
 }
 
 // Return a VIEW into the framebuffer. This view is merely a reference to the m_frameBuffer member variable.
@@ -58,85 +184,909 @@ gsl::span<const glm::vec4> Renderer::frameBuffer() const
 }
 
 // Main render function. It computes an image according to the current renderMode.
-// Multithreading is enabled in Release/RelWithDebInfo modes. In Debug mode multithreading is disabled to make debugging easier.
+// The volume sampler is selected once per frame so that the loops below are specialized for the voxel type and
+// interpolation mode instead of dispatching on them for every sample.
 void Renderer::render()
 {
-    resetImage();
-
-    static constexpr float sampleStep = 1.0f;
-    const glm::vec3 planeNormal = -glm::normalize(m_pCamera->forward());
-    const glm::vec3 volumeCenter = glm::vec3(m_pVolume->dims()) / 2.0f;
-    const Bounds bounds { glm::vec3(0.0f), glm::vec3(m_pVolume->dims() - glm::ivec3(1)) };
-
-    // 0 = sequential (single-core), 1 = TBB (multi-core)
-#ifdef NDEBUG 
-    // If NOT in debug mode then enable parallelism using the TBB library (Intel Threaded Building Blocks).
-#define PARALLELISM 1
-#else
-    // Disable multithreading in debug mode.
-#define PARALLELISM 0
-#endif
-
-#if PARALLELISM == 0
-    // Regular (single threaded) for loops.
-    for (int x = 0; x < m_config.renderResolution.x; x++) {
-        for (int y = 0; y < m_config.renderResolution.y; y++) {
-#else
-    // Parallel for loop (in 2 dimensions) that subdivides the screen into tiles.
-    const tbb::blocked_range2d<int> screenRange { 0, m_config.renderResolution.y, 0, m_config.renderResolution.x };
-        tbb::parallel_for(screenRange, [&](tbb::blocked_range2d<int> localRange) {
-        // Loop over the pixels in a tile. This function is called on multiple threads at the same time.
-        for (int y = std::begin(localRange.rows()); y != std::end(localRange.rows()); y++) {
-            for (int x = std::begin(localRange.cols()); x != std::end(localRange.cols()); x++) {
-#endif
-            // Compute a ray for the current pixel.
-            const glm::vec2 pixelPos = glm::vec2(x, y) / glm::vec2(m_config.renderResolution);
-            Ray ray = m_pCamera->generateRay(pixelPos * 2.0f - 1.0f);
-
-            // Compute where the ray enters and exists the volume.
-            // If the ray misses the volume then we continue to the next pixel.
-            if (!instersectRayVolumeBounds(ray, bounds))
-                continue;
+    if (m_pBrickPager) {
+        m_pBrickPager->beginFrame();
+        m_brickGeneration = m_pBrickPager->loadedGeneration();
+    }
+    prepareSampleCache();
+    startProfile();
+    // The image does not record a temporal history (see startTemporalImage).
+    m_temporalImage = false;
+    m_optTemporalGeneration.reset();
+    visitFrameSampler([&](const auto& sampler) { renderFrame(sampler); });
+    collectThreadProfiles();
+    m_progressiveStride = 0;
+}
 
-            // Get a color for the current pixel according to the current render mode.
-            glm::vec4 color {};
-            switch (m_config.renderMode) {
-            case RenderMode::RenderSlicer: {
-                color = traceRaySlice(ray, volumeCenter, planeNormal);
-                break;
+// The screen is split into tiles (see createTiles) that are distributed over the threads with work stealing. Tiles
+// outside of the projection of the volume are not rendered at all since all of their rays miss the volume.
+template <typename Sampler>
+void Renderer::renderFrame(const Sampler& sampler)
+{
+    const FrameParameters frame = frameParameters();
+    const ScreenRect visible = visibleScreenRect(frame);
+    clearOutside(visible, m_frameBuffer);
+    createTiles(visible, std::max(m_config.tileSize, 1), m_tiles);
+    const std::vector<ScreenRect>& tiles = m_tiles;
+
+    const auto renderTile = [&](size_t tileIndex) {
+        const ScreenRect& tile = tiles[tileIndex];
+        profileTile(tile, [&]() {
+            for (int y = tile.begin.y; y != tile.end.y; y++) {
+                for (int x = tile.begin.x; x < tile.end.x; x += int(packetSize)) {
+                    // Trace up to packetSize neighbouring pixels together and write the resulting colors to the screen.
+                    PixelPacket pixels;
+                    pixels.count = static_cast<size_t>(std::min(int(packetSize), tile.end.x - x));
+                    for (size_t i = 0; i < pixels.count; i++)
+                        pixels.coords[i] = glm::ivec2(x + int(i), y);
+                    const ColorPacket colors = tracePixelPacket(pixels, frame, sampler);
+                    for (size_t i = 0; i < pixels.count; i++)
+                        fillColor(pixels.coords[i].x, y, colors[i]);
+                }
             }
-            case RenderMode::RenderMIP: {
-                color = traceRayMIP(ray, sampleStep);
-                break;
+        });
+    };
+
+    // Parallel loop over the tiles (see volume::ExecutionPolicy, which runs it on the calling thread in debug builds by
+    // default to make debugging easier). The simple partitioner hands out exactly tileGrainSize consecutive tiles (in
+    // Morton order) per task; idle threads steal tasks from busy ones.
+    const size_t grainSize = static_cast<size_t>(std::max(m_config.tileGrainSize, 1));
+    volume::ExecutionPolicy::global().parallelFor(
+        tbb::blocked_range<size_t>(0, tiles.size(), grainSize),
+        [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t tileIndex = range.begin(); tileIndex != range.end(); tileIndex++)
+                renderTile(tileIndex);
+        },
+        tbb::simple_partitioner());
+}
+
+// The rays of the pixels are generated and clipped once for all modes (see traceRayModes). Like render(), the image
+// does not record a temporal history, and it does not use the sample cache (which belongs to the render mode of the
+// config).
+bool Renderer::renderModes(gsl::span<const RenderMode> modes)
+{
+    if (modes.size() > maxBatchModes) {
+        std::cerr << "Cannot render more than " << maxBatchModes << " render modes at once" << std::endl;
+        return false;
+    }
+    const auto needsOwnTable = [&](RenderMode mode) {
+        return mode != m_config.renderMode
+            && (mode == RenderMode::RenderTF2D || mode == RenderMode::RenderTF2DV2 || (mode == RenderMode::RenderComposite && m_config.preIntegratedTF));
+    };
+    if (std::any_of(std::begin(modes), std::end(modes), needsOwnTable)) {
+        std::cerr << "Render modes with 2D transfer functions or pre-integration can only be rendered in the render mode of the config" << std::endl;
+        return false;
+    }
+
+    if (m_pBrickPager) {
+        m_pBrickPager->beginFrame();
+        m_brickGeneration = m_pBrickPager->loadedGeneration();
+    }
+    m_modeFrameBuffers.resize(modes.size());
+    for (std::vector<glm::vec4>& frameBuffer : m_modeFrameBuffers)
+        frameBuffer.resize(m_frameBuffer.size());
+    startProfile();
+    visitFrameSampler([&](const auto& sampler) { renderModesFrame(modes, sampler); });
+    collectThreadProfiles();
+    return true;
+}
+
+gsl::span<const glm::vec4> Renderer::modeFrameBuffer(size_t index) const
+{
+    return m_modeFrameBuffers[index];
+}
+
+// Same tiles as renderFrame, tracing every pixel in all modes.
+template <typename Sampler>
+void Renderer::renderModesFrame(gsl::span<const RenderMode> modes, const Sampler& sampler)
+{
+    const FrameParameters frame = frameParameters();
+    const ScreenRect visible = visibleScreenRect(frame);
+    for (std::vector<glm::vec4>& frameBuffer : m_modeFrameBuffers)
+        clearOutside(visible, frameBuffer);
+    createTiles(visible, std::max(m_config.tileSize, 1), m_tiles);
+    const std::vector<ScreenRect>& tiles = m_tiles;
+
+    const int width = m_config.renderResolution.x;
+    const auto renderTile = [&](size_t tileIndex) {
+        const ScreenRect& tile = tiles[tileIndex];
+        profileTile(tile, [&]() {
+            RenderStatistics& statistics = threadRenderStatistics();
+            for (int y = tile.begin.y; y != tile.end.y; y++) {
+                for (int x = tile.begin.x; x != tile.end.x; x++) {
+                    Ray ray = pixelRay(glm::ivec2(x, y), frame);
+                    statistics.raysCast++;
+                    ModeColors colors {};
+                    if (clipRay(ray, frame))
+                        colors = traceRayModes(ray, frame, modes, sampler);
+                    else
+                        statistics.raysMissed++;
+                    const size_t index = size_t(width) * size_t(y) + size_t(x);
+                    for (size_t i = 0; i < modes.size(); i++)
+                        m_modeFrameBuffers[i][index] = colors[i];
+                }
             }
-            case RenderMode::RenderComposite: {
-                color = traceRayComposite(ray, sampleStep);
-                break;
+        });
+    };
+
+    const size_t grainSize = static_cast<size_t>(std::max(m_config.tileGrainSize, 1));
+    volume::ExecutionPolicy::global().parallelFor(
+        tbb::blocked_range<size_t>(0, tiles.size(), grainSize),
+        [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t tileIndex = range.begin(); tileIndex != range.end(); tileIndex++)
+                renderTile(tileIndex);
+        },
+        tbb::simple_partitioner());
+}
+
+// The modes that traceRayModes computes from a single walk along the ray: MIP, iso and front-to-back composite (with a
+// fixed sample step and without pre-integration, the modes that tracePixelPacket traces as packets).
+bool Renderer::sharesSampleWalk(RenderMode mode) const
+{
+    return mode == RenderMode::RenderMIP
+        || mode == RenderMode::RenderIso
+        || (mode == RenderMode::RenderComposite && m_config.frontToBackCompositing && !m_config.adaptiveSampleStep && !m_config.preIntegratedTF);
+}
+
+// Colors of a ray (that hits the volume) in each of the modes. The modes that share a sample walk (see
+// sharesSampleWalk) take the same samples as the compositing: in steps of sampleStep that end at tmax, so MIP and iso
+// sample positions are shifted by less than a step from those of their own ray tracing functions (iso surfaces are
+// refined to the same location). A macro cell is only skipped if every one of these modes can skip it, and the walk
+// stops once the iso surface is found and the compositing terminated, unless it computes a MIP. The other modes trace
+// the ray on their own.
+template <typename Sampler>
+Renderer::ModeColors Renderer::traceRayModes(const Ray& ray, const FrameParameters& frame, gsl::span<const RenderMode> modes, const Sampler& sampler) const
+{
+    ModeColors colors {};
+    bool mip = false, iso = false, composite = false;
+    for (size_t i = 0; i < modes.size(); i++) {
+        if (!sharesSampleWalk(modes[i])) {
+            colors[i] = traceRay(modes[i], ray, frame, sampler);
+            continue;
+        }
+        mip |= modes[i] == RenderMode::RenderMIP;
+        iso |= modes[i] == RenderMode::RenderIso;
+        composite |= modes[i] == RenderMode::RenderComposite;
+    }
+    if (!mip && !iso && !composite)
+        return colors;
+
+    const float sampleStep = frame.sampleStep;
+    const float tStart = ray.tmax - std::floor((ray.tmax - ray.tmin) / sampleStep) * sampleStep;
+    float maxVal = 0.0f;
+    bool isoFound = !iso, atLeastTwoSteps = false;
+    glm::vec4 isoColor { 0.0f };
+    bool terminated = !composite;
+    glm::vec3 color { 0.0f };
+    float opacity = 0.0f;
+    const PhongShader shader = createShader(ray.direction);
+    const auto skippable = [&](float cellMin, float cellMax) {
+        return (!mip || cellMax <= maxVal) && (isoFound || cellMax <= m_config.isoValue) && (terminated || isTFTransparent(cellMin, cellMax));
+    };
+    EmptySpaceSkipper skipper = createSkipper(ray, tStart, sampleStep);
+    RenderStatistics& statistics = threadRenderStatistics();
+
+    glm::vec3 samplePos = ray.origin + tStart * ray.direction;
+    const glm::vec3 increment = sampleStep * ray.direction;
+    for (float t = tStart; t <= ray.tmax; t += sampleStep, samplePos += increment) {
+        skipper.skip(t, samplePos, skippable);
+        if (t > ray.tmax)
+            break;
+
+        const float value = sampler(samplePos);
+        statistics.samples++;
+        maxVal = std::max(value, maxVal);
+        if (!isoFound) {
+            if (value > m_config.isoValue) {
+                isoColor = isoSurfaceColor(ray, sampleStep, t, samplePos, value, atLeastTwoSteps, sampler);
+                isoFound = true;
             }
-            case RenderMode::RenderIso: {
-                color = traceRayISO(ray, sampleStep);
-                break;
+            atLeastTwoSteps = true;
+        }
+        if (!terminated) {
+            const glm::vec4 sample = classifyTFValue(value, samplePos, shader, sampler);
+            const float weight = (1 - opacity) * correctOpacity(sample.a, sampleStep);
+            color += weight * glm::vec3(sample);
+            opacity += weight;
+            if (opacity >= m_config.earlyRayTerminationThreshold) {
+                statistics.earlyTerminations++;
+                terminated = true;
             }
-            case RenderMode::RenderTF2D: {
-                color = traceRayTF2D(ray, sampleStep);
-                break;
+        }
+        if (!mip && isoFound && terminated)
+            break;
+    }
+
+    for (size_t i = 0; i < modes.size(); i++) {
+        if (!sharesSampleWalk(modes[i]))
+            continue;
+        if (modes[i] == RenderMode::RenderMIP)
+            colors[i] = glm::vec4(glm::vec3(maxVal) / volumeMaximum(), 1.0f);
+        else if (modes[i] == RenderMode::RenderIso)
+            colors[i] = isoColor;
+        else
+            colors[i] = compositedColor(color, opacity);
+    }
+    return colors;
+}
+
+const RenderStatistics& Renderer::statistics() const
+{
+    return m_statistics;
+}
+
+// Time spent on each tile of the current image, in the order in which the tiles were started. Tiles outside of the
+// projected volume are not listed. The tiles of a progressive image are the (partial) block rows that a task traced.
+gsl::span<const TileTiming> Renderer::tileTimings() const
+{
+    return m_tileTimings;
+}
+
+// Start the statistics and tile timings of a new image.
+void Renderer::startProfile()
+{
+    m_statistics = {};
+    m_tileTimings.clear();
+    m_imageStart = std::chrono::steady_clock::now();
+}
+
+// Call traceTile() and record how long it took and the work that it did (see RenderStatistics) in the profile of the
+// calling thread.
+template <typename F>
+void Renderer::profileTile(const ScreenRect& tile, F&& traceTile)
+{
+    using clock = std::chrono::steady_clock;
+    const RenderStatistics before = threadRenderStatistics();
+    const auto start = clock::now();
+    traceTile();
+    const auto end = clock::now();
+
+    ThreadProfile& profile = m_threadProfiles.local();
+    profile.statistics += threadRenderStatistics() - before;
+    profile.tileTimings.push_back(TileTiming {
+        tile,
+        std::chrono::duration<float>(end - start).count(),
+        std::chrono::duration<float>(start - m_imageStart).count(),
+        volume::ExecutionPolicy::currentThreadIndex() });
+}
+
+// Merge the profiles of the threads into the profile of the image.
+void Renderer::collectThreadProfiles()
+{
+    const auto newTimings = static_cast<std::ptrdiff_t>(m_tileTimings.size());
+    for (ThreadProfile& profile : m_threadProfiles) {
+        m_statistics += profile.statistics;
+        m_tileTimings.insert(std::end(m_tileTimings), std::begin(profile.tileTimings), std::end(profile.tileTimings));
+        profile.statistics = {};
+        profile.tileTimings.clear();
+    }
+    const auto startedBefore = [](const TileTiming& lhs, const TileTiming& rhs) { return lhs.startSeconds < rhs.startSeconds; };
+    std::sort(std::begin(m_tileTimings) + newTimings, std::end(m_tileTimings), startedBefore);
+    std::inplace_merge(std::begin(m_tileTimings), std::begin(m_tileTimings) + newTimings, std::end(m_tileTimings), startedBefore);
+}
+
+// Compute the pixels whose rays may hit the bounds of the frame: the bounding rectangle of the projected box corners.
+// The projection requires a pinhole camera (see fitPinholeCamera); for other cameras, or if a box corner is not in
+// front of the camera, the whole screen is returned.
+ScreenRect Renderer::visibleScreenRect(const FrameParameters& frame) const
+{
+    const glm::ivec2 resolution = m_config.renderResolution;
+    const ScreenRect fullScreen { glm::ivec2(0), resolution };
+    // The region of interest may not overlap the volume (or the owned part of a block) at all.
+    const Bounds& bounds = frame.bounds;
+    if (glm::any(glm::greaterThan(bounds.lowerUpper[0], bounds.lowerUpper[1])))
+        return ScreenRect { glm::ivec2(0), glm::ivec2(0) };
+
+    if (!frame.optPinhole)
+        return fullScreen;
+    const auto& [origin, forward, right, up] = *frame.optPinhole;
+
+    glm::vec2 lower { std::numeric_limits<float>::max() };
+    glm::vec2 upper { std::numeric_limits<float>::lowest() };
+    for (size_t i = 0; i < 8; i++) {
+        const glm::vec3 corner { bounds.lowerUpper[i & 1].x, bounds.lowerUpper[(i >> 1) & 1].y, bounds.lowerUpper[i >> 2].z };
+        const glm::vec3 toCorner = corner - origin;
+        const float depth = glm::dot(toCorner, forward);
+        if (depth <= 0.0f)
+            return fullScreen;
+
+        const glm::vec3 offset = toCorner / depth - forward;
+        const glm::vec2 ndc { glm::dot(offset, right) / glm::dot(right, right), glm::dot(offset, up) / glm::dot(up, up) };
+        lower = glm::min(lower, ndc);
+        upper = glm::max(upper, ndc);
+    }
+
+    // Convert to pixels (the inverse of the mapping in tracePixel) with a margin of a pixel for rounding errors.
+    const glm::vec2 halfResolution = glm::vec2(resolution) / 2.0f;
+    const glm::ivec2 begin = glm::ivec2(glm::floor((lower + 1.0f) * halfResolution)) - 1;
+    const glm::ivec2 end = glm::ivec2(glm::ceil((upper + 1.0f) * halfResolution)) + 2;
+    return ScreenRect { glm::clamp(begin, glm::ivec2(0), resolution), glm::clamp(end, glm::ivec2(0), resolution) };
+}
+
+// Calls f(sampler) with the sampler for the rays of the image: a volume::PyramidSampler if levels of detail are enabled
+// or bricks are streamed (and there is more than one level), otherwise the sampler of the compressed volume or that of
+// the volume.
+template <typename F>
+void Renderer::visitFrameSampler(F&& f) const
+{
+    if ((m_config.levelOfDetail || m_pBrickPager) && m_pVolumePyramid && m_pVolumePyramid->numLevels() > 1) {
+        const float scale = m_config.levelOfDetail ? footprintScale() : 0.0f;
+        volume::visitPyramidSampler(*m_pVolumePyramid, m_pCamera->position(), scale, m_pBrickPager, std::forward<F>(f));
+    } else if (m_pCompressedVolume)
+        m_pCompressedVolume->visitSampler(m_pVolume->interpolationMode, std::forward<F>(f));
+    else
+        m_pVolume->visitSampler(std::forward<F>(f));
+}
+
+// Footprint of a pixel at a distance of one voxel from the camera, in voxels: the distance between the rays of two
+// neighbouring pixels in the center of the screen. Every unit of the level of detail bias doubles the footprint.
+float Renderer::footprintScale() const
+{
+    const glm::vec3 center = glm::normalize(m_pCamera->generateRay(glm::vec2(0.0f)).direction);
+    const glm::vec3 neighbour = glm::normalize(m_pCamera->generateRay(glm::vec2(2.0f / float(m_config.renderResolution.x), 0.0f)).direction);
+    return glm::length(neighbour - center) * std::exp2(m_config.levelOfDetailBias);
+}
+
+// The region of interest of a block is that of the larger volume, whose size follows from its center and origin.
+Renderer::FrameParameters Renderer::frameParameters() const
+{
+    const glm::vec3 volumeCenter = m_optBlock ? m_optBlock->volumeCenter : glm::vec3(m_pVolume->dims()) / 2.0f;
+    const glm::vec3 volumeOrigin = m_optBlock ? m_optBlock->volumeOrigin : glm::vec3(0.0f);
+    const Bounds volumeBounds = m_optBlock ? m_optBlock->bounds : Bounds { glm::vec3(0.0f), glm::vec3(m_pVolume->dims() - glm::ivec3(1)) };
+    const ClipRegion region = clipRegion(m_config, volumeOrigin, 2.0f * (volumeCenter - volumeOrigin));
+    FrameParameters frame {
+        -glm::normalize(m_pCamera->forward()),
+        volumeCenter,
+        Bounds { glm::max(volumeBounds.lowerUpper[0], region.lower), glm::min(volumeBounds.lowerUpper[1], region.upper) },
+        std::max(m_config.sampleStep, minSampleStep),
+        region.planes,
+        region.numPlanes,
+        region.clipped,
+        fitPinholeCamera(*m_pCamera)
+    };
+    if (!frame.optPinhole)
+        return frame;
+
+    // The direction through pixel (x, y) is firstPixelDirection + x * pixelRight + y * pixelUp (before normalization),
+    // the mapping of pixels to screen coordinates of tracePixel.
+    const auto& [origin, forward, right, up] = *frame.optPinhole;
+    const glm::vec2 pixelSize = 2.0f / glm::vec2(m_config.renderResolution);
+    frame.firstPixelDirection = forward - right - up;
+    frame.pixelRight = pixelSize.x * right;
+    frame.pixelUp = pixelSize.y * up;
+    frame.boundsFromCamera = { frame.bounds.lowerUpper[0] - origin, frame.bounds.lowerUpper[1] - origin };
+    for (size_t i = 0; i < frame.numClipPlanes; i++)
+        frame.clipPlaneDistances[i] = frame.clipPlanes[i].w - glm::dot(glm::vec3(frame.clipPlanes[i]), origin);
+    return frame;
+}
+
+// The voxel value and gradient magnitude that MIP and the 2D transfer functions are normalized to.
+float Renderer::volumeMaximum() const
+{
+    return m_optBlock ? m_optBlock->volumeMaximum : m_pVolume->maximum();
+}
+
+float Renderer::gradientMaxMagnitude() const
+{
+    return m_optBlock ? m_optBlock->gradientMaxMagnitude : m_pGradientVolume->maxMagnitude();
+}
+
+// Compute the color of pixel (x, y) according to the current render mode. Pixels whose ray misses the volume are black.
+template <typename Sampler>
+glm::vec4 Renderer::tracePixel(int x, int y, const FrameParameters& frame, const Sampler& sampler) const
+{
+    // Compute a ray for the current pixel.
+    Ray ray = pixelRay(glm::ivec2(x, y), frame);
+    RenderStatistics& statistics = threadRenderStatistics();
+    statistics.raysCast++;
+
+    // Compute where the ray enters and exists the volume.
+    // If the ray misses the volume then the pixel stays black.
+    if (!clipRay(ray, frame)) {
+        statistics.raysMissed++;
+        return glm::vec4(0.0f);
+    }
+
+    // Get a color for the current pixel according to the current render mode.
+    return traceRay(m_config.renderMode, ray, frame, sampler);
+}
+
+// Color of a ray that hits the volume (see clipRay) in the given render mode.
+template <typename Sampler>
+glm::vec4 Renderer::traceRay(RenderMode mode, const Ray& ray, const FrameParameters& frame, const Sampler& sampler) const
+{
+    const float sampleStep = frame.sampleStep;
+    switch (mode) {
+    case RenderMode::RenderSlicer: {
+        threadRenderStatistics().samples++;
+        const glm::vec4 color = traceRaySlice(ray, frame.volumeCenter, frame.planeNormal);
+        if (!m_optBlock && !frame.clipped)
+            return color;
+        // The slice plane of a block lies in another block where it is outside of the owned part, and the region of
+        // interest cuts it off where it is outside of the region.
+        const float t = glm::dot(frame.volumeCenter - ray.origin, frame.planeNormal) / glm::dot(ray.direction, frame.planeNormal);
+        if (!(t >= ray.tmin && t <= ray.tmax))
+            return glm::vec4(0.0f);
+        if (!m_optBlock)
+            return color;
+        return glm::vec4(glm::vec3(color) * (m_pVolume->maximum() / volumeMaximum()), color.a);
+    }
+    case RenderMode::RenderMIP:
+        return traceRayMIP(ray, sampleStep, sampler);
+    case RenderMode::RenderComposite:
+        return traceRayComposite(ray, sampleStep, sampler);
+    case RenderMode::RenderIso:
+        return traceRayISO(ray, sampleStep, sampler);
+    case RenderMode::RenderTF2D:
+        return traceRayTF2D(ray, sampleStep, sampler);
+    case RenderMode::RenderTF2DV2:
+        return traceRayTF2DV2(ray, sampleStep, sampler);
+    };
+    return glm::vec4(0.0f);
+}
+
+// Compute the colors of a packet of (neighbouring) pixels. The MIP, iso and front-to-back composite modes trace the
+// rays as a packet; the other modes trace them one by one. So do iso rays with empty space skipping: they skip
+// straight to the surface and take too few samples for packets to pay off.
+template <typename Sampler>
+Renderer::ColorPacket Renderer::tracePixelPacket(const PixelPacket& pixels, const FrameParameters& frame, const Sampler& sampler) const
+{
+    const float sampleStep = frame.sampleStep;
+
+    ColorPacket colors;
+    colors.fill(glm::vec4(0.0f));
+    if (m_sampleCacheActive) {
+        for (size_t i = 0; i < pixels.count; i++)
+            colors[i] = traceCachedPixel(pixels.coords[i], frame, sampler);
+        return colors;
+    }
+
+    const RenderMode mode = m_config.renderMode;
+    const bool tracePacket = mode == RenderMode::RenderMIP
+        || (mode == RenderMode::RenderIso && !m_config.emptySpaceSkipping)
+        || (mode == RenderMode::RenderComposite && m_config.frontToBackCompositing && !m_config.adaptiveSampleStep && !m_config.preIntegratedTF);
+    if (!tracePacket) {
+        for (size_t i = 0; i < pixels.count; i++)
+            colors[i] = tracePixel(pixels.coords[i].x, pixels.coords[i].y, frame, sampler);
+        return colors;
+    }
+
+    // Lanes that are not used or whose ray misses the volume are inactive (and black).
+    RayPacket rays {};
+    LaneMask active {};
+    RenderStatistics& statistics = threadRenderStatistics();
+    for (size_t i = 0; i < pixels.count; i++) {
+        rays[i] = pixelRay(pixels.coords[i], frame);
+        active[i] = clipRay(rays[i], frame);
+        if (!active[i])
+            statistics.raysMissed++;
+    }
+    statistics.raysCast += pixels.count;
+
+    if (mode == RenderMode::RenderMIP)
+        return traceRayMIPPacket(rays, active, sampleStep, sampler);
+    else if (mode == RenderMode::RenderIso)
+        return traceRayISOPacket(rays, active, sampleStep, sampler);
+    else
+        return traceRayCompositePacket(rays, active, sampleStep, sampler);
+}
+
+// Walk a packet of rays through the volume in lock step, sampling all lanes at once. Every lane takes the same samples
+// as the scalar ray tracing functions: from tStart[i] in steps of sampleStep until tmax, with empty space skipping.
+// transparent(lane, minValue, maxValue) returns whether a macro cell can be skipped for a lane, and
+// visit(lane, value, t, samplePos) processes a sample and returns false to terminate the lane.
+// Terminated lanes keep being sampled (at an outside position, which is cheap) while the packet is marched.
+template <typename Sampler, typename Transparent, typename Visit>
+void Renderer::marchPacket(const RayPacket& rays, LaneMask active, const std::array<float, packetSize>& tStart, float sampleStep, const Sampler& sampler, Transparent&& transparent, Visit&& visit) const
+{
+    auto skippers = [&]<size_t... I>(std::index_sequence<I...>) {
+        return std::array<EmptySpaceSkipper, packetSize> { createSkipper(rays[I], tStart[I], sampleStep)... };
+    }(std::make_index_sequence<packetSize>());
+
+    static constexpr float outside = -1.0f;
+    RenderStatistics& statistics = threadRenderStatistics();
+    std::array<float, packetSize> t = tStart;
+    volume::CoordinatePacket<packetSize> samplePos, increment;
+    const auto deactivate = [&](size_t i) {
+        active[i] = false;
+        samplePos.x[i] = samplePos.y[i] = samplePos.z[i] = outside;
+    };
+    for (size_t i = 0; i < packetSize; i++) {
+        const glm::vec3 start = rays[i].origin + tStart[i] * rays[i].direction;
+        const glm::vec3 step = sampleStep * rays[i].direction;
+        samplePos.x[i] = start.x, samplePos.y[i] = start.y, samplePos.z[i] = start.z;
+        increment.x[i] = step.x, increment.y[i] = step.y, increment.z[i] = step.z;
+        if (!(active[i] && t[i] <= rays[i].tmax))
+            deactivate(i);
+    }
+
+    // Once few lanes remain, sampling the whole packet costs more than it gains: finish those lanes one by one.
+    while (std::count(std::begin(active), std::end(active), true) > int(minActiveLanes)) {
+        for (size_t i = 0; i < packetSize; i++) {
+            if (!active[i])
+                continue;
+            glm::vec3 pos { samplePos.x[i], samplePos.y[i], samplePos.z[i] };
+            skippers[i].skip(t[i], pos, [&](float cellMin, float cellMax) { return transparent(i, cellMin, cellMax); });
+            samplePos.x[i] = pos.x, samplePos.y[i] = pos.y, samplePos.z[i] = pos.z;
+            if (t[i] > rays[i].tmax)
+                deactivate(i);
+        }
+
+        const std::array<float, packetSize> values = sampler(samplePos);
+
+        for (size_t i = 0; i < packetSize; i++) {
+            if (!active[i])
+                continue;
+            statistics.samples++;
+            if (!visit(i, values[i], t[i], glm::vec3(samplePos.x[i], samplePos.y[i], samplePos.z[i]))) {
+                deactivate(i);
+                continue;
             }
-            case RenderMode::RenderTF2DV2: {
-                color = traceRayTF2DV2(ray, sampleStep);
+            t[i] += sampleStep;
+            samplePos.x[i] += increment.x[i];
+            samplePos.y[i] += increment.y[i];
+            samplePos.z[i] += increment.z[i];
+            if (t[i] > rays[i].tmax)
+                deactivate(i);
+        }
+    }
+
+    for (size_t i = 0; i < packetSize; i++) {
+        if (!active[i])
+            continue;
+        glm::vec3 pos { samplePos.x[i], samplePos.y[i], samplePos.z[i] };
+        const glm::vec3 step { increment.x[i], increment.y[i], increment.z[i] };
+        const auto transparentLane = [&](float cellMin, float cellMax) { return transparent(i, cellMin, cellMax); };
+        for (float& tLane = t[i]; tLane <= rays[i].tmax; tLane += sampleStep, pos += step) {
+            skippers[i].skip(tLane, pos, transparentLane);
+            if (tLane > rays[i].tmax)
                 break;
-            }
+            statistics.samples++;
+            if (!visit(i, sampler(pos), tLane, pos))
+                break;
+        }
+    }
+}
+
+// Start a new progressively refined image. Call this whenever the camera changes; setConfig calls it automatically.
+void Renderer::restartProgressive()
+{
+    if (m_pBrickPager)
+        m_pBrickPager->beginFrame();
+    m_progressiveStride = progressiveStartStride;
+    m_progressiveBlockRow = 0;
+}
+
+bool Renderer::isProgressiveComplete() const
+{
+    return m_progressiveStride == 0;
+}
+
+bool Renderer::isStreaming() const
+{
+    return m_pBrickPager && (m_pBrickPager->loadedGeneration() != m_brickGeneration || m_pBrickPager->hasPendingRequests());
+}
+
+// Restart the progressive image if bricks were loaded since it started. The refreshed image belongs to the same frame
+// of the pager, so its bricks stay resident; it converges once the requested bricks are loaded or the budget is full.
+// The sample cache holds samples of the fallback level and is discarded.
+bool Renderer::refreshStreamedBricks()
+{
+    if (!m_pBrickPager || m_pBrickPager->loadedGeneration() == m_brickGeneration)
+        return false;
+    m_optSampleCacheKey.reset();
+    m_progressiveStride = progressiveStartStride;
+    m_progressiveBlockRow = 0;
+    return true;
+}
+
+// Refine the progressive image for roughly timeBudget and return whether it is complete.
+//
+// Refinement works in passes with a decreasing stride s (progressiveStartStride, ..., 2, 1). A pass traces the pixels
+// whose coordinates are multiples of s (skipping those that an earlier pass already traced) and fills the s x s block
+// below and to the right of each traced pixel with its color. Every pass therefore refines the blocks of the previous
+// pass in place and the last pass traces exactly the pixels that are still missing: every pixel is traced once.
+//
+// The first pass (1/64th of the pixels) always completes so that the whole screen is covered. Later passes are split
+// into horizontal bands and the budget is checked between bands, so a partially refined image is returned.
+//
+// With temporal reprojection the passes are replaced by the reprojected previous image (see reprojectImage) where
+// possible, followed by a stride 1 pass over the pixels that it did not trace.
+bool Renderer::renderProgressive(std::chrono::duration<double> timeBudget)
+{
+    if (isProgressiveComplete())
+        return true;
+    bool reproject = false;
+    if (m_progressiveStride == progressiveStartStride && m_progressiveBlockRow == 0) {
+        if (m_pBrickPager)
+            m_brickGeneration = m_pBrickPager->loadedGeneration();
+        prepareSampleCache();
+        startProfile();
+        reproject = startTemporalImage();
+    }
+
+    using clock = std::chrono::steady_clock;
+    const auto deadline = clock::now() + std::chrono::duration_cast<clock::duration>(timeBudget);
+    visitFrameSampler([&](const auto& sampler) {
+        const FrameParameters frame = frameParameters();
+        const glm::ivec2 resolution = m_config.renderResolution;
+        // The reprojected image is complete, like the first pass; its refinement starts within the budget only.
+        if (reproject) {
+            reprojectImage(frame, sampler);
+            if (clock::now() >= deadline)
+                return;
+        }
+        while (!isProgressiveComplete()) {
+            const int stride = m_progressiveStride;
+            const bool firstPass = stride == progressiveStartStride;
+            const glm::ivec2 numBlocks = (resolution + stride - 1) / stride;
+            // Bands of roughly progressiveBandHeight pixel rows.
+            const int bandBlockRows = firstPass ? numBlocks.y : std::max(progressiveBandHeight / stride, 1);
+            const int blockRowEnd = std::min(m_progressiveBlockRow + bandBlockRows, numBlocks.y);
+
+            const tbb::blocked_range2d<int> blockRange { m_progressiveBlockRow, blockRowEnd, 0, numBlocks.x };
+            const auto traceBlocks = [&](const tbb::blocked_range2d<int>& localRange) {
+                // Trace the pixels of a block row in packets and fill their blocks.
+                PixelPacket pixels;
+                for (int blockY = std::begin(localRange.rows()); blockY != std::end(localRange.rows()); blockY++) {
+                    for (int blockX = std::begin(localRange.cols()); blockX != std::end(localRange.cols()); blockX++) {
+                        // Pixels at even block coordinates were traced by the previous pass. The refinement of a
+                        // reprojected image traces the pixels that were not traced for it yet.
+                        if (m_temporalRefinement ? m_temporalPixels[size_t(resolution.x) * size_t(blockY) + size_t(blockX)].age == 0 : !firstPass && blockX % 2 == 0 && blockY % 2 == 0)
+                            continue;
+
+                        pixels.coords[pixels.count++] = glm::ivec2(blockX, blockY) * stride;
+                        if (pixels.count == packetSize)
+                            traceBlockPacket(pixels, stride, frame, sampler);
+                    }
+                    if (pixels.count > 0)
+                        traceBlockPacket(pixels, stride, frame, sampler);
+                }
+            };
+            // The pixels that the blocks of a task cover are a tile of the profile.
+            const auto traceProfiledBlocks = [&](const tbb::blocked_range2d<int>& localRange) {
+                const ScreenRect tile {
+                    glm::ivec2(std::begin(localRange.cols()), std::begin(localRange.rows())) * stride,
+                    glm::min(glm::ivec2(std::end(localRange.cols()), std::end(localRange.rows())) * stride, resolution)
+                };
+                profileTile(tile, [&]() { traceBlocks(localRange); });
             };
-            // Write the resulting color to the screen.
-            fillColor(x, y, color);
+            volume::ExecutionPolicy::global().parallelFor(blockRange, traceProfiledBlocks);
 
-#if PARALLELISM == 1
+            m_progressiveBlockRow = blockRowEnd;
+            if (m_progressiveBlockRow == numBlocks.y) {
+                m_progressiveStride /= 2;
+                m_progressiveBlockRow = 0;
+            }
+            if (clock::now() >= deadline)
+                break;
         }
+    });
+    collectThreadProfiles();
+    return isProgressiveComplete();
+}
+
+// Trace a packet of the pixels of a progressive pass, fill the stride x stride block below and to the right of every
+// pixel with its color and empty the packet. The traced pixels become part of the temporal history (see
+// startTemporalImage); the rest of their blocks are only copies and do not.
+template <typename Sampler>
+void Renderer::traceBlockPacket(PixelPacket& pixels, int stride, const FrameParameters& frame, const Sampler& sampler)
+{
+    const glm::ivec2 resolution = m_config.renderResolution;
+    const ColorPacket colors = tracePixelPacket(pixels, frame, sampler);
+    for (size_t i = 0; i < pixels.count; i++) {
+        const glm::ivec2 pixel = pixels.coords[i];
+        const glm::ivec2 blockEnd = glm::min(pixel + stride, resolution);
+        for (int y = pixel.y; y < blockEnd.y; y++) {
+            for (int x = pixel.x; x < blockEnd.x; x++)
+                fillColor(x, y, colors[i]);
+        }
+        if (m_temporalImage)
+            m_temporalPixels[size_t(resolution.x) * size_t(pixel.y) + size_t(pixel.x)] = tracedTemporalPixel(pixel, frame, sampler);
     }
-});
-#else
+    pixels.count = 0;
+}
+
+// Decide at the start of a progressive image whether it is reprojected from the previous image (see
+// RenderConfig::temporalReprojection). That requires a pinhole camera and a previous image with the same resolution
+// and the same settings apart from the sampling, whose change only makes the colors of the previous image less
+// accurate until they are traced again. Otherwise the temporal history of the new image starts out empty.
+bool Renderer::startTemporalImage()
+{
+    m_temporalRefinement = false;
+    m_temporalImage = m_config.temporalReprojection;
+    if (!m_temporalImage) {
+        m_optTemporalGeneration.reset();
+        return false;
+    }
+
+    const bool reproject = m_optTemporalGeneration
+        && !changedSince(*m_optTemporalGeneration, { RenderConfigSection::Mode, RenderConfigSection::Resolution, RenderConfigSection::Compositing, RenderConfigSection::IsoValue, RenderConfigSection::TransferFunction, RenderConfigSection::TransferFunction2D })
+        && fitPinholeCamera(*m_pCamera).has_value();
+    m_optTemporalGeneration = m_configGeneration;
+    if (!reproject) {
+        m_temporalPixels.resize(m_frameBuffer.size());
+        std::fill(std::begin(m_temporalPixels), std::end(m_temporalPixels), TemporalPixel { glm::vec3(0.0f), temporalMaxAge, false });
+    }
+    return reproject;
+}
+
+// Build the image from the previous image: every pixel of the previous image that has a position is projected onto the
+// new camera and the pixel that it lands on takes its color, the closest position winning where several land on the
+// same pixel. The pixels that no position lands on (disocclusions and magnified regions) are traced, and so are the
+// pixels that are much further away than the neighbours on both sides (a background that shows through a crack in a
+// foreground surface), the pixels that have been reprojected for temporalMaxAge images and a rotating subset of one in
+// 16 pixels, so that every pixel is traced again regularly while the camera keeps moving. The reprojected pixels are traced by the refinement
+// (a stride 1 pass over the pixels that were not traced yet) that renderProgressive continues with.
+template <typename Sampler>
+void Renderer::reprojectImage(const FrameParameters& frame, const Sampler& sampler)
+{
+    const glm::ivec2 resolution = m_config.renderResolution;
+    const size_t numPixels = m_frameBuffer.size();
+    std::swap(m_frameBuffer, m_previousFrameBuffer);
+    std::swap(m_temporalPixels, m_previousTemporalPixels);
+    m_frameBuffer.resize(numPixels);
+    m_temporalPixels.resize(numPixels);
+    // The depth along the forward axis (a positive float, whose bits compare like the float itself) in the high half
+    // and the previous pixel in the low half, so the smallest target per pixel is the closest position.
+    static constexpr uint64_t noTarget = std::numeric_limits<uint64_t>::max();
+    m_reprojectionTargets.resize(numPixels);
+    std::fill(std::begin(m_reprojectionTargets), std::end(m_reprojectionTargets), noTarget);
+    const auto targetDepth = [](uint64_t target) { return std::bit_cast<float>(static_cast<uint32_t>(target >> 32)); };
+
+    const PinholeCamera camera = *frame.optPinhole;
+    const glm::vec2 halfResolution = glm::vec2(resolution) / 2.0f;
+    const auto splatRows = [&](const tbb::blocked_range<int>& rows) {
+        for (int y = std::begin(rows); y != std::end(rows); y++) {
+            for (int x = 0; x < resolution.x; x++) {
+                const size_t previous = size_t(resolution.x) * size_t(y) + size_t(x);
+                const TemporalPixel& pixel = m_previousTemporalPixels[previous];
+                if (!pixel.hasPosition || pixel.age >= temporalMaxAge)
+                    continue;
+
+                // The inverse of the mapping in tracePixel (see also visibleScreenRect).
+                const glm::vec3 toPosition = pixel.position - camera.origin;
+                const float depth = glm::dot(toPosition, camera.forward);
+                if (!(depth > 0.0f))
+                    continue;
+                const glm::vec3 offset = toPosition / depth - camera.forward;
+                const glm::vec2 ndc { glm::dot(offset, camera.right) / glm::dot(camera.right, camera.right), glm::dot(offset, camera.up) / glm::dot(camera.up, camera.up) };
+                const glm::ivec2 target = glm::ivec2(glm::floor((ndc + 1.0f) * halfResolution + 0.5f));
+                if (glm::any(glm::lessThan(target, glm::ivec2(0))) || glm::any(glm::greaterThanEqual(target, resolution)))
+                    continue;
+
+                const uint64_t key = uint64_t(std::bit_cast<uint32_t>(depth)) << 32 | previous;
+                std::atomic_ref<uint64_t> closest { m_reprojectionTargets[size_t(resolution.x) * size_t(target.y) + size_t(target.x)] };
+                uint64_t current = closest.load(std::memory_order_relaxed);
+                while (key < current && !closest.compare_exchange_weak(current, key, std::memory_order_relaxed)) { }
+            }
+        }
+    };
+
+    // Index in the 4 x 4 ordered dither (Bayer) matrix of the pixels that are traced again in this image.
+    static constexpr std::array<int, 16> refreshOrder { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+    const int refreshIndex = int(m_temporalFrame++ % refreshOrder.size());
+    const auto resolveRows = [&](const tbb::blocked_range<int>& rows) {
+        for (int y = std::begin(rows); y != std::end(rows); y++) {
+            for (int x = 0; x < resolution.x; x++) {
+                const size_t index = size_t(resolution.x) * size_t(y) + size_t(x);
+                const uint64_t target = m_reprojectionTargets[index];
+                if (target == noTarget) {
+                    // Pixels whose ray misses the volume are black, which is cheap to find out.
+                    Ray ray = pixelRay(glm::ivec2(x, y), frame);
+                    const bool missed = !clipRay(ray, frame);
+                    m_frameBuffer[index] = glm::vec4(0.0f);
+                    m_temporalPixels[index] = TemporalPixel { glm::vec3(0.0f), missed ? uint8_t(0) : temporalMaxAge, false };
+                    continue;
+                }
+
+                const size_t previous = target & 0xFFFFFFFFu;
+                m_frameBuffer[index] = m_previousFrameBuffer[previous];
+                TemporalPixel& pixel = m_temporalPixels[index];
+                pixel = m_previousTemporalPixels[previous];
+                pixel.age++;
+
+                const float depth = targetDepth(target);
+                const auto occludedBy = [&](int neighbourX, int neighbourY) {
+                    if (neighbourX < 0 || neighbourY < 0 || neighbourX >= resolution.x || neighbourY >= resolution.y)
+                        return false;
+                    const uint64_t neighbour = m_reprojectionTargets[size_t(resolution.x) * size_t(neighbourY) + size_t(neighbourX)];
+                    return neighbour != noTarget && targetDepth(neighbour) < depth - temporalDepthTolerance;
+                };
+                const bool crack = (occludedBy(x - 1, y) && occludedBy(x + 1, y)) || (occludedBy(x, y - 1) && occludedBy(x, y + 1));
+                if (crack || refreshOrder[size_t((y & 3) * 4 + (x & 3))] == refreshIndex)
+                    pixel.age = temporalMaxAge;
             }
         }
-#endif
+    };
+
+    // Trace the pixels that are due (see above) in packets along the rows.
+    const auto traceRows = [&](const tbb::blocked_range<int>& rows) {
+        const ScreenRect tile { glm::ivec2(0, std::begin(rows)), glm::ivec2(resolution.x, std::end(rows)) };
+        profileTile(tile, [&]() {
+            PixelPacket pixels;
+            for (int y = std::begin(rows); y != std::end(rows); y++) {
+                for (int x = 0; x < resolution.x; x++) {
+                    if (m_temporalPixels[size_t(resolution.x) * size_t(y) + size_t(x)].age < temporalMaxAge)
+                        continue;
+                    pixels.coords[pixels.count++] = glm::ivec2(x, y);
+                    if (pixels.count == packetSize)
+                        traceBlockPacket(pixels, 1, frame, sampler);
+                }
+                if (pixels.count > 0)
+                    traceBlockPacket(pixels, 1, frame, sampler);
+            }
+        });
+    };
+
+    const tbb::blocked_range<int> rows { 0, resolution.y };
+    const volume::ExecutionPolicy& policy = volume::ExecutionPolicy::global();
+    policy.parallelFor(rows, splatRows);
+    policy.parallelFor(rows, resolveRows);
+    policy.parallelFor(tbb::blocked_range<int> { 0, resolution.y, progressiveBandHeight }, traceRows);
+
+    m_temporalRefinement = true;
+    m_progressiveStride = 1;
+    m_progressiveBlockRow = 0;
+}
+
+// The temporal history of a pixel that is traced for the current image: the position of the first sample along its ray
+// that contributes to the image (see reprojectionDepth), which is where its color moves to with the camera.
+template <typename Sampler>
+Renderer::TemporalPixel Renderer::tracedTemporalPixel(const glm::ivec2& pixel, const FrameParameters& frame, const Sampler& sampler) const
+{
+    Ray ray = pixelRay(pixel, frame);
+    // Rays that miss the volume are black, which is cheap to find out again.
+    if (!clipRay(ray, frame))
+        return TemporalPixel { glm::vec3(0.0f), 0, false };
+    const float t = reprojectionDepth(ray, frame, sampler);
+    return TemporalPixel { ray.origin + t * ray.direction, 0, true };
+}
+
+// Ray parameter of the first sample that contributes to the pixel in the current render mode: the first sample that
+// the transfer function does not map to transparent, the first sample on or above the iso value, the first non-zero
+// sample of a maximum intensity projection and the slice plane of the slicer. It is found by walking the ray with
+// empty space skipping (with the macro cells even if the render config disables skipping). Transparent rays take the
+// position where they exit the volume.
+template <typename Sampler>
+float Renderer::reprojectionDepth(const Ray& ray, const FrameParameters& frame, const Sampler& sampler) const
+{
+    const auto transparent = [&](float minValue, float maxValue) {
+        switch (m_config.renderMode) {
+        case RenderMode::RenderMIP:
+            return maxValue <= 0.0f;
+        case RenderMode::RenderIso:
+            return maxValue < m_config.isoValue;
+        case RenderMode::RenderComposite:
+            return isTFTransparent(minValue, maxValue);
+        case RenderMode::RenderTF2D:
+        case RenderMode::RenderTF2DV2:
+            return isTF2DTransparent(minValue, maxValue);
+        default:
+            return false;
+        }
+    };
+    if (m_config.renderMode == RenderMode::RenderSlicer) {
+        const float t = glm::dot(frame.volumeCenter - ray.origin, frame.planeNormal) / glm::dot(ray.direction, frame.planeNormal);
+        return std::isfinite(t) ? std::clamp(t, ray.tmin, ray.tmax) : ray.tmin;
+    }
+
+    const float sampleStep = frame.sampleStep;
+    const float overshoot = volume::MacroCellGrid::interpolationOvershoot(m_pVolume->interpolationMode);
+    EmptySpaceSkipper skipper { &m_macroCellGrid, overshoot, ray.origin, ray.direction, ray.tmin, sampleStep };
+    for (float t = ray.tmin; t <= ray.tmax; t += sampleStep) {
+        t = skipper.nextSample(t, transparent);
+        if (t > ray.tmax)
+            break;
+        const float value = sampler(ray.origin + t * ray.direction);
+        if (!transparent(value, value))
+            return t;
+    }
+    return ray.tmax;
 }
 
 // ======= DO NOT MODIFY THIS FUNCTION ========
@@ -150,25 +1100,62 @@ glm::vec4 Renderer::traceRaySlice(const Ray& ray, const glm::vec3& volumeCenter,
     return glm::vec4(glm::vec3(std::max(val / m_pVolume->maximum(), 0.0f)), 1.f);
 }
 
-// ======= DO NOT MODIFY THIS FUNCTION ========
 // Function that implements maximum-intensity-projection (MIP) raycasting.
 // It returns the color assigned to a ray/pixel given it's origin, direction and the distances
 // at which it enters/exits the volume (ray.tmin & ray.tmax respectively).
 // The ray must be sampled with a distance defined by the sampleStep
+// Macro cells whose maximum does not exceed the maximum found so far are skipped.
 glm::vec4 Renderer::traceRayMIP(const Ray& ray, float sampleStep) const
+{
+    return m_pVolume->visitSampler([&](const auto& sampler) { return traceRayMIP(ray, sampleStep, sampler); });
+}
+
+template <typename Sampler>
+glm::vec4 Renderer::traceRayMIP(const Ray& ray, float sampleStep, const Sampler& sampler) const
 {
     float maxVal = 0.0f;
+    EmptySpaceSkipper skipper = createSkipper(ray, ray.tmin, sampleStep);
+    const auto cannotExceedMax = [&](float, float cellMax) { return cellMax <= maxVal; };
+    RenderStatistics& statistics = threadRenderStatistics();
 
     // Incrementing samplePos directly instead of recomputing it each frame gives a measureable speed-up.
     glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
     const glm::vec3 increment = sampleStep * ray.direction;
     for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, samplePos += increment) {
-        const float val = m_pVolume->getVoxelInterpolate(samplePos);
+        skipper.skip(t, samplePos, cannotExceedMax);
+        if (t > ray.tmax)
+            break;
+
+        const float val = sampler(samplePos);
+        statistics.samples++;
         maxVal = std::max(val, maxVal);
     }
 
     // Normalize the result to a range of [0 to mpVolume->maximum()].
-    return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
+    return glm::vec4(glm::vec3(maxVal) / volumeMaximum(), 1.0f);
+}
+
+// Packet version of traceRayMIP.
+template <typename Sampler>
+Renderer::ColorPacket Renderer::traceRayMIPPacket(const RayPacket& rays, const LaneMask& active, float sampleStep, const Sampler& sampler) const
+{
+    std::array<float, packetSize> tStart, maxVal;
+    for (size_t i = 0; i < packetSize; i++) {
+        tStart[i] = rays[i].tmin;
+        maxVal[i] = 0.0f;
+    }
+    marchPacket(
+        rays, active, tStart, sampleStep, sampler,
+        [&](size_t i, float, float cellMax) { return cellMax <= maxVal[i]; },
+        [&](size_t i, float value, float, const glm::vec3&) {
+            maxVal[i] = std::max(value, maxVal[i]);
+            return true;
+        });
+
+    ColorPacket colors;
+    for (size_t i = 0; i < packetSize; i++)
+        colors[i] = active[i] ? glm::vec4(glm::vec3(maxVal[i]) / volumeMaximum(), 1.0f) : glm::vec4(0.0f);
+    return colors;
 }
 
 // This function should find the position where the ray intersects with the volume's isosurface.
@@ -176,50 +1163,104 @@ glm::vec4 Renderer::traceRayMIP(const Ray& ray, float sampleStep) const
 // If volume shading is ENABLED then return the phong-shaded color at that location using the local gradient (from m_pGradientVolume).
 //   Use the camera position (m_pCamera->position()) as the light position.
 // Use the bisectionAccuracy function (to be implemented) to get a more precise isosurface location between two steps.
+// Macro cells that lie completely below the iso value are skipped. The surface location is refined with secantAccuracy,
+// which converges in a few samples where bisection needs tens (except for nearest neighbour sampling).
 glm::vec4 Renderer::traceRayISO(const Ray& ray, float sampleStep) const
 {
-    glm::vec4 color(0.0f);
-    if (!this->m_config.volumeShading) {
-        glm::vec3 sample_pos = ray.origin + ray.tmin * ray.direction;
-        const glm::vec3 increment = sampleStep * ray.direction;
+    return m_pVolume->visitSampler([&](const auto& sampler) { return traceRayISO(ray, sampleStep, sampler); });
+}
 
-        for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, sample_pos += increment) {
-            auto voxel_value = this->m_pVolume->getVoxelInterpolate(sample_pos);
-            if (voxel_value > this->m_config.isoValue) {
-                // color = this->getTFValue(voxel_value);
-                color = glm::vec4 { 0.8f, 0.8f, 0.2f, 1.0f };
-                break;
-            }
-        }
-    } else {
+template <typename Sampler>
+glm::vec4 Renderer::traceRayISO(const Ray& ray, float sampleStep, const Sampler& sampler) const
+{
+    EmptySpaceSkipper skipper = createSkipper(ray, ray.tmin, sampleStep);
+    const auto belowIsoValue = [&](float, float cellMax) { return cellMax <= m_config.isoValue; };
+    RenderStatistics& statistics = threadRenderStatistics();
 
-        glm::vec3 sample_pos = ray.origin + ray.tmin * ray.direction;
-        const glm::vec3 increment = sampleStep * ray.direction;
-        bool atLeastTwoSteps = false;
-
-        for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, sample_pos += increment) {
-            auto voxel_value = this->m_pVolume->getVoxelInterpolate(sample_pos);
-            if (voxel_value > this->m_config.isoValue) {
-                if (atLeastTwoSteps) {
-                    t = this->bisectionAccuracy(ray, t - sampleStep, t, this->m_config.isoValue);
-                    sample_pos = ray.origin + ray.direction * t;
-                }
-                auto _color = glm::vec4 { 0.8f, 0.8f, 0.2f, 1.0f };
-                auto gradient = this->m_pGradientVolume->getGradientVoxel(sample_pos);
-                color = glm::vec4(this->computePhongShading(_color, gradient, this->m_pCamera->position(), ray.direction), 1.0f);
-                break;
+    glm::vec3 sample_pos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = sampleStep * ray.direction;
+    bool atLeastTwoSteps = false;
+
+    for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, sample_pos += increment) {
+        // The sample before a skipped cell is below the iso value as well so bisection stays valid.
+        skipper.skip(t, sample_pos, belowIsoValue);
+        if (t > ray.tmax)
+            break;
+
+        auto voxel_value = sampler(sample_pos);
+        statistics.samples++;
+        if (voxel_value > this->m_config.isoValue)
+            return isoSurfaceColor(ray, sampleStep, t, sample_pos, voxel_value, atLeastTwoSteps, sampler);
+        atLeastTwoSteps = true;
+    }
+
+    return glm::vec4(0.0f);
+}
+
+// Packet version of traceRayISO. Lanes that hit the iso surface are shaded individually.
+template <typename Sampler>
+Renderer::ColorPacket Renderer::traceRayISOPacket(const RayPacket& rays, const LaneMask& active, float sampleStep, const Sampler& sampler) const
+{
+    ColorPacket colors;
+    std::array<float, packetSize> tStart;
+    std::array<bool, packetSize> atLeastTwoSteps;
+    for (size_t i = 0; i < packetSize; i++) {
+        colors[i] = glm::vec4(0.0f);
+        tStart[i] = rays[i].tmin;
+        atLeastTwoSteps[i] = false;
+    }
+    marchPacket(
+        rays, active, tStart, sampleStep, sampler,
+        [&](size_t, float, float cellMax) { return cellMax <= m_config.isoValue; },
+        [&](size_t i, float value, float t, const glm::vec3& samplePos) {
+            if (value > m_config.isoValue) {
+                colors[i] = isoSurfaceColor(rays[i], sampleStep, t, samplePos, value, atLeastTwoSteps[i], sampler);
+                return false;
             }
-            atLeastTwoSteps = true;
+            atLeastTwoSteps[i] = true;
+            return true;
+        });
+    return colors;
+}
+
+// Color of the iso surface that the ray crosses between t - sampleStep and t (samplePos, where the volume has the given
+// value). If volume shading is enabled the location is refined when the ray took a sample before t (refine) and the
+// surface is phong shaded.
+template <typename Sampler>
+glm::vec4 Renderer::isoSurfaceColor(const Ray& ray, float sampleStep, float t, glm::vec3 samplePos, float value, bool refine, const Sampler& sampler) const
+{
+    const glm::vec4 isoColor { 0.8f, 0.8f, 0.2f, 1.0f };
+    if (!this->m_config.volumeShading)
+        return isoColor;
+
+    if (refine) {
+        // Regula falsi assumes a continuous volume; nearest neighbour sampling jumps at voxel boundaries.
+        const float t0 = t - sampleStep;
+        if constexpr (Sampler::interpolationMode == volume::InterpolationMode::NearestNeighbour) {
+            t = this->bisectionAccuracy(ray, t0, t, this->m_config.isoValue, sampler);
+        } else {
+            // The previous sample may lie in a skipped macro cell, so its value is not known to the caller.
+            const float v0 = sampler(ray.origin + t0 * ray.direction);
+            threadRenderStatistics().samples++;
+            t = this->secantAccuracy(ray, t0, t, v0, value, this->m_config.isoValue, sampler);
         }
+        samplePos = ray.origin + ray.direction * t;
     }
-
-    return color;
+    threadRenderStatistics().shadedSamples++;
+    auto gradient = sampleGradient(samplePos, sampler);
+    return glm::vec4(createShader(ray.direction).shade(glm::vec3(isoColor), gradient), 1.0f);
 }
 
 // Given that the iso value lies somewhere between t0 and t1, find a t for which the value
 // closely matches the iso value (less than 0.01 difference). Add a limit to the number of
 // iterations such that it does not get stuck in degerate cases.
 float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoValue) const
+{
+    return m_pVolume->visitSampler([&](const auto& sampler) { return bisectionAccuracy(ray, t0, t1, isoValue, sampler); });
+}
+
+template <typename Sampler>
+float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoValue, const Sampler& sampler) const
 {
 
     int maxIterations = 500;
@@ -231,9 +1272,13 @@ float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoV
 
         maxIterations--;
         tMiddle = (t0 + t1) / 2;
+        // The interval cannot shrink any further in floating point, so the remaining iterations would not change tMiddle.
+        if (tMiddle == t0 || tMiddle == t1)
+            return tMiddle;
 
         glm::vec3 middle = ray.origin + tMiddle * ray.direction;
-        float voxelValue = this->m_pVolume->getVoxelInterpolate(middle);
+        float voxelValue = sampler(middle);
+        threadRenderStatistics().refinementIterations++;
 
         if (std::abs(voxelValue - isoValue) < minDifference) {
             return tMiddle;
@@ -247,62 +1292,552 @@ float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoV
     return tMiddle;
 }
 
+// Same as bisectionAccuracy, but with regula falsi: each iteration samples where the line between the two end points
+// crosses the iso value. The Illinois modification halves the value of an end point that is kept twice in a row, which
+// keeps the interval shrinking from both sides. The iteration count is bounded because the end points are known to
+// bracket the iso value: v0 (at t0) is below or at the iso value and v1 (at t1) above it.
+float Renderer::secantAccuracy(const Ray& ray, float t0, float t1, float isoValue) const
+{
+    return m_pVolume->visitSampler([&](const auto& sampler) {
+        const float v0 = sampler(ray.origin + t0 * ray.direction);
+        const float v1 = sampler(ray.origin + t1 * ray.direction);
+        return secantAccuracy(ray, t0, t1, v0, v1, isoValue, sampler);
+    });
+}
+
+template <typename Sampler>
+float Renderer::secantAccuracy(const Ray& ray, float t0, float t1, float v0, float v1, float isoValue, const Sampler& sampler) const
+{
+    const int maxIterations = 8;
+    const float minDifference = 0.0001f;
+
+    float f0 = v0 - isoValue;
+    float f1 = v1 - isoValue;
+    float t = t1;
+    int keptSide = 0;
+    for (int i = 0; i < maxIterations && f1 - f0 > 0.0f; i++) {
+        t = t1 - f1 * (t1 - t0) / (f1 - f0);
+
+        const float f = sampler(ray.origin + t * ray.direction) - isoValue;
+        threadRenderStatistics().refinementIterations++;
+        if (std::abs(f) < minDifference)
+            return t;
+
+        if (f < 0.0f) {
+            t0 = t;
+            f0 = f;
+            if (keptSide == 1)
+                f1 *= 0.5f;
+            keptSide = 1;
+        } else {
+            t1 = t;
+            f1 = f;
+            if (keptSide == -1)
+                f0 *= 0.5f;
+            keptSide = -1;
+        }
+    }
+
+    return t;
+}
+
 // In this function, implement 1D transfer function raycasting.
 // Use getTFValue to compute the color for a given volume value according to the 1D transfer function.
 glm::vec4 Renderer::traceRayComposite(const Ray& ray, float sampleStep) const
 {
-    return this->backToFrontComposite(ray, sampleStep);
+    return m_pVolume->visitSampler([&](const auto& sampler) { return traceRayComposite(ray, sampleStep, sampler); });
+}
+
+template <typename Sampler>
+glm::vec4 Renderer::traceRayComposite(const Ray& ray, float sampleStep, const Sampler& sampler) const
+{
+    if (m_config.preIntegratedTF)
+        return preIntegratedCompositing(ray, sampleStep, sampler);
+
+    const PhongShader shader = createShader(ray.direction);
+    const auto classify = [&](const glm::vec3& samplePos) { return classifyTF(samplePos, shader, sampler); };
+    const auto transparent = [&](float cellMin, float cellMax) { return isTFTransparent(cellMin, cellMax); };
+    return composite(ray, sampleStep, classify, transparent);
+}
+
+// Packet version of traceRayComposite with front-to-back compositing (see frontToBackCompositing).
+template <typename Sampler>
+Renderer::ColorPacket Renderer::traceRayCompositePacket(const RayPacket& rays, const LaneMask& active, float sampleStep, const Sampler& sampler) const
+{
+    std::array<float, packetSize> tStart, opacity;
+    std::array<glm::vec3, packetSize> color;
+    for (size_t i = 0; i < packetSize; i++) {
+        tStart[i] = rays[i].tmax - std::floor((rays[i].tmax - rays[i].tmin) / sampleStep) * sampleStep;
+        opacity[i] = 0.0f;
+        color[i] = glm::vec3(0.0f);
+    }
+    const auto shaders = [&]<size_t... I>(std::index_sequence<I...>) {
+        return std::array<PhongShader, packetSize> { createShader(rays[I].direction)... };
+    }(std::make_index_sequence<packetSize>());
+    marchPacket(
+        rays, active, tStart, sampleStep, sampler,
+        [&](size_t, float cellMin, float cellMax) { return isTFTransparent(cellMin, cellMax); },
+        [&](size_t i, float value, float, const glm::vec3& samplePos) {
+            const glm::vec4 sample = classifyTFValue(value, samplePos, shaders[i], sampler);
+            const float weight = (1 - opacity[i]) * correctOpacity(sample.a, sampleStep);
+            color[i] += weight * glm::vec3(sample);
+            opacity[i] += weight;
+            if (opacity[i] < m_config.earlyRayTerminationThreshold)
+                return true;
+            threadRenderStatistics().earlyTerminations++;
+            return false;
+        });
+
+    ColorPacket colors;
+    for (size_t i = 0; i < packetSize; i++)
+        colors[i] = active[i] ? compositedColor(color[i], opacity[i]) : glm::vec4(0.0f);
+    return colors;
 }
 
 /**
- * Applies back to front compositing and returns the color composed
+ * Front to back compositing of the ray segments between successive samples with the pre-integrated transfer function
+ * (see PreIntegrationTable), which is baked for segments of sampleStep.
+ * The first sample and the first sample after skipped empty space have no segment in front of them; they are
+ * composited as a segment of constant value.
  *  @param ray: ray throught the volume
  *  @param sampleStep: step along the ray
+ *  @param sampler: samples the volume
  *  @return: resulting color
  */
-glm::vec4 Renderer::backToFrontComposite(const Ray& ray, float sampleStep) const
+template <typename Sampler>
+glm::vec4 Renderer::preIntegratedCompositing(const Ray& ray, float sampleStep, const Sampler& sampler) const
 {
-    glm::vec3 samplePos = ray.origin + ray.tmax * ray.direction;
+    const float tStart = ray.tmax - std::floor((ray.tmax - ray.tmin) / sampleStep) * sampleStep;
+    glm::vec3 samplePos = ray.origin + tStart * ray.direction;
     const glm::vec3 increment = sampleStep * ray.direction;
+    EmptySpaceSkipper skipper = createSkipper(ray, tStart, sampleStep);
+    const auto transparent = [&](float cellMin, float cellMax) { return isTFTransparent(cellMin, cellMax); };
 
     glm::vec3 color(0.0f);
+    float opacity = 0.0f;
+    std::optional<size_t> previousIndex;
+    const PhongShader shader = createShader(ray.direction);
+    RenderStatistics& statistics = threadRenderStatistics();
+
+    for (float t = tStart; t <= ray.tmax; t += sampleStep, samplePos += increment) {
+        const float tBeforeSkip = t;
+        skipper.skip(t, samplePos, transparent);
+        if (t > ray.tmax)
+            break;
+        if (t != tBeforeSkip)
+            previousIndex.reset();
+
+        const size_t index = tfIndex(sampler(samplePos));
+        statistics.samples++;
+        glm::vec4 segment = m_preIntegrationTable.lookup(previousIndex.value_or(index), index);
+        previousIndex = index;
+        if (segment.a <= 0.0f)
+            continue;
+        if (m_config.volumeShading) {
+            const auto gradient = sampleGradient(samplePos, sampler);
+            segment = glm::vec4(shader.shade(glm::vec3(segment), gradient), segment.a);
+            statistics.shadedSamples++;
+        }
 
-    for (float t = ray.tmax; t >= ray.tmin; t -= sampleStep, samplePos -= increment) {
-        glm::vec4 tf_value = this->getTFValue(this->m_pVolume->getVoxelInterpolate(samplePos));
-        glm::vec3 current_color = glm::vec3(tf_value);
-        if (this->m_config.volumeShading) {
-            auto gradient = this->m_pGradientVolume->getGradientVoxel(samplePos);
-            current_color = computePhongShading(current_color, gradient, this->m_pCamera->position(), ray.direction);
+        const float weight = (1 - opacity) * segment.a;
+        color += weight * glm::vec3(segment);
+        opacity += weight;
+        if (opacity >= m_config.earlyRayTerminationThreshold) {
+            statistics.earlyTerminations++;
+            break;
         }
-        color = tf_value[3] * current_color + (1 - tf_value[3]) * color;
     }
 
-    return glm::vec4(color, 1);
+    return compositedColor(color, opacity);
 }
 
-// In this function, implement 2D transfer function raycasting.
-// Use the getTF2DOpacity function that you implemented to compute the opacity according to the 2D transfer function.
-glm::vec4 Renderer::traceRayTF2D(const Ray& ray, float sampleStep) const
+// Decide at the start of an image whether it is composited from the sample cache (see RenderConfig::sampleCache).
+// The samples only depend on the camera and the ray sampling settings. The cache is (re)started when an image has the
+// same of those as the previous image, which means that only the transfer functions or the shading changed; while the
+// camera moves no samples are recorded.
+void Renderer::prepareSampleCache()
+{
+    const RenderMode mode = m_config.renderMode;
+    const bool cacheable = m_config.sampleCache && !m_config.adaptiveSampleStep
+        && (mode == RenderMode::RenderTF2D || mode == RenderMode::RenderTF2DV2 || (mode == RenderMode::RenderComposite && !m_config.preIntegratedTF));
+    if (!cacheable) {
+        m_sampleCacheActive = false;
+        m_optSampleCacheKey.reset();
+        m_sampleCache.clear();
+        return;
+    }
+
+    const SampleCacheKey key {
+        m_configGeneration,
+        m_pVolume->interpolationMode,
+        m_config.shadingModel,
+        { m_pCamera->position(), m_pCamera->forward(), m_pCamera->generateRay(glm::vec2(-1.0f)).direction, m_pCamera->generateRay(glm::vec2(1.0f)).direction }
+    };
+    const bool sameSamples = m_optSampleCacheKey
+        && !changedSince(m_optSampleCacheKey->configGeneration, { RenderConfigSection::Resolution, RenderConfigSection::Sampling })
+        && m_optSampleCacheKey->interpolationMode == key.interpolationMode
+        && m_optSampleCacheKey->shadingModel == key.shadingModel
+        && m_optSampleCacheKey->camera == key.camera;
+    if (sameSamples) {
+        if (!m_sampleCacheActive) {
+            const size_t numPixels = size_t(m_config.renderResolution.x) * size_t(m_config.renderResolution.y);
+            m_sampleCache.reset(numPixels, size_t(std::max(m_config.sampleCacheMegabytes, 0)) << 20);
+            m_sampleCacheActive = true;
+        }
+    } else {
+        m_sampleCacheActive = false;
+        m_sampleCache.clear();
+    }
+    m_optSampleCacheKey = key;
+}
+
+// Composite pixel from its cached samples. Pixels that are not in the cache yet are sampled (without empty space
+// skipping or early ray termination, which depend on the transfer function) and recorded.
+template <typename Sampler>
+glm::vec4 Renderer::traceCachedPixel(const glm::ivec2& pixel, const FrameParameters& frame, const Sampler& sampler) const
+{
+    const size_t pixelIndex = size_t(m_config.renderResolution.x) * size_t(pixel.y) + size_t(pixel.x);
+    RenderStatistics& statistics = threadRenderStatistics();
+    statistics.raysCast++;
+    if (m_sampleCache.isRecorded(pixelIndex))
+        return compositeCachedSamples(m_sampleCache.samples(pixelIndex), frame.sampleStep);
+
+    Ray ray = pixelRay(pixel, frame);
+    const PhongShader shader = createShader(ray.direction);
+    std::vector<SampleRun>& samples = m_sampleCache.scratch();
+    const auto addSample = [&](const glm::vec3& samplePos) {
+        const auto gradient = sampleGradient(samplePos, sampler);
+        const SampleRun sample {
+            sampler(samplePos),
+            gradient.magnitude,
+            shader.factor(gradient),
+            1
+        };
+        statistics.samples++;
+        statistics.shadedSamples++;
+        if (!samples.empty() && samples.back().value == sample.value && samples.back().gradientMagnitude == sample.gradientMagnitude && samples.back().shading == sample.shading)
+            samples.back().count++;
+        else
+            samples.push_back(sample);
+    };
+    if (clipRay(ray, frame)) {
+        // Take the same samples as frontToBackCompositing or backToFrontComposite (stored front to back).
+        const float sampleStep = frame.sampleStep;
+        const glm::vec3 increment = sampleStep * ray.direction;
+        if (m_config.frontToBackCompositing) {
+            const float tStart = ray.tmax - std::floor((ray.tmax - ray.tmin) / sampleStep) * sampleStep;
+            glm::vec3 samplePos = ray.origin + tStart * ray.direction;
+            for (float t = tStart; t <= ray.tmax; t += sampleStep, samplePos += increment)
+                addSample(samplePos);
+        } else {
+            glm::vec3 samplePos = ray.origin + ray.tmax * ray.direction;
+            for (float t = ray.tmax; t >= ray.tmin; t -= sampleStep, samplePos -= increment)
+                addSample(samplePos);
+            std::reverse(std::begin(samples), std::end(samples));
+        }
+    } else {
+        statistics.raysMissed++;
+    }
+
+    const glm::vec4 color = compositeCachedSamples(samples, frame.sampleStep);
+    m_sampleCache.record(pixelIndex, samples);
+    return color;
+}
+
+// Composite the cached samples of a ray in the order selected in the render config.
+// This gives the same result as tracing the ray again; rays that missed the volume have no samples.
+glm::vec4 Renderer::compositeCachedSamples(gsl::span<const SampleRun> samples, float sampleStep) const
+{
+    if (samples.empty())
+        return glm::vec4(0.0f);
+
+    const RenderMode mode = m_config.renderMode;
+    const auto classify = [&](const SampleRun& sample) {
+        glm::vec4 tfValue = mode == RenderMode::RenderComposite ? getTFValue(sample.value) : m_tf2DTable.lookup(sample.value, sample.gradientMagnitude);
+        if (tfValue.a > 0.0f && m_config.volumeShading && mode != RenderMode::RenderTF2DV2)
+            tfValue = glm::vec4(sample.shading * glm::vec3(tfValue), tfValue.a);
+        tfValue.a = correctOpacity(tfValue.a, sampleStep);
+        return tfValue;
+    };
+
+    glm::vec3 color(0.0f);
+    float opacity = 0.0f;
+    if (m_config.frontToBackCompositing) {
+        for (const SampleRun& run : samples) {
+            const glm::vec4 sample = classify(run);
+            if (sample.a <= 0.0f)
+                continue;
+            for (uint32_t i = 0; i < run.count; i++) {
+                const float weight = (1 - opacity) * sample.a;
+                color += weight * glm::vec3(sample);
+                opacity += weight;
+                if (opacity >= m_config.earlyRayTerminationThreshold) {
+                    threadRenderStatistics().earlyTerminations++;
+                    return compositedColor(color, opacity);
+                }
+            }
+        }
+    } else {
+        for (auto run = std::rbegin(samples); run != std::rend(samples); run++) {
+            const glm::vec4 sample = classify(*run);
+            for (uint32_t i = 0; i < run->count; i++) {
+                color = sample.a * glm::vec3(sample) + (1 - sample.a) * color;
+                opacity = sample.a + (1 - sample.a) * opacity;
+            }
+        }
+    }
+    return compositedColor(color, opacity);
+}
+
+// Composite the ray in the order selected in the render config.
+// classify(samplePos) returns the (non pre-multiplied) color and opacity of a sample.
+// transparent(minValue, maxValue) returns whether every value in the range is classified as fully transparent.
+template <typename Classify, typename Transparent>
+glm::vec4 Renderer::composite(const Ray& ray, float sampleStep, Classify&& classify, Transparent&& transparent) const
+{
+    if (m_config.adaptiveSampleStep)
+        return adaptiveFrontToBackCompositing(ray, sampleStep, classify, transparent);
+    else if (m_config.frontToBackCompositing)
+        return frontToBackCompositing(ray, sampleStep, classify, transparent);
+    else
+        return backToFrontComposite(ray, sampleStep, classify, transparent);
+}
+
+/**
+ * Applies back to front compositing and returns the color composed
+ *  @param ray: ray throught the volume
+ *  @param sampleStep: step along the ray
+ *  @param classify: returns the color and opacity of a sample
+ *  @param transparent: returns whether a value range is fully transparent (used to skip empty space)
+ *  @return: resulting color
+ */
+template <typename Classify, typename Transparent>
+glm::vec4 Renderer::backToFrontComposite(const Ray& ray, float sampleStep, Classify&& classify, Transparent&& transparent) const
 {
     glm::vec3 samplePos = ray.origin + ray.tmax * ray.direction;
     const glm::vec3 increment = sampleStep * ray.direction;
+    EmptySpaceSkipper skipper = createSkipper(ray, ray.tmax, -sampleStep);
+    RenderStatistics& statistics = threadRenderStatistics();
 
     glm::vec3 color(0.0f);
+    float opacity = 0.0f;
 
     for (float t = ray.tmax; t >= ray.tmin; t -= sampleStep, samplePos -= increment) {
-        float intensity = this->m_pVolume->getVoxelInterpolate(samplePos);
-        auto gradient = this->m_pGradientVolume->getGradientVoxel(samplePos);
-        float opacity = this->getTF2DOpacity(intensity, gradient.magnitude) * this->m_config.TF2DColor.w;
-        auto _color = glm::vec3(this->m_config.TF2DColor);
+        skipper.skip(t, samplePos, transparent);
+        if (t < ray.tmin)
+            break;
+
+        const glm::vec4 sample = classify(samplePos);
+        statistics.samples++;
+        const float alpha = correctOpacity(sample.a, sampleStep);
+        color = alpha * glm::vec3(sample) + (1 - alpha) * color;
+        opacity = alpha + (1 - alpha) * opacity;
+    }
 
-        if (this->m_config.volumeShading) {
-            _color = computePhongShading(_color, gradient, m_pCamera->position(), ray.direction);
+    return compositedColor(color, opacity);
+}
+
+/**
+ * Applies front to back compositing and returns the color composed.
+ * The ray is terminated as soon as the accumulated opacity reaches m_config.earlyRayTerminationThreshold since
+ * the remaining samples can hardly contribute to the pixel anymore.
+ *  @param ray: ray throught the volume
+ *  @param sampleStep: step along the ray
+ *  @param classify: returns the color and opacity of a sample
+ *  @param transparent: returns whether a value range is fully transparent (used to skip empty space)
+ *  @return: resulting color
+ */
+template <typename Classify, typename Transparent>
+glm::vec4 Renderer::frontToBackCompositing(const Ray& ray, float sampleStep, Classify&& classify, Transparent&& transparent) const
+{
+    // Start on the sample grid of back-to-front compositing (which is anchored at tmax) so that both orders take the same samples.
+    const float tStart = ray.tmax - std::floor((ray.tmax - ray.tmin) / sampleStep) * sampleStep;
+    glm::vec3 samplePos = ray.origin + tStart * ray.direction;
+    const glm::vec3 increment = sampleStep * ray.direction;
+    EmptySpaceSkipper skipper = createSkipper(ray, tStart, sampleStep);
+    RenderStatistics& statistics = threadRenderStatistics();
+
+    glm::vec3 color(0.0f);
+    float opacity = 0.0f;
+
+    for (float t = tStart; t <= ray.tmax; t += sampleStep, samplePos += increment) {
+        skipper.skip(t, samplePos, transparent);
+        if (t > ray.tmax)
+            break;
+
+        const glm::vec4 sample = classify(samplePos);
+        statistics.samples++;
+        const float weight = (1 - opacity) * correctOpacity(sample.a, sampleStep);
+        color += weight * glm::vec3(sample);
+        opacity += weight;
+
+        if (opacity >= m_config.earlyRayTerminationThreshold) {
+            statistics.earlyTerminations++;
+            break;
         }
+    }
+
+    return compositedColor(color, opacity);
+}
 
-        color = opacity * _color + (1 - opacity) * color;
+/**
+ * Front to back compositing with a step that adapts to the samples (see RenderConfig::adaptiveSampleStep).
+ * The step doubles, up to m_config.maxSampleStep, while successive samples have about the same color and opacity.
+ * When a sample differs from the previous one after a step larger than sampleStep, the part of the ray after the
+ * previous sample is sampled again at sampleStep, so that the transition itself is sampled at the base rate.
+ * A sample stands for the part of the ray up to the next sample that is kept, so it is only composited once that
+ * sample is known. In a uniform region this gives the same color as frontToBackCompositing.
+ *  @param ray: ray throught the volume
+ *  @param sampleStep: smallest step along the ray
+ *  @param classify: returns the color and opacity of a sample
+ *  @param transparent: returns whether a value range is fully transparent (used to skip empty space)
+ *  @return: resulting color
+ */
+template <typename Classify, typename Transparent>
+glm::vec4 Renderer::adaptiveFrontToBackCompositing(const Ray& ray, float sampleStep, Classify&& classify, Transparent&& transparent) const
+{
+    // Largest difference in color or opacity between two samples that still counts as the same.
+    static constexpr float tolerance = 0.01f;
+    const float maxSampleStep = std::max(m_config.maxSampleStep, sampleStep);
+    EmptySpaceSkipper skipper = createSkipper(ray, ray.tmin, sampleStep);
+    RenderStatistics& statistics = threadRenderStatistics();
+
+    glm::vec3 color(0.0f);
+    float opacity = 0.0f;
+    // The last sample that was taken but not composited yet, and its position along the ray.
+    std::optional<glm::vec4> pendingSample;
+    float pendingT = ray.tmin;
+    // Composites the pending sample over the given length of the ray and returns whether the ray terminates.
+    const auto compositePending = [&](float length) {
+        const float weight = (1 - opacity) * correctOpacity(pendingSample->a, length);
+        color += weight * glm::vec3(*pendingSample);
+        opacity += weight;
+        pendingSample.reset();
+        if (opacity < m_config.earlyRayTerminationThreshold)
+            return false;
+        statistics.earlyTerminations++;
+        return true;
+    };
+    float step = sampleStep;
+
+    float t = ray.tmin;
+    glm::vec3 samplePos = ray.origin + t * ray.direction;
+    while (true) {
+        // Going back to the pending sample is fine for the skipper: the samples before the current (non-empty) cell
+        // are never moved. The pending sample stands for the part of the ray up to the skipped cells, and after a
+        // skip the step starts again at sampleStep.
+        const float tBeforeSkip = t;
+        skipper.skip(t, samplePos, transparent);
+        if (t != tBeforeSkip) {
+            step = sampleStep;
+            if (pendingSample && compositePending(tBeforeSkip - pendingT))
+                break;
+        }
+        if (t > ray.tmax)
+            break;
+
+        const glm::vec4 sample = classify(samplePos);
+        statistics.samples++;
+        const bool changed = pendingSample && glm::compMax(glm::abs(sample - *pendingSample)) > tolerance;
+        if (changed && step > sampleStep) {
+            step = sampleStep;
+            t = pendingT + step;
+            samplePos = ray.origin + t * ray.direction;
+            continue;
+        }
+        if (pendingSample && compositePending(t - pendingT))
+            break;
+        step = changed ? sampleStep : std::min(2.0f * step, maxSampleStep);
+
+        pendingSample = sample;
+        pendingT = t;
+        t += step;
+        samplePos += step * ray.direction;
+    }
+    // The last sample stands for as many samples at sampleStep as fit before tmax, like in frontToBackCompositing.
+    if (pendingSample)
+        compositePending((std::floor((ray.tmax - pendingT) / sampleStep) + 1.0f) * sampleStep);
+
+    return compositedColor(color, opacity);
+}
+
+// Composited rays are opaque (over a black background), except for the rays of a block, whose colors are composited
+// with those of the other blocks (see RenderBlock).
+glm::vec4 Renderer::compositedColor(const glm::vec3& color, float opacity) const
+{
+    return glm::vec4(color, m_optBlock ? opacity : 1.0f);
+}
+
+// The opacities of the transfer functions are defined for samples that are one voxel apart. A sample that stands for
+// a segment of sampleStep voxels has the opacity of that many such samples: 1 - (1 - alpha)^sampleStep.
+float Renderer::correctOpacity(float alpha, float sampleStep)
+{
+    if (sampleStep == 1.0f)
+        return alpha;
+    return 1.0f - std::pow(1.0f - alpha, sampleStep);
+}
+
+// Color and opacity of a sample according to the 1D transfer function (phong shaded if volume shading is enabled).
+template <typename Sampler>
+glm::vec4 Renderer::classifyTF(const glm::vec3& samplePos, const PhongShader& shader, const Sampler& sampler) const
+{
+    return classifyTFValue(sampler(samplePos), samplePos, shader, sampler);
+}
+
+// Gradient at samplePos of the level of detail that sampler samples (see volume::PyramidSampler::gradient).
+template <typename Sampler>
+volume::GradientVoxel Renderer::sampleGradient(const glm::vec3& samplePos, const Sampler& sampler) const
+{
+    if constexpr (requires { sampler.gradient(samplePos); })
+        return sampler.gradient(samplePos);
+    else
+        return m_pGradientVolume->getGradientVoxel(samplePos);
+}
+
+// Same as classifyTF for a sample whose value is already known.
+template <typename Sampler>
+glm::vec4 Renderer::classifyTFValue(float value, const glm::vec3& samplePos, const PhongShader& shader, const Sampler& sampler) const
+{
+    glm::vec4 tf_value = this->getTFValue(value);
+    if (tf_value.a > 0.0f && this->m_config.volumeShading) {
+        auto gradient = sampleGradient(samplePos, sampler);
+        tf_value = glm::vec4(shader.shade(glm::vec3(tf_value), gradient), tf_value.a);
+        threadRenderStatistics().shadedSamples++;
+    }
+    return tf_value;
+}
+
+// In this function, implement 2D transfer function raycasting.
+// Use the getTF2DOpacity function that you implemented to compute the opacity according to the 2D transfer function.
+glm::vec4 Renderer::traceRayTF2D(const Ray& ray, float sampleStep) const
+{
+    return m_pVolume->visitSampler([&](const auto& sampler) { return traceRayTF2D(ray, sampleStep, sampler); });
+}
+
+template <typename Sampler>
+glm::vec4 Renderer::traceRayTF2D(const Ray& ray, float sampleStep, const Sampler& sampler) const
+{
+    const PhongShader shader = createShader(ray.direction);
+    const auto classify = [&](const glm::vec3& samplePos) { return classifyTF2D(samplePos, shader, sampler); };
+    const auto transparent = [&](float cellMin, float cellMax) { return isTF2DTransparent(cellMin, cellMax); };
+    return composite(ray, sampleStep, classify, transparent);
+}
+
+// Color and opacity of a sample according to the 2D transfer function (phong shaded if volume shading is enabled).
+template <typename Sampler>
+glm::vec4 Renderer::classifyTF2D(const glm::vec3& samplePos, const PhongShader& shader, const Sampler& sampler) const
+{
+    float intensity = sampler(samplePos);
+    auto gradient = sampleGradient(samplePos, sampler);
+    const glm::vec4 tfValue = m_tf2DTable.lookup(intensity, gradient.magnitude);
+    auto _color = glm::vec3(tfValue);
+
+    if (tfValue.a > 0.0f && this->m_config.volumeShading) {
+        _color = shader.shade(_color, gradient);
+        threadRenderStatistics().shadedSamples++;
     }
 
-    return glm::vec4(color, 1.0f);
+    return glm::vec4(_color, tfValue.a);
 }
 
 // Compute Phong Shading given the voxel color (material color), the gradient, the light vector and view vector.
@@ -325,6 +1860,12 @@ glm::vec3 Renderer::computePhongShading(const glm::vec3& color, const volume::Gr
     return (ka + kd * cos(theta) + ks * float(pow(cos(phi), n))) * color;
 }
 
+// Same result as computePhongShading, computed by PhongShader (which renders the shaded modes).
+glm::vec3 Renderer::computeFastPhongShading(const glm::vec3& color, const volume::GradientVoxel& gradient, const glm::vec3& L, const glm::vec3& V)
+{
+    return PhongShader(ShadingModel::Phong, L, V).shade(color, gradient);
+}
+
 // ======= DO NOT MODIFY THIS FUNCTION ========
 // Looks up the color+opacity corresponding to the given volume value from the 1D tranfer function LUT (m_config.tfColorMap).
 // The value will initially range from (m_config.tfColorMapIndexStart) to (m_config.tfColorMapIndexStart + m_config.tfColorMapIndexRange) .
@@ -397,29 +1938,109 @@ float Renderer::getTF2DOpacity(float intensity, float gradientMagnitude) const
     return 0.0f;
 }
 
-// This function computes if a ray intersects with the axis-aligned bounding box around the volume.
-// If the ray intersects then tmin/tmax are set to the distance at which the ray hits/exists the
-// volume and true is returned. If the ray misses the volume the the function returns false.
-//
-// If you are interested you can learn about it at.
-// https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-box-intersection
-bool Renderer::instersectRayVolumeBounds(Ray& ray, const Bounds& bounds) const
+// Create the shader for the samples of a ray. The light is the camera position, as in computePhongShading.
+PhongShader Renderer::createShader(const glm::vec3& rayDirection) const
+{
+    return PhongShader(m_config.shadingModel, m_pCamera->position(), rayDirection);
+}
+
+// Create an empty space skipper that walks the ray from t0 in steps of sampleStep (negative to walk backwards).
+// When empty space skipping is disabled the skipper never moves a sample.
+EmptySpaceSkipper Renderer::createSkipper(const Ray& ray, float t0, float sampleStep) const
+{
+    const volume::MacroCellGrid* pGrid = m_config.emptySpaceSkipping ? &m_macroCellGrid : nullptr;
+    const float overshoot = volume::MacroCellGrid::interpolationOvershoot(m_pVolume->interpolationMode);
+    return EmptySpaceSkipper(pGrid, overshoot, ray.origin, ray.direction, t0, sampleStep);
+}
+
+// Count the transfer function entries with a non-zero opacity so that isTFTransparent can check a value range in constant time.
+void Renderer::updateTFOpacityTable()
+{
+    m_tfOpacityPrefixSum[0] = 0;
+    for (size_t i = 0; i < m_config.tfColorMap.size(); i++)
+        m_tfOpacityPrefixSum[i + 1] = m_tfOpacityPrefixSum[i] + (m_config.tfColorMap[i].a > 0.0f ? 1 : 0);
+}
+
+// Index of the 1D transfer function entry of a value; the same mapping as getTFValue.
+size_t Renderer::tfIndex(float val) const
+{
+    const float range01 = (val - m_config.tfColorMapIndexStart) / m_config.tfColorMapIndexRange;
+    const float index = range01 * static_cast<float>(m_config.tfColorMap.size());
+    if (!(index > 0.0f)) // Also catches NaN when the transfer function range has not been set yet.
+        return size_t(0);
+    return std::min(static_cast<size_t>(index), m_config.tfColorMap.size() - 1);
+}
+
+// Returns true if the 1D transfer function is fully transparent for all values in [minValue, maxValue].
+bool Renderer::isTFTransparent(float minValue, float maxValue) const
+{
+    return m_tfOpacityPrefixSum[tfIndex(maxValue) + 1] == m_tfOpacityPrefixSum[tfIndex(minValue)];
+}
+
+// Integrate the 1D transfer function for segments of the current sample step. The table is only rebuilt when the
+// transfer function or the sampling settings changed.
+void Renderer::updatePreIntegrationTable()
+{
+    if (m_config.renderMode != RenderMode::RenderComposite || !m_config.preIntegratedTF)
+        return;
+    if (m_optPreIntegrationTableGeneration
+        && !changedSince(*m_optPreIntegrationTableGeneration, { RenderConfigSection::TransferFunction, RenderConfigSection::Sampling }))
+        return;
+
+    m_preIntegrationTable.bake(m_config.tfColorMap, std::max(m_config.sampleStep, minSampleStep));
+    m_optPreIntegrationTableGeneration = m_configGeneration;
+}
+
+// Bake the 2D transfer function of the current render mode into m_tf2DTable, which classifyTF2D and classifyTF2DV2
+// read from. The table is only rebuilt when the render mode or the 2D transfer functions changed.
+void Renderer::updateTF2DTable()
+{
+    const RenderMode mode = m_config.renderMode;
+    if (mode != RenderMode::RenderTF2D && mode != RenderMode::RenderTF2DV2)
+        return;
+    if (m_optTF2DTableGeneration && !changedSince(*m_optTF2DTableGeneration, { RenderConfigSection::Mode, RenderConfigSection::TransferFunction2D }))
+        return;
+
+    const float maxIntensity = volumeMaximum();
+    const float maxMagnitude = gradientMaxMagnitude();
+    if (mode == RenderMode::RenderTF2D) {
+        m_tf2DTable.bake(maxIntensity, maxMagnitude, [&](float intensity, float gradientMagnitude) {
+            return glm::vec4(glm::vec3(m_config.TF2DColor), getTF2DOpacity(intensity, gradientMagnitude) * m_config.TF2DColor.a);
+        });
+    } else {
+        m_tf2DTable.bake(maxIntensity, maxMagnitude, [&](float intensity, float gradientMagnitude) {
+            const glm::vec4 color = getTF2DV2Color(intensity, gradientMagnitude);
+            return glm::vec4(glm::vec3(color), getTF2DV2Opacity(intensity, gradientMagnitude) * color.a);
+        });
+    }
+    m_optTF2DTableGeneration = m_configGeneration;
+}
+
+// Returns true if the 2D transfer function of the current render mode is fully transparent for all values in
+// [minValue, maxValue] (for any gradient magnitude).
+bool Renderer::isTF2DTransparent(float minValue, float maxValue) const
+{
+    return m_tf2DTable.isTransparent(minValue, maxValue);
+}
+
+// The slab test of instersectRayVolumeBounds, given the offsets from the ray origin to the lower and upper bounds.
+static bool intersectSlabs(Ray& ray, const std::array<glm::vec3, 2>& boundsFromOrigin)
 {
     const glm::vec3 invDir = 1.0f / ray.direction;
     const glm::bvec3 sign = glm::lessThan(invDir, glm::vec3(0.0f));
 
-    float tmin = (bounds.lowerUpper[sign[0]].x - ray.origin.x) * invDir.x;
-    float tmax = (bounds.lowerUpper[!sign[0]].x - ray.origin.x) * invDir.x;
-    const float tymin = (bounds.lowerUpper[sign[1]].y - ray.origin.y) * invDir.y;
-    const float tymax = (bounds.lowerUpper[!sign[1]].y - ray.origin.y) * invDir.y;
+    float tmin = boundsFromOrigin[sign[0]].x * invDir.x;
+    float tmax = boundsFromOrigin[!sign[0]].x * invDir.x;
+    const float tymin = boundsFromOrigin[sign[1]].y * invDir.y;
+    const float tymax = boundsFromOrigin[!sign[1]].y * invDir.y;
 
     if ((tmin > tymax) || (tymin > tmax))
         return false;
     tmin = std::max(tmin, tymin);
     tmax = std::min(tmax, tymax);
 
-    const float tzmin = (bounds.lowerUpper[sign[2]].z - ray.origin.z) * invDir.z;
-    const float tzmax = (bounds.lowerUpper[!sign[2]].z - ray.origin.z) * invDir.z;
+    const float tzmin = boundsFromOrigin[sign[2]].z * invDir.z;
+    const float tzmax = boundsFromOrigin[!sign[2]].z * invDir.z;
 
     if ((tmin > tzmax) || (tzmin > tmax))
         return false;
@@ -429,6 +2050,52 @@ bool Renderer::instersectRayVolumeBounds(Ray& ray, const Bounds& bounds) const
     return true;
 }
 
+// This function computes if a ray intersects with the axis-aligned bounding box around the volume.
+// If the ray intersects then tmin/tmax are set to the distance at which the ray hits/exists the
+// volume and true is returned. If the ray misses the volume the the function returns false.
+//
+// If you are interested you can learn about it at.
+// https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-box-intersection
+bool Renderer::instersectRayVolumeBounds(Ray& ray, const Bounds& bounds) const
+{
+    return intersectSlabs(ray, { bounds.lowerUpper[0] - ray.origin, bounds.lowerUpper[1] - ray.origin });
+}
+
+// The ray through pixel (x, y) of the frame, which is the ray that the camera generates for it (up to rounding) if it
+// is a pinhole camera.
+Ray Renderer::pixelRay(const glm::ivec2& pixel, const FrameParameters& frame) const
+{
+    if (!frame.optPinhole) {
+        const glm::vec2 pixelPos = glm::vec2(pixel) / glm::vec2(m_config.renderResolution);
+        return m_pCamera->generateRay(pixelPos * 2.0f - 1.0f);
+    }
+    const glm::vec3 direction = frame.firstPixelDirection + float(pixel.x) * frame.pixelRight + float(pixel.y) * frame.pixelUp;
+    return Ray { frame.optPinhole->origin, glm::normalize(direction), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::max() };
+}
+
+// Restricts a ray of pixelRay to the part of the volume that is rendered: the bounds of the frame (which include the
+// region of interest) and the clip planes. Returns false if no part of the ray is left.
+bool Renderer::clipRay(Ray& ray, const FrameParameters& frame) const
+{
+    const bool hit = frame.optPinhole ? intersectSlabs(ray, frame.boundsFromCamera) : instersectRayVolumeBounds(ray, frame.bounds);
+    if (!hit)
+        return false;
+
+    for (size_t i = 0; i < frame.numClipPlanes; i++) {
+        const glm::vec3 normal { frame.clipPlanes[i] };
+        const float distance = frame.optPinhole ? frame.clipPlaneDistances[i] : frame.clipPlanes[i].w - glm::dot(normal, ray.origin);
+        const float speed = glm::dot(normal, ray.direction);
+        if (speed > 0.0f)
+            ray.tmax = std::min(ray.tmax, distance / speed);
+        else if (speed < 0.0f)
+            ray.tmin = std::max(ray.tmin, distance / speed);
+        else if (distance < 0.0f)
+            return false;
+    }
+    // An empty region of interest has lower bounds above its upper bounds.
+    return ray.tmin <= ray.tmax;
+}
+
 // This function inserts a color into the framebuffer at position x,y
 void Renderer::fillColor(int x, int y, const glm::vec4& color)
 {
@@ -445,24 +2112,24 @@ void Renderer::fillColor(int x, int y, const glm::vec4& color)
  */
 glm::vec4 Renderer::traceRayTF2DV2(const Ray& ray, float sampleStep) const
 {
-    glm::vec3 samplePos = ray.origin + ray.tmax * ray.direction;
-    const glm::vec3 increment = sampleStep * ray.direction;
-
-    glm::vec3 color(0.0f);
-
-    for (float t = ray.tmax; t >= ray.tmin; t -= sampleStep, samplePos -= increment) {
-        float intensity = this->m_pVolume->getVoxelInterpolate(samplePos);
-        auto gradient = this->m_pGradientVolume->getGradientVoxel(samplePos);
-        float opacity = this->getTF2DV2Opacity(intensity, gradient.magnitude);
-
-        auto _color = this->getTF2DV2Color(intensity, gradient.magnitude);
-
-        opacity *= _color.w;
+    return m_pVolume->visitSampler([&](const auto& sampler) { return traceRayTF2DV2(ray, sampleStep, sampler); });
+}
 
-        color = opacity * glm::vec3(_color) + (1 - opacity) * color;
-    }
+template <typename Sampler>
+glm::vec4 Renderer::traceRayTF2DV2(const Ray& ray, float sampleStep, const Sampler& sampler) const
+{
+    const auto classify = [&](const glm::vec3& samplePos) { return classifyTF2DV2(samplePos, sampler); };
+    const auto transparent = [&](float cellMin, float cellMax) { return isTF2DTransparent(cellMin, cellMax); };
+    return composite(ray, sampleStep, classify, transparent);
+}
 
-    return glm::vec4(color, 1.0f);
+// Color and opacity of a sample according to the second version of the 2D transfer function.
+template <typename Sampler>
+glm::vec4 Renderer::classifyTF2DV2(const glm::vec3& samplePos, const Sampler& sampler) const
+{
+    float intensity = sampler(samplePos);
+    auto gradient = sampleGradient(samplePos, sampler);
+    return m_tf2DTable.lookup(intensity, gradient.magnitude);
 }
 
 /**
@@ -1,16 +1,33 @@
 #pragma once
+#include "render/empty_space_skipper.h"
+#include "render/phong_shader.h"
+#include "render/pinhole_camera.h"
+#include "render/pre_integration_table.h"
 #include "render/ray.h"
 #include "render/ray_trace_camera.h"
 #include "render/render_config.h"
+#include "render/render_statistics.h"
+#include "render/sample_cache.h"
+#include "render/tf2d_lookup_table.h"
+#include "render/tile_scheduler.h"
+#include "volume/brick_pager.h"
+#include "volume/compressed_volume.h"
 #include "volume/gradient_volume.h"
+#include "volume/macro_cell_grid.h"
 #include "volume/volume.h"
-#include <cstring> // memcmp
+#include "volume/volume_pyramid.h"
+#include <chrono>
+#include <cstdint>
 #include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <gsl/span>
+#include <tbb/enumerable_thread_specific.h>
+#include <initializer_list>
 #include <memory>
+#include <optional>
+#include <utility>
 #include <tuple>
 #include <vector>
 
@@ -24,17 +41,62 @@ union Bounds {
     std::array<glm::vec3, 2> lowerUpper;
 };
 
+// Sort-last rendering (see render/sort_last.h): the renderer's volume is a block of a larger volume, of which it renders
+// only the part that the block owns. The images of all blocks composite to the image of the larger volume, so they are
+// normalized to the value ranges of the larger volume. Composited rays keep their opacity (instead of being opaque).
+struct RenderBlock {
+    // Owned part of the block, center of the larger volume (through which the slicer cuts) and position of its first
+    // voxel (where the region of interest starts, see RenderConfig::roiLower), in the voxel coordinates of the
+    // renderer's volume.
+    Bounds bounds;
+    glm::vec3 volumeCenter;
+    glm::vec3 volumeOrigin;
+    // Maximum voxel value and gradient magnitude of the larger volume.
+    float volumeMaximum;
+    float gradientMaxMagnitude;
+};
+
 class Renderer {
 public:
+    // The macro cells are copied from pMacroCellGrid if given (see volume::DerivedDataCache), and computed otherwise.
     Renderer(
         const volume::Volume* pVolume,
         const volume::GradientVolume* pGradientVolume,
         const render::RayTraceCamera* pCamera,
-        const RenderConfig& config);
+        const RenderConfig& config,
+        const volume::MacroCellGrid* pMacroCellGrid = nullptr);
 
     void setConfig(const RenderConfig& config);
+    const RenderConfig& config() const;
+    void setCamera(const render::RayTraceCamera* pCamera);
+    void setVolume(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume, const volume::MacroCellGrid* pMacroCellGrid = nullptr);
+    void setVolumePyramid(const volume::VolumePyramid* pVolumePyramid);
+    void setBrickPager(volume::BrickPager* pBrickPager);
+    void setCompressedVolume(const volume::CompressedVolume* pCompressedVolume);
+    void setBlock(const std::optional<RenderBlock>& optBlock);
     void render();
     gsl::span<const glm::vec4> frameBuffer() const;
+    // Render the config in several render modes at once, into the frame buffers of modeFrameBuffer (in the order of
+    // modes; the frame buffer of render() is left alone). Returns false, rendering nothing, for more than
+    // maxBatchModes modes or a mode whose table is only baked for the render mode of the config: the 2D transfer
+    // functions and pre-integrated compositing.
+    static constexpr size_t maxBatchModes = 8;
+    bool renderModes(gsl::span<const RenderMode> modes);
+    gsl::span<const glm::vec4> modeFrameBuffer(size_t index) const;
+    // Work done for the current image: by the last call to render() or renderModes(), or since the progressive image
+    // was started.
+    const RenderStatistics& statistics() const;
+    gsl::span<const TileTiming> tileTimings() const;
+
+    // Progressive rendering: a coarse image first, refined over successive calls without discarding earlier work.
+    // The frame buffer always holds a complete (possibly coarse) image after the first call.
+    void restartProgressive();
+    bool renderProgressive(std::chrono::duration<double> timeBudget);
+    bool isProgressiveComplete() const;
+    // Whether the brick pager may still load bricks (or has loaded bricks) that the current image fell back to a
+    // coarser level for, and restart the image to sample them once they are loaded.
+    bool isStreaming() const;
+    bool refreshStreamedBricks();
 
 protected:
     // These functions will be automatically tested.
@@ -46,12 +108,102 @@ protected:
     glm::vec4 traceRayTF2DV2(const Ray& ray, float sampleStep) const;
 
     float bisectionAccuracy(const Ray& ray, float t0, float t1, float isoValue) const;
+    float secantAccuracy(const Ray& ray, float t0, float t1, float isoValue) const;
 
     static glm::vec3 computePhongShading(const glm::vec3& color, const volume::GradientVoxel& gradient, const glm::vec3& lightDirection, const glm::vec3& viewDirection);
+    static glm::vec3 computeFastPhongShading(const glm::vec3& color, const volume::GradientVoxel& gradient, const glm::vec3& lightDirection, const glm::vec3& viewDirection);
 
 private:
+    // Smallest sample step that the renderer accepts from the render config.
+    static constexpr float minSampleStep = 0.01f;
+
+    // Per frame constants for the slicer, ray-box intersection and ray marching. The bounds are those of the volume (or
+    // of the owned part of the block) intersected with the region of interest.
+    struct FrameParameters {
+        glm::vec3 planeNormal;
+        glm::vec3 volumeCenter;
+        Bounds bounds;
+        float sampleStep;
+        std::array<glm::vec4, maxClipPlanes> clipPlanes;
+        size_t numClipPlanes;
+        bool clipped;
+        // With a pinhole camera the rays of the pixels are generated from its basis (see pixelRay). They all start at
+        // the camera, so the offsets from there to the bounds and the clip planes are computed once (see clipRay).
+        std::optional<PinholeCamera> optPinhole;
+        glm::vec3 firstPixelDirection {}, pixelRight {}, pixelUp {};
+        std::array<glm::vec3, 2> boundsFromCamera {};
+        std::array<float, maxClipPlanes> clipPlaneDistances {};
+    };
+    FrameParameters frameParameters() const;
+    float volumeMaximum() const;
+    float gradientMaxMagnitude() const;
+    template <typename F>
+    void visitFrameSampler(F&& f) const;
+    float footprintScale() const;
+    bool changedSince(uint64_t generation, std::initializer_list<RenderConfigSection> sections) const;
+    void startProfile();
+    template <typename F>
+    void profileTile(const ScreenRect& tile, F&& traceTile);
+    void collectThreadProfiles();
+    ScreenRect visibleScreenRect(const FrameParameters& frame) const;
+
+    // Number of neighbouring pixels whose rays are traced together by the packet versions of the ray tracing
+    // functions, and the types that hold one element per lane.
+    static constexpr size_t packetSize = 8;
+    // Lanes that are left when marchPacket switches to tracing them one by one.
+    static constexpr size_t minActiveLanes = 2;
+    struct PixelPacket {
+        std::array<glm::ivec2, packetSize> coords;
+        size_t count { 0 };
+    };
+    using RayPacket = std::array<Ray, packetSize>;
+    using LaneMask = std::array<bool, packetSize>;
+    using ColorPacket = std::array<glm::vec4, packetSize>;
+
+    // Specialized versions of the ray tracing functions; sampler(samplePos) samples the volume (see volume::VolumeSampler
+    // and volume::PyramidSampler).
+    template <typename Sampler>
+    void renderFrame(const Sampler& sampler);
+    template <typename Sampler>
+    glm::vec4 tracePixel(int x, int y, const FrameParameters& frame, const Sampler& sampler) const;
+    template <typename Sampler>
+    glm::vec4 traceRay(RenderMode mode, const Ray& ray, const FrameParameters& frame, const Sampler& sampler) const;
+    // Colors of a ray in each mode of a batch (see renderModes).
+    using ModeColors = std::array<glm::vec4, maxBatchModes>;
+    template <typename Sampler>
+    void renderModesFrame(gsl::span<const RenderMode> modes, const Sampler& sampler);
+    bool sharesSampleWalk(RenderMode mode) const;
+    template <typename Sampler>
+    ModeColors traceRayModes(const Ray& ray, const FrameParameters& frame, gsl::span<const RenderMode> modes, const Sampler& sampler) const;
+    template <typename Sampler>
+    ColorPacket tracePixelPacket(const PixelPacket& pixels, const FrameParameters& frame, const Sampler& sampler) const;
+    template <typename Sampler, typename Transparent, typename Visit>
+    void marchPacket(const RayPacket& rays, LaneMask active, const std::array<float, packetSize>& tStart, float sampleStep, const Sampler& sampler, Transparent&& transparent, Visit&& visit) const;
+    template <typename Sampler>
+    ColorPacket traceRayMIPPacket(const RayPacket& rays, const LaneMask& active, float sampleStep, const Sampler& sampler) const;
+    template <typename Sampler>
+    ColorPacket traceRayISOPacket(const RayPacket& rays, const LaneMask& active, float sampleStep, const Sampler& sampler) const;
+    template <typename Sampler>
+    ColorPacket traceRayCompositePacket(const RayPacket& rays, const LaneMask& active, float sampleStep, const Sampler& sampler) const;
+    template <typename Sampler>
+    glm::vec4 isoSurfaceColor(const Ray& ray, float sampleStep, float t, glm::vec3 samplePos, float value, bool refine, const Sampler& sampler) const;
+    template <typename Sampler>
+    glm::vec4 traceRayMIP(const Ray& ray, float sampleStep, const Sampler& sampler) const;
+    template <typename Sampler>
+    glm::vec4 traceRayISO(const Ray& ray, float sampleStep, const Sampler& sampler) const;
+    template <typename Sampler>
+    glm::vec4 traceRayComposite(const Ray& ray, float sampleStep, const Sampler& sampler) const;
+    template <typename Sampler>
+    glm::vec4 traceRayTF2D(const Ray& ray, float sampleStep, const Sampler& sampler) const;
+    template <typename Sampler>
+    glm::vec4 traceRayTF2DV2(const Ray& ray, float sampleStep, const Sampler& sampler) const;
+    template <typename Sampler>
+    float bisectionAccuracy(const Ray& ray, float t0, float t1, float isoValue, const Sampler& sampler) const;
+    template <typename Sampler>
+    float secantAccuracy(const Ray& ray, float t0, float t1, float v0, float v1, float isoValue, const Sampler& sampler) const;
+
     void resizeImage(const glm::ivec2& resolution);
-    void resetImage();
+    void clearOutside(const ScreenRect& rect, gsl::span<glm::vec4> frameBuffer) const;
 
     glm::vec4 getTFValue(float val) const;
     float getTF2DOpacity(float val, float gradientMagnitude) const;
@@ -59,19 +211,152 @@ private:
     float getTF2DV2Opacity(float val, float gradientMagnitude) const;
     glm::vec4 getTF2DV2Color(float val, float gradientMagnitude) const;
 
+    EmptySpaceSkipper createSkipper(const Ray& ray, float t0, float sampleStep) const;
+    PhongShader createShader(const glm::vec3& rayDirection) const;
+    void updateTFOpacityTable();
+    size_t tfIndex(float val) const;
+    bool isTFTransparent(float minValue, float maxValue) const;
+    void updatePreIntegrationTable();
+    void updateTF2DTable();
+    bool isTF2DTransparent(float minValue, float maxValue) const;
+
     bool instersectRayVolumeBounds(Ray& ray, const Bounds& volumeBounds) const;
+    Ray pixelRay(const glm::ivec2& pixel, const FrameParameters& frame) const;
+    bool clipRay(Ray& ray, const FrameParameters& frame) const;
     void fillColor(int x, int y, const glm::vec4& color);
 
-    glm::vec4 backToFrontComposite(const Ray& ray, float sampleStep) const;
-    glm::vec4 frontToBackCompositing(const Ray& ray, float sampleStep) const;
+    template <typename Classify, typename Transparent>
+    glm::vec4 composite(const Ray& ray, float sampleStep, Classify&& classify, Transparent&& transparent) const;
+    template <typename Classify, typename Transparent>
+    glm::vec4 backToFrontComposite(const Ray& ray, float sampleStep, Classify&& classify, Transparent&& transparent) const;
+    template <typename Classify, typename Transparent>
+    glm::vec4 frontToBackCompositing(const Ray& ray, float sampleStep, Classify&& classify, Transparent&& transparent) const;
+    template <typename Classify, typename Transparent>
+    glm::vec4 adaptiveFrontToBackCompositing(const Ray& ray, float sampleStep, Classify&& classify, Transparent&& transparent) const;
+    glm::vec4 compositedColor(const glm::vec3& color, float opacity) const;
+    static float correctOpacity(float alpha, float sampleStep);
+    template <typename Sampler>
+    glm::vec4 preIntegratedCompositing(const Ray& ray, float sampleStep, const Sampler& sampler) const;
+
+    // Temporal reprojection (see RenderConfig::temporalReprojection): every traced pixel of an image remembers the
+    // position in the volume that its color belongs to and the number of images since it was traced (0 for the pixels
+    // that were traced for the current image).
+    struct TemporalPixel {
+        glm::vec3 position;
+        uint8_t age;
+        bool hasPosition;
+    };
+    template <typename Sampler>
+    void traceBlockPacket(PixelPacket& pixels, int stride, const FrameParameters& frame, const Sampler& sampler);
+    bool startTemporalImage();
+    template <typename Sampler>
+    void reprojectImage(const FrameParameters& frame, const Sampler& sampler);
+    template <typename Sampler>
+    TemporalPixel tracedTemporalPixel(const glm::ivec2& pixel, const FrameParameters& frame, const Sampler& sampler) const;
+    template <typename Sampler>
+    float reprojectionDepth(const Ray& ray, const FrameParameters& frame, const Sampler& sampler) const;
+
+    void prepareSampleCache();
+    template <typename Sampler>
+    glm::vec4 traceCachedPixel(const glm::ivec2& pixel, const FrameParameters& frame, const Sampler& sampler) const;
+    glm::vec4 compositeCachedSamples(gsl::span<const SampleRun> samples, float sampleStep) const;
+
+    template <typename Sampler>
+    glm::vec4 classifyTF(const glm::vec3& samplePos, const PhongShader& shader, const Sampler& sampler) const;
+    template <typename Sampler>
+    glm::vec4 classifyTFValue(float value, const glm::vec3& samplePos, const PhongShader& shader, const Sampler& sampler) const;
+    template <typename Sampler>
+    volume::GradientVoxel sampleGradient(const glm::vec3& samplePos, const Sampler& sampler) const;
+    template <typename Sampler>
+    glm::vec4 classifyTF2D(const glm::vec3& samplePos, const PhongShader& shader, const Sampler& sampler) const;
+    template <typename Sampler>
+    glm::vec4 classifyTF2DV2(const glm::vec3& samplePos, const Sampler& sampler) const;
 
 protected:
     const volume::Volume* m_pVolume;
     const volume::GradientVolume* m_pGradientVolume;
     const render::RayTraceCamera* m_pCamera;
+    // Levels of detail of the volume (see setVolumePyramid), or null.
+    const volume::VolumePyramid* m_pVolumePyramid { nullptr };
+    // Pages the bricks of the volume in from its file (see setBrickPager), or null. Its loaded generation at the start
+    // of the current image.
+    volume::BrickPager* m_pBrickPager { nullptr };
+    uint64_t m_brickGeneration { 0 };
+    // Compressed copy of the voxels of the volume that the rays sample instead (see setCompressedVolume), or null.
+    const volume::CompressedVolume* m_pCompressedVolume { nullptr };
+    // The part of a larger volume that the volume is a block of (see setBlock), if any.
+    std::optional<RenderBlock> m_optBlock;
     RenderConfig m_config;
 
+    volume::MacroCellGrid m_macroCellGrid;
+    // Prefix sum of the number of 1D transfer function entries with a non-zero opacity.
+    std::array<int, std::tuple_size_v<decltype(RenderConfig::tfColorMap)> + 1> m_tfOpacityPrefixSum;
+    // Versions of the render config: every change in setConfig increments m_configGeneration and stores it for the
+    // sections that changed. A cache remembers the generation that it was built at (see changedSince).
+    uint64_t m_configGeneration { 0 };
+    std::array<uint64_t, numRenderConfigSections> m_sectionGenerations {};
+
+    // The 2D transfer function of the current render mode and the config generation it was baked at.
+    TF2DLookupTable m_tf2DTable;
+    std::optional<uint64_t> m_optTF2DTableGeneration;
+    // Pre-integrated 1D transfer function and the config generation it was baked at.
+    PreIntegrationTable m_preIntegrationTable;
+    std::optional<uint64_t> m_optPreIntegrationTableGeneration;
+
+    // Everything that the samples along the rays depend on, apart from the volume: the Resolution and Sampling
+    // sections of the config, the interpolation mode and the camera.
+    struct SampleCacheKey {
+        uint64_t configGeneration;
+        volume::InterpolationMode interpolationMode;
+        ShadingModel shadingModel;
+        // Position, forward and the directions of two corner rays of the camera.
+        std::array<glm::vec3, 4> camera;
+    };
+    // Key of the previous image and whether the current image is composited from the sample cache. The cache is
+    // filled while tracing (every pixel by a single thread), hence mutable.
+    std::optional<SampleCacheKey> m_optSampleCacheKey;
+    bool m_sampleCacheActive { false };
+    mutable SampleCache m_sampleCache;
+
     std::vector<glm::vec4> m_frameBuffer;
+    // Frame buffers of the last call to renderModes, one per mode.
+    std::vector<std::vector<glm::vec4>> m_modeFrameBuffers;
+    // Tiles of the current image (see renderFrame), kept to reuse their memory.
+    std::vector<ScreenRect> m_tiles;
+
+    // Statistics and tile timings of the current image. The threads record theirs separately (see profileTile), which
+    // are merged into these after every call to render() and renderProgressive().
+    struct ThreadProfile {
+        RenderStatistics statistics;
+        std::vector<TileTiming> tileTimings;
+    };
+    tbb::enumerable_thread_specific<ThreadProfile> m_threadProfiles;
+    RenderStatistics m_statistics;
+    std::vector<TileTiming> m_tileTimings;
+    std::chrono::steady_clock::time_point m_imageStart;
+
+    // Block size of the first progressive pass and the number of pixel rows between two time budget checks.
+    static constexpr int progressiveStartStride = 8;
+    static constexpr int progressiveBandHeight = 32;
+    // Stride of the current progressive pass (0 once the image is complete) and the next block row to trace.
+    int m_progressiveStride { 0 };
+    int m_progressiveBlockRow { 0 };
+
+    // Pixels that have been reprojected this many times are traced again, and so are pixels that are further away than
+    // the neighbours on both sides by more than the depth tolerance (in voxels), see reprojectImage.
+    static constexpr uint8_t temporalMaxAge = 8;
+    static constexpr float temporalDepthTolerance = 4.0f;
+    // Whether the current image records its temporal history, and whether its stride 1 pass refines a reprojected image.
+    bool m_temporalImage { false };
+    bool m_temporalRefinement { false };
+    // Config generation of the image that the temporal history belongs to, or empty if it cannot be reprojected.
+    std::optional<uint64_t> m_optTemporalGeneration;
+    uint32_t m_temporalFrame { 0 };
+    std::vector<TemporalPixel> m_temporalPixels;
+    // The previous image and its history while it is reprojected, and the closest previous pixel per pixel.
+    std::vector<glm::vec4> m_previousFrameBuffer;
+    std::vector<TemporalPixel> m_previousTemporalPixels;
+    std::vector<uint64_t> m_reprojectionTargets;
 };
 
 }
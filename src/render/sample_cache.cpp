@@ -0,0 +1,62 @@
+#include "sample_cache.h"
+#include <algorithm>
+#include <iterator>
+
+namespace render {
+
+void SampleCache::reset(size_t numPixels, size_t maxBytes)
+{
+    for (Arena& arena : m_arenas) {
+        for (auto& block : arena.blocks)
+            block.clear();
+        arena.currentBlock = 0;
+    }
+    m_pixels.assign(numPixels, {});
+    m_recorded.assign(numPixels, 0);
+    m_maxBytes = maxBytes;
+    m_bytes = 0;
+}
+
+void SampleCache::clear()
+{
+    // Release the memory; the next image may be recorded at a different resolution, or not at all.
+    m_arenas.clear();
+    m_pixels = {};
+    m_recorded = {};
+    m_bytes = 0;
+}
+
+bool SampleCache::record(size_t pixel, gsl::span<const SampleRun> samples)
+{
+    const size_t bytes = samples.size() * sizeof(SampleRun);
+    if (m_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes > m_maxBytes) {
+        m_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Append the samples to the current block of the thread's arena, or continue in the next block if they do not fit.
+    Arena& arena = m_arenas.local();
+    while (arena.currentBlock < arena.blocks.size()) {
+        const auto& block = arena.blocks[arena.currentBlock];
+        if (block.capacity() - block.size() >= samples.size())
+            break;
+        arena.currentBlock++;
+    }
+    if (arena.currentBlock == arena.blocks.size())
+        arena.blocks.emplace_back().reserve(std::max(samples.size(), blockRuns));
+
+    auto& block = arena.blocks[arena.currentBlock];
+    const size_t offset = block.size();
+    block.insert(std::end(block), std::begin(samples), std::end(samples));
+    m_pixels[pixel] = gsl::span<const SampleRun>(block.data() + offset, samples.size());
+    m_recorded[pixel] = 1;
+    return true;
+}
+
+std::vector<SampleRun>& SampleCache::scratch()
+{
+    std::vector<SampleRun>& samples = m_arenas.local().scratch;
+    samples.clear();
+    return samples;
+}
+}
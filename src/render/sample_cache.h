@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+#include <tbb/enumerable_thread_specific.h>
+#include <vector>
+
+namespace render {
+
+// A run of equal consecutive samples along a ray, with everything that the transfer functions classify a sample by.
+struct SampleRun {
+    float value;
+    float gradientMagnitude;
+    // Factor by which Phong shading scales the color of the sample (see Renderer::computePhongShading).
+    float shading;
+    uint32_t count;
+};
+
+// The samples along the ray of every pixel of an image, so that the image can be composited again after a transfer
+// function changed without sampling the volume. Runs of equal samples (typically the empty space around an object)
+// are stored once.
+// The pixels are recorded while the image is traced, by different threads; each pixel is recorded at most once.
+// Recording stops when the cache would exceed its memory budget; those pixels are simply traced again.
+class SampleCache {
+public:
+    SampleCache() = default;
+    SampleCache(const SampleCache&) = delete;
+    SampleCache& operator=(const SampleCache&) = delete;
+
+    // Remove all samples and prepare for an image of numPixels pixels. The memory of the previous samples is reused.
+    void reset(size_t numPixels, size_t maxBytes);
+    // Remove all samples and release their memory.
+    void clear();
+
+    bool isRecorded(size_t pixel) const { return m_recorded[pixel] != 0; }
+    gsl::span<const SampleRun> samples(size_t pixel) const { return m_pixels[pixel]; }
+    // Store (a copy of) the samples of a pixel. Returns false if they do not fit in the memory budget.
+    bool record(size_t pixel, gsl::span<const SampleRun> samples);
+    // Empty vector of the calling thread to collect the samples of a pixel in before they are recorded.
+    std::vector<SampleRun>& scratch();
+
+private:
+    // The samples recorded by one thread, stored back to back in blocks of (at least) blockRuns runs. The blocks are
+    // reserved up front so that the recorded spans stay valid while the blocks are filled.
+    static constexpr size_t blockRuns = size_t(1) << 16;
+    struct Arena {
+        std::vector<std::vector<SampleRun>> blocks;
+        size_t currentBlock { 0 };
+        std::vector<SampleRun> scratch;
+    };
+    tbb::enumerable_thread_specific<Arena> m_arenas;
+
+    std::vector<gsl::span<const SampleRun>> m_pixels;
+    // Written by the thread that records the pixel (so not a vector<bool>, whose elements share bytes).
+    std::vector<uint8_t> m_recorded;
+    size_t m_maxBytes { 0 };
+    std::atomic<size_t> m_bytes { 0 };
+};
+}
@@ -0,0 +1,99 @@
+#include "sort_last.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <limits>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace render {
+
+BlockCamera::BlockCamera(const RayTraceCamera* pCamera, const volume::VolumeBlock& block)
+    : m_pCamera(pCamera)
+    , m_origin(block.origin)
+{
+}
+
+glm::vec3 BlockCamera::position() const
+{
+    return m_pCamera->position() - m_origin;
+}
+
+glm::vec3 BlockCamera::forward() const
+{
+    return m_pCamera->forward();
+}
+
+Ray BlockCamera::generateRay(const glm::vec2& pixel) const
+{
+    Ray ray = m_pCamera->generateRay(pixel);
+    ray.origin -= m_origin;
+    return ray;
+}
+
+RenderBlock createRenderBlock(const volume::VolumeBlock& block, const glm::ivec3& volumeDims, float volumeMaximum, float gradientMaxMagnitude)
+{
+    const glm::vec3 origin { block.origin };
+    return RenderBlock {
+        Bounds { glm::vec3(block.lower) - origin, glm::vec3(block.upper) - origin },
+        glm::vec3(volumeDims) / 2.0f - origin,
+        -origin,
+        volumeMaximum,
+        gradientMaxMagnitude
+    };
+}
+
+// The depth of a pixel is where its ray (as generated by tracePixel) enters the box of the owned voxels.
+BlockImage createBlockImage(gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution, const RayTraceCamera& camera, const volume::VolumeBlock& block)
+{
+    BlockImage image { std::vector<glm::vec4>(std::begin(frameBuffer), std::end(frameBuffer)), std::vector<float>(frameBuffer.size()) };
+    const glm::vec3 lower { block.lower }, upper { block.upper };
+    tbb::parallel_for(tbb::blocked_range<int>(0, resolution.y), [&](const tbb::blocked_range<int>& rows) {
+        for (int y = rows.begin(); y != rows.end(); y++) {
+            for (int x = 0; x < resolution.x; x++) {
+                const Ray ray = camera.generateRay(glm::vec2(x, y) / glm::vec2(resolution) * 2.0f - 1.0f);
+                const glm::vec3 invDir = 1.0f / ray.direction;
+                const glm::vec3 t0 = (lower - ray.origin) * invDir, t1 = (upper - ray.origin) * invDir;
+                const float tEnter = glm::compMax(glm::min(t0, t1)), tExit = glm::compMin(glm::max(t0, t1));
+                image.depths[size_t(resolution.x) * size_t(y) + size_t(x)] = tEnter <= tExit ? tEnter : std::numeric_limits<float>::infinity();
+            }
+        }
+    });
+    return image;
+}
+
+static void compositePair(BlockImage& image, const BlockImage& other, RenderMode renderMode)
+{
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, image.colors.size()), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++) {
+            if (renderMode == RenderMode::RenderMIP) {
+                image.colors[i] = glm::max(image.colors[i], other.colors[i]);
+            } else {
+                const bool otherInFront = other.depths[i] < image.depths[i];
+                const glm::vec4 front = otherInFront ? other.colors[i] : image.colors[i];
+                const glm::vec4 back = otherInFront ? image.colors[i] : other.colors[i];
+                image.colors[i] = front + (1.0f - front.a) * back;
+            }
+            image.depths[i] = std::min(image.depths[i], other.depths[i]);
+        }
+    });
+}
+
+void compositeBlockImages(gsl::span<BlockImage> images, RenderMode renderMode)
+{
+    for (size_t stride = 1; stride < images.size(); stride *= 2) {
+        for (size_t i = 0; i + stride < images.size(); i += 2 * stride)
+            compositePair(images[i], images[i + stride], renderMode);
+    }
+
+    // Like the image of a single renderer, the composited rays are opaque wherever they hit the volume.
+    if (renderMode == RenderMode::RenderMIP || images.empty())
+        return;
+    BlockImage& image = images[0];
+    for (size_t i = 0; i < image.colors.size(); i++) {
+        if (std::isfinite(image.depths[i]))
+            image.colors[i].a = 1.0f;
+    }
+}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "render/ray.h"
+#include "render/ray_trace_camera.h"
+#include "render/render_config.h"
+#include "render/renderer.h"
+#include "volume/volume_blocks.h"
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <gsl/span>
+#include <vector>
+
+namespace render {
+
+// Sort-last rendering of a volume that is split into blocks (see volume::partitionVolume): a renderer per block renders
+// the part of the volume that the block owns (see RenderBlock), and the images of the blocks are composited in the
+// order in which the rays pass through the blocks. A block only needs the voxels of its block volume, so the blocks
+// can be rendered by different processes or machines that exchange their BlockImages.
+
+// The premultiplied colors of the image of a block and, per pixel, the distance along the ray at which it enters the
+// block (infinity where the ray misses the block), which orders the images of the blocks.
+struct BlockImage {
+    std::vector<glm::vec4> colors;
+    std::vector<float> depths;
+};
+
+// Generates the rays of a camera of the full volume in the voxel coordinates of a block volume.
+class BlockCamera : public RayTraceCamera {
+public:
+    BlockCamera(const RayTraceCamera* pCamera, const volume::VolumeBlock& block);
+
+    glm::vec3 position() const override;
+    glm::vec3 forward() const override;
+
+    Ray generateRay(const glm::vec2& pixel) const override;
+
+private:
+    const RayTraceCamera* m_pCamera;
+    glm::vec3 m_origin;
+};
+
+// The RenderBlock of a block of a volume with the given size, maximum voxel value and maximum gradient magnitude.
+RenderBlock createRenderBlock(const volume::VolumeBlock& block, const glm::ivec3& volumeDims, float volumeMaximum, float gradientMaxMagnitude);
+// Pairs the image of a block (as rendered with a BlockCamera of camera) with its depths.
+BlockImage createBlockImage(gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution, const RayTraceCamera& camera, const volume::VolumeBlock& block);
+// Composites the images of the blocks of a partition (in the order of volume::partitionVolume) into images[0]. The
+// images are combined pairwise like binary-swap compositing does: first the halves of the last split, then the
+// halves of the split before, and so on. Each pair is composited front to back per pixel, except for MIP, which keeps
+// the maximum. The composited image is opaque where the rays hit the volume, like the image of a single renderer.
+void compositeBlockImages(gsl::span<BlockImage> images, RenderMode renderMode);
+}
@@ -0,0 +1,20 @@
+#include "tf2d_lookup_table.h"
+#include <cmath>
+
+namespace render {
+
+// An intensity is interpolated from the columns on either side of it, so the range covers the columns from the one
+// before minIntensity up to the one after maxIntensity.
+bool TF2DLookupTable::isTransparent(float minIntensity, float maxIntensity) const
+{
+    const auto toColumn = [&](float intensity, auto round) {
+        const float column = round(intensity * m_scale.x);
+        if (!(column > 0.0f)) // Also catches NaN.
+            return size_t(0);
+        return std::min(static_cast<size_t>(column), static_cast<size_t>(m_resolution.x - 1));
+    };
+    const size_t first = toColumn(minIntensity, [](float x) { return std::floor(x); });
+    const size_t last = toColumn(maxIntensity, [](float x) { return std::ceil(x); });
+    return m_opaqueColumnPrefixSum[last + 1] == m_opaqueColumnPrefixSum[first];
+}
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <algorithm>
+#include <glm/common.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <vector>
+
+namespace render {
+
+// A 2D transfer function baked into a dense table over (intensity, gradient magnitude). Classifying a sample then
+// costs a single bilinear lookup, no matter how the transfer function is defined.
+// The table stores pre-multiplied colors so that interpolating between an opaque and a transparent entry does not
+// darken the color; lookup returns the (non pre-multiplied) color and opacity like the transfer functions do.
+class TF2DLookupTable {
+public:
+    // Number of table entries along the intensity and gradient magnitude axes.
+    static constexpr int intensityResolution = 1024;
+    static constexpr int magnitudeResolution = 256;
+
+public:
+    // Fill the table with classify(intensity, gradientMagnitude) for [0, maxIntensity] x [0, maxMagnitude].
+    template <typename F>
+    void bake(float maxIntensity, float maxMagnitude, F&& classify);
+
+    // Values outside of the table are clamped to its border.
+    glm::vec4 lookup(float intensity, float gradientMagnitude) const
+    {
+        const glm::vec2 texel = glm::clamp(glm::vec2(intensity, gradientMagnitude) * m_scale, glm::vec2(0.0f), glm::vec2(m_resolution - 1));
+        const glm::ivec2 base = glm::min(glm::ivec2(texel), m_resolution - 2);
+        const glm::vec2 f = texel - glm::vec2(base);
+
+        const size_t i = static_cast<size_t>(base.x + m_resolution.x * base.y);
+        const size_t rowSize = static_cast<size_t>(m_resolution.x);
+        const glm::vec4 bottom = glm::mix(m_table[i], m_table[i + 1], f.x);
+        const glm::vec4 top = glm::mix(m_table[i + rowSize], m_table[i + rowSize + 1], f.x);
+        const glm::vec4 premultiplied = glm::mix(bottom, top, f.y);
+        if (premultiplied.a <= 0.0f)
+            return glm::vec4(0.0f);
+        return glm::vec4(glm::vec3(premultiplied) / premultiplied.a, premultiplied.a);
+    }
+
+    // Returns true if lookup is fully transparent for every intensity in [minIntensity, maxIntensity] (and any
+    // gradient magnitude).
+    bool isTransparent(float minIntensity, float maxIntensity) const;
+
+private:
+    glm::ivec2 m_resolution { 0 };
+    // Table coordinates per unit of intensity and gradient magnitude.
+    glm::vec2 m_scale { 0.0f };
+    // Row major, one row per gradient magnitude.
+    std::vector<glm::vec4> m_table;
+    // Prefix sum of the number of columns (intensities) with a non-zero opacity.
+    std::vector<int> m_opaqueColumnPrefixSum;
+};
+
+template <typename F>
+void TF2DLookupTable::bake(float maxIntensity, float maxMagnitude, F&& classify)
+{
+    m_resolution = glm::ivec2(intensityResolution, magnitudeResolution);
+    m_scale = glm::vec2(m_resolution - 1) / glm::max(glm::vec2(maxIntensity, maxMagnitude), glm::vec2(1e-6f));
+    m_table.resize(static_cast<size_t>(m_resolution.x * m_resolution.y));
+
+    std::vector<bool> opaqueColumns(static_cast<size_t>(m_resolution.x), false);
+    size_t i = 0;
+    for (int y = 0; y < m_resolution.y; y++) {
+        const float gradientMagnitude = float(y) / m_scale.y;
+        for (int x = 0; x < m_resolution.x; x++) {
+            const glm::vec4 value = classify(float(x) / m_scale.x, gradientMagnitude);
+            const float opacity = std::max(value.a, 0.0f);
+            m_table[i++] = glm::vec4(glm::vec3(value) * opacity, opacity);
+            if (opacity > 0.0f)
+                opaqueColumns[static_cast<size_t>(x)] = true;
+        }
+    }
+
+    m_opaqueColumnPrefixSum.resize(opaqueColumns.size() + 1);
+    m_opaqueColumnPrefixSum[0] = 0;
+    for (size_t x = 0; x < opaqueColumns.size(); x++)
+        m_opaqueColumnPrefixSum[x + 1] = m_opaqueColumnPrefixSum[x] + (opaqueColumns[x] ? 1 : 0);
+}
+}
@@ -0,0 +1,51 @@
+#include "tile_scheduler.h"
+#include <algorithm>
+#include <cstdint>
+#include <glm/common.hpp>
+#include <iterator>
+
+namespace render {
+
+// Spread the lower 16 bits of v over the even bits of the result.
+static uint32_t spreadBits(uint32_t v)
+{
+    v &= 0x0000FFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+static uint32_t mortonCode(const glm::ivec2& tile)
+{
+    return spreadBits(static_cast<uint32_t>(tile.x)) | (spreadBits(static_cast<uint32_t>(tile.y)) << 1);
+}
+
+std::vector<ScreenRect> createTiles(const ScreenRect& area, int tileSize)
+{
+    std::vector<ScreenRect> tiles;
+    createTiles(area, tileSize, tiles);
+    return tiles;
+}
+
+void createTiles(const ScreenRect& area, int tileSize, std::vector<ScreenRect>& tiles)
+{
+    tiles.clear();
+    if (area.end.x <= area.begin.x || area.end.y <= area.begin.y)
+        return;
+
+    const glm::ivec2 firstTile = area.begin / tileSize;
+    const glm::ivec2 lastTile = (area.end - 1) / tileSize;
+    for (int y = firstTile.y; y <= lastTile.y; y++) {
+        for (int x = firstTile.x; x <= lastTile.x; x++) {
+            const glm::ivec2 tile { x, y };
+            tiles.push_back(ScreenRect { glm::max(tile * tileSize, area.begin), glm::min((tile + 1) * tileSize, area.end) });
+        }
+    }
+    // The first pixel of a (clipped) tile lies in the tile, which gives its position on the grid.
+    std::sort(std::begin(tiles), std::end(tiles), [&](const ScreenRect& lhs, const ScreenRect& rhs) {
+        return mortonCode(lhs.begin / tileSize) < mortonCode(rhs.begin / tileSize);
+    });
+}
+}
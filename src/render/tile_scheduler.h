@@ -0,0 +1,28 @@
+#pragma once
+#include <glm/vec2.hpp>
+#include <vector>
+
+namespace render {
+
+// Rectangle of pixels [begin, end).
+struct ScreenRect {
+    glm::ivec2 begin { 0 };
+    glm::ivec2 end { 0 };
+};
+
+// Time spent on a tile, which startSeconds after the start of the image was picked up by the thread with the given
+// index (see volume::ExecutionPolicy::currentThreadIndex).
+struct TileTiming {
+    ScreenRect tile;
+    float seconds;
+    float startSeconds;
+    int threadIndex;
+};
+
+// Splits the pixels of area into tiles on a grid of tileSize x tileSize pixels (tiles on the border of area are
+// clipped). The tiles are ordered along a Morton (Z-order) curve, so tiles that are rendered after each other are
+// also close on screen and mostly sample the same part of the volume.
+std::vector<ScreenRect> createTiles(const ScreenRect& area, int tileSize);
+// Same as above, but writes the tiles to (and reuses the memory of) tiles.
+void createTiles(const ScreenRect& area, int tileSize, std::vector<ScreenRect>& tiles);
+}
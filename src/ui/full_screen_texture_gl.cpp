@@ -1,11 +1,39 @@
 #include "ui/full_screen_texture_gl.h"
 #include "opengl.h"
 #include "ui/gl_error.h"
+#include <algorithm>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/vec3.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 namespace ui {
 
+// Bytes per pixel of the texture (GL_RGBA8).
+static constexpr size_t pixelBytes = 4;
+
+// Rounds a channel in [0, 1] to 8 bits; NaN becomes 0.
+static uint8_t quantize(float value)
+{
+    return static_cast<uint8_t>((value > 0.0f ? std::min(value, 1.0f) : 0.0f) * 255.0f + 0.5f);
+}
+
+static void writePixel(const glm::vec3& color, uint8_t* pOut)
+{
+    pOut[0] = quantize(color.r);
+    pOut[1] = quantize(color.g);
+    pOut[2] = quantize(color.b);
+    pOut[3] = 255;
+}
+
+static void writePixel(const glm::vec4& color, uint8_t* pOut)
+{
+    pOut[0] = quantize(color.r);
+    pOut[1] = quantize(color.g);
+    pOut[2] = quantize(color.b);
+    pOut[3] = quantize(color.a);
+}
+
 FullScreenTextureGL::FullScreenTextureGL()
 {
     // Generate texture
@@ -72,6 +100,14 @@ FullScreenTextureGL::FullScreenTextureGL()
 
 FullScreenTextureGL::~FullScreenTextureGL()
 {
+    for (size_t region = 0; region < numUploadRegions; region++)
+        waitForRegion(region);
+    if (m_pMappedPixels) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &m_pixelBuffer);
     glDeleteTextures(1, &m_texture);
     glDeleteVertexArrays(1, &m_vao);
     glDeleteBuffers(1, &m_vbo);
@@ -80,14 +116,90 @@ FullScreenTextureGL::~FullScreenTextureGL()
 
 void FullScreenTextureGL::update(gsl::span<const glm::vec3> frameBuffer, const glm::ivec2& resolution)
 {
-    glBindTexture(GL_TEXTURE_2D, m_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, resolution.x, resolution.y, 0, GL_RGB, GL_FLOAT, frameBuffer.data());
+    upload(frameBuffer, resolution);
 }
 
 void FullScreenTextureGL::update(gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution)
 {
+    upload(frameBuffer, resolution);
+}
+
+// The pixels are converted straight into the pixel buffer (in parallel, since a 4K image has 8 million of them), and
+// the texture copies them from there without stalling the CPU.
+template <typename Pixel>
+void FullScreenTextureGL::upload(gsl::span<const Pixel> frameBuffer, const glm::ivec2& resolution)
+{
+    if (resolution != m_resolution)
+        resize(resolution);
+
+    const size_t region = m_nextRegion;
+    m_nextRegion = (m_nextRegion + 1) % numUploadRegions;
+    waitForRegion(region);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+    const size_t offset = region * m_regionBytes;
+    uint8_t* pPixels = m_pMappedPixels
+        ? m_pMappedPixels + offset
+        // The fence guarantees that the GPU no longer reads the region.
+        : static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, GLintptr(offset), GLsizeiptr(m_regionBytes),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    const size_t numPixels = std::min(frameBuffer.size(), m_regionBytes / pixelBytes);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, numPixels), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++)
+            writePixel(frameBuffer[i], pPixels + i * pixelBytes);
+    });
+    if (!m_pMappedPixels)
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
     glBindTexture(GL_TEXTURE_2D, m_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, resolution.x, resolution.y, 0, GL_RGBA, GL_FLOAT, frameBuffer.data());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution.x, resolution.y, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset));
+    m_fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// Allocates the texture and a pixel buffer for images of the given resolution.
+void FullScreenTextureGL::resize(const glm::ivec2& resolution)
+{
+    for (size_t region = 0; region < numUploadRegions; region++)
+        waitForRegion(region);
+    if (m_pMappedPixels) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        m_pMappedPixels = nullptr;
+    }
+    glDeleteBuffers(1, &m_pixelBuffer);
+
+    m_resolution = resolution;
+    m_regionBytes = size_t(resolution.x) * size_t(resolution.y) * pixelBytes;
+    const auto bufferBytes = GLsizeiptr(numUploadRegions * m_regionBytes);
+    glGenBuffers(1, &m_pixelBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+        // Coherent, so the writes need no explicit flush before glTexSubImage2D.
+        constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bufferBytes, nullptr, flags);
+        m_pMappedPixels = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bufferBytes, flags));
+    } else {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferBytes, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // Rows of RGBA8 pixels are always 4 byte aligned.
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, resolution.x, resolution.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Waits until the GPU has finished reading the region of the pixel buffer (if it was used before).
+void FullScreenTextureGL::waitForRegion(size_t region)
+{
+    GLsync& fence = m_fences[region];
+    if (!fence)
+        return;
+    constexpr GLuint64 timeoutNanoseconds = 1'000'000'000;
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeoutNanoseconds);
+    glDeleteSync(fence);
+    fence = nullptr;
 }
 
 void FullScreenTextureGL::draw()
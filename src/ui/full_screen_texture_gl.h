@@ -1,5 +1,8 @@
 #pragma once
 #include "ui/window.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
@@ -7,18 +10,41 @@
 
 namespace ui {
 
+// Shows an image of the CPU renderer on a full screen quad. The image is converted to 8 bits per channel while it is
+// written into a pixel buffer, from which the texture is updated in place. The pixel buffer holds numUploadRegions
+// images, so that the next image can be written while the GPU still reads the previous ones; a fence per region tells
+// when the GPU is done with it. Where buffer storage (OpenGL 4.4 or ARB_buffer_storage) is available the pixel buffer
+// stays mapped, otherwise the region is mapped for every image.
 class FullScreenTextureGL {
+public:
+    static constexpr size_t numUploadRegions = 3;
+
 public:
     FullScreenTextureGL();
     ~FullScreenTextureGL();
 
+    // Colors are clamped to [0, 1]; the alpha of RGB images is 1.
     void update(gsl::span<const glm::vec3> frameBuffer, const glm::ivec2& resolution);
     void update(gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution);
     void draw();
 
+private:
+    template <typename Pixel>
+    void upload(gsl::span<const Pixel> frameBuffer, const glm::ivec2& resolution);
+    void resize(const glm::ivec2& resolution);
+    void waitForRegion(size_t region);
+
 private:
     GLuint m_texture;
+    glm::ivec2 m_resolution { 0 };
     GLuint m_vbo, m_vao;
     GLuint m_shader;
+
+    GLuint m_pixelBuffer { 0 };
+    size_t m_regionBytes { 0 };
+    // Start of the pixel buffer if it is persistently mapped, otherwise null.
+    uint8_t* m_pMappedPixels { nullptr };
+    std::array<GLsync, numUploadRegions> m_fences {};
+    size_t m_nextRegion { 0 };
 };
 }
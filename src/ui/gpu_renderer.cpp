@@ -0,0 +1,240 @@
+#include "gpu_renderer.h"
+#include "render/pinhole_camera.h"
+#include <algorithm>
+#include <cstdint>
+#include <glm/gtc/type_ptr.hpp>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace ui {
+
+GPURenderer::GPURenderer(const volume::Volume& volume, const volume::GradientVolume& gradientVolume)
+    : m_dims(volume.dims())
+    , m_volumeMaximum(volume.maximum())
+{
+    // Textures are created with a zero border so that samples outside of the volume are 0, as in volume::Volume.
+    const glm::vec4 border { 0.0f };
+    glGenTextures(1, &m_volumeTexture);
+    glGenTextures(1, &m_gradientTexture);
+    for (GLuint texture : { m_volumeTexture, m_gradientTexture }) {
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
+        glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, glm::value_ptr(border));
+    }
+    uploadVolume(volume);
+    uploadGradients(gradientVolume);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    m_tfColorMap.fill(glm::vec4(0.0f));
+    glGenTextures(1, &m_tfTexture);
+    glBindTexture(GL_TEXTURE_1D, m_tfTexture);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA32F, GLsizei(m_tfColorMap.size()), 0, GL_RGBA, GL_FLOAT, m_tfColorMap.data());
+    glBindTexture(GL_TEXTURE_1D, 0);
+
+    // Full screen quad; the fragment shader computes the ray of every pixel.
+    // clang-format off
+    const std::array vertices {
+        -1.0f, -1.0f,
+        1.0f, -1.0f,
+        1.0f,  1.0f,
+
+        -1.0f, -1.0f,
+        1.0f,  1.0f,
+        -1.0f,  1.0f
+    };
+    // clang-format on
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+    glGenBuffers(1, &m_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
+    glBindVertexArray(0);
+
+    // Load shader
+    {
+        GLuint vertexShader = loadShader("volume_raycast.vs", GL_VERTEX_SHADER);
+        GLuint fragmentShader = loadShader("volume_raycast.fs", GL_FRAGMENT_SHADER);
+
+        m_shader = glCreateProgram();
+        glAttachShader(m_shader, vertexShader);
+        glAttachShader(m_shader, fragmentShader);
+        glLinkProgram(m_shader);
+
+        glDetachShader(m_shader, vertexShader);
+        glDetachShader(m_shader, fragmentShader);
+    }
+
+    glGenQueries(GLsizei(m_timerQueries.size()), m_timerQueries.data());
+}
+
+GPURenderer::~GPURenderer()
+{
+    glDeleteTextures(1, &m_volumeTexture);
+    glDeleteTextures(1, &m_gradientTexture);
+    glDeleteTextures(1, &m_tfTexture);
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteBuffers(1, &m_vbo);
+    glDeleteProgram(m_shader);
+    glDeleteQueries(GLsizei(m_timerQueries.size()), m_timerQueries.data());
+}
+
+// Voxels are uploaded at their native size as normalized integers, one slice at a time so that bricked volumes can
+// be converted to the linear layout of the texture without a full size copy.
+void GPURenderer::uploadVolume(const volume::Volume& volume)
+{
+    glBindTexture(GL_TEXTURE_3D, m_volumeTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    volume.visitVoxelType([&](auto voxelType) {
+        using T = decltype(voxelType);
+        constexpr bool isByte = sizeof(T) == 1;
+        m_valueScale = float(std::numeric_limits<T>::max());
+        glTexImage3D(GL_TEXTURE_3D, 0, isByte ? GL_R8 : GL_R16, m_dims.x, m_dims.y, m_dims.z, 0, GL_RED, isByte ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT, nullptr);
+
+        std::vector<T> slice(static_cast<size_t>(m_dims.x * m_dims.y));
+        for (int z = 0; z < m_dims.z; z++) {
+            size_t i = 0;
+            for (int y = 0; y < m_dims.y; y++) {
+                for (int x = 0; x < m_dims.x; x++)
+                    slice[i++] = static_cast<T>(volume.getVoxelUnchecked<T>(x, y, z));
+            }
+            glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, z, m_dims.x, m_dims.y, 1, GL_RED, isByte ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT, slice.data());
+        }
+    });
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// Gradients are stored as half floats (direction, magnitude), which is plenty for shading and the 2D transfer
+// functions. They are read through getGradientVoxel so that every gradient storage mode is supported.
+void GPURenderer::uploadGradients(const volume::GradientVolume& gradientVolume)
+{
+    glBindTexture(GL_TEXTURE_3D, m_gradientTexture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, m_dims.x, m_dims.y, m_dims.z, 0, GL_RGBA, GL_FLOAT, nullptr);
+
+    std::vector<glm::vec4> slice(static_cast<size_t>(m_dims.x * m_dims.y));
+    for (int z = 0; z < m_dims.z; z++) {
+        size_t i = 0;
+        for (int y = 0; y < m_dims.y; y++) {
+            for (int x = 0; x < m_dims.x; x++) {
+                const volume::GradientVoxel gradient = gradientVolume.getGradientVoxel(x, y, z);
+                slice[i++] = glm::vec4(gradient.dir, gradient.magnitude);
+            }
+        }
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, z, m_dims.x, m_dims.y, 1, GL_RGBA, GL_FLOAT, slice.data());
+    }
+}
+
+// The transfer function only changes while the user edits it, so it is only uploaded when it differs from the last upload.
+void GPURenderer::updateTransferFunction(const render::RenderConfig& config)
+{
+    if (config.tfColorMap == m_tfColorMap)
+        return;
+
+    m_tfColorMap = config.tfColorMap;
+    glBindTexture(GL_TEXTURE_1D, m_tfTexture);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, GLsizei(m_tfColorMap.size()), GL_RGBA, GL_FLOAT, m_tfColorMap.data());
+    glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+// Nearest neighbour and trilinear interpolation are done by the texture units. Tricubic interpolation reads the voxels
+// with texelFetch (which ignores the filter) and uses trilinearly interpolated gradients, like volume::GradientVolume.
+void GPURenderer::setInterpolationMode(volume::InterpolationMode interpolationMode)
+{
+    const GLint volumeFilter = interpolationMode == volume::InterpolationMode::Linear ? GL_LINEAR : GL_NEAREST;
+    const GLint gradientFilter = interpolationMode == volume::InterpolationMode::NearestNeighbour ? GL_NEAREST : GL_LINEAR;
+    glBindTexture(GL_TEXTURE_3D, m_volumeTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, volumeFilter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, volumeFilter);
+    glBindTexture(GL_TEXTURE_3D, m_gradientTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, gradientFilter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, gradientFilter);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void GPURenderer::draw(const render::RayTraceCamera& camera, const render::RenderConfig& config, volume::InterpolationMode interpolationMode)
+{
+    // The shader generates rays from an explicit pinhole model instead of calling generateRay.
+    const std::optional<render::PinholeCamera> optPinhole = render::fitPinholeCamera(camera);
+    if (!optPinhole)
+        return;
+
+    updateTransferFunction(config);
+    setInterpolationMode(interpolationMode);
+
+    // Read the timing of the draw call that used this query before (a few frames ago).
+    GLuint timerQuery = m_timerQueries[m_nextTimerQuery];
+    if (m_timerQueryIssued[m_nextTimerQuery]) {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &nanoseconds);
+        m_renderTime = std::chrono::duration<double>(double(nanoseconds) * 1e-9);
+    }
+    m_timerQueryIssued[m_nextTimerQuery] = true;
+    m_nextTimerQuery = (m_nextTimerQuery + 1) % m_timerQueries.size();
+
+    glUseProgram(m_shader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, m_volumeTexture);
+    glUniform1i(glGetUniformLocation(m_shader, "u_volume"), 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, m_gradientTexture);
+    glUniform1i(glGetUniformLocation(m_shader, "u_gradients"), 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_1D, m_tfTexture);
+    glUniform1i(glGetUniformLocation(m_shader, "u_tfColorMap"), 2);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform3iv(glGetUniformLocation(m_shader, "u_dims"), 1, glm::value_ptr(m_dims));
+    glUniform1f(glGetUniformLocation(m_shader, "u_valueScale"), m_valueScale);
+    glUniform1f(glGetUniformLocation(m_shader, "u_volumeMaximum"), m_volumeMaximum);
+    glUniform1i(glGetUniformLocation(m_shader, "u_interpolationMode"), int(interpolationMode));
+
+    glUniform3fv(glGetUniformLocation(m_shader, "u_cameraOrigin"), 1, glm::value_ptr(optPinhole->origin));
+    glUniform3fv(glGetUniformLocation(m_shader, "u_cameraForward"), 1, glm::value_ptr(optPinhole->forward));
+    glUniform3fv(glGetUniformLocation(m_shader, "u_cameraRight"), 1, glm::value_ptr(optPinhole->right));
+    glUniform3fv(glGetUniformLocation(m_shader, "u_cameraUp"), 1, glm::value_ptr(optPinhole->up));
+
+    glUniform1i(glGetUniformLocation(m_shader, "u_renderMode"), int(config.renderMode));
+    glUniform1i(glGetUniformLocation(m_shader, "u_volumeShading"), config.volumeShading);
+    glUniform1i(glGetUniformLocation(m_shader, "u_shadingModel"), int(config.shadingModel));
+    glUniform1f(glGetUniformLocation(m_shader, "u_isoValue"), config.isoValue);
+    glUniform1i(glGetUniformLocation(m_shader, "u_frontToBackCompositing"), config.frontToBackCompositing);
+    glUniform1f(glGetUniformLocation(m_shader, "u_earlyRayTerminationThreshold"), config.earlyRayTerminationThreshold);
+    glUniform1f(glGetUniformLocation(m_shader, "u_sampleStep"), std::max(config.sampleStep, 0.01f));
+    glUniform1i(glGetUniformLocation(m_shader, "u_adaptiveSampleStep"), config.adaptiveSampleStep);
+    glUniform1f(glGetUniformLocation(m_shader, "u_maxSampleStep"), config.maxSampleStep);
+
+    const render::ClipRegion region = render::clipRegion(config, glm::vec3(0.0f), glm::vec3(m_dims));
+    glUniform3fv(glGetUniformLocation(m_shader, "u_roiLower"), 1, glm::value_ptr(region.lower));
+    glUniform3fv(glGetUniformLocation(m_shader, "u_roiUpper"), 1, glm::value_ptr(region.upper));
+    glUniform4fv(glGetUniformLocation(m_shader, "u_clipPlanes"), GLsizei(region.planes.size()), glm::value_ptr(region.planes[0]));
+    glUniform1i(glGetUniformLocation(m_shader, "u_numClipPlanes"), int(region.numPlanes));
+    glUniform1i(glGetUniformLocation(m_shader, "u_clipped"), region.clipped);
+
+    glUniform1f(glGetUniformLocation(m_shader, "u_tfColorMapIndexStart"), config.tfColorMapIndexStart);
+    glUniform1f(glGetUniformLocation(m_shader, "u_tfColorMapIndexRange"), config.tfColorMapIndexRange);
+    glUniform1f(glGetUniformLocation(m_shader, "u_tf2DIntensity"), config.TF2DIntensity);
+    glUniform1f(glGetUniformLocation(m_shader, "u_tf2DRadius"), config.TF2DRadius);
+    glUniform4fv(glGetUniformLocation(m_shader, "u_tf2DColor"), 1, glm::value_ptr(config.TF2DColor));
+    glUniform2f(glGetUniformLocation(m_shader, "u_tf2DV2Intensity"), config.TF2DV2Intensity_0, config.TF2DV2Intensity_1);
+    glUniform2f(glGetUniformLocation(m_shader, "u_tf2DV2Radius"), config.TF2DV2Radius_0, config.TF2DV2Radius_1);
+    glUniform4fv(glGetUniformLocation(m_shader, "u_tf2DV2Color0"), 1, glm::value_ptr(config.TF2DV2Color_0));
+    glUniform4fv(glGetUniformLocation(m_shader, "u_tf2DV2Color1"), 1, glm::value_ptr(config.TF2DV2Color_1));
+
+    glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+    glBindVertexArray(m_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
+std::chrono::duration<double> GPURenderer::renderTime() const
+{
+    return m_renderTime;
+}
+}
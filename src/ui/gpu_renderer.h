@@ -0,0 +1,57 @@
+#pragma once
+#include "render/ray_trace_camera.h"
+#include "render/render_config.h"
+#include "ui/opengl.h"
+#include "volume/gradient_volume.h"
+#include "volume/volume.h"
+#include <array>
+#include <chrono>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace ui {
+
+// Ray casts the volume in a fragment shader (shaders/volume_raycast.fs). The volume and its gradients are uploaded
+// once as 3D textures and the 1D transfer function as a 1D texture; all other settings are passed as uniforms.
+//
+// Supports the same render modes and interpolation modes as render::Renderer and produces the same (premultiplied)
+// colors, but always at the resolution of the viewport and without empty space skipping.
+class GPURenderer {
+public:
+    GPURenderer(const volume::Volume& volume, const volume::GradientVolume& gradientVolume);
+    ~GPURenderer();
+
+    GPURenderer(const GPURenderer&) = delete;
+    GPURenderer& operator=(const GPURenderer&) = delete;
+
+    // Draw the volume into the current viewport. The camera must be a pinhole camera (see render::fitPinholeCamera).
+    void draw(const render::RayTraceCamera& camera, const render::RenderConfig& config, volume::InterpolationMode interpolationMode);
+    // GPU time of the most recent draw call whose timing is known.
+    std::chrono::duration<double> renderTime() const;
+
+private:
+    void uploadVolume(const volume::Volume& volume);
+    void uploadGradients(const volume::GradientVolume& gradientVolume);
+    void updateTransferFunction(const render::RenderConfig& config);
+    void setInterpolationMode(volume::InterpolationMode interpolationMode);
+
+private:
+    glm::ivec3 m_dims;
+    // Converts normalized texture values back into voxel values.
+    float m_valueScale;
+    float m_volumeMaximum;
+
+    GLuint m_volumeTexture, m_gradientTexture, m_tfTexture;
+    decltype(render::RenderConfig::tfColorMap) m_tfColorMap;
+    GLuint m_vbo, m_vao;
+    GLuint m_shader;
+
+    // Timer queries of the last few draw calls. A query is only read when it is reused, by which time the GPU
+    // has finished it, so that draw() does not wait for the GPU.
+    static constexpr size_t numTimerQueries = 4;
+    std::array<GLuint, numTimerQueries> m_timerQueries;
+    std::array<bool, numTimerQueries> m_timerQueryIssued {};
+    size_t m_nextTimerQuery { 0 };
+    std::chrono::duration<double> m_renderTime { 0 };
+};
+}
@@ -0,0 +1,188 @@
+#include "ui/histogram_image_gl.h"
+#include "opengl.h"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace ui {
+
+// Merges neighbouring bins into at most HistogramImageGL::maxBins along each axis, keeping the largest count.
+static std::vector<int> mergeBins(gsl::span<const int> counts, const glm::ivec2& resolution, glm::ivec2& outResolution)
+{
+    const glm::ivec2 factor = (resolution + HistogramImageGL::maxBins - 1) / HistogramImageGL::maxBins;
+    outResolution = (resolution + factor - 1) / factor;
+    if (factor == glm::ivec2(1))
+        return std::vector<int>(std::begin(counts), std::end(counts));
+
+    std::vector<int> merged(size_t(outResolution.x) * size_t(outResolution.y), 0);
+    for (int y = 0; y < resolution.y; y++) {
+        int* pOutRow = merged.data() + size_t(y / factor.y) * size_t(outResolution.x);
+        const int* pRow = counts.data() + size_t(y) * size_t(resolution.x);
+        for (int x = 0; x < resolution.x; x++)
+            pOutRow[x / factor.x] = std::max(pOutRow[x / factor.x], pRow[x]);
+    }
+    return merged;
+}
+
+HistogramImageGL::HistogramImageGL(const glm::ivec2& imageSize)
+    : m_imageSize(imageSize)
+{
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, imageSize.x, imageSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+
+    // Integer textures cannot be filtered; the shader fetches the bins it needs.
+    glGenTextures(1, &m_countsTexture);
+    glBindTexture(GL_TEXTURE_2D, m_countsTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    const int noCounts = 0;
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, 1, 1, 0, GL_RED_INTEGER, GL_INT, &noCounts);
+    m_countsResolution = glm::ivec2(1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The image is covered by a single triangle whose corners are computed from gl_VertexID, so the vertex array
+    // has no buffers (but core profiles require one to be bound).
+    glGenVertexArrays(1, &m_vao);
+
+    // Load shader
+    {
+        GLuint vertexShader = loadShader("histogram.vs", GL_VERTEX_SHADER);
+        GLuint fragmentShader = loadShader("histogram.fs", GL_FRAGMENT_SHADER);
+
+        m_shader = glCreateProgram();
+        glAttachShader(m_shader, vertexShader);
+        glAttachShader(m_shader, fragmentShader);
+        glLinkProgram(m_shader);
+
+        glDetachShader(m_shader, vertexShader);
+        glDetachShader(m_shader, fragmentShader);
+    }
+}
+
+HistogramImageGL::~HistogramImageGL()
+{
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteTextures(1, &m_texture);
+    glDeleteTextures(1, &m_countsTexture);
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteProgram(m_shader);
+}
+
+void HistogramImageGL::setCounts(gsl::span<const int> counts)
+{
+    setCounts(counts, glm::ivec2(int(counts.size()), 1));
+    m_densityPlot = false;
+}
+
+// The counts texture is updated in place if the merged bins have the same resolution as the current ones.
+void HistogramImageGL::setCounts(gsl::span<const int> counts, const glm::ivec2& resolution)
+{
+    m_densityPlot = true;
+    m_changed = true;
+    if (counts.empty() || size_t(resolution.x) * size_t(resolution.y) > counts.size()) {
+        m_maxCount = 0;
+        return;
+    }
+
+    glm::ivec2 mergedResolution;
+    const std::vector<int> merged = mergeBins(counts, resolution, mergedResolution);
+    m_maxCount = *std::max_element(std::begin(merged), std::end(merged));
+
+    // Rows of 32-bit texels are always 4 byte aligned.
+    glBindTexture(GL_TEXTURE_2D, m_countsTexture);
+    if (mergedResolution == m_countsResolution)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mergedResolution.x, mergedResolution.y, GL_RED_INTEGER, GL_INT, merged.data());
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, mergedResolution.x, mergedResolution.y, 0, GL_RED_INTEGER, GL_INT, merged.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_countsResolution = mergedResolution;
+}
+
+void HistogramImageGL::setColorMap(GLuint colorMapTexture)
+{
+    m_colorMapTexture = colorMapTexture;
+    m_changed = true;
+}
+
+void HistogramImageGL::setLogScale(bool logScale)
+{
+    m_changed |= logScale != m_logScale;
+    m_logScale = logScale;
+}
+
+void HistogramImageGL::setOpacity(float opacity)
+{
+    m_changed |= opacity != m_opacity;
+    m_opacity = opacity;
+}
+
+GLuint HistogramImageGL::texture()
+{
+    if (m_changed)
+        render();
+    m_changed = false;
+    return m_texture;
+}
+
+// The image is rendered in the middle of building the UI, so the state that this changes is restored afterwards.
+void HistogramImageGL::render()
+{
+    GLint previousFramebuffer = 0, previousProgram = 0, previousVao = 0, previousActiveTexture = 0;
+    std::array<GLint, 4> previousViewport {};
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &previousActiveTexture);
+    glGetIntegerv(GL_VIEWPORT, previousViewport.data());
+    const GLboolean blend = glIsEnabled(GL_BLEND);
+    const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glViewport(0, 0, m_imageSize.x, m_imageSize.y);
+
+    glUseProgram(m_shader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_countsTexture);
+    glUniform1i(glGetUniformLocation(m_shader, "u_counts"), 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_colorMapTexture);
+    glUniform1i(glGetUniformLocation(m_shader, "u_colorMap"), 1);
+
+    glUniform2f(glGetUniformLocation(m_shader, "u_imageSize"), float(m_imageSize.x), float(m_imageSize.y));
+    glUniform1i(glGetUniformLocation(m_shader, "u_densityPlot"), m_densityPlot);
+    glUniform1i(glGetUniformLocation(m_shader, "u_useColorMap"), m_colorMapTexture != 0);
+    glUniform1i(glGetUniformLocation(m_shader, "u_logScale"), m_logScale);
+    glUniform1f(glGetUniformLocation(m_shader, "u_maxCount"), float(m_maxCount));
+    glUniform1f(glGetUniformLocation(m_shader, "u_opacity"), m_opacity);
+
+    glBindVertexArray(m_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GLenum(previousActiveTexture));
+    glBindVertexArray(GLuint(previousVao));
+    glUseProgram(GLuint(previousProgram));
+    glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    if (blend)
+        glEnable(GL_BLEND);
+    if (depthTest)
+        glEnable(GL_DEPTH_TEST);
+}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <GL/glew.h> // Include before glfw3
+#include <glm/vec2.hpp>
+#include <gsl/span>
+
+namespace ui {
+
+// Image of the histogram behind a transfer function widget. Only the counts of the bins are uploaded (as an integer
+// texture); a shader turns them into the image (scaling, opacity and the colors of the transfer function) when it
+// changed, rendering into a texture of the size of the widget. Bins are merged (keeping the largest count) until there
+// are at most maxBins along each axis, and every pixel shows the largest count of the bins that it covers, so that
+// narrow peaks do not disappear from the image.
+class HistogramImageGL {
+public:
+    static constexpr int maxBins = 1024;
+
+public:
+    explicit HistogramImageGL(const glm::ivec2& imageSize);
+    ~HistogramImageGL();
+    HistogramImageGL(const HistogramImageGL&) = delete;
+    HistogramImageGL& operator=(const HistogramImageGL&) = delete;
+
+    // Bar chart of a 1D histogram, whose bars are tinted by the color map (see setColorMap).
+    void setCounts(gsl::span<const int> counts);
+    // Density plot of a 2D histogram of resolution.x by resolution.y bins (stored row by row, see Histogram2D), with
+    // its y axis pointing upwards.
+    void setCounts(gsl::span<const int> counts, const glm::ivec2& resolution);
+    // Texture with a row of RGBA colors that the bars are colored with, or 0 for white bars. Call it again when the
+    // colors in the texture change.
+    void setColorMap(GLuint colorMapTexture);
+    void setLogScale(bool logScale);
+    void setOpacity(float opacity);
+
+    // Renders the image if anything changed and returns its texture (GL_RGBA8, imageSize pixels).
+    GLuint texture();
+
+private:
+    void render();
+
+private:
+    glm::ivec2 m_imageSize;
+    GLuint m_texture, m_framebuffer;
+    GLuint m_countsTexture;
+    glm::ivec2 m_countsResolution { 0 };
+    GLuint m_vao;
+    GLuint m_shader;
+
+    bool m_densityPlot { false };
+    int m_maxCount { 0 };
+    GLuint m_colorMapTexture { 0 };
+    bool m_logScale { false };
+    float m_opacity { 1.0f };
+    bool m_changed { true };
+};
+}
@@ -1,10 +1,17 @@
 #include "menu.h"
 #include "render/renderer.h"
+#include "volume/histogram_2d.h"
+#include <algorithm>
+#include <cfloat>
 #include <filesystem>
+#include <fstream>
 #include <fmt/format.h>
+#include <glm/gtc/type_ptr.hpp>
 #include <imgui.h>
 #include <iostream>
 #include <nfd.h>
+#include <numeric>
+#include <vector>
 
 namespace ui {
 
@@ -19,6 +26,11 @@ void Menu::setLoadVolumeCallback(LoadVolumeCallback&& callback)
     m_optLoadVolumeCallback = std::move(callback);
 }
 
+void Menu::setLoadVolumeSeriesCallback(LoadVolumeCallback&& callback)
+{
+    m_optLoadVolumeSeriesCallback = std::move(callback);
+}
+
 void Menu::setRenderConfigChangedCallback(RenderConfigChangedCallback&& callback)
 {
     m_optRenderConfigChangedCallback = std::move(callback);
@@ -29,7 +41,7 @@ void Menu::setInterpolationModeChangedCallback(InterpolationModeChangedCallback&
     m_optInterpolationModeChangedCallback = std::move(callback);
 }
 
-render::RenderConfig Menu::renderConfig() const
+const render::RenderConfig& Menu::renderConfig() const
 {
     return m_renderConfig;
 }
@@ -39,6 +51,48 @@ volume::InterpolationMode Menu::interpolationMode() const
     return m_interpolationMode;
 }
 
+volume::VoxelLayout Menu::voxelLayout() const
+{
+    return m_voxelLayout;
+}
+
+volume::GradientStorage Menu::gradientStorage() const
+{
+    return m_gradientStorage;
+}
+
+std::optional<size_t> Menu::brickStreamingBudget() const
+{
+    if (!m_streamBricks)
+        return {};
+    return size_t(std::max(m_brickStreamingMegabytes, 1)) << 20;
+}
+
+bool Menu::compressVoxels() const
+{
+    return m_compressVoxels;
+}
+
+bool Menu::cacheDerivedData() const
+{
+    return m_cacheDerivedData;
+}
+
+size_t Menu::timestep() const
+{
+    return size_t(m_timestep);
+}
+
+bool Menu::isPlaying() const
+{
+    return m_playing;
+}
+
+std::chrono::duration<double> Menu::timestepDuration() const
+{
+    return std::chrono::duration<double>(1.0 / std::max(m_playbackRate, 1));
+}
+
 void Menu::setBaseRenderResolution(const glm::ivec2& baseRenderResolution)
 {
     m_baseRenderResolution = baseRenderResolution;
@@ -48,25 +102,66 @@ void Menu::setBaseRenderResolution(const glm::ivec2& baseRenderResolution)
 
 // This function handles a part of the volume loading where we create the widget histograms, set some config values
 //  and set the menu volume information
-void Menu::setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume& gradientVolume)
+void Menu::setLoadedVolume(const volume::Volume& volume, const volume::Histogram2D& histogram)
 {
-    m_tfWidget = TransferFunctionWidget(volume);
-    m_tf2DWidget = TransferFunction2DWidget(volume, gradientVolume);
-    m_tf2DV2Widget = TransferFunction2DV2Widget(volume, gradientVolume);
+    m_tfWidget.emplace(volume);
+    m_tf2DWidget.emplace(volume, histogram);
+    m_tf2DV2Widget.emplace(volume, histogram);
 
     m_tfWidget->updateRenderConfig(m_renderConfig);
     m_tf2DWidget->updateRenderConfig(m_renderConfig);
     m_tf2DV2Widget->updateRenderConfig(m_renderConfig);
 
+    updateVolumeInfo(volume);
+    m_numTimesteps = 0;
+    m_timestep = 0;
+    m_playing = false;
+    m_volumeLoaded = true;
+}
+
+void Menu::setLoadedVolumeSeries(size_t numTimesteps)
+{
+    m_numTimesteps = numTimesteps;
+}
+
+// Updating the histograms in place (instead of creating new widgets) keeps the transfer functions during playback.
+void Menu::setShownTimestep(size_t step, const volume::Volume& volume, const volume::Histogram2D& histogram)
+{
+    updateHistograms(volume, histogram);
+    // While playing the slider follows the shown timestep.
+    if (m_playing)
+        m_timestep = int(step);
+}
+
+void Menu::updateHistograms(const volume::Volume& volume, const volume::Histogram2D& histogram)
+{
+    m_tfWidget->updateHistogram(volume);
+    m_tf2DWidget->updateHistogram(volume, histogram);
+    m_tf2DV2Widget->updateHistogram(volume, histogram);
+
+    m_tfWidget->updateRenderConfig(m_renderConfig);
+    m_tf2DWidget->updateRenderConfig(m_renderConfig);
+    m_tf2DV2Widget->updateRenderConfig(m_renderConfig);
+
+    updateVolumeInfo(volume);
+}
+
+void Menu::setLoadProgress(std::optional<float> optProgress, const std::string& step)
+{
+    m_optLoadProgress = optProgress;
+    m_loadStep = step;
+}
+
+void Menu::updateVolumeInfo(const volume::Volume& volume)
+{
     const glm::ivec3 dim = volume.dims();
     m_volumeInfo = fmt::format("Volume info:\n{}\nDimensions: ({}, {}, {})\nVoxel value range: {} - {}\n",
         volume.fileName(), dim.x, dim.y, dim.z, volume.minimum(), volume.maximum());
     m_volumeMax = int(volume.maximum());
-    m_volumeLoaded = true;
 }
 
 // This function draws the menu
-void Menu::drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::duration<double> renderTime)
+void Menu::drawMenu(const glm::ivec2& pos, const glm::ivec2& size, const render::RenderProfile& profile)
 {
     static bool open = 1;
     ImGui::Begin("VolVis", &open, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
@@ -79,10 +174,11 @@ void Menu::drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::
         const auto renderConfigBefore = m_renderConfig;
         const auto interpolationModeBefore = m_interpolationMode;
 
-        showRayCastTab(renderTime);
+        showRayCastTab(profile.renderTime);
         showTransFuncTab();
         show2DTransFuncTab();
         show2DV2TransFuncTab();
+        showProfilerTab(profile);
 
         if (m_renderConfig != renderConfigBefore)
             callRenderConfigChangedCallback();
@@ -111,9 +207,70 @@ void Menu::showLoadVolTab()
             }
         }
 
-        if (m_volumeLoaded)
+        // A time series is a directory with one .fld file per timestep, played in the order of the file names.
+        ImGui::SameLine();
+        if (ImGui::Button("Load time series")) {
+            nfdchar_t* pOutPath = nullptr;
+            nfdresult_t result = NFD_PickFolder(nullptr, &pOutPath);
+
+            if (result == NFD_OKAY) {
+                std::filesystem::path path = pOutPath;
+                if (m_optLoadVolumeSeriesCallback)
+                    (*m_optLoadVolumeSeriesCallback)(path);
+            }
+        }
+        // A volume is shown (with gradients computed on the fly) before all of its data has been derived.
+        if (m_optLoadProgress)
+            ImGui::ProgressBar(*m_optLoadProgress, ImVec2(-1.0f, 0.0f), m_loadStep.c_str());
+
+        // The voxel layout and gradient storage are chosen when a volume is loaded.
+        int* pVoxelLayoutInt = reinterpret_cast<int*>(&m_voxelLayout);
+        ImGui::Text("Voxel layout:");
+        ImGui::RadioButton("Linear", pVoxelLayoutInt, int(volume::VoxelLayout::Linear));
+        ImGui::SameLine();
+        ImGui::RadioButton("Bricked", pVoxelLayoutInt, int(volume::VoxelLayout::Bricked));
+
+        int* pGradientStorageInt = reinterpret_cast<int*>(&m_gradientStorage);
+        ImGui::Text("Gradient storage:");
+        ImGui::RadioButton("Full (16 bytes/voxel)", pGradientStorageInt, int(volume::GradientStorage::Full));
+        ImGui::SameLine();
+        ImGui::RadioButton("Compact (4 bytes/voxel)", pGradientStorageInt, int(volume::GradientStorage::Compact));
+        ImGui::RadioButton("On the fly", pGradientStorageInt, int(volume::GradientStorage::OnTheFly));
+        ImGui::SameLine();
+        ImGui::RadioButton("Cached on first use", pGradientStorageInt, int(volume::GradientStorage::Cached));
+
+        // Streaming only applies to files in the bricked layout (see ConvertVolume) and computes the gradients on the fly.
+        ImGui::Checkbox("Stream bricks from disk", &m_streamBricks);
+        if (m_streamBricks)
+            ImGui::SliderInt("Streaming budget (MB)", &m_brickStreamingMegabytes, 64, 64 * 1024);
+        ImGui::Checkbox("Compress voxels in memory", &m_compressVoxels);
+        // The cache is written the first time that a file is loaded with the chosen layout and gradient storage.
+        ImGui::Checkbox("Cache derived data next to the file", &m_cacheDerivedData);
+
+        if (m_volumeLoaded) {
             ImGui::Text("%s", m_volumeInfo.c_str());
 
+            // Timesteps that are not loaded yet are shown once they are, so playback may run slower than the rate.
+            if (m_numTimesteps > 0) {
+                ImGui::Checkbox("Play", &m_playing);
+                ImGui::SliderInt("Timestep", &m_timestep, 0, int(m_numTimesteps) - 1);
+                ImGui::SliderInt("Playback rate (timesteps/s)", &m_playbackRate, 1, 60);
+            }
+
+            // Saves the render settings, for example to render an animation with the same settings in BatchRender.
+            if (ImGui::Button("Save render config")) {
+                nfdchar_t* pOutPath = nullptr;
+                nfdresult_t result = NFD_SaveDialog("cfg", nullptr, &pOutPath);
+
+                if (result == NFD_OKAY) {
+                    std::ofstream stream { std::filesystem::path(pOutPath) };
+                    render::writeRenderConfig(stream, m_renderConfig);
+                    if (!stream)
+                        std::cerr << "Could not write render config to " << pOutPath << std::endl;
+                }
+            }
+        }
+
         ImGui::EndTabItem();
     }
 }
@@ -128,6 +285,14 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
         ImGui::Text("%s", renderText.c_str());
         ImGui::NewLine();
 
+        int* pRenderBackendInt = reinterpret_cast<int*>(&m_renderConfig.renderBackend);
+        ImGui::Text("Renderer:");
+        ImGui::RadioButton("CPU", pRenderBackendInt, int(render::RenderBackend::CPU));
+        ImGui::SameLine();
+        ImGui::RadioButton("GPU (OpenGL)", pRenderBackendInt, int(render::RenderBackend::GPU));
+
+        ImGui::NewLine();
+
         int* pRenderModeInt = reinterpret_cast<int*>(&m_renderConfig.renderMode);
         ImGui::Text("Render Mode:");
         ImGui::RadioButton("Slicer", pRenderModeInt, int(render::RenderMode::RenderSlicer));
@@ -140,6 +305,16 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
         ImGui::NewLine();
 
         ImGui::Checkbox("Volume Shading", &m_renderConfig.volumeShading);
+        if (m_renderConfig.volumeShading) {
+            int* pShadingModelInt = reinterpret_cast<int*>(&m_renderConfig.shadingModel);
+            ImGui::RadioButton("Phong", pShadingModelInt, int(render::ShadingModel::Phong));
+            ImGui::SameLine();
+            ImGui::RadioButton("Blinn-Phong", pShadingModelInt, int(render::ShadingModel::BlinnPhong));
+        }
+        ImGui::Checkbox("Empty Space Skipping", &m_renderConfig.emptySpaceSkipping);
+        ImGui::Checkbox("Front-to-back Compositing", &m_renderConfig.frontToBackCompositing);
+        if (m_renderConfig.frontToBackCompositing || m_renderConfig.adaptiveSampleStep || m_renderConfig.preIntegratedTF)
+            ImGui::DragFloat("Ray Termination Opacity", &m_renderConfig.earlyRayTerminationThreshold, 0.001f, 0.5f, 1.0f);
 
         ImGui::NewLine();
 
@@ -147,8 +322,45 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
 
         ImGui::NewLine();
 
+        ImGui::DragFloat("Sample step", &m_renderConfig.sampleStep, 0.01f, 0.1f, 4.0f);
+        ImGui::DragFloat("Interactive sample step", &m_renderConfig.interactiveSampleStep, 0.01f, 0.1f, 8.0f);
+        ImGui::Checkbox("Adaptive sample step", &m_renderConfig.adaptiveSampleStep);
+        ImGui::Checkbox("Pre-integrated transfer function", &m_renderConfig.preIntegratedTF);
+        ImGui::Checkbox("Cache samples for transfer function edits", &m_renderConfig.sampleCache);
+        ImGui::Checkbox("Reproject the previous image", &m_renderConfig.temporalReprojection);
+        if (m_renderConfig.adaptiveSampleStep)
+            ImGui::DragFloat("Max sample step", &m_renderConfig.maxSampleStep, 0.01f, 1.0f, 16.0f);
+        ImGui::Checkbox("Levels of detail", &m_renderConfig.levelOfDetail);
+        if (m_renderConfig.levelOfDetail) {
+            ImGui::DragFloat("Level of detail bias", &m_renderConfig.levelOfDetailBias, 0.01f, -2.0f, 4.0f);
+            ImGui::DragFloat("Interactive level of detail bias", &m_renderConfig.interactiveLevelOfDetailBias, 0.01f, -2.0f, 4.0f);
+        }
+
+        ImGui::NewLine();
+
+        // The region of interest is given as fractions of the volume size, the clip plane offsets in voxels.
+        ImGui::Text("Region of interest:");
+        ImGui::SliderFloat3("ROI lower", glm::value_ptr(m_renderConfig.roiLower), 0.0f, 1.0f);
+        ImGui::SliderFloat3("ROI upper", glm::value_ptr(m_renderConfig.roiUpper), 0.0f, 1.0f);
+        for (size_t i = 0; i < m_renderConfig.clipPlanes.size(); i++) {
+            glm::vec4& plane = m_renderConfig.clipPlanes[i];
+            ImGui::PushID(int(i));
+            bool enabled = glm::vec3(plane) != glm::vec3(0.0f);
+            if (ImGui::Checkbox("Clip plane", &enabled))
+                plane = enabled ? glm::vec4(1.0f, 0.0f, 0.0f, 0.0f) : glm::vec4(0.0f);
+            if (enabled) {
+                ImGui::SliderFloat3("Normal", glm::value_ptr(plane), -1.0f, 1.0f);
+                ImGui::DragFloat("Offset", &plane.w, 0.25f);
+            }
+            ImGui::PopID();
+        }
+
+        ImGui::NewLine();
+
         ImGui::DragFloat("Resolution scale", &m_resolutionScale, 0.0025f, 0.25f, 2.0f);
         m_renderConfig.renderResolution = glm::ivec2(glm::vec2(m_baseRenderResolution) * m_resolutionScale);
+        ImGui::SliderInt("Tile size", &m_renderConfig.tileSize, 4, 128);
+        ImGui::SliderInt("Tiles per task", &m_renderConfig.tileGrainSize, 1, 64);
 
         ImGui::NewLine();
 
@@ -204,4 +416,87 @@ void Menu::callInterpolationModeChangedCallback() const
         (*m_optInterpolationModeChangedCallback)(m_interpolationMode);
 }
 
+// This renders the Profiler tab, which shows what the CPU ray caster spent the time of the latest image on: the samples
+//  that it took and shaded (see render::RenderStatistics) and how the tiles were distributed over the threads.
+void Menu::showProfilerTab(const render::RenderProfile& profile)
+{
+    if (ImGui::BeginTabItem("Profiler")) {
+        if (m_renderConfig.renderBackend != render::RenderBackend::CPU) {
+            ImGui::Text("Only the CPU renderer is profiled.");
+            ImGui::EndTabItem();
+            return;
+        }
+
+        const render::RenderStatistics& s = profile.statistics;
+        const auto percentage = [](uint64_t part, uint64_t total) { return total > 0 ? 100.0 * double(part) / double(total) : 0.0; };
+        const uint64_t raysHit = s.raysCast - s.raysMissed;
+        const std::string countersText = fmt::format(
+            "rendering time: {:.1f}ms\n"
+            "rays cast: {} ({:.1f}% miss the volume)\n"
+            "samples: {} ({:.1f} per ray that hits the volume)\n"
+            "samples skipped: {} ({:.1f}% of the ray length)\n"
+            "shaded samples: {} ({:.1f}% of the samples)\n"
+            "early ray terminations: {} ({:.1f}% of the rays that hit)\n"
+            "iso surface refinement iterations: {}\n",
+            std::chrono::duration<double, std::milli>(profile.renderTime).count(),
+            s.raysCast, percentage(s.raysMissed, s.raysCast),
+            s.samples, raysHit > 0 ? double(s.samples) / double(raysHit) : 0.0,
+            s.samplesSkipped, percentage(s.samplesSkipped, s.samples + s.samplesSkipped),
+            s.shadedSamples, percentage(s.shadedSamples, s.samples),
+            s.earlyTerminations, percentage(s.earlyTerminations, raysHit),
+            s.refinementIterations);
+        ImGui::Text("%s", countersText.c_str());
+
+        if (!profile.tileTimings.empty()) {
+            // Histogram of the tile times, and the time that every thread spent on tiles between the start of the first
+            // tile and the end of the last one. Threads that are busy for only part of that time wait for work.
+            constexpr size_t numBuckets = 32;
+            float maxSeconds = 0.0f, endSeconds = 0.0f;
+            std::vector<float> threadSeconds;
+            for (const render::TileTiming& timing : profile.tileTimings) {
+                maxSeconds = std::max(maxSeconds, timing.seconds);
+                endSeconds = std::max(endSeconds, timing.startSeconds + timing.seconds);
+                const size_t thread = size_t(std::max(timing.threadIndex, 0));
+                threadSeconds.resize(std::max(threadSeconds.size(), thread + 1), 0.0f);
+                threadSeconds[thread] += timing.seconds;
+            }
+            std::vector<float> tileHistogram(numBuckets, 0.0f);
+            for (const render::TileTiming& timing : profile.tileTimings) {
+                const size_t bucket = maxSeconds > 0.0f ? size_t(timing.seconds / maxSeconds * float(numBuckets)) : 0;
+                tileHistogram[std::min(bucket, numBuckets - 1)]++;
+            }
+            const float startSeconds = profile.tileTimings.front().startSeconds;
+            const float busySeconds = std::accumulate(std::begin(threadSeconds), std::end(threadSeconds), 0.0f);
+            const size_t activeThreads = size_t(std::count_if(std::begin(threadSeconds), std::end(threadSeconds), [](float seconds) { return seconds > 0.0f; }));
+            const float spanSeconds = float(activeThreads) * (endSeconds - startSeconds);
+            const float utilization = spanSeconds > 0.0f ? busySeconds / spanSeconds : 1.0f;
+
+            ImGui::NewLine();
+            const std::string tilesText = fmt::format("{} tiles, 0 - {:.2f}ms per tile:", profile.tileTimings.size(), maxSeconds * 1000.0f);
+            ImGui::Text("%s", tilesText.c_str());
+            ImGui::PlotHistogram("##TileTimes", tileHistogram.data(), int(tileHistogram.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 80));
+            const std::string threadsText = fmt::format("time on tiles per thread ({} threads busy {:.0f}% of the time):", activeThreads, 100.0f * utilization);
+            ImGui::Text("%s", threadsText.c_str());
+            for (float& seconds : threadSeconds)
+                seconds *= 1000.0f;
+            ImGui::PlotHistogram("##ThreadTimes", threadSeconds.data(), int(threadSeconds.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 80));
+        }
+
+        ImGui::NewLine();
+        if (ImGui::Button("Export Chrome trace")) {
+            nfdchar_t* pOutPath = nullptr;
+            nfdresult_t result = NFD_SaveDialog("json", nullptr, &pOutPath);
+
+            if (result == NFD_OKAY) {
+                std::ofstream stream { std::filesystem::path(pOutPath) };
+                render::writeChromeTrace(stream, profile);
+                if (!stream)
+                    std::cerr << "Could not write trace to " << pOutPath << std::endl;
+            }
+        }
+
+        ImGui::EndTabItem();
+    }
+}
+
 }
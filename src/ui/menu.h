@@ -1,9 +1,11 @@
 #pragma once
 #include "render/render_config.h"
+#include "render/render_statistics.h"
 #include "ui/transfer_func.h"
 #include "ui/transfer_func_2d.h"
 #include "ui/transfer_func_2d_v2.h"
 #include "volume/gradient_volume.h"
+#include "volume/histogram_2d.h"
 #include "volume/volume.h"
 #include <chrono>
 #include <filesystem>
@@ -23,18 +25,42 @@ public:
 
     using LoadVolumeCallback = std::function<void(const std::filesystem::path&)>;
     void setLoadVolumeCallback(LoadVolumeCallback&& callback);
+    // Called with the directory of a time series (see volume::VolumeSeries).
+    void setLoadVolumeSeriesCallback(LoadVolumeCallback&& callback);
     using RenderConfigChangedCallback = std::function<void(const render::RenderConfig&)>;
     void setRenderConfigChangedCallback(RenderConfigChangedCallback&& callback);
     using InterpolationModeChangedCallback = std::function<void(volume::InterpolationMode)>;
     void setInterpolationModeChangedCallback(InterpolationModeChangedCallback&& callback);
 
-    render::RenderConfig renderConfig() const;
+    const render::RenderConfig& renderConfig() const;
     volume::InterpolationMode interpolationMode() const;
+    volume::VoxelLayout voxelLayout() const;
+    volume::GradientStorage gradientStorage() const;
+    // Memory budget in bytes for streaming the bricks of bricked files (see volume::BrickPager), if enabled.
+    std::optional<size_t> brickStreamingBudget() const;
+    // Whether the renderer samples a compressed copy of the voxels (see volume::CompressedVolume).
+    bool compressVoxels() const;
+    // Whether the data derived from a volume file is cached next to it (see volume::DerivedDataCache).
+    bool cacheDerivedData() const;
+    // Playback of a time series: the timestep that the user selected, whether it plays and how long a timestep is shown.
+    size_t timestep() const;
+    bool isPlaying() const;
+    std::chrono::duration<double> timestepDuration() const;
 
     void setBaseRenderResolution(const glm::ivec2& baseRenderResolution);
-    void setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume& gradientVolume);
+    // The 2D transfer function widgets show the joint histogram of the volume and its gradients.
+    void setLoadedVolume(const volume::Volume& volume, const volume::Histogram2D& histogram);
+    // After setLoadedVolume with the first timestep of a time series.
+    void setLoadedVolumeSeries(size_t numTimesteps);
+    // Shows the histograms and information of another timestep of the series, keeping the transfer functions.
+    void setShownTimestep(size_t step, const volume::Volume& volume, const volume::Histogram2D& histogram);
+    // Shows the histograms of the loaded volume once they are derived (see volume::VolumeLoader), keeping the transfer
+    // functions.
+    void updateHistograms(const volume::Volume& volume, const volume::Histogram2D& histogram);
+    // Progress (0 to 1) and description of the step of a volume that is being loaded, or std::nullopt once it is.
+    void setLoadProgress(std::optional<float> optProgress, const std::string& step);
 
-    void drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::duration<double> renderTime);
+    void drawMenu(const glm::ivec2& pos, const glm::ivec2& size, const render::RenderProfile& profile);
 
 private:
     void showLoadVolTab();
@@ -42,7 +68,9 @@ private:
     void showTransFuncTab();
     void show2DTransFuncTab();
     void show2DV2TransFuncTab();
+    void showProfilerTab(const render::RenderProfile& profile);
 
+    void updateVolumeInfo(const volume::Volume& volume);
     void callRenderConfigChangedCallback() const;
     void callInterpolationModeChangedCallback() const;
 
@@ -50,6 +78,8 @@ private:
     bool m_volumeLoaded = false;
     std::string m_volumeInfo;
     int m_volumeMax;
+    std::optional<float> m_optLoadProgress;
+    std::string m_loadStep;
 
     std::optional<TransferFunctionWidget> m_tfWidget;
     std::optional<TransferFunction2DWidget> m_tf2DWidget;
@@ -59,8 +89,20 @@ private:
     float m_resolutionScale { 1.0f };
     render::RenderConfig m_renderConfig {};
     volume::InterpolationMode m_interpolationMode { volume::InterpolationMode::NearestNeighbour };
+    volume::VoxelLayout m_voxelLayout { volume::VoxelLayout::Linear };
+    volume::GradientStorage m_gradientStorage { volume::GradientStorage::Full };
+    bool m_streamBricks { false };
+    int m_brickStreamingMegabytes { 1024 };
+    bool m_compressVoxels { false };
+    bool m_cacheDerivedData { true };
+    // Number of timesteps of the loaded time series (0 for a single volume).
+    size_t m_numTimesteps { 0 };
+    int m_timestep { 0 };
+    bool m_playing { false };
+    int m_playbackRate { 10 };
 
     std::optional<LoadVolumeCallback> m_optLoadVolumeCallback;
+    std::optional<LoadVolumeCallback> m_optLoadVolumeSeriesCallback;
     std::optional<RenderConfigChangedCallback> m_optRenderConfigChangedCallback;
     std::optional<InterpolationModeChangedCallback> m_optInterpolationModeChangedCallback;
 };
@@ -80,9 +80,9 @@ SurfaceCube::~SurfaceCube()
     glDeleteBuffers(1, &m_vbo);
 }
 
-void ui::SurfaceCube::draw(const Trackball& camera, const glm::vec3& scale)
+void ui::SurfaceCube::draw(const Trackball& camera, const glm::vec3& scale, const glm::vec3& offset)
 {
-    const auto modelMatrix = glm::scale(glm::identity<glm::mat4>(), scale);
+    const auto modelMatrix = glm::scale(glm::translate(glm::identity<glm::mat4>(), offset), scale);
     const auto viewMatrix = camera.viewMatrix();
     const auto projectionMatrix = camera.projectionMatrix();
     auto viewProjectionMatrix = projectionMatrix * viewMatrix * modelMatrix;
@@ -9,7 +9,7 @@ public:
     SurfaceCube();
     ~SurfaceCube();
 
-    void draw(const Trackball& camera, const glm::vec3& scale);
+    void draw(const Trackball& camera, const glm::vec3& scale, const glm::vec3& offset);
 
 private:
     GLuint m_ibo, m_vbo, m_vao;
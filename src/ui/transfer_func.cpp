@@ -1,6 +1,7 @@
 ﻿#include "ui/transfer_func.h"
 #include <algorithm>
 #include <cassert>
+#include <cstring> // memcpy
 #include <filesystem>
 #include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -10,13 +11,13 @@
 #include <iostream>
 
 static GLuint createTexture();
-static std::vector<glm::vec4> createHistogramImage(gsl::span<const int> data, float opacity);
 static ImVec2 glmToIm(const glm::vec2& v);
 static glm::vec2 ImToGlm(const ImVec2& v);
 
 // Radius of the points in the histogram image.
 static constexpr float pointRadius = 8.0f;
 static constexpr glm::ivec2 widgetSize { 475, 300 };
+static constexpr glm::ivec2 histogramImageSize { widgetSize.x, widgetSize.y - 20 };
 static constexpr float histogramOpacity = 0.3f;
 static constexpr size_t sentinel = static_cast<size_t>(-1);
 
@@ -28,23 +29,32 @@ TransferFunctionWidget::TransferFunctionWidget(const volume::Volume& volume)
     , m_maxValue(volume.maximum())
     , m_interactingPoint(sentinel)
     , m_selectedPoint(sentinel)
-    , m_histogramImg(createTexture())
+    , m_histogramImage(histogramImageSize)
+    , m_logHistogram(false)
     , m_colorMapImg(createTexture())
 {
     m_tfPoints.push_back(TFPoint { glm::vec2(0.0f), glm::vec3(0.0f) });
     m_tfPoints.push_back(TFPoint { glm::vec2(0.7f, 0.03f), glm::vec3(0.7f) });
     m_tfPoints.push_back(TFPoint { glm::vec2(1.0f), glm::vec3(1.0f) });
 
-    const auto histogram = volume.histogram();
-    const auto imgData = createHistogramImage(histogram, histogramOpacity);
-
-    glBindTexture(GL_TEXTURE_2D, m_histogramImg);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GLsizei(histogram.size()), GLsizei(widgetSize.y), 0, GL_RGBA, GL_FLOAT, imgData.data());
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // The color map texture is allocated once, updateColormap only uploads the new colors.
+    glBindTexture(GL_TEXTURE_2D, m_colorMapImg);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, GLsizei(m_colorMap.size()), 1, 0, GL_RGBA, GL_FLOAT, nullptr);
 
+    // The bars of the histogram are tinted by the transfer function (see updateColormap).
+    m_histogramImage.setOpacity(histogramOpacity);
+    updateHistogram(volume);
     updateColormap();
 }
 
+// Only the counts of the histogram are uploaded; the image is drawn from them on the GPU (see HistogramImageGL).
+void TransferFunctionWidget::updateHistogram(const volume::Volume& volume)
+{
+    m_minValue = volume.minimum();
+    m_maxValue = volume.maximum();
+    m_histogramImage.setCounts(volume.histogram());
+}
+
 void TransferFunctionWidget::updateRenderConfig(render::RenderConfig& renderConfig) const
 {
     assert(m_colorMap.size() == renderConfig.tfColorMap.size());
@@ -94,7 +104,8 @@ void TransferFunctionWidget::draw()
     // When it is needed to interpret the bytes of an object as a value of a different type, std::memcpy or std::bit_cast (since C++20)can be used:
     // https://en.cppreference.com/w/cpp/language/reinterpret_cast
     ImTextureID imguiTexture;
-    std::memcpy(&imguiTexture, &m_histogramImg, sizeof(m_histogramImg));
+    const GLuint histogramTexture = m_histogramImage.texture();
+    std::memcpy(&imguiTexture, &histogramTexture, sizeof(histogramTexture));
     ImGui::Image(imguiTexture, glmToIm(canvasSize - glm::vec2(1)));
 
     // Detect and handle mouse interaction.
@@ -192,6 +203,10 @@ void TransferFunctionWidget::draw()
     ImGui::SetCursorPosX(ImGui::GetCursorPosX() + xOffset + canvasSize.x / 2 - 40);
     ImGui::Text("Voxel Value");
 
+    ImGui::SetCursorPosX(ImGui::GetCursorPosX() + xOffset);
+    if (ImGui::Checkbox("Logarithmic histogram", &m_logHistogram))
+        m_histogramImage.setLogScale(m_logHistogram);
+
     if (m_selectedPoint != sentinel) {
         ImGui::NewLine();
         ImGui::SetCursorPosX(ImGui::GetCursorPosX() + xOffset / 2);
@@ -219,7 +234,8 @@ void TransferFunctionWidget::updateColormap()
 
     // Upload it to the GPU.
     glBindTexture(GL_TEXTURE_2D, m_colorMapImg);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, GLsizei(m_colorMap.size()), 1, 0, GL_RGBA, GL_FLOAT, m_colorMap.data());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GLsizei(m_colorMap.size()), 1, GL_RGBA, GL_FLOAT, m_colorMap.data());
+    m_histogramImage.setColorMap(m_colorMapImg);
 }
 
 void TransferFunctionWidget::insertTFPoint(const glm::vec2& pos)
@@ -255,23 +271,6 @@ GLuint createTexture()
     return tex;
 }
 
-// Compute a histogram texture from the histogram vector
-static std::vector<glm::vec4> createHistogramImage(gsl::span<const int> data, float opacity)
-{
-    const int maxVal = *std::max_element(std::begin(data), std::end(data));
-    const glm::uvec2 res { data.size(), widgetSize.y };
-
-    const float scale = float(widgetSize.y) / (float(maxVal) * 1.1f);
-    std::vector<glm::vec4> imgData(static_cast<size_t>(res.x * res.y));
-    for (unsigned x = 0; x < res.x; x++) {
-        for (unsigned y = 0; y < res.y; y++) {
-            const size_t index = static_cast<size_t>(x + y * res.x);
-            imgData[index] = (static_cast<float>(res.y - y) < static_cast<float>(data[x]) * scale) ? glm::vec4(1.f, 1.f, 1.f, opacity) : glm::vec4(0.f);
-        }
-    }
-    return imgData;
-}
-
 // Vector conversion functions for glm - Imgui interaction
 static ImVec2 glmToIm(const glm::vec2& v)
 {
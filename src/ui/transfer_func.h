@@ -1,5 +1,6 @@
 #pragma once
 #include "render/render_config.h"
+#include "ui/histogram_image_gl.h"
 #include "volume/volume.h"
 #include <GL/glew.h> // Include before glfw3
 #include <glm/vec2.hpp>
@@ -12,6 +13,9 @@ class TransferFunctionWidget {
 public:
     TransferFunctionWidget(const volume::Volume& volume);
 
+    // Shows the histogram and value range of another volume (such as the next timestep of a volume series) but keeps
+    // the transfer function.
+    void updateHistogram(const volume::Volume& volume);
     void draw();
     void updateRenderConfig(render::RenderConfig& renderConfig) const;
 
@@ -34,7 +38,8 @@ private:
 
     size_t m_interactingPoint; // Point currently being dragged around.
     size_t m_selectedPoint; // Point that is selected (for which the color picker is shown).
-    GLuint m_histogramImg;
+    HistogramImageGL m_histogramImage;
+    bool m_logHistogram;
     GLuint m_colorMapImg;
 };
 }
@@ -1,6 +1,7 @@
 #include "transfer_func_2d_v2.h"
 #include <algorithm>
 #include <array>
+#include <cstring> // memcpy
 #include <filesystem>
 #include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -11,8 +12,6 @@
 
 static ImVec2 glmToIm(const glm::vec2& v);
 static glm::vec2 ImToGlm(const ImVec2& v);
-static std::vector<glm::vec4> createHistogramImage(
-    const volume::Volume& volume, const volume::GradientVolume& gradient, const glm::ivec2& res);
 
 namespace ui {
 
@@ -20,7 +19,7 @@ namespace ui {
 static constexpr float pointRadius = 8.0f;
 static constexpr glm::ivec2 widgetSize { 475, 300 };
 
-TransferFunction2DV2Widget::TransferFunction2DV2Widget(const volume::Volume& volume, const volume::GradientVolume& gradient)
+TransferFunction2DV2Widget::TransferFunction2DV2Widget(const volume::Volume& volume, const volume::Histogram2D& histogram)
     : m_intensity_0(68.0f)
     , m_intensity_1(100.0f)
     , m_maxIntensity(volume.maximum())
@@ -29,19 +28,18 @@ TransferFunction2DV2Widget::TransferFunction2DV2Widget(const volume::Volume& vol
     , m_color_0(0.0f, 0.8f, 0.6f, 0.3f)
     , m_color_1(0.0f, 0.8f, 0.6f, 0.3f)
     , m_interactingPoint(-1)
-    , m_histogramImg(0)
+    , m_histogramImage(glm::ivec2(widgetSize.x, widgetSize.y - 20))
 {
-    const glm::ivec2 res = glm::ivec2(volume.maximum(), gradient.maxMagnitude() + 1);
-    const auto imgData = createHistogramImage(volume, gradient, res);
-
-    glGenTextures(1, &m_histogramImg);
-    glBindTexture(GL_TEXTURE_2D, m_histogramImg);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, m_histogramImg);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, res.x, res.y, 0, GL_RGBA, GL_FLOAT, imgData.data());
+    // Density of the voxels on a logarithmic scale.
+    m_histogramImage.setLogScale(true);
+    updateHistogram(volume, histogram);
+}
+
+// Only the counts of the histogram are uploaded; the image is drawn from them on the GPU (see HistogramImageGL).
+void TransferFunction2DV2Widget::updateHistogram(const volume::Volume& volume, const volume::Histogram2D& histogram)
+{
+    m_maxIntensity = volume.maximum();
+    m_histogramImage.setCounts(histogram.bins, histogram.resolution);
 }
 
 // Draw the widget and handle interactions
@@ -86,7 +84,8 @@ void TransferFunction2DV2Widget::draw()
     // When it is needed to interpret the bytes of an object as a value of a different type, std::memcpy or std::bit_cast (since C++20)can be used:
     // https://en.cppreference.com/w/cpp/language/reinterpret_cast
     ImTextureID imguiTexture;
-    std::memcpy(&imguiTexture, &m_histogramImg, sizeof(m_histogramImg));
+    const GLuint histogramTexture = m_histogramImage.texture();
+    std::memcpy(&imguiTexture, &histogramTexture, sizeof(histogramTexture));
     ImGui::Image(imguiTexture, glmToIm(canvasSize - glm::vec2(1)));
 
     // Detect and handle mouse interaction.
@@ -274,31 +273,3 @@ static glm::vec2 ImToGlm(const ImVec2& v)
 {
     return glm::vec2(v.x, v.y);
 }
-
-// Compute a histogram texture from the volume and gradient data
-static std::vector<glm::vec4> createHistogramImage(
-    const volume::Volume& volume, const volume::GradientVolume& gradient, const glm::ivec2& res)
-{
-    const size_t numPixels = static_cast<size_t>(res.x * res.y);
-    std::vector<int> bins(numPixels, 0);
-    for (int z = 0; z < volume.dims().z; z++) {
-        for (int y = 0; y < volume.dims().y; y++) {
-            for (int x = 0; x < volume.dims().x; x++) {
-                const size_t imgX = static_cast<size_t>(volume.getVoxel(x, y, z));
-                const size_t imgY = static_cast<size_t>(res.y - 1) - static_cast<size_t>(gradient.getGradientVoxel(x, y, z).magnitude);
-                const size_t index = imgX + imgY * static_cast<size_t>(res.x);
-                bins[index]++;
-            }
-        }
-    }
-
-    const int maxCount = *std::max_element(std::begin(bins), std::end(bins));
-    const float factor = 1.0f / std::log(float(maxCount));
-
-    std::vector<glm::vec4> imageData(numPixels, glm::vec4(0.0f));
-    std::transform(std::begin(bins), std::end(bins), std::begin(imageData),
-        [&](int count) {
-            return glm::vec4(1.0f, 1.0f, 1.0f, std::log(float(count)) * factor);
-        });
-    return imageData;
-}
@@ -1,6 +1,7 @@
 #pragma once
 #include "render/render_config.h"
-#include "volume/gradient_volume.h"
+#include "ui/histogram_image_gl.h"
+#include "volume/histogram_2d.h"
 #include "volume/volume.h"
 #include <GL/glew.h> // Include before glfw3
 #include <glm/vec2.hpp>
@@ -10,8 +11,11 @@ namespace ui {
 
 class TransferFunction2DV2Widget {
 public:
-    TransferFunction2DV2Widget(const volume::Volume& volume, const volume::GradientVolume& gradient);
+    TransferFunction2DV2Widget(const volume::Volume& volume, const volume::Histogram2D& histogram);
 
+    // Shows the histogram of another volume (such as the next timestep of a volume series) but keeps the transfer
+    // function.
+    void updateHistogram(const volume::Volume& volume, const volume::Histogram2D& histogram);
     void draw();
     void updateRenderConfig(render::RenderConfig& renderConfig);
 
@@ -21,6 +25,6 @@ private:
     glm::vec4 m_color_0, m_color_1;
 
     int m_interactingPoint;
-    GLuint m_histogramImg;
+    HistogramImageGL m_histogramImage;
 };
 }
@@ -0,0 +1,163 @@
+#include "brick_pager.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <iterator>
+
+namespace volume {
+
+// Eviction frees this fraction of the budget at once, so that the pages are not sorted for every load.
+static constexpr size_t evictionFraction = 10;
+
+BrickPager::BrickPager(const Volume& volume, size_t memoryBudget, size_t pageBytes)
+    : m_voxels(volume.mappedVoxels())
+    , m_dim(volume.dims())
+    , m_bricks((volume.dims() + VoxelIndexer::brickSize - 1) / VoxelIndexer::brickSize)
+{
+    constexpr auto brickVoxels = static_cast<size_t>(VoxelIndexer::brickSize * VoxelIndexer::brickSize * VoxelIndexer::brickSize);
+    const size_t brickBytes = brickVoxels * volume.elementSize();
+    const size_t numBricks = static_cast<size_t>(m_bricks.x) * static_cast<size_t>(m_bricks.y) * static_cast<size_t>(m_bricks.z);
+    m_bricksPerPage = std::max(pageBytes / brickBytes, size_t(1));
+    m_pageBytes = m_bricksPerPage * brickBytes;
+    m_budgetPages = std::max(memoryBudget / m_pageBytes, size_t(1));
+    m_pages = std::vector<Page>((numBricks + m_bricksPerPage - 1) / m_bricksPerPage);
+    m_loader = std::thread([this]() { loaderLoop(); });
+}
+
+BrickPager::~BrickPager()
+{
+    {
+        std::lock_guard lock { m_requestMutex };
+        m_stopRequested = true;
+    }
+    m_requestCondition.notify_one();
+    m_loader.join();
+}
+
+bool BrickPager::isSupported(const Volume& volume)
+{
+    return !volume.mappedVoxels().empty() && volume.indexer().layout() == VoxelLayout::Bricked;
+}
+
+void BrickPager::beginFrame()
+{
+    m_frame.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BrickPager::evictAll()
+{
+    {
+        std::lock_guard lock { m_requestMutex };
+        m_requests.clear();
+    }
+    std::lock_guard lock { m_residentMutex };
+    for (const size_t page : m_residentPages)
+        m_pages[page].resident.store(false, std::memory_order_relaxed);
+    // Everything that the loader did not load is mapped as well, so the whole volume is evicted.
+    MappedFile::evict(m_voxels);
+    m_residentPages.clear();
+}
+
+uint64_t BrickPager::loadedGeneration() const
+{
+    return m_generation.load(std::memory_order_acquire);
+}
+
+bool BrickPager::hasPendingRequests() const
+{
+    std::lock_guard lock { m_requestMutex };
+    return m_loading || !m_requests.empty();
+}
+
+size_t BrickPager::residentBytes() const
+{
+    std::lock_guard lock { m_residentMutex };
+    return m_residentPages.size() * m_pageBytes;
+}
+
+size_t BrickPager::memoryBudget() const
+{
+    return m_budgetPages * m_pageBytes;
+}
+
+gsl::span<const std::byte> BrickPager::pageVoxels(size_t page) const
+{
+    const size_t begin = page * m_pageBytes;
+    return m_voxels.subspan(begin, std::min(m_pageBytes, m_voxels.size() - begin));
+}
+
+void BrickPager::request(size_t page, uint32_t frame)
+{
+    uint32_t requestedFrame = m_pages[page].requestedFrame.load(std::memory_order_relaxed);
+    if (requestedFrame == frame || !m_pages[page].requestedFrame.compare_exchange_strong(requestedFrame, frame, std::memory_order_relaxed))
+        return;
+    {
+        std::lock_guard lock { m_requestMutex };
+        m_requests.push_back(page);
+    }
+    m_requestCondition.notify_one();
+}
+
+void BrickPager::loaderLoop()
+{
+    std::unique_lock lock { m_requestMutex };
+    while (true) {
+        m_loading = false;
+        m_requestCondition.wait(lock, [&]() { return m_stopRequested || !m_requests.empty(); });
+        if (m_stopRequested)
+            return;
+
+        const size_t page = m_requests.front();
+        m_requests.pop_front();
+        m_loading = true;
+        lock.unlock();
+        load(page);
+        lock.lock();
+    }
+}
+
+// Loads a page by reading one byte of every OS page of it, which makes the OS read it from the file.
+void BrickPager::load(size_t page)
+{
+    std::lock_guard lock { m_residentMutex };
+    if (m_pages[page].resident.load(std::memory_order_relaxed))
+        return;
+    // Pages that do not fit because the budget is taken by the current frame are not loaded; their samples stay on
+    // the coarser level for this frame.
+    if (m_residentPages.size() >= m_budgetPages && !evictLeastRecentlyUsed())
+        return;
+
+    const gsl::span<const std::byte> voxels = pageVoxels(page);
+    const volatile std::byte* pVoxels = voxels.data();
+    const size_t osPageSize = MappedFile::pageSize();
+    for (size_t offset = 0; offset < voxels.size(); offset += osPageSize)
+        (void)pVoxels[offset];
+
+    m_pages[page].resident.store(true, std::memory_order_release);
+    m_residentPages.push_back(page);
+    m_generation.fetch_add(1, std::memory_order_release);
+}
+
+// Evicts the least recently used pages that the current frame did not use, until evictionFraction of the budget is
+// free. Returns whether any page was evicted. Must be called with m_residentMutex locked.
+bool BrickPager::evictLeastRecentlyUsed()
+{
+    const uint32_t frame = m_frame.load(std::memory_order_relaxed);
+    const auto firstInUse = std::partition(std::begin(m_residentPages), std::end(m_residentPages),
+        [&](size_t page) { return m_pages[page].lastUse.load(std::memory_order_relaxed) != frame; });
+    const size_t numFree = std::max(m_budgetPages / evictionFraction, size_t(1));
+    const auto numEvicted = static_cast<std::ptrdiff_t>(std::min(numFree, static_cast<size_t>(std::distance(std::begin(m_residentPages), firstInUse))));
+    if (numEvicted == 0)
+        return false;
+
+    const auto evictedEnd = std::begin(m_residentPages) + numEvicted;
+    std::nth_element(std::begin(m_residentPages), evictedEnd - 1, firstInUse,
+        [&](size_t lhs, size_t rhs) { return m_pages[lhs].lastUse.load(std::memory_order_relaxed) < m_pages[rhs].lastUse.load(std::memory_order_relaxed); });
+    // A sampler that still reads an evicted page (after acquire returned true) makes the OS load it again.
+    for (auto iter = std::begin(m_residentPages); iter != evictedEnd; iter++) {
+        m_pages[*iter].resident.store(false, std::memory_order_relaxed);
+        MappedFile::evict(pageVoxels(*iter));
+    }
+    m_residentPages.erase(std::begin(m_residentPages), evictedEnd);
+    return true;
+}
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "volume.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace volume {
+
+// Keeps the bricks of a volume that is mapped from a bricked file (see Volume::write) in memory within a fixed budget,
+// so that volumes larger than main memory can be rendered. The bricks are paged in groups of consecutive bricks (a
+// page of the pager, roughly pageBytes large) by a loader thread, in the order in which the renderer first asked for
+// them. When the budget is exceeded the least recently used pages are evicted, but never pages that were used since
+// the last call to beginFrame.
+//
+// Samplers call acquire before sampling level 0 and sample a coarser level of the volume pyramid (which is always
+// resident) when it returns false; see PyramidSampler. Reading a brick that is not resident is still correct since the
+// OS loads it from the file on access, it is just slow.
+class BrickPager {
+public:
+    static constexpr size_t defaultPageBytes = 256 * 1024;
+
+public:
+    // The volume must outlive the pager and be supported (see isSupported).
+    BrickPager(const Volume& volume, size_t memoryBudget, size_t pageBytes = defaultPageBytes);
+    ~BrickPager();
+
+    BrickPager(const BrickPager&) = delete;
+    BrickPager& operator=(const BrickPager&) = delete;
+
+    // Whether the voxels of the volume are mapped from a file in the bricked layout.
+    static bool isSupported(const Volume& volume);
+
+    // Start a new image: pages that the previous images used may be evicted again.
+    void beginFrame();
+    // Whether the brick that contains the voxel closest to coord is resident. If not, the brick is requested (once per
+    // frame). Thread safe.
+    bool acquire(const glm::vec3& coord);
+    // Evicts all pages, for example after the whole volume was read once to build the acceleration structures.
+    void evictAll();
+
+    // Incremented every time a page has been loaded.
+    uint64_t loadedGeneration() const;
+    bool hasPendingRequests() const;
+    size_t residentBytes() const;
+    size_t memoryBudget() const;
+
+private:
+    struct Page {
+        std::atomic<bool> resident { false };
+        // Frame in which the page was last used and last requested.
+        std::atomic<uint32_t> lastUse { 0 };
+        std::atomic<uint32_t> requestedFrame { 0 };
+    };
+
+    size_t pageIndex(const glm::vec3& coord) const;
+    gsl::span<const std::byte> pageVoxels(size_t page) const;
+    void request(size_t page, uint32_t frame);
+    void loaderLoop();
+    void load(size_t page);
+    bool evictLeastRecentlyUsed();
+
+private:
+    gsl::span<const std::byte> m_voxels;
+    glm::ivec3 m_dim;
+    glm::ivec3 m_bricks;
+    size_t m_bricksPerPage;
+    size_t m_pageBytes;
+    size_t m_budgetPages;
+    std::vector<Page> m_pages;
+    std::atomic<uint32_t> m_frame { 1 };
+    std::atomic<uint64_t> m_generation { 0 };
+
+    // Requests of the samplers, in the order in which they were made.
+    mutable std::mutex m_requestMutex;
+    std::condition_variable m_requestCondition;
+    std::deque<size_t> m_requests;
+    bool m_stopRequested { false };
+    bool m_loading { false };
+
+    // Resident pages, modified by the loader and by evictAll.
+    mutable std::mutex m_residentMutex;
+    std::vector<size_t> m_residentPages;
+
+    std::thread m_loader;
+};
+
+inline size_t BrickPager::pageIndex(const glm::vec3& coord) const
+{
+    // Same rounding as nearest neighbour interpolation; the neighbours that interpolation reads across a brick border
+    // are not requested.
+    const int x = std::clamp(int(coord.x + 0.5f), 0, m_dim.x - 1) / VoxelIndexer::brickSize;
+    const int y = std::clamp(int(coord.y + 0.5f), 0, m_dim.y - 1) / VoxelIndexer::brickSize;
+    const int z = std::clamp(int(coord.z + 0.5f), 0, m_dim.z - 1) / VoxelIndexer::brickSize;
+    const size_t brick = static_cast<size_t>(x) + static_cast<size_t>(m_bricks.x) * (static_cast<size_t>(y) + static_cast<size_t>(m_bricks.y) * static_cast<size_t>(z));
+    return brick / m_bricksPerPage;
+}
+
+inline bool BrickPager::acquire(const glm::vec3& coord)
+{
+    const size_t index = pageIndex(coord);
+    Page& page = m_pages[index];
+    const uint32_t frame = m_frame.load(std::memory_order_relaxed);
+    // Only write if needed: every sample of every thread passes here, so the cache line should stay shared.
+    if (page.lastUse.load(std::memory_order_relaxed) != frame)
+        page.lastUse.store(frame, std::memory_order_relaxed);
+    if (page.resident.load(std::memory_order_acquire))
+        return true;
+    request(index, frame);
+    return false;
+}
+}
@@ -0,0 +1,118 @@
+#include "compressed_volume.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <limits>
+#include <utility>
+#include <tbb/parallel_for.h>
+
+namespace volume {
+
+static std::atomic<uint64_t> s_nextVolumeId { 1 };
+
+// Bricks are encoded in two parallel passes: the first finds the range (and therefore the size) of every brick, the
+// second packs the bricks at the offsets that follow from the sizes. Voxels of bricks on the border that lie outside
+// of the volume repeat the voxel on the border, so they do not widen the range.
+CompressedVolume::CompressedVolume(const Volume& volume)
+    : m_id(s_nextVolumeId.fetch_add(1))
+    , m_dim(volume.dims())
+{
+    const glm::ivec3 bricks = (m_dim + brickSize - 1) / brickSize;
+    m_bricksX = static_cast<size_t>(bricks.x);
+    m_bricksY = static_cast<size_t>(bricks.y);
+    m_bricks.resize(m_bricksX * m_bricksY * static_cast<size_t>(bricks.z));
+
+    const auto visitBrick = [&](size_t brick, auto&& f) {
+        const glm::ivec3 origin = brickSize * glm::ivec3(int(brick % m_bricksX), int(brick / m_bricksX % m_bricksY), int(brick / (m_bricksX * m_bricksY)));
+        volume.visitVoxelType([&]<typename T>(T) {
+            size_t i = 0;
+            for (int z = origin.z; z < origin.z + brickSize; z++) {
+                for (int y = origin.y; y < origin.y + brickSize; y++) {
+                    for (int x = origin.x; x < origin.x + brickSize; x++) {
+                        const glm::ivec3 voxel = glm::min(glm::ivec3(x, y, z), m_dim - 1);
+                        f(i++, static_cast<uint16_t>(volume.getVoxelUnchecked<T>(voxel.x, voxel.y, voxel.z)));
+                    }
+                }
+            }
+        });
+    };
+
+    tbb::parallel_for(size_t(0), m_bricks.size(), [&](size_t brick) {
+        uint16_t minimum = std::numeric_limits<uint16_t>::max(), maximum = 0;
+        visitBrick(brick, [&](size_t, uint16_t value) {
+            minimum = std::min(minimum, value);
+            maximum = std::max(maximum, value);
+        });
+        m_bricks[brick].minimum = minimum;
+        m_bricks[brick].bits = static_cast<uint8_t>(std::bit_width(static_cast<uint16_t>(maximum - minimum)));
+    });
+
+    // A brick with b bits per voxel takes exactly 8 * b words (brickVoxels * b bits).
+    constexpr size_t wordsPerBit = brickVoxels / 64;
+    size_t numWords = 0;
+    for (Brick& brick : m_bricks) {
+        brick.offset = numWords;
+        numWords += wordsPerBit * brick.bits;
+    }
+    m_words.resize(numWords, 0);
+
+    tbb::parallel_for(size_t(0), m_bricks.size(), [&](size_t brickIndex) {
+        const Brick& brick = m_bricks[brickIndex];
+        if (brick.bits == 0)
+            return;
+        uint64_t* pWords = m_words.data() + brick.offset;
+        visitBrick(brickIndex, [&](size_t i, uint16_t value) {
+            const size_t bit = i * brick.bits, shift = bit % 64;
+            const auto offset = static_cast<uint64_t>(value - brick.minimum);
+            pWords[bit / 64] |= offset << shift;
+            if (shift + brick.bits > 64)
+                pWords[bit / 64 + 1] |= offset >> (64 - shift);
+        });
+    });
+}
+
+glm::ivec3 CompressedVolume::dims() const
+{
+    return m_dim;
+}
+
+size_t CompressedVolume::compressedBytes() const
+{
+    return m_words.size() * sizeof(uint64_t) + m_bricks.size() * sizeof(Brick);
+}
+
+// Unpacks the voxels of a brick with Bits bits per voxel. With the width known at compile time the shifts and masks are
+// constants, which makes decoding several times faster than with the width of the brick at run time.
+template <int Bits>
+static void unpack(const uint64_t* pWords, uint16_t minimum, uint16_t* pVoxels)
+{
+    constexpr uint64_t mask = (uint64_t(1) << Bits) - 1;
+    for (size_t i = 0; i < CompressedVolume::brickVoxels; i++) {
+        const size_t bit = i * Bits, shift = bit % 64;
+        uint64_t offset = pWords[bit / 64] >> shift;
+        if (shift + Bits > 64)
+            offset |= pWords[bit / 64 + 1] << (64 - shift);
+        pVoxels[i] = static_cast<uint16_t>(minimum + (offset & mask));
+    }
+}
+
+template <int... Bits>
+static void unpack(int bits, const uint64_t* pWords, uint16_t minimum, uint16_t* pVoxels, std::integer_sequence<int, Bits...>)
+{
+    ((bits == Bits + 1 ? unpack<Bits + 1>(pWords, minimum, pVoxels) : void()), ...);
+}
+
+// Decodes a brick into a slot of the cache of the calling thread.
+void CompressedVolume::decode(size_t brickIndex, size_t slot) const
+{
+    DecodedBricks& cache = s_decodedBricks;
+    const Brick& brick = m_bricks[brickIndex];
+    uint16_t* pVoxels = cache.voxels[slot].data();
+    if (brick.bits == 0)
+        std::fill_n(pVoxels, brickVoxels, brick.minimum);
+    else
+        unpack(brick.bits, m_words.data() + brick.offset, brick.minimum, pVoxels, std::make_integer_sequence<int, 16>());
+    cache.volumeIds[slot] = m_id;
+    cache.bricks[slot] = brickIndex;
+}
+}
@@ -0,0 +1,238 @@
+#pragma once
+#include "volume.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/vector_relational.hpp>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace volume {
+
+// Copy of the voxels of a volume in which every brick of brickSize^3 voxels is bit-packed: a brick stores its minimum
+// and the offsets of its voxels from it with just enough bits for its range. Constant bricks (such as the air around
+// a scan) take no voxel storage at all. Samplers decode whole bricks on demand into a small cache per thread, see
+// CompressedSampler.
+class CompressedVolume {
+public:
+    static constexpr int brickSize = VoxelIndexer::brickSize;
+    static constexpr size_t brickVoxels = size_t(brickSize * brickSize * brickSize);
+
+public:
+    explicit CompressedVolume(const Volume& volume);
+
+    glm::ivec3 dims() const;
+    // Bytes used by the packed voxels and the brick headers.
+    size_t compressedBytes() const;
+    // Voxel at a position that is known to be inside the volume.
+    float getVoxelUnchecked(int x, int y, int z) const;
+    // The decoded voxels of the brick that contains voxel (x, y, z) (in slice-major order within the brick) and the
+    // index of the voxel in them. The voxels stay valid until the calling thread decodes another brick.
+    std::pair<const uint16_t*, size_t> getBrickVoxels(int x, int y, int z) const;
+
+    // Calls f(sampler) with a CompressedSampler for the given interpolation mode (like Volume::visitSampler).
+    template <typename F>
+    decltype(auto) visitSampler(InterpolationMode interpolationMode, F&& f) const;
+
+private:
+    struct Brick {
+        // First word of the packed voxels in m_words.
+        size_t offset;
+        uint16_t minimum;
+        uint8_t bits;
+    };
+    // The most recently decoded bricks of a thread, direct mapped on a hash of the brick index (128 KiB per thread). A
+    // slot is tagged with the id of the volume (ids start at 1, so the zero initialized slots are empty) because all
+    // volumes share the cache.
+    struct DecodedBricks {
+        static constexpr int slotBits = 7;
+        static constexpr size_t numSlots = size_t(1) << slotBits;
+        std::array<uint64_t, numSlots> volumeIds;
+        std::array<size_t, numSlots> bricks;
+        std::array<std::array<uint16_t, brickVoxels>, numSlots> voxels;
+    };
+
+    const uint16_t* decodedBrick(size_t brick) const;
+    void decode(size_t brick, size_t slot) const;
+
+private:
+    static inline thread_local DecodedBricks s_decodedBricks;
+
+    uint64_t m_id;
+    glm::ivec3 m_dim;
+    size_t m_bricksX, m_bricksY;
+    std::vector<Brick> m_bricks;
+    std::vector<uint64_t> m_words;
+};
+
+// Callable with the interface of VolumeSampler that samples a compressed volume. The interpolation is the same as
+// that of Volume::getVoxelInterpolate, so the samples are identical to those of the original volume.
+template <InterpolationMode Mode>
+class CompressedSampler {
+public:
+    static constexpr InterpolationMode interpolationMode = Mode;
+
+    explicit CompressedSampler(const CompressedVolume* pVolume)
+        : m_pVolume(pVolume)
+        , m_dim(pVolume->dims())
+        , m_size(pVolume->dims())
+    {
+    }
+
+    float operator()(const glm::vec3& coord) const
+    {
+        if constexpr (Mode == InterpolationMode::NearestNeighbour)
+            return nearestNeighbour(coord);
+        else if constexpr (Mode == InterpolationMode::Linear)
+            return linear(coord);
+        else
+            return cubic(coord);
+    }
+    // Lanes share bricks (and therefore the decoded cache), so the packet is simply sampled lane by lane.
+    template <size_t N>
+    std::array<float, N> operator()(const CoordinatePacket<N>& coords) const
+    {
+        std::array<float, N> values;
+        for (size_t i = 0; i < N; i++)
+            values[i] = (*this)(glm::vec3(coords.x[i], coords.y[i], coords.z[i]));
+        return values;
+    }
+
+private:
+    float voxel(int x, int y, int z) const { return m_pVolume->getVoxelUnchecked(x, y, z); }
+    // Whether coord lies in [0, dim - 1) (the bounds are compared per component, which is faster than with glm).
+    bool isInterior(const glm::vec3& coord) const
+    {
+        return coord.x >= 0.0f && coord.y >= 0.0f && coord.z >= 0.0f && coord.x < m_size.x - 1.0f && coord.y < m_size.y - 1.0f && coord.z < m_size.z - 1.0f;
+    }
+
+    // See Volume::getVoxelNN.
+    float nearestNeighbour(const glm::vec3& coord) const
+    {
+        const float x = coord.x + 0.5f, y = coord.y + 0.5f, z = coord.z + 0.5f;
+        if (!(x >= 0.0f && y >= 0.0f && z >= 0.0f && x < m_size.x && y < m_size.y && z < m_size.z))
+            return 0.0f;
+        return voxel(static_cast<int>(x), static_cast<int>(y), static_cast<int>(z));
+    }
+
+    // See Volume::getVoxelLinearInterpolate.
+    float linear(const glm::vec3& coord) const
+    {
+        if (!isInterior(coord))
+            return 0.0f;
+
+        const int x = static_cast<int>(coord.x);
+        const int y = static_cast<int>(coord.y);
+        const int z = static_cast<int>(coord.z);
+        const float facX = coord.x - float(x);
+        const float facY = coord.y - float(y);
+        const float facZ = coord.z - float(z);
+
+        // Most of the time all eight voxels lie in the same brick, which is then looked up only once.
+        constexpr int last = CompressedVolume::brickSize - 1;
+        if (x % CompressedVolume::brickSize != last && y % CompressedVolume::brickSize != last && z % CompressedVolume::brickSize != last) {
+            const auto [pVoxels, i] = m_pVolume->getBrickVoxels(x, y, z);
+            constexpr auto dy = static_cast<size_t>(CompressedVolume::brickSize), dz = dy * dy;
+            const auto v = [pVoxels = pVoxels](size_t index) { return static_cast<float>(pVoxels[index]); };
+            const float t0 = Volume::linearInterpolate(v(i), v(i + 1), facX);
+            const float t1 = Volume::linearInterpolate(v(i + dy), v(i + dy + 1), facX);
+            const float t2 = Volume::linearInterpolate(v(i + dz), v(i + dz + 1), facX);
+            const float t3 = Volume::linearInterpolate(v(i + dy + dz), v(i + dy + dz + 1), facX);
+            return Volume::linearInterpolate(Volume::linearInterpolate(t0, t1, facY), Volume::linearInterpolate(t2, t3, facY), facZ);
+        }
+
+        const float t0 = Volume::linearInterpolate(voxel(x, y, z), voxel(x + 1, y, z), facX);
+        const float t1 = Volume::linearInterpolate(voxel(x, y + 1, z), voxel(x + 1, y + 1, z), facX);
+        const float t2 = Volume::linearInterpolate(voxel(x, y, z + 1), voxel(x + 1, y, z + 1), facX);
+        const float t3 = Volume::linearInterpolate(voxel(x, y + 1, z + 1), voxel(x + 1, y + 1, z + 1), facX);
+        const float t4 = Volume::linearInterpolate(t0, t1, facY);
+        const float t5 = Volume::linearInterpolate(t2, t3, facY);
+        return Volume::linearInterpolate(t4, t5, facZ);
+    }
+
+    // See Volume::getVoxelFastTriCubicInterpolate (including its handling of the border).
+    float cubic(const glm::vec3& coord) const
+    {
+        if (!isInterior(coord))
+            return 0.0f;
+
+        const glm::ivec3 base { coord };
+        glm::vec4 wx = Volume::cubicWeights(coord.x - float(base.x));
+        glm::vec4 wy = Volume::cubicWeights(coord.y - float(base.y));
+        glm::vec4 wz = Volume::cubicWeights(coord.z - float(base.z));
+        if (base.y == 0)
+            wy[0] = 0.0f;
+        if (base.x + 2 >= m_dim.x)
+            wx[3] = 0.0f;
+        if (base.y + 2 >= m_dim.y)
+            wy[3] = 0.0f;
+        if (base.z + 2 >= m_dim.z)
+            wz[3] = 0.0f;
+
+        std::array<int, 4> nx, ny, nz;
+        for (size_t i = 0; i < 4; i++) {
+            const glm::ivec3 neighbour = glm::clamp(base - 1 + int(i), glm::ivec3(0), m_dim - 1);
+            nx[i] = neighbour.x;
+            ny[i] = neighbour.y;
+            nz[i] = neighbour.z;
+        }
+
+        float value = 0.0f;
+        for (size_t k = 0; k < 4; k++) {
+            float slice = 0.0f;
+            for (size_t j = 0; j < 4; j++) {
+                const float row = wx[0] * voxel(nx[0], ny[j], nz[k]) + wx[1] * voxel(nx[1], ny[j], nz[k]) + wx[2] * voxel(nx[2], ny[j], nz[k]) + wx[3] * voxel(nx[3], ny[j], nz[k]);
+                slice += wy[int(j)] * row;
+            }
+            value += wz[int(k)] * slice;
+        }
+        return std::max(value, 0.0f);
+    }
+
+private:
+    const CompressedVolume* m_pVolume;
+    glm::ivec3 m_dim;
+    glm::vec3 m_size;
+};
+
+inline float CompressedVolume::getVoxelUnchecked(int x, int y, int z) const
+{
+    const auto [pVoxels, index] = getBrickVoxels(x, y, z);
+    return static_cast<float>(pVoxels[index]);
+}
+
+inline std::pair<const uint16_t*, size_t> CompressedVolume::getBrickVoxels(int x, int y, int z) const
+{
+    constexpr auto bs = static_cast<size_t>(brickSize);
+    const auto ux = static_cast<size_t>(x), uy = static_cast<size_t>(y), uz = static_cast<size_t>(z);
+    const size_t brick = ux / bs + m_bricksX * (uy / bs + m_bricksY * (uz / bs));
+    return { decodedBrick(brick), ux % bs + bs * (uy % bs + bs * (uz % bs)) };
+}
+
+inline const uint16_t* CompressedVolume::decodedBrick(size_t brick) const
+{
+    DecodedBricks& cache = s_decodedBricks;
+    // Fibonacci hashing: neighbouring bricks in all three directions map to different slots.
+    const size_t slot = (brick * size_t(0x9E3779B97F4A7C15ull)) >> (std::numeric_limits<size_t>::digits - DecodedBricks::slotBits);
+    if (cache.volumeIds[slot] != m_id || cache.bricks[slot] != brick)
+        decode(brick, slot);
+    return cache.voxels[slot].data();
+}
+
+template <typename F>
+decltype(auto) CompressedVolume::visitSampler(InterpolationMode interpolationMode, F&& f) const
+{
+    switch (interpolationMode) {
+    case InterpolationMode::NearestNeighbour:
+        return f(CompressedSampler<InterpolationMode::NearestNeighbour>(this));
+    case InterpolationMode::Linear:
+        return f(CompressedSampler<InterpolationMode::Linear>(this));
+    default:
+        return f(CompressedSampler<InterpolationMode::Cubic>(this));
+    }
+}
+}
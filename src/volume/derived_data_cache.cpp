@@ -0,0 +1,305 @@
+#include "derived_data_cache.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <glm/vector_relational.hpp>
+#include <iostream>
+#include <memory>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+// Byte range of an array in the cache file.
+struct Section {
+    uint64_t offset, size;
+};
+struct LevelHeader {
+    std::array<int32_t, 3> dim;
+    uint32_t elementSize;
+    uint32_t layout;
+    float minimum, maximum, maxMagnitude;
+    Section voxels, histogram, gradients;
+};
+// The file starts with the header (padded to a page) followed by the arrays, in the byte order of the machine.
+struct CacheHeader {
+    std::array<char, 8> magic;
+    uint32_t version;
+    // The key: the layout that the volume was loaded with and the version of the .fld file.
+    uint32_t layout;
+    uint64_t fileSize;
+    int64_t fileTime;
+
+    uint32_t gradientStorage;
+
+    uint32_t numLevels;
+    std::array<LevelHeader, volume::VolumePyramid::maxLevels> levels;
+    int32_t cellSize;
+    std::array<int32_t, 3> cellDim;
+    Section macroCells;
+    std::array<int32_t, 2> histogram2DResolution;
+    Section histogram2D;
+};
+static_assert(std::is_trivially_copyable_v<CacheHeader>);
+
+static constexpr std::array<char, 8> cacheMagic { 'V', 'V', 'C', 'A', 'C', 'H', 'E', '\0' };
+// Increase whenever the layout of the file or the way that the data is derived changes, which invalidates the caches.
+static constexpr uint32_t cacheVersion = 1;
+
+// The size and modification time of the .fld file, if it exists.
+static std::optional<std::pair<uint64_t, int64_t>> fileVersion(const std::filesystem::path& file)
+{
+    std::error_code error;
+    const auto size = std::filesystem::file_size(file, error);
+    if (error)
+        return {};
+    const auto time = std::filesystem::last_write_time(file, error);
+    if (error)
+        return {};
+    return std::pair<uint64_t, int64_t> { size, time.time_since_epoch().count() };
+}
+
+static size_t gradientSize(volume::GradientStorage storage)
+{
+    switch (storage) {
+    case volume::GradientStorage::Full:
+        return sizeof(volume::GradientVoxel);
+    case volume::GradientStorage::Compact:
+        return sizeof(volume::CompactGradientVoxel);
+    default:
+        return 0;
+    }
+}
+
+template <typename T>
+static gsl::span<const std::byte> asBytes(const std::vector<T>& values)
+{
+    return { reinterpret_cast<const std::byte*>(values.data()), values.size() * sizeof(T) };
+}
+
+template <typename T>
+static std::vector<T> fromBytes(gsl::span<const std::byte> bytes)
+{
+    std::vector<T> values(bytes.size() / sizeof(T));
+    if (!values.empty())
+        std::memcpy(values.data(), bytes.data(), values.size() * sizeof(T));
+    return values;
+}
+
+namespace volume {
+
+std::filesystem::path DerivedDataCache::cacheFile(const std::filesystem::path& volumeFile)
+{
+    std::filesystem::path file = volumeFile;
+    file += ".cache";
+    return file;
+}
+
+// The cache is written to a temporary file that replaces the previous cache once it is complete, so that a cache that
+// is opened is never partially written.
+bool DerivedDataCache::write(const std::filesystem::path& volumeFile, VoxelLayout layout, const VolumePyramid& pyramid,
+    const MacroCellGrid& macroCellGrid, const Histogram2D& histogram)
+{
+    const auto optFileVersion = fileVersion(volumeFile);
+    if (!optFileVersion) {
+        std::cerr << "Could not read the size and modification time of " << volumeFile << std::endl;
+        return false;
+    }
+    const std::filesystem::path file = cacheFile(volumeFile);
+    std::filesystem::path temporaryFile = file;
+    temporaryFile += ".tmp";
+    std::ofstream stream { temporaryFile, std::ios::binary };
+    if (!stream) {
+        std::cerr << "Could not open " << temporaryFile << " for writing" << std::endl;
+        return false;
+    }
+
+    const size_t pageSize = MappedFile::pageSize();
+    const std::vector<char> zeros(pageSize, 0);
+    uint64_t offset = 0;
+    const auto pad = [&]() {
+        const size_t padding = (pageSize - offset % pageSize) % pageSize;
+        stream.write(zeros.data(), std::streamsize(padding));
+        offset += padding;
+    };
+    const auto append = [&](gsl::span<const std::byte> data) {
+        const Section section { offset, data.size() };
+        stream.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+        offset += data.size();
+        pad();
+        return section;
+    };
+
+    CacheHeader header {};
+    header.magic = cacheMagic;
+    header.version = cacheVersion;
+    header.layout = uint32_t(layout);
+    header.gradientStorage = uint32_t(pyramid.gradientLevel(0).storage());
+    header.fileSize = optFileVersion->first;
+    header.fileTime = optFileVersion->second;
+    // The header is written last, once the offsets are known.
+    stream.write(zeros.data(), std::streamsize(sizeof(CacheHeader)));
+    offset = sizeof(CacheHeader);
+    pad();
+
+    header.numLevels = uint32_t(pyramid.numLevels());
+    for (size_t i = 0; i < pyramid.numLevels(); i++) {
+        const Volume& level = pyramid.level(i);
+        const GradientVolume& gradientLevel = pyramid.gradientLevel(i);
+        LevelHeader& levelHeader = header.levels[i];
+        levelHeader.dim = { level.dims().x, level.dims().y, level.dims().z };
+        levelHeader.elementSize = uint32_t(level.elementSize());
+        levelHeader.layout = uint32_t(level.indexer().layout());
+        levelHeader.minimum = level.minimum();
+        levelHeader.maximum = level.maximum();
+        levelHeader.maxMagnitude = gradientLevel.maxMagnitude();
+        if (i > 0)
+            levelHeader.voxels = append(level.storedVoxels());
+        levelHeader.histogram = append(asBytes(level.histogram()));
+        levelHeader.gradients = append(gradientLevel.storedGradients());
+    }
+    header.cellSize = macroCellGrid.cellSize();
+    header.cellDim = { macroCellGrid.dims().x, macroCellGrid.dims().y, macroCellGrid.dims().z };
+    header.macroCells = append(asBytes(macroCellGrid.valueRanges()));
+    header.histogram2DResolution = { histogram.resolution.x, histogram.resolution.y };
+    header.histogram2D = append(asBytes(histogram.bins));
+
+    stream.seekp(0);
+    stream.write(reinterpret_cast<const char*>(&header), std::streamsize(sizeof(CacheHeader)));
+    stream.close();
+    std::error_code error;
+    if (!stream) {
+        std::cerr << "Could not write " << temporaryFile << std::endl;
+        std::filesystem::remove(temporaryFile, error);
+        return false;
+    }
+    std::filesystem::rename(temporaryFile, file, error);
+    if (error) {
+        std::cerr << "Could not replace " << file << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporaryFile, error);
+        return false;
+    }
+    return true;
+}
+
+// Every array is checked against the size that it must have for the dimensions and layout of its level, so that a
+// damaged cache is rejected instead of read out of bounds. Level 0 matches the volume of the same version of the file.
+DerivedDataCache::DerivedDataCache(const std::filesystem::path& volumeFile, VoxelLayout layout)
+{
+    const std::filesystem::path file = cacheFile(volumeFile);
+    std::error_code error;
+    const auto optFileVersion = fileVersion(volumeFile);
+    if (!optFileVersion || !std::filesystem::exists(file, error))
+        return;
+    MappedFile mappedFile { file };
+    const gsl::span<const std::byte> data = mappedFile.data();
+    if (!mappedFile.isMapped() || data.size() < sizeof(CacheHeader))
+        return;
+
+    CacheHeader header;
+    std::memcpy(&header, data.data(), sizeof(CacheHeader));
+    if (header.magic != cacheMagic || header.version != cacheVersion || header.layout != uint32_t(layout)
+        || header.fileSize != optFileVersion->first || header.fileTime != optFileVersion->second
+        || header.gradientStorage > uint32_t(GradientStorage::Cached) || header.numLevels == 0 || header.numLevels > VolumePyramid::maxLevels)
+        return;
+    const auto gradientStorage = GradientStorage(header.gradientStorage);
+
+    bool valid = true;
+    const size_t pageSize = MappedFile::pageSize();
+    const auto section = [&](const Section& range, size_t expectedSize) {
+        if (range.size != expectedSize || range.offset % pageSize != 0 || range.offset > data.size() || range.size > data.size() - range.offset) {
+            valid = false;
+            return gsl::span<const std::byte> {};
+        }
+        return data.subspan(size_t(range.offset), size_t(range.size));
+    };
+
+    std::vector<Level> levels;
+    for (uint32_t i = 0; i < header.numLevels && valid; i++) {
+        const LevelHeader& levelHeader = header.levels[i];
+        const glm::ivec3 dim { levelHeader.dim[0], levelHeader.dim[1], levelHeader.dim[2] };
+        if (glm::any(glm::lessThan(dim, glm::ivec3(1))) || (levelHeader.elementSize != 1 && levelHeader.elementSize != 2)
+            || levelHeader.layout > uint32_t(VoxelLayout::Bricked) || !(levelHeader.minimum >= 0.0f && levelHeader.maximum >= levelHeader.minimum && levelHeader.maximum <= 65535.0f))
+            return;
+
+        Level level;
+        level.dim = dim;
+        level.elementSize = levelHeader.elementSize;
+        level.layout = VoxelLayout(levelHeader.layout);
+        level.minimum = levelHeader.minimum;
+        level.maximum = levelHeader.maximum;
+        level.maxMagnitude = levelHeader.maxMagnitude;
+        const size_t storageSize = VoxelIndexer(dim, level.layout).storageSize();
+        level.voxels = section(levelHeader.voxels, i > 0 ? storageSize * level.elementSize : 0);
+        level.histogram = section(levelHeader.histogram, (size_t(level.maximum) + 1) * sizeof(int));
+        level.gradients = section(levelHeader.gradients, storageSize * gradientSize(gradientStorage));
+        levels.push_back(level);
+    }
+    const glm::ivec3 cellDim { header.cellDim[0], header.cellDim[1], header.cellDim[2] };
+    const glm::ivec2 histogram2DResolution { header.histogram2DResolution[0], header.histogram2DResolution[1] };
+    if (header.cellSize < 1 || glm::any(glm::lessThan(cellDim, glm::ivec3(0))) || glm::any(glm::lessThan(histogram2DResolution, glm::ivec2(0))))
+        return;
+    const auto macroCells = section(header.macroCells, size_t(cellDim.x) * size_t(cellDim.y) * size_t(cellDim.z) * sizeof(glm::vec2));
+    const auto histogram2D = section(header.histogram2D, size_t(histogram2DResolution.x) * size_t(histogram2DResolution.y) * sizeof(int));
+    if (!valid)
+        return;
+
+    m_gradientStorage = gradientStorage;
+    m_levels = std::move(levels);
+    m_cellSize = header.cellSize;
+    m_cellDim = cellDim;
+    m_macroCells = macroCells;
+    m_histogram2DResolution = histogram2DResolution;
+    m_histogram2D = histogram2D;
+    // The spans stay valid: moving a mapping does not move the mapped memory.
+    m_optFile.emplace(std::move(mappedFile));
+}
+
+bool DerivedDataCache::isValid() const
+{
+    return m_optFile.has_value();
+}
+
+GradientStorage DerivedDataCache::gradientStorage() const
+{
+    return m_gradientStorage;
+}
+
+VolumeStatistics DerivedDataCache::statistics(size_t level) const
+{
+    const Level& cachedLevel = m_levels[level];
+    return VolumeStatistics { cachedLevel.minimum, cachedLevel.maximum, fromBytes<int>(cachedLevel.histogram) };
+}
+
+gsl::span<const std::byte> DerivedDataCache::storedGradients(size_t level) const
+{
+    return m_levels[level].gradients;
+}
+
+float DerivedDataCache::maxMagnitude(size_t level) const
+{
+    return m_levels[level].maxMagnitude;
+}
+
+VolumePyramid DerivedDataCache::pyramid(const Volume& volume, const GradientVolume& gradientVolume) const
+{
+    std::vector<std::unique_ptr<Volume>> levels;
+    std::vector<std::unique_ptr<GradientVolume>> gradientLevels;
+    for (size_t i = 1; i < m_levels.size(); i++) {
+        const Level& level = m_levels[i];
+        levels.push_back(std::make_unique<Volume>(level.voxels, level.elementSize, level.dim, level.layout, statistics(i)));
+        gradientLevels.push_back(std::make_unique<GradientVolume>(*levels.back(), m_gradientStorage, level.gradients, level.maxMagnitude));
+    }
+    return VolumePyramid(volume, gradientVolume, std::move(levels), std::move(gradientLevels));
+}
+
+MacroCellGrid DerivedDataCache::macroCellGrid() const
+{
+    return MacroCellGrid(m_cellSize, m_cellDim, fromBytes<glm::vec2>(m_macroCells));
+}
+
+Histogram2D DerivedDataCache::histogram2D() const
+{
+    return Histogram2D { m_histogram2DResolution, fromBytes<int>(m_histogram2D) };
+}
+}
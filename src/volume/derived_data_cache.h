@@ -0,0 +1,73 @@
+#pragma once
+#include "gradient_volume.h"
+#include "histogram_2d.h"
+#include "macro_cell_grid.h"
+#include "mapped_file.h"
+#include "volume.h"
+#include "volume_pyramid.h"
+#include <cstddef>
+#include <filesystem>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <optional>
+#include <vector>
+
+namespace volume {
+
+// Sidecar file of a .fld file (see cacheFile) with the data that is derived from the volume when it is opened: the
+// statistics and gradients of the volume, the voxels, statistics and gradients of the coarse levels of its pyramid, its
+// macro cells and its 2D histogram. A cache is only valid for the version of the .fld file that it was written for
+// (the same size and modification time) and for the voxel layout that the file was loaded with. The gradients are
+// those of the gradient storage that the cache was written with (see gradientStorage).
+//
+// Every array starts at a multiple of MappedFile::pageSize() in the file, so the gradients and the voxels of the levels
+// are used in place from the mapping of the cache: opening it only loads the pages that are read. The volumes and
+// gradient volumes created from the cache therefore view its mapping, and the cache must outlive them.
+class DerivedDataCache {
+public:
+    // The cache lives next to the .fld file, with ".cache" appended to its name.
+    static std::filesystem::path cacheFile(const std::filesystem::path& volumeFile);
+    // Writes the cache for a volume that was loaded from volumeFile with the given voxel layout (see Volume). The volume
+    // and its gradients are level 0 of the pyramid. Returns false (and reports why) if the cache could not be written.
+    static bool write(const std::filesystem::path& volumeFile, VoxelLayout layout, const VolumePyramid& pyramid,
+        const MacroCellGrid& macroCellGrid, const Histogram2D& histogram);
+
+    // Maps the cache of volumeFile. It is not valid if there is none, or if it does not match the file or layout.
+    DerivedDataCache(const std::filesystem::path& volumeFile, VoxelLayout layout);
+    DerivedDataCache(const DerivedDataCache&) = delete;
+    DerivedDataCache& operator=(const DerivedDataCache&) = delete;
+
+    bool isValid() const;
+    GradientStorage gradientStorage() const;
+
+    // The statistics of the volume (level 0) and of the coarse levels.
+    VolumeStatistics statistics(size_t level = 0) const;
+    // The arguments of the GradientVolume constructor that views the precomputed gradients of a level.
+    gsl::span<const std::byte> storedGradients(size_t level = 0) const;
+    float maxMagnitude(size_t level = 0) const;
+    // The pyramid of the volume that was loaded from the file and of its gradients.
+    VolumePyramid pyramid(const Volume& volume, const GradientVolume& gradientVolume) const;
+    MacroCellGrid macroCellGrid() const;
+    Histogram2D histogram2D() const;
+
+private:
+    struct Level {
+        glm::ivec3 dim;
+        size_t elementSize;
+        VoxelLayout layout;
+        float minimum, maximum, maxMagnitude;
+        // The voxels of level 0 are those of the .fld file.
+        gsl::span<const std::byte> voxels, histogram, gradients;
+    };
+
+    std::optional<MappedFile> m_optFile;
+    GradientStorage m_gradientStorage { GradientStorage::Full };
+    std::vector<Level> m_levels;
+    int m_cellSize { 0 };
+    glm::ivec3 m_cellDim { 0 };
+    gsl::span<const std::byte> m_macroCells;
+    glm::ivec2 m_histogram2DResolution { 0 };
+    gsl::span<const std::byte> m_histogram2D;
+};
+}
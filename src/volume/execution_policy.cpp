@@ -0,0 +1,79 @@
+#include "execution_policy.h"
+#include <tbb/info.h>
+
+namespace volume {
+
+thread_local int ExecutionPolicy::s_threadOffset = 0;
+
+ExecutionPolicy::ExecutionPolicy(const ExecutionConfig& config)
+    : m_config(config)
+{
+    if (config.numThreads > 0)
+        m_pThreadLimit = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, size_t(config.numThreads));
+
+    std::vector<tbb::numa_node_id> nodes { tbb::task_arena::automatic };
+    if (config.numaArenas) {
+        nodes = tbb::info::numa_nodes();
+        nodes.resize(std::min(nodes.size(), maxArenas));
+    }
+    std::vector<int> nodeThreads;
+    for (const tbb::numa_node_id node : nodes)
+        nodeThreads.push_back(tbb::info::default_concurrency(node));
+
+    // A thread limit is divided over the nodes in proportion to their cores (at least one thread each).
+    int numThreads = 0;
+    for (const int threads : nodeThreads)
+        numThreads += threads;
+    if (config.numThreads > 0 && config.numThreads < numThreads) {
+        const int limit = config.numThreads;
+        for (int& threads : nodeThreads)
+            threads = std::max(1, threads * limit / numThreads);
+    }
+
+    m_arenas.reserve(nodes.size());
+    m_threadOffsets.push_back(0);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        m_arenas.emplace_back(tbb::task_arena::constraints { nodes[i], nodeThreads[i] });
+        m_threadOffsets.push_back(m_threadOffsets.back() + nodeThreads[i]);
+    }
+}
+
+const ExecutionConfig& ExecutionPolicy::config() const
+{
+    return m_config;
+}
+
+size_t ExecutionPolicy::numArenas() const
+{
+    return m_arenas.size();
+}
+
+int ExecutionPolicy::concurrency() const
+{
+    return m_config.parallel ? m_threadOffsets.back() : 1;
+}
+
+static ExecutionPolicy& globalPolicy()
+{
+    static ExecutionPolicy policy;
+    return policy;
+}
+
+const ExecutionPolicy& ExecutionPolicy::global()
+{
+    return globalPolicy();
+}
+
+void ExecutionPolicy::setGlobal(const ExecutionConfig& config)
+{
+    // Release the thread limit of the old policy first; TBB applies the smallest limit that is alive.
+    ExecutionPolicy& policy = globalPolicy();
+    policy.m_pThreadLimit.reset();
+    policy = ExecutionPolicy(config);
+}
+
+int ExecutionPolicy::currentThreadIndex()
+{
+    return s_threadOffset + tbb::this_task_arena::current_thread_index();
+}
+}
@@ -0,0 +1,196 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <gsl/span>
+#include <memory>
+#include <new>
+#include <tbb/blocked_range.h>
+#include <tbb/blocked_range2d.h>
+#include <tbb/global_control.h>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace volume {
+
+// How the parallel loops of the renderer and of the volume precomputations are executed (see ExecutionPolicy).
+struct ExecutionConfig {
+    // Run the loops on multiple threads. Debug builds run them on the calling thread by default to make debugging easier.
+#ifdef NDEBUG
+    bool parallel { true };
+#else
+    bool parallel { false };
+#endif
+    // Maximum number of threads of the process, or 0 for one per core.
+    int numThreads { 0 };
+    // Create a task arena per NUMA node whose threads are pinned to the cores of that node. Requires TBB with hwloc
+    // support (tbbbind); without it the machine is a single node.
+    bool numaArenas { false };
+};
+
+// Allocator that default-initializes (instead of value-initializes) the elements, so that resizing a vector of
+// trivial elements does not write to the memory. Its pages are then placed on the NUMA node of the thread that
+// writes them first, see ExecutionPolicy::fill.
+template <typename T>
+struct FirstTouchAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        using other = FirstTouchAllocator<U>;
+    };
+
+    FirstTouchAllocator() = default;
+    template <typename U>
+    FirstTouchAllocator(const FirstTouchAllocator<U>&) noexcept { }
+
+    template <typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>)
+    {
+        ::new (static_cast<void*>(p)) U;
+    }
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+template <typename T>
+using FirstTouchVector = std::vector<T, FirstTouchAllocator<T>>;
+
+// Executes parallel loops in one or more TBB task arenas. With NUMA arenas a loop is split into one contiguous part
+// per node (in proportion to its threads), so that neighbouring elements are processed by the threads of the same
+// node, and data that is initialized by a loop (see fill) is placed in the memory of the node that processes it.
+// The policy of the process is configured once at startup (see global).
+class ExecutionPolicy {
+public:
+    explicit ExecutionPolicy(const ExecutionConfig& config = {});
+
+    const ExecutionConfig& config() const;
+    size_t numArenas() const;
+    // Total number of threads of the arenas.
+    int concurrency() const;
+
+    // The policy used by the renderer and the volume precomputations. setGlobal must not be called while any of them runs.
+    static const ExecutionPolicy& global();
+    static void setGlobal(const ExecutionConfig& config);
+
+    // Index of the calling thread among the threads of all arenas, in [0, concurrency()) inside of parallelFor.
+    static int currentThreadIndex();
+
+    // Calls body(subrange) for subranges of a tbb::blocked_range or (split along its rows) tbb::blocked_range2d. Within
+    // an arena the subranges are created by the partitioner, as in tbb::parallel_for.
+    template <typename Range, typename Body, typename Partitioner = tbb::auto_partitioner>
+    void parallelFor(const Range& range, const Body& body, const Partitioner& partitioner = {}) const;
+    // Assign value to all elements, in the same static partition of the elements over the threads as every fill of the
+    // same size, so that the memory of a FirstTouchVector is placed on the nodes that fill it.
+    template <typename T>
+    void fill(gsl::span<T> data, const T& value) const;
+    template <typename T>
+    void copy(gsl::span<const T> source, gsl::span<T> destination) const;
+
+private:
+    // The parts of a loop are waited for with a task group per arena.
+    static constexpr size_t maxArenas = 8;
+
+    template <typename Value>
+    static tbb::blocked_range<Value> part(const tbb::blocked_range<Value>& range, size_t begin, size_t end, size_t total);
+    template <typename RowValue, typename ColValue>
+    static tbb::blocked_range2d<RowValue, ColValue> part(const tbb::blocked_range2d<RowValue, ColValue>& range, size_t begin, size_t end, size_t total);
+    template <typename Value>
+    static Value interpolate(Value begin, Value end, size_t numerator, size_t denominator);
+
+    ExecutionConfig m_config;
+    std::unique_ptr<tbb::global_control> m_pThreadLimit;
+    // Executing work in an arena does not change the policy (and is thread safe), hence mutable.
+    mutable std::vector<tbb::task_arena> m_arenas;
+    // Number of threads of the arenas before each arena (and of all arenas at the end).
+    std::vector<int> m_threadOffsets;
+
+    // Arena that the calling thread executes a part of a loop in (see currentThreadIndex).
+    static thread_local int s_threadOffset;
+};
+
+template <typename Range, typename Body, typename Partitioner>
+void ExecutionPolicy::parallelFor(const Range& range, const Body& body, const Partitioner& partitioner) const
+{
+    if (!m_config.parallel || range.empty()) {
+        body(range);
+        return;
+    }
+
+    const auto runPart = [&](size_t arena) {
+        const int previousOffset = s_threadOffset;
+        s_threadOffset = m_threadOffsets[arena];
+        const Range local = part(range, size_t(m_threadOffsets[arena]), size_t(m_threadOffsets[arena + 1]), size_t(m_threadOffsets.back()));
+        if (!local.empty()) {
+            tbb::parallel_for(
+                local, [&](const Range& subrange) {
+                    s_threadOffset = m_threadOffsets[arena];
+                    body(subrange);
+                },
+                partitioner);
+        }
+        s_threadOffset = previousOffset;
+    };
+    if (m_arenas.size() == 1) {
+        m_arenas[0].execute([&]() { runPart(0); });
+        return;
+    }
+
+    // The calling thread processes the part of the first arena while the threads of the others process theirs.
+    std::array<tbb::task_group, maxArenas> groups;
+    for (size_t arena = 1; arena < m_arenas.size(); arena++)
+        m_arenas[arena].execute([&, arena]() { groups[arena].run([&, arena]() { runPart(arena); }); });
+    m_arenas[0].execute([&]() { runPart(0); });
+    for (size_t arena = 1; arena < m_arenas.size(); arena++)
+        m_arenas[arena].execute([&, arena]() { groups[arena].wait(); });
+}
+
+template <typename T>
+void ExecutionPolicy::fill(gsl::span<T> data, const T& value) const
+{
+    parallelFor(
+        tbb::blocked_range<size_t>(0, data.size()), [&](const tbb::blocked_range<size_t>& range) {
+            std::fill(std::begin(data) + std::ptrdiff_t(range.begin()), std::begin(data) + std::ptrdiff_t(range.end()), value);
+        },
+        tbb::static_partitioner());
+}
+
+template <typename T>
+void ExecutionPolicy::copy(gsl::span<const T> source, gsl::span<T> destination) const
+{
+    parallelFor(
+        tbb::blocked_range<size_t>(0, std::min(source.size(), destination.size())), [&](const tbb::blocked_range<size_t>& range) {
+            std::copy(std::begin(source) + std::ptrdiff_t(range.begin()), std::begin(source) + std::ptrdiff_t(range.end()), std::begin(destination) + std::ptrdiff_t(range.begin()));
+        },
+        tbb::static_partitioner());
+}
+
+template <typename Value>
+Value ExecutionPolicy::interpolate(Value begin, Value end, size_t numerator, size_t denominator)
+{
+    const auto size = static_cast<size_t>(end - begin);
+    return static_cast<Value>(begin + static_cast<Value>(size * numerator / denominator));
+}
+
+template <typename Value>
+tbb::blocked_range<Value> ExecutionPolicy::part(const tbb::blocked_range<Value>& range, size_t begin, size_t end, size_t total)
+{
+    return { interpolate(range.begin(), range.end(), begin, total), interpolate(range.begin(), range.end(), end, total), range.grainsize() };
+}
+
+template <typename RowValue, typename ColValue>
+tbb::blocked_range2d<RowValue, ColValue> ExecutionPolicy::part(const tbb::blocked_range2d<RowValue, ColValue>& range, size_t begin, size_t end, size_t total)
+{
+    const auto& rows = range.rows();
+    const auto& cols = range.cols();
+    return {
+        interpolate(rows.begin(), rows.end(), begin, total), interpolate(rows.begin(), rows.end(), end, total), rows.grainsize(),
+        cols.begin(), cols.end(), cols.grainsize()
+    };
+}
+}
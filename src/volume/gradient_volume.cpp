@@ -1,64 +1,213 @@
 #include "gradient_volume.h"
 #include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
 #include <exception>
+#include <glm/common.hpp>
 #include <glm/geometric.hpp>
 #include <glm/vector_relational.hpp>
-#include <gsl/span>
+#include <tbb/blocked_range.h>
+#include <tbb/combinable.h>
+#include <utility>
 
 namespace volume {
 
-// Compute the maximum magnitude from all gradient voxels
-static float computeMaxMagnitude(gsl::span<const GradientVoxel> data)
+// Central difference gradient at an interior voxel.
+template <typename T>
+static glm::vec3 centralDifference(const Volume& volume, int x, int y, int z)
 {
-    return std::max_element(
-        std::begin(data),
-        std::end(data),
-        [](const GradientVoxel& lhs, const GradientVoxel& rhs) {
-            return lhs.magnitude < rhs.magnitude;
-        })
-        ->magnitude;
+    const float gx = (volume.getVoxelUnchecked<T>(x + 1, y, z) - volume.getVoxelUnchecked<T>(x - 1, y, z)) / 2.0f;
+    const float gy = (volume.getVoxelUnchecked<T>(x, y + 1, z) - volume.getVoxelUnchecked<T>(x, y - 1, z)) / 2.0f;
+    const float gz = (volume.getVoxelUnchecked<T>(x, y, z + 1) - volume.getVoxelUnchecked<T>(x, y, z - 1)) / 2.0f;
+    return { gx, gy, gz };
 }
 
-// Compute the minimum magnitude from all gradient voxels
-static float computeMinMagnitude(gsl::span<const GradientVoxel> data)
+// Calls f(x, y, z, gradient) for every voxel at which a gradient is computed (the border voxels keep a zero gradient).
+// The slices are processed in parallel (see ExecutionPolicy) so f must be safe to call concurrently for different voxels.
+template <typename F>
+static void forEachInteriorGradient(const Volume& volume, F&& f)
 {
-    return std::min_element(
-        std::begin(data),
-        std::end(data),
-        [](const GradientVoxel& lhs, const GradientVoxel& rhs) {
-            return lhs.magnitude < rhs.magnitude;
-        })
-        ->magnitude;
+    const glm::ivec3 dim = volume.dims();
+    if (glm::any(glm::lessThan(dim, glm::ivec3(3))))
+        return;
+
+    volume.visitVoxelType([&](auto voxelType) {
+        using T = decltype(voxelType);
+        ExecutionPolicy::global().parallelFor(tbb::blocked_range<int>(1, dim.z - 1), [&](const tbb::blocked_range<int>& range) {
+            for (int z = range.begin(); z != range.end(); z++) {
+                for (int y = 1; y < dim.y - 1; y++) {
+                    for (int x = 1; x < dim.x - 1; x++) {
+                        f(x, y, z, centralDifference<T>(volume, x, y, z));
+                    }
+                }
+            }
+        });
+    });
 }
 
-// Compute a gradient volume from a volume
-static std::vector<GradientVoxel> computeGradientVolume(const Volume& volume)
+// Maximum gradient magnitude in the volume.
+static float computeMaxMagnitude(const Volume& volume)
 {
-    const auto dim = volume.dims();
+    tbb::combinable<float> maxMagnitudes { [] { return 0.0f; } };
+    forEachInteriorGradient(volume, [&](int, int, int, const glm::vec3& v) {
+        float& maxMagnitude = maxMagnitudes.local();
+        maxMagnitude = std::max(maxMagnitude, glm::length(v));
+    });
+    return maxMagnitudes.combine([](float lhs, float rhs) { return std::max(lhs, rhs); });
+}
 
-    std::vector<GradientVoxel> out(static_cast<size_t>(dim.x * dim.y * dim.z));
-    for (int z = 1; z < dim.z - 1; z++) {
-        for (int y = 1; y < dim.y - 1; y++) {
-            for (int x = 1; x < dim.x - 1; x++) {
-                const float gx = (volume.getVoxel(x + 1, y, z) - volume.getVoxel(x - 1, y, z)) / 2.0f;
-                const float gy = (volume.getVoxel(x, y + 1, z) - volume.getVoxel(x, y - 1, z)) / 2.0f;
-                const float gz = (volume.getVoxel(x, y, z + 1) - volume.getVoxel(x, y, z - 1)) / 2.0f;
+// Compute a gradient volume from a volume into out (reusing its storage), together with its maximum magnitude.
+// The storage is zeroed in parallel, which places its pages on the NUMA nodes that fill them (see FirstTouchAllocator).
+static void computeGradientVolume(const Volume& volume, FirstTouchVector<GradientVoxel>& out, float& maxMagnitude)
+{
+    const VoxelIndexer& indexer = volume.indexer();
 
-                const glm::vec3 v { gx, gy, gz };
-                const size_t index = static_cast<size_t>(x + dim.x * (y + dim.y * z));
-                out[index] = GradientVoxel { v, glm::length(v) };
-            }
-        }
+    out.resize(indexer.storageSize());
+    ExecutionPolicy::global().fill(gsl::span<GradientVoxel>(out), GradientVoxel { glm::vec3(0.0f), 0.0f });
+    tbb::combinable<float> maxMagnitudes { [] { return 0.0f; } };
+    forEachInteriorGradient(volume, [&](int x, int y, int z, const glm::vec3& v) {
+        const float magnitude = glm::length(v);
+        out[indexer.index(x, y, z)] = GradientVoxel { v, magnitude };
+        float& localMax = maxMagnitudes.local();
+        localMax = std::max(localMax, magnitude);
+    });
+    maxMagnitude = maxMagnitudes.combine([](float lhs, float rhs) { return std::max(lhs, rhs); });
+}
+
+// Map a unit vector onto the octahedron |x| + |y| + |z| = 1, unfold the lower half over the diagonals of the
+// upper half and quantize the resulting [-1, 1]^2 coordinates to a byte each.
+static CompactGradientVoxel encodeDirection(const glm::vec3& n)
+{
+    glm::vec2 oct = glm::vec2(n) / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+    if (n.z < 0.0f) {
+        const glm::vec2 signs { oct.x >= 0.0f ? 1.0f : -1.0f, oct.y >= 0.0f ? 1.0f : -1.0f };
+        oct = (1.0f - glm::abs(glm::vec2(oct.y, oct.x))) * signs;
     }
-    return out;
+    const auto quantize = [](float f) { return static_cast<uint8_t>(std::lround((f * 0.5f + 0.5f) * 255.0f)); };
+    return CompactGradientVoxel { quantize(oct.x), quantize(oct.y), 0 };
+}
+
+// Returns an unnormalized vector in the encoded direction.
+static glm::vec3 decodeDirection(uint8_t octU, uint8_t octV)
+{
+    const glm::vec2 oct = glm::vec2(float(octU), float(octV)) / 127.5f - 1.0f;
+    glm::vec3 n { oct.x, oct.y, 1.0f - std::abs(oct.x) - std::abs(oct.y) };
+    if (n.z < 0.0f) {
+        const glm::vec2 signs { n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f };
+        const glm::vec2 xy = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signs;
+        n.x = xy.x;
+        n.y = xy.y;
+    }
+    return n;
+}
+
+// Compute a compact gradient volume in two passes: the first finds the magnitude range used for quantization so
+// that the full precision gradients never have to be stored.
+static void computeCompactGradientVolume(const Volume& volume, FirstTouchVector<CompactGradientVoxel>& out, float& maxMagnitude)
+{
+    const VoxelIndexer& indexer = volume.indexer();
+    maxMagnitude = computeMaxMagnitude(volume);
+
+    const float scale = maxMagnitude > 0.0f ? 65535.0f / maxMagnitude : 0.0f;
+    out.resize(indexer.storageSize());
+    ExecutionPolicy::global().fill(gsl::span<CompactGradientVoxel>(out), CompactGradientVoxel { 0, 0, 0 });
+    forEachInteriorGradient(volume, [&](int x, int y, int z, const glm::vec3& v) {
+        const float magnitude = glm::length(v);
+        CompactGradientVoxel& voxel = out[indexer.index(x, y, z)];
+        if (magnitude > 0.0f)
+            voxel = encodeDirection(v / magnitude);
+        voxel.magnitude = static_cast<uint16_t>(std::lround(magnitude * scale));
+    });
 }
 
-GradientVolume::GradientVolume(const Volume& volume)
+GradientVolume::GradientVolume(const Volume& volume, GradientStorage storage)
     : m_dim(volume.dims())
-    , m_data(computeGradientVolume(volume))
-    , m_minMagnitude(computeMinMagnitude(m_data))
-    , m_maxMagnitude(computeMaxMagnitude(m_data))
+    , m_indexer(volume.indexer())
+    , m_storage(storage)
+    , m_pVolume(&volume)
 {
+    computeGradients(volume);
+}
+
+// Only the buffers are taken over; the recycled gradient volume may have been computed from a volume that no longer
+// exists.
+GradientVolume::GradientVolume(const Volume& volume, GradientStorage storage, GradientVolume&& recycled)
+    : m_dim(volume.dims())
+    , m_indexer(volume.indexer())
+    , m_storage(storage)
+    , m_pVolume(&volume)
+{
+    if (recycled.m_storage == storage) {
+        m_data = std::move(recycled.m_data);
+        m_compactData = std::move(recycled.m_compactData);
+    }
+    computeGradients(volume);
+}
+
+GradientVolume::GradientVolume(const Volume& volume, GradientStorage storage, gsl::span<const std::byte> storedGradients, float maxMagnitude)
+    : m_dim(volume.dims())
+    , m_indexer(volume.indexer())
+    , m_storage(storage)
+    , m_minMagnitude(0.0f)
+    , m_maxMagnitude(maxMagnitude)
+    , m_pVolume(&volume)
+{
+    switch (storage) {
+    case GradientStorage::Full:
+        assert(storedGradients.size() == m_indexer.storageSize() * sizeof(GradientVoxel));
+        m_pData = reinterpret_cast<const GradientVoxel*>(storedGradients.data());
+        break;
+    case GradientStorage::Compact:
+        assert(storedGradients.size() == m_indexer.storageSize() * sizeof(CompactGradientVoxel));
+        m_pCompactData = reinterpret_cast<const CompactGradientVoxel*>(storedGradients.data());
+        break;
+    default:
+        // Nothing is precomputed for the lazy storage modes.
+        computeGradients(volume);
+    }
+}
+
+void GradientVolume::computeGradients(const Volume& volume)
+{
+    // Gradients are only computed for interior voxels. The others (the border of the volume and the padding of the
+    // bricked layout) store a zero gradient, so the minimum magnitude is always 0.
+    switch (m_storage) {
+    case GradientStorage::Full: {
+        computeGradientVolume(volume, m_data, m_maxMagnitude);
+        m_pData = m_data.data();
+        m_minMagnitude = 0.0f;
+        break;
+    }
+    case GradientStorage::Compact: {
+        computeCompactGradientVolume(volume, m_compactData, m_maxMagnitude);
+        m_pCompactData = m_compactData.data();
+        m_minMagnitude = 0.0f;
+        break;
+    }
+    case GradientStorage::OnTheFly:
+    case GradientStorage::Cached: {
+        // Each component of a central difference is at most (max - min) / 2.
+        m_minMagnitude = 0.0f;
+        m_maxMagnitude = std::sqrt(3.0f) * (volume.maximum() - volume.minimum()) / 2.0f;
+        if (m_storage == GradientStorage::Cached) {
+            m_cacheDim = (m_dim + brickSize - 1) / brickSize;
+            const size_t numBricks = size_t(m_cacheDim.x) * size_t(m_cacheDim.y) * size_t(m_cacheDim.z);
+            // Value initialized, so all slots start out null.
+            m_brickCache = std::make_unique<std::atomic<const GradientVoxel*>[]>(numBricks);
+        }
+        break;
+    }
+    };
+}
+
+GradientVolume::~GradientVolume()
+{
+    if (m_brickCache) {
+        const size_t numBricks = size_t(m_cacheDim.x) * size_t(m_cacheDim.y) * size_t(m_cacheDim.z);
+        for (size_t i = 0; i < numBricks; i++)
+            delete[] m_brickCache[i].load(std::memory_order_relaxed);
+    }
 }
 
 float GradientVolume::maxMagnitude() const
@@ -76,6 +225,20 @@ glm::ivec3 GradientVolume::dims() const
     return m_dim;
 }
 
+GradientStorage GradientVolume::storage() const
+{
+    return m_storage;
+}
+
+gsl::span<const std::byte> GradientVolume::storedGradients() const
+{
+    if (m_pData)
+        return { reinterpret_cast<const std::byte*>(m_pData), m_indexer.storageSize() * sizeof(GradientVoxel) };
+    if (m_pCompactData)
+        return { reinterpret_cast<const std::byte*>(m_pCompactData), m_indexer.storageSize() * sizeof(CompactGradientVoxel) };
+    return {};
+}
+
 // This function returns a gradientVoxel at coord based on the current interpolation mode.
 GradientVoxel GradientVolume::getGradientVoxel(const glm::vec3& coord) const
 {
@@ -143,10 +306,74 @@ GradientVoxel GradientVolume::linearInterpolate(const GradientVoxel& g0, const G
     return result;
 }
 
-// This function returns a gradientVoxel without using interpolation
+// This function returns a gradientVoxel without using interpolation (a zero gradient outside of the volume)
 GradientVoxel GradientVolume::getGradientVoxel(int x, int y, int z) const
 {
-    const size_t i = static_cast<size_t>(x + m_dim.x * (y + m_dim.y * z));
-    return m_data[i];
+    if (!m_indexer.contains(x, y, z))
+        return { glm::vec3(0.0f), 0.0f };
+    switch (m_storage) {
+    case GradientStorage::Full:
+        return m_pData[m_indexer.index(x, y, z)];
+    case GradientStorage::Compact:
+        return decode(m_pCompactData[m_indexer.index(x, y, z)]);
+    case GradientStorage::OnTheFly:
+        return computeGradientVoxel(x, y, z);
+    default:
+        return getCachedGradientVoxel(x, y, z);
+    }
+}
+
+// Computes the same gradient as the full gradient volume stores (zero at the border of the volume).
+GradientVoxel GradientVolume::computeGradientVoxel(int x, int y, int z) const
+{
+    if (x < 1 || y < 1 || z < 1 || x >= m_dim.x - 1 || y >= m_dim.y - 1 || z >= m_dim.z - 1)
+        return { glm::vec3(0.0f), 0.0f };
+    const glm::vec3 v = m_pVolume->visitVoxelType([&](auto voxelType) { return centralDifference<decltype(voxelType)>(*m_pVolume, x, y, z); });
+    return { v, glm::length(v) };
+}
+
+// Look up a gradient in the brick cache, computing the brick if it has not been accessed before.
+GradientVoxel GradientVolume::getCachedGradientVoxel(int x, int y, int z) const
+{
+    // brickSize is a power of two; the coordinates are non-negative (checked by the caller).
+    static_assert((brickSize & (brickSize - 1)) == 0);
+    constexpr int shift = std::countr_zero(unsigned(brickSize));
+    constexpr int mask = brickSize - 1;
+    const glm::ivec3 brick { x >> shift, y >> shift, z >> shift };
+    std::atomic<const GradientVoxel*>& slot = m_brickCache[size_t(brick.x + m_cacheDim.x * (brick.y + m_cacheDim.y * brick.z))];
+
+    const GradientVoxel* pBrick = slot.load(std::memory_order_acquire);
+    if (!pBrick)
+        pBrick = fillBrick(brick, slot);
+    return pBrick[(x & mask) + ((y & mask) << shift) + ((z & mask) << (2 * shift))];
+}
+
+// Compute all gradients of a brick and publish them in the slot. If another thread got there first its brick is
+// used and ours is discarded.
+const GradientVoxel* GradientVolume::fillBrick(const glm::ivec3& brick, std::atomic<const GradientVoxel*>& slot) const
+{
+    auto pBrick = std::make_unique<GradientVoxel[]>(size_t(brickSize * brickSize * brickSize));
+    const glm::ivec3 begin = brick * brickSize;
+    for (int z = 0; z < brickSize; z++) {
+        for (int y = 0; y < brickSize; y++) {
+            for (int x = 0; x < brickSize; x++)
+                pBrick[size_t(x + brickSize * (y + brickSize * z))] = computeGradientVoxel(begin.x + x, begin.y + y, begin.z + z);
+        }
+    }
+
+    const GradientVoxel* pExpected = nullptr;
+    if (slot.compare_exchange_strong(pExpected, pBrick.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+        return pBrick.release();
+    return pExpected;
+}
+
+// Convert a compact gradient back to a direction (scaled by the magnitude, like the full gradient) and magnitude.
+GradientVoxel GradientVolume::decode(const CompactGradientVoxel& voxel) const
+{
+    if (voxel.magnitude == 0)
+        return { glm::vec3(0.0f), 0.0f };
+    const float magnitude = float(voxel.magnitude) * (m_maxMagnitude / 65535.0f);
+    const glm::vec3 direction = decodeDirection(voxel.octU, voxel.octV);
+    return { direction * (magnitude / glm::length(direction)), magnitude };
 }
 }
\ No newline at end of file
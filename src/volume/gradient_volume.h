@@ -1,7 +1,12 @@
 #pragma once
 #include "volume.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <gsl/span>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -11,29 +16,77 @@ struct GradientVoxel {
     float magnitude;
 };
 
+enum class GradientStorage {
+    Full = 0, // GradientVoxel per voxel (16 bytes).
+    Compact, // CompactGradientVoxel per voxel (4 bytes).
+    OnTheFly, // Nothing is precomputed, every lookup computes central differences from the volume.
+    Cached // Like OnTheFly but bricks of gradients are cached the first time they are accessed.
+};
+
+// Gradient with the direction octahedral encoded into two bytes and the magnitude quantized to 16 bits
+// relative to the maximum magnitude of the volume.
+struct CompactGradientVoxel {
+    uint8_t octU, octV;
+    uint16_t magnitude;
+};
+
 class GradientVolume {
 public:
     // DO NOT REMOVE
     InterpolationMode interpolationMode { InterpolationMode::NearestNeighbour };
 
 public:
-    GradientVolume(const Volume& volume);
+    // The lazy storage modes (OnTheFly and Cached) keep a pointer to the volume, which must outlive the gradient volume.
+    GradientVolume(const Volume& volume, GradientStorage storage = GradientStorage::Full);
+    // Computes the gradients of the volume into the buffers of a gradient volume that is no longer needed (if it has the
+    // same storage), which saves allocating them again for volumes of the same size, see VolumeSeries.
+    GradientVolume(const Volume& volume, GradientStorage storage, GradientVolume&& recycled);
+    // Views the gradients of the Full or Compact storage that were computed before (see storedGradients and
+    // DerivedDataCache), which must outlive the gradient volume. The lazy storage modes ignore the stored gradients.
+    GradientVolume(const Volume& volume, GradientStorage storage, gsl::span<const std::byte> storedGradients, float maxMagnitude);
+    ~GradientVolume();
 
     GradientVoxel getGradientVoxel(const glm::vec3& coord) const;
     GradientVoxel getGradientVoxel(int x, int y, int z) const;
 
+    // For the lazy storage modes these are bounds on the magnitude range (computing them would require all gradients).
     float minMagnitude() const;
     float maxMagnitude() const;
     glm::ivec3 dims() const;
+    GradientStorage storage() const;
+    // The precomputed gradients in the layout of the volume (an empty span for the lazy storage modes).
+    gsl::span<const std::byte> storedGradients() const;
 
 protected:
+    void computeGradients(const Volume& volume);
     GradientVoxel getGradientVoxelNN(const glm::vec3& coord) const;
     GradientVoxel getGradientVoxelLinearInterpolate(const glm::vec3& coord) const;
     static GradientVoxel linearInterpolate(const GradientVoxel& g0, const GradientVoxel& g1, float factor);
 
+    GradientVoxel decode(const CompactGradientVoxel& voxel) const;
+    GradientVoxel computeGradientVoxel(int x, int y, int z) const;
+    GradientVoxel getCachedGradientVoxel(int x, int y, int z) const;
+    const GradientVoxel* fillBrick(const glm::ivec3& brick, std::atomic<const GradientVoxel*>& slot) const;
+
 protected:
+    static constexpr int brickSize = VoxelIndexer::brickSize;
+
     const glm::ivec3 m_dim;
-    const std::vector<GradientVoxel> m_data;
-    const float m_minMagnitude, m_maxMagnitude;
+    // Gradients are stored in the same layout as the volume they were computed from.
+    const VoxelIndexer m_indexer;
+    const GradientStorage m_storage;
+    // Only the buffer that matches m_storage is filled, unless the gradients are viewed from elsewhere. The pointer
+    // that matches m_storage points to the gradients.
+    FirstTouchVector<GradientVoxel> m_data;
+    FirstTouchVector<CompactGradientVoxel> m_compactData;
+    const GradientVoxel* m_pData { nullptr };
+    const CompactGradientVoxel* m_pCompactData { nullptr };
+    float m_minMagnitude, m_maxMagnitude;
+
+    const Volume* m_pVolume;
+    // Cached storage: one slot per brick of brickSize^3 gradients (in slice-major order within the brick), null until
+    // the brick is first accessed. Slots are filled lock-free so concurrent render threads may race to compute a brick.
+    glm::ivec3 m_cacheDim { 0 };
+    std::unique_ptr<std::atomic<const GradientVoxel*>[]> m_brickCache;
 };
 }
@@ -0,0 +1,38 @@
+#include "histogram_2d.h"
+#include <algorithm>
+#include <atomic>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace volume {
+
+Histogram2D computeHistogram2D(const Volume& volume, const GradientVolume& gradientVolume)
+{
+    Histogram2D histogram;
+    computeHistogram2D(volume, gradientVolume, histogram);
+    return histogram;
+}
+
+// The bins are shared between threads and incremented atomically. Per-thread copies are not an option because
+// a 16-bit volume can easily have tens of millions of bins.
+void computeHistogram2D(const Volume& volume, const GradientVolume& gradientVolume, Histogram2D& histogram)
+{
+    histogram.resolution = glm::ivec2(int(volume.maximum()) + 1, int(gradientVolume.maxMagnitude()) + 1);
+    histogram.bins.assign(size_t(histogram.resolution.x) * size_t(histogram.resolution.y), 0);
+
+    const glm::ivec3 dim = volume.dims();
+    const glm::ivec2 maxBin = histogram.resolution - 1;
+    tbb::parallel_for(tbb::blocked_range<int>(0, dim.z), [&](const tbb::blocked_range<int>& range) {
+        for (int z = range.begin(); z != range.end(); z++) {
+            for (int y = 0; y < dim.y; y++) {
+                for (int x = 0; x < dim.x; x++) {
+                    const int valueBin = std::min(static_cast<int>(volume.getVoxel(x, y, z)), maxBin.x);
+                    const int magnitudeBin = std::min(static_cast<int>(gradientVolume.getGradientVoxel(x, y, z).magnitude), maxBin.y);
+                    const size_t index = size_t(valueBin) + size_t(histogram.resolution.x) * size_t(magnitudeBin);
+                    std::atomic_ref<int>(histogram.bins[index]).fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+    });
+}
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "gradient_volume.h"
+#include "volume.h"
+#include <glm/vec2.hpp>
+#include <vector>
+
+namespace volume {
+
+// Joint histogram of voxel value and gradient magnitude with one bin per integer value and magnitude (values are
+// truncated). Used by the 2D transfer function widgets.
+struct Histogram2D {
+    // Number of value (x) and magnitude (y) bins.
+    glm::ivec2 resolution { 0 };
+    // Count for (value, magnitude) at bins[value + resolution.x * magnitude].
+    std::vector<int> bins;
+};
+
+// Computed in one parallel pass over the volume.
+Histogram2D computeHistogram2D(const Volume& volume, const GradientVolume& gradientVolume);
+// Same, but into an existing histogram whose bins are reused (see VolumeSeries).
+void computeHistogram2D(const Volume& volume, const GradientVolume& gradientVolume, Histogram2D& histogram);
+}
@@ -0,0 +1,88 @@
+#include "macro_cell_grid.h"
+#include <algorithm>
+#include <glm/common.hpp>
+#include <limits>
+#include <utility>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace volume {
+
+// Compute the min/max of every cell. A cell covers the sample positions [cell * cellSize, (cell + 1) * cellSize)
+// but the interpolation kernels read up to one voxel before and two voxels after the sample position, so the
+// range is computed over the cell plus that border. Cells touching the border of the volume also include 0,
+// which is what the samplers return outside of the volume.
+MacroCellGrid::MacroCellGrid(const Volume& volume, int cellSize)
+    : m_cellSize(cellSize)
+    , m_dim((volume.dims() + cellSize - 1) / cellSize)
+    , m_minMax(static_cast<size_t>(m_dim.x * m_dim.y * m_dim.z))
+{
+    const glm::ivec3 volumeDim = volume.dims();
+    tbb::parallel_for(tbb::blocked_range<int>(0, m_dim.z), [&](const tbb::blocked_range<int>& range) {
+        for (int cz = range.begin(); cz != range.end(); cz++) {
+            for (int cy = 0; cy < m_dim.y; cy++) {
+                for (int cx = 0; cx < m_dim.x; cx++) {
+                    const glm::ivec3 cell { cx, cy, cz };
+                    const glm::ivec3 begin = cell * m_cellSize - 1;
+                    const glm::ivec3 end = (cell + 1) * m_cellSize + 2;
+                    const glm::ivec3 clampedBegin = glm::max(begin, glm::ivec3(0));
+                    const glm::ivec3 clampedEnd = glm::min(end, volumeDim);
+
+                    float minVal = std::numeric_limits<float>::max();
+                    float maxVal = std::numeric_limits<float>::lowest();
+                    for (int z = clampedBegin.z; z < clampedEnd.z; z++) {
+                        for (int y = clampedBegin.y; y < clampedEnd.y; y++) {
+                            for (int x = clampedBegin.x; x < clampedEnd.x; x++) {
+                                const float v = volume.getVoxel(x, y, z);
+                                minVal = std::min(minVal, v);
+                                maxVal = std::max(maxVal, v);
+                            }
+                        }
+                    }
+                    if (glm::any(glm::lessThan(begin, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(end, volumeDim)))
+                        minVal = std::min(minVal, 0.0f);
+
+                    const size_t index = static_cast<size_t>(cx + m_dim.x * (cy + m_dim.y * cz));
+                    m_minMax[index] = glm::vec2(minVal, maxVal);
+                }
+            }
+        }
+    });
+}
+
+MacroCellGrid::MacroCellGrid(int cellSize, const glm::ivec3& dim, std::vector<glm::vec2> valueRanges)
+    : m_cellSize(cellSize)
+    , m_dim(dim)
+    , m_minMax(std::move(valueRanges))
+{
+}
+
+int MacroCellGrid::cellSize() const
+{
+    return m_cellSize;
+}
+
+glm::ivec3 MacroCellGrid::dims() const
+{
+    return m_dim;
+}
+
+const std::vector<glm::vec2>& MacroCellGrid::valueRanges() const
+{
+    return m_minMax;
+}
+
+glm::vec2 MacroCellGrid::valueRange(const glm::ivec3& cell) const
+{
+    const size_t index = static_cast<size_t>(cell.x + m_dim.x * (cell.y + m_dim.y * cell.z));
+    return m_minMax[index];
+}
+
+// The cubic kernel has negative lobes so it may over/undershoot the values it interpolates. With a = -0.75 the
+// negative weights of the 4x4x4 tensor product kernel sum to at most 0.8, so the result stays within
+// [min - 0.8 * (max - min), max + 0.8 * (max - min)]. Nearest neighbour and trilinear never leave [min, max].
+float MacroCellGrid::interpolationOvershoot(InterpolationMode interpolationMode)
+{
+    return interpolationMode == InterpolationMode::Cubic ? 0.8f : 0.0f;
+}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "volume.h"
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <vector>
+
+namespace volume {
+
+// Coarse grid of min/max values over bricks of cellSize^3 voxels. Used by the renderer to jump over
+// regions of the volume that cannot contribute to the image (empty space skipping).
+class MacroCellGrid {
+public:
+    static constexpr int defaultCellSize = 8;
+
+public:
+    MacroCellGrid(const Volume& volume, int cellSize = defaultCellSize);
+    // Cells that were computed before (see valueRanges and DerivedDataCache).
+    MacroCellGrid(int cellSize, const glm::ivec3& dim, std::vector<glm::vec2> valueRanges);
+
+    int cellSize() const;
+    glm::ivec3 dims() const;
+    // The value ranges of all cells, in x-major order.
+    const std::vector<glm::vec2>& valueRanges() const;
+
+    // Range of voxel values that any sample taken inside the cell may return (x = min, y = max).
+    glm::vec2 valueRange(const glm::ivec3& cell) const;
+
+    static float interpolationOvershoot(InterpolationMode interpolationMode);
+
+private:
+    int m_cellSize;
+    glm::ivec3 m_dim;
+    std::vector<glm::vec2> m_minMax;
+};
+}
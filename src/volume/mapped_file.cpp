@@ -0,0 +1,127 @@
+#include "mapped_file.h"
+#include <cstdint>
+#include <utility>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace volume {
+
+// The file (and on Windows the mapping object) can be closed as soon as the view exists; the view keeps a
+// reference to the file until it is unmapped.
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& file)
+{
+    HANDLE fileHandle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(fileHandle, &fileSize) && fileSize.QuadPart > 0) {
+        HANDLE mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mappingHandle) {
+            m_pData = static_cast<const std::byte*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+            if (m_pData)
+                m_size = static_cast<size_t>(fileSize.QuadPart);
+            CloseHandle(mappingHandle);
+        }
+    }
+    CloseHandle(fileHandle);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_pData)
+        UnmapViewOfFile(m_pData);
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& file)
+{
+    const int fd = open(file.c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+        const auto fileSize = static_cast<size_t>(fileStat.st_size);
+        void* pMapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (pMapping != MAP_FAILED) {
+            m_pData = static_cast<const std::byte*>(pMapping);
+            m_size = fileSize;
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_pData)
+        munmap(const_cast<std::byte*>(m_pData), m_size);
+}
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_pData(std::exchange(other.m_pData, nullptr))
+    , m_size(std::exchange(other.m_size, 0))
+{
+}
+
+bool MappedFile::isMapped() const
+{
+    return m_pData != nullptr;
+}
+
+gsl::span<const std::byte> MappedFile::data() const
+{
+    return { m_pData, m_size };
+}
+
+size_t MappedFile::pageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return static_cast<size_t>(systemInfo.dwPageSize);
+#else
+    static const auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return pageSize;
+#endif
+}
+
+void MappedFile::evict(gsl::span<const std::byte> range)
+{
+    const size_t pageSize = MappedFile::pageSize();
+    const auto begin = (reinterpret_cast<uintptr_t>(range.data()) + pageSize - 1) / pageSize * pageSize;
+    const auto end = (reinterpret_cast<uintptr_t>(range.data()) + range.size()) / pageSize * pageSize;
+    if (begin >= end)
+        return;
+#ifdef _WIN32
+    // Unlocking pages that are not locked removes them from the working set of the process.
+    VirtualUnlock(reinterpret_cast<void*>(begin), end - begin);
+#else
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+}
+
+void MappedFile::prefetch(gsl::span<const std::byte> range)
+{
+    const size_t pageSize = MappedFile::pageSize();
+    const auto begin = reinterpret_cast<uintptr_t>(range.data()) / pageSize * pageSize;
+    const auto end = reinterpret_cast<uintptr_t>(range.data()) + range.size();
+    if (begin >= end)
+        return;
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY entry { reinterpret_cast<void*>(begin), end - begin };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &entry, 0);
+#else
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+#endif
+}
+}
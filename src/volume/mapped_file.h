@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <gsl/span>
+
+namespace volume {
+
+// Read-only memory mapping of a whole file. The pages are loaded by the OS on first access and can be evicted
+// under memory pressure, so mapping a file does not require it to fit in (or be copied into) main memory.
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& file);
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    ~MappedFile();
+
+    MappedFile& operator=(MappedFile&&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // False if the file could not be opened or mapped (or is empty).
+    bool isMapped() const;
+    gsl::span<const std::byte> data() const;
+
+    // Granularity in bytes at which mapped pages are loaded and evicted.
+    static size_t pageSize();
+    // Asks the OS to drop the pages of a mapping that lie completely inside of range. The pages are not lost: the next
+    // access loads them from the file again.
+    static void evict(gsl::span<const std::byte> range);
+    // Asks the OS to start loading the pages of a mapping that overlap range in the background, so that they are
+    // (mostly) loaded when they are accessed.
+    static void prefetch(gsl::span<const std::byte> range);
+
+private:
+    const std::byte* m_pData { nullptr };
+    size_t m_size { 0 };
+};
+}
@@ -1,53 +1,168 @@
 #include "volume.h"
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
 #include <cctype> // isspace
 #include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <glm/glm.hpp>
 #include <gsl/span>
 #include <iostream>
+#include <limits>
 #include <math.h>
 #include <string>
+#include <tbb/blocked_range.h>
+#include <tbb/combinable.h>
+#include <tbb/parallel_for.h>
 
 struct Header {
     glm::ivec3 dim;
     size_t elementSize;
+    volume::VoxelLayout layout;
 };
 static Header readHeader(std::ifstream& ifs);
-static float computeMinimum(gsl::span<const uint16_t> data);
-static float computeMaximum(gsl::span<const uint16_t> data);
-static std::vector<int> computeHistogram(gsl::span<const uint16_t> data);
+template <typename T>
+static volume::VolumeStatistics computeStatistics(gsl::span<const T> data);
+template <typename T>
+static volume::FirstTouchVector<T> firstTouchCopy(gsl::span<const T> data);
 
 namespace volume {
 
-Volume::Volume(const std::filesystem::path& file)
+Volume::Volume(const std::filesystem::path& file, VoxelLayout layout, std::optional<VolumeStatistics> optStatistics)
     : m_fileName(file.string())
 {
     using clock = std::chrono::high_resolution_clock;
     auto start = clock::now();
-    loadFile(file);
+    const VoxelLayout fileLayout = loadFile(file);
     auto end = clock::now();
     std::cout << "Time to load: " << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
 
-    if (m_data.size() > 0) {
-        m_minimum = computeMinimum(m_data);
-        m_maximum = computeMaximum(m_data);
-        m_histogram = computeHistogram(m_data);
+    // The statistics of linear files are computed before reordering such that they do not include the padding of the
+    // bricked layout.
+    if (fileLayout == VoxelLayout::Bricked) {
+        m_indexer = VoxelIndexer(m_dim, fileLayout);
+        if (!optStatistics)
+            computeStatistics(m_indexer.storageSize());
+    } else {
+        m_indexer = VoxelIndexer(m_dim, layout);
+        if (!optStatistics)
+            computeStatistics(static_cast<size_t>(m_dim.x) * static_cast<size_t>(m_dim.y) * static_cast<size_t>(m_dim.z));
+        applyLayout(layout);
     }
+    if (optStatistics)
+        setStatistics(std::move(*optStatistics));
 }
 
-Volume::Volume(std::vector<uint16_t> data, const glm::ivec3& dim)
+Volume::Volume(std::vector<uint16_t> data, const glm::ivec3& dim, VoxelLayout layout)
     : m_fileName()
     , m_elementSize(2)
     , m_dim(dim)
-    , m_data(std::move(data))
-    , m_minimum(computeMinimum(m_data))
-    , m_maximum(computeMaximum(m_data))
-    , m_histogram(computeHistogram(m_data))
+    , m_indexer(dim, layout)
+    , m_data16(firstTouchCopy<uint16_t>(data))
+    , m_pVoxels16(m_data16.data())
 {
+    computeStatistics(m_data16.size());
+    applyLayout(layout);
+}
+
+Volume::Volume(std::vector<uint8_t> data, const glm::ivec3& dim, VoxelLayout layout)
+    : m_fileName()
+    , m_elementSize(1)
+    , m_dim(dim)
+    , m_indexer(dim, layout)
+    , m_data8(firstTouchCopy<uint8_t>(data))
+    , m_pVoxels8(m_data8.data())
+{
+    computeStatistics(m_data8.size());
+    applyLayout(layout);
+}
+
+Volume::Volume(gsl::span<const std::byte> storedVoxels, size_t elementSize, const glm::ivec3& dim, VoxelLayout layout, VolumeStatistics statistics)
+    : m_fileName()
+    , m_elementSize(elementSize)
+    , m_dim(dim)
+    , m_indexer(dim, layout)
+{
+    assert(storedVoxels.size() == m_indexer.storageSize() * elementSize);
+    if (elementSize == 1)
+        m_pVoxels8 = reinterpret_cast<const uint8_t*>(storedVoxels.data());
+    else
+        m_pVoxels16 = reinterpret_cast<const uint16_t*>(storedVoxels.data());
+    setStatistics(std::move(statistics));
+}
+
+// Statistics over the storedVoxels voxels in storage. Storage that is larger than the volume holds the zero padding of
+// the bricked layout, which is removed from the histogram (and from the minimum).
+void Volume::computeStatistics(size_t storedVoxels)
+{
+    const size_t voxelCount = static_cast<size_t>(m_dim.x) * static_cast<size_t>(m_dim.y) * static_cast<size_t>(m_dim.z);
+    if (voxelCount == 0)
+        return;
+
+    setStatistics(m_elementSize == 1
+            ? ::computeStatistics(gsl::span<const uint8_t>(m_pVoxels8, storedVoxels))
+            : ::computeStatistics(gsl::span<const uint16_t>(m_pVoxels16, storedVoxels)));
+
+    const size_t padding = storedVoxels - voxelCount;
+    if (padding > 0) {
+        m_histogram[0] -= static_cast<int>(padding);
+        const auto firstValue = std::find_if(std::begin(m_histogram), std::end(m_histogram), [](int count) { return count > 0; });
+        m_minimum = float(std::distance(std::begin(m_histogram), firstValue));
+    }
+}
+
+void Volume::setStatistics(VolumeStatistics statistics)
+{
+    m_minimum = statistics.minimum;
+    m_maximum = statistics.maximum;
+    m_histogram = std::move(statistics.histogram);
+}
+
+// Reorder the (linearly stored) voxels into the given layout. This always produces an owned buffer, so a mapped
+// file is released afterwards.
+void Volume::applyLayout(VoxelLayout layout)
+{
+    if (layout == VoxelLayout::Linear)
+        return;
+
+    const size_t voxelCount = static_cast<size_t>(m_dim.x) * static_cast<size_t>(m_dim.y) * static_cast<size_t>(m_dim.z);
+    if (m_elementSize == 1) {
+        m_data8 = fromLinear<uint8_t>({ m_pVoxels8, voxelCount });
+        m_pVoxels8 = m_data8.data();
+    } else {
+        m_data16 = fromLinear<uint16_t>({ m_pVoxels16, voxelCount });
+        m_pVoxels16 = m_data16.data();
+    }
+    m_mappedFile.reset();
+}
+
+// The voxels reordered into the layout of the indexer, with zero padding. The slices are reordered in parallel, after
+// the buffer was initialized in parallel (see m_data8).
+template <typename T>
+FirstTouchVector<T> Volume::fromLinear(gsl::span<const T> linear) const
+{
+    FirstTouchVector<T> out(m_indexer.storageSize());
+    const ExecutionPolicy& policy = ExecutionPolicy::global();
+    policy.fill(gsl::span<T>(out), T {});
+    policy.parallelFor(tbb::blocked_range<int>(0, m_dim.z), [&](const tbb::blocked_range<int>& range) {
+        size_t i = size_t(range.begin()) * size_t(m_dim.x) * size_t(m_dim.y);
+        for (int z = range.begin(); z != range.end(); z++) {
+            for (int y = 0; y < m_dim.y; y++) {
+                for (int x = 0; x < m_dim.x; x++)
+                    out[m_indexer.index(x, y, z)] = linear[i++];
+            }
+        }
+    });
+    return out;
+}
+
+size_t Volume::elementSize() const
+{
+    return m_elementSize;
 }
 
 float Volume::minimum() const
@@ -60,7 +175,7 @@ float Volume::maximum() const
     return m_maximum;
 }
 
-std::vector<int> Volume::histogram() const
+const std::vector<int>& Volume::histogram() const
 {
     return m_histogram;
 }
@@ -75,13 +190,106 @@ std::string_view Volume::fileName() const
     return m_fileName;
 }
 
-float Volume::getVoxel(int x, int y, int z) const
+const VoxelIndexer& Volume::indexer() const
+{
+    return m_indexer;
+}
+
+gsl::span<const std::byte> Volume::mappedVoxels() const
+{
+    if (!m_mappedFile)
+        return {};
+    const auto* pVoxels = m_elementSize == 1 ? reinterpret_cast<const std::byte*>(m_pVoxels8) : reinterpret_cast<const std::byte*>(m_pVoxels16);
+    return { pVoxels, m_indexer.storageSize() * m_elementSize };
+}
+
+gsl::span<const std::byte> Volume::storedVoxels() const
 {
-    const size_t i = size_t(x + m_dim.x * (y + m_dim.y * z));
-    if (i >= m_data.size() || i < 0) {
-        return 0;
+    const auto* pVoxels = m_elementSize == 1 ? reinterpret_cast<const std::byte*>(m_pVoxels8) : reinterpret_cast<const std::byte*>(m_pVoxels16);
+    return { pVoxels, m_indexer.storageSize() * m_elementSize };
+}
+
+// Writes the voxels of one brick (or of one row of voxels for the linear layout) at a time. Voxels in the padding of the
+// bricked layout are 0. Multi-byte voxels are written in little endian order, like the files that are read.
+template <typename T>
+static void writeVoxels(std::ostream& stream, const Volume& volume, VoxelLayout layout)
+{
+    const glm::ivec3 dim = volume.dims();
+    std::vector<T> buffer;
+    const auto flush = [&]() {
+        if constexpr (sizeof(T) > 1 && std::endian::native != std::endian::little) {
+            for (T& v : buffer)
+                v = static_cast<T>((v >> 8) | (v << 8));
+        }
+        stream.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size() * sizeof(T)));
+        buffer.clear();
+    };
+    const auto voxel = [&](int x, int y, int z) {
+        const bool inside = x < dim.x && y < dim.y && z < dim.z;
+        return inside ? static_cast<T>(volume.getVoxelUnchecked<T>(x, y, z)) : T { 0 };
+    };
+
+    if (layout == VoxelLayout::Linear) {
+        for (int z = 0; z < dim.z; z++) {
+            for (int y = 0; y < dim.y; y++) {
+                for (int x = 0; x < dim.x; x++)
+                    buffer.push_back(voxel(x, y, z));
+                flush();
+            }
+        }
+        return;
+    }
+
+    constexpr int brickSize = VoxelIndexer::brickSize;
+    const glm::ivec3 bricks = (dim + brickSize - 1) / brickSize;
+    for (int bz = 0; bz < bricks.z; bz++) {
+        for (int by = 0; by < bricks.y; by++) {
+            for (int bx = 0; bx < bricks.x; bx++) {
+                const glm::ivec3 origin = glm::ivec3(bx, by, bz) * brickSize;
+                for (int z = origin.z; z < origin.z + brickSize; z++) {
+                    for (int y = origin.y; y < origin.y + brickSize; y++) {
+                        for (int x = origin.x; x < origin.x + brickSize; x++)
+                            buffer.push_back(voxel(x, y, z));
+                    }
+                }
+                flush();
+            }
+        }
+    }
+}
+
+bool Volume::write(const std::filesystem::path& file, VoxelLayout layout) const
+{
+    std::ofstream stream { file, std::ios::binary };
+    if (!stream) {
+        std::cerr << "Could not open " << file << " for writing" << std::endl;
+        return false;
+    }
+
+    std::string header = "ndim=3\ndim1=" + std::to_string(m_dim.x) + "\ndim2=" + std::to_string(m_dim.y) + "\ndim3=" + std::to_string(m_dim.z)
+        + "\nnspace=3\nveclen=1\ndata=" + (m_elementSize == 1 ? "byte" : "short") + "\nfield=uniform\n";
+    if (layout == VoxelLayout::Bricked)
+        header += "layout=bricked\n";
+    // Pad the header with a comment line (of at least "#\n") so that the voxels after the two form feeds are page aligned.
+    const size_t pageSize = MappedFile::pageSize();
+    size_t padding = (pageSize - (header.size() + 2) % pageSize) % pageSize;
+    if (padding < 2)
+        padding += pageSize;
+    header += "#" + std::string(padding - 2, ' ') + "\n\f\f";
+    stream << header;
+
+    visitVoxelType([&]<typename T>(T) { writeVoxels<T>(stream, *this, layout); });
+    if (!stream) {
+        std::cerr << "Could not write " << file << std::endl;
+        return false;
     }
-    return static_cast<float>(m_data[i]);
+    return true;
+}
+
+// Returns the voxel value at the given integer position, or 0 outside of the volume.
+float Volume::getVoxel(int x, int y, int z) const
+{
+    return m_elementSize == 1 ? getVoxel<uint8_t>(x, y, z) : getVoxel<uint16_t>(x, y, z);
 }
 
 // This function returns a value based on the current interpolation mode
@@ -103,49 +311,15 @@ float Volume::getVoxelInterpolate(const glm::vec3& coord) const
     }
 }
 
-// This function returns the nearest neighbour given a position in the volume given by coord.
-// Notice that in this framework we assume that the distance between neighbouring voxels is 1 in all directions
+// The samplers below select the implementation (see volume.h) that matches the voxel type.
 float Volume::getVoxelNN(const glm::vec3& coord) const
 {
-    if (glm::any(glm::lessThan(coord + 0.5f, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord + 0.5f, glm::vec3(m_dim))))
-        return 0.0f;
-
-    auto roundToPositiveInt = [](float f) {
-        return static_cast<int>(f + 0.5f);
-    };
-
-    return getVoxel(roundToPositiveInt(coord.x), roundToPositiveInt(coord.y), roundToPositiveInt(coord.z));
+    return m_elementSize == 1 ? getVoxelNN<uint8_t>(coord) : getVoxelNN<uint16_t>(coord);
 }
 
-// This function returns the trilinear interpolated value of the position given by position coord.
 float Volume::getVoxelLinearInterpolate(const glm::vec3& coord) const
 {
-    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord, glm::vec3(m_dim - 1))))
-        return 0.0f;
-
-    const int x = static_cast<int>(coord.x);
-    const int y = static_cast<int>(coord.y);
-    const int z = static_cast<int>(coord.z);
-
-    const float fac_x = coord.x - float(x);
-    const float fac_y = coord.y - float(y);
-    const float fac_z = coord.z - float(z);
-
-    const float t0 = linearInterpolate(getVoxel(x, y, z), getVoxel(x + 1, y, z), fac_x);
-    const float t1 = linearInterpolate(getVoxel(x, y + 1, z), getVoxel(x + 1, y + 1, z), fac_x);
-    const float t2 = linearInterpolate(getVoxel(x, y, z + 1), getVoxel(x + 1, y, z + 1), fac_x);
-    const float t3 = linearInterpolate(getVoxel(x, y + 1, z + 1), getVoxel(x + 1, y + 1, z + 1), fac_x);
-    const float t4 = linearInterpolate(t0, t1, fac_y);
-    const float t5 = linearInterpolate(t2, t3, fac_y);
-    const float t6 = linearInterpolate(t4, t5, fac_z);
-    return t6;
-}
-
-// This function linearly interpolates the value g0 and g1 given a factor
-// The result is returned. It is used for the tri-linearly interpolation the values
-float Volume::linearInterpolate(float g0, float g1, float factor)
-{
-    return (1 - factor) * g0 + factor * g1;
+    return m_elementSize == 1 ? getVoxelLinearInterpolate<uint8_t>(coord) : getVoxelLinearInterpolate<uint16_t>(coord);
 }
 
 // This function represents the h(x) function, which returns the weight of the cubic interpolation kernel for a given position x
@@ -168,61 +342,22 @@ float Volume::cubicInterpolate(float g0, float g1, float g2, float g3, float fac
     return weight(1 + factor) * g0 + weight(factor) * g1 + weight(1 - factor) * g2 + weight(2 - factor) * g3;
 }
 
-// This function returns the value of a bicubic interpolation
 float Volume::bicubicInterpolateXY(const glm::vec2& xyCoord, int z) const
 {
-    glm::vec4 values;
-
-    int offset = 1;
-    // int y = static_cast<int>(xyCoord.y);
-
-    const int x = static_cast<int>(xyCoord.x);
-    const int y = static_cast<int>(xyCoord.y);
-
-    const float fac_x = xyCoord.x - int(x);
-    const float fac_y = xyCoord.y - int(y);
-
-    for (int i = 0 - offset; i < 4 - offset; i++) {
-        int x = static_cast<int>(xyCoord.x + i);
-        values[i + offset] = this->cubicInterpolate(
-            this->getVoxel(x, y - offset, z),
-            this->getVoxel(x, y - offset + 1, z),
-            this->getVoxel(x, y - offset + 2, z),
-            this->getVoxel(x, y - offset + 3, z),
-            fac_y);
-    }
-
-    // interpolate for y
-    return cubicInterpolate(values[0], values[1], values[2], values[3], fac_x);
+    return m_elementSize == 1 ? bicubicInterpolateXY<uint8_t>(xyCoord, z) : bicubicInterpolateXY<uint16_t>(xyCoord, z);
 }
 
-// This function computes the tricubic interpolation at coord
 float Volume::getVoxelTriCubicInterpolate(const glm::vec3& coord) const
 {
-    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord, glm::vec3(m_dim - 1))))
-        return 0.0f;
-
-    glm::vec4 values;
-    int offset = 1;
-    const int z = static_cast<int>(coord.z);
-    const float fac_z = coord.z - int(z);
-
-    for (int i = 0 - offset; i < 4 - offset; i++) {
-        int z = static_cast<int>(coord.z + i);
-        values[i + offset] = this->bicubicInterpolateXY(glm::vec2(coord), z);
-    }
-
-    float value = this->cubicInterpolate(values[0], values[1], values[2], values[3], fac_z);
-
-    if (value < 0) {
-        return 0;
-    }
-    return value;
+    return m_elementSize == 1 ? getVoxelTriCubicInterpolate<uint8_t>(coord) : getVoxelTriCubicInterpolate<uint16_t>(coord);
 }
 
 // Load an fld volume data file
-// First read and parse the header, then the volume data can be directly converted from bytes to uint16_ts
-void Volume::loadFile(const std::filesystem::path& file)
+// First read and parse the header, then map the file and use the data section in place. 16-bit data can only be
+// used in place if it is aligned and the machine is little endian (like the file); otherwise it is read into
+// m_data16, which is also the fallback if the file cannot be mapped.
+// Returns the layout in which the voxels are stored in the file.
+VoxelLayout Volume::loadFile(const std::filesystem::path& file)
 {
     assert(std::filesystem::exists(file));
     std::ifstream ifs(file, std::ios::binary);
@@ -232,23 +367,44 @@ void Volume::loadFile(const std::filesystem::path& file)
     m_dim = header.dim;
     m_elementSize = header.elementSize;
 
-    const size_t voxelCount = static_cast<size_t>(header.dim.x * header.dim.y * header.dim.z);
+    // Bricked files also store the padding of the bricked layout.
+    const size_t voxelCount = VoxelIndexer(header.dim, header.layout).storageSize();
     const size_t byteCount = voxelCount * header.elementSize;
-    std::vector<char> buffer(byteCount);
     // Data section is separated from header by two /f characters.
-    ifs.seekg(2, std::ios::cur);
-    ifs.read(buffer.data(), std::streamsize(byteCount));
+    const size_t dataOffset = static_cast<size_t>(ifs.tellg()) + 2;
+
+    m_mappedFile.emplace(file);
+    if (m_mappedFile->isMapped() && m_mappedFile->data().size() >= dataOffset + byteCount) {
+        const std::byte* pData = m_mappedFile->data().data() + dataOffset;
+        if (header.elementSize == 1) {
+            m_pVoxels8 = reinterpret_cast<const uint8_t*>(pData);
+            return header.layout;
+        }
+        if (std::endian::native == std::endian::little && reinterpret_cast<uintptr_t>(pData) % alignof(uint16_t) == 0) {
+            m_pVoxels16 = reinterpret_cast<const uint16_t*>(pData);
+            return header.layout;
+        }
+    }
+    m_mappedFile.reset();
 
-    m_data.resize(voxelCount);
+    ifs.seekg(std::streamoff(dataOffset), std::ios::beg);
+    // The buffers are filled with zeros in parallel before reading (see m_data8).
     if (header.elementSize == 1) { // Bytes.
-        for (size_t i = 0; i < byteCount; i++) {
-            m_data[i] = static_cast<uint16_t>(buffer[i] & 0xFF);
-        }
+        m_data8.resize(voxelCount);
+        ExecutionPolicy::global().fill(gsl::span<uint8_t>(m_data8), uint8_t(0));
+        ifs.read(reinterpret_cast<char*>(m_data8.data()), std::streamsize(byteCount));
+        m_pVoxels8 = m_data8.data();
     } else if (header.elementSize == 2) { // uint16_ts.
-        for (size_t i = 0; i < byteCount; i += 2) {
-            m_data[i / 2] = static_cast<uint16_t>((buffer[i] & 0xFF) + (buffer[i + 1] & 0xFF) * 256);
+        m_data16.resize(voxelCount);
+        ExecutionPolicy::global().fill(gsl::span<uint16_t>(m_data16), uint16_t(0));
+        ifs.read(reinterpret_cast<char*>(m_data16.data()), std::streamsize(byteCount));
+        if constexpr (std::endian::native != std::endian::little) {
+            for (uint16_t& v : m_data16)
+                v = static_cast<uint16_t>((v >> 8) | (v << 8));
         }
+        m_pVoxels16 = m_data16.data();
     }
+    return header.layout;
 }
 }
 
@@ -297,6 +453,12 @@ static Header readHeader(std::ifstream& ifs)
         } else if (key == "field") {
             if (value != "uniform")
                 std::cerr << "Only uniform m_data are supported" << std::endl;
+        } else if (key == "layout") {
+            // Not part of the AVS format: the voxels of files written by Volume::write are stored bricked.
+            if (value == "bricked")
+                out.layout = volume::VoxelLayout::Bricked;
+            else if (value != "linear")
+                std::cerr << "Voxel layout " << value << " not recognized" << std::endl;
         } else if (key == "#") {
             // Comment.
         } else {
@@ -306,20 +468,59 @@ static Header readHeader(std::ifstream& ifs)
     return out;
 }
 
-static float computeMinimum(gsl::span<const uint16_t> data)
+// Compute the minimum, maximum and histogram in a single parallel pass. Every thread fills its own histogram over
+// the full range of T, which is then summed and cut off after the maximum.
+template <typename T>
+static volume::VolumeStatistics computeStatistics(gsl::span<const T> data)
 {
-    return float(*std::min_element(std::begin(data), std::end(data)));
-}
+    constexpr size_t numValues = size_t(std::numeric_limits<T>::max()) + 1;
+    struct Partial {
+        T minimum { std::numeric_limits<T>::max() };
+        T maximum { std::numeric_limits<T>::lowest() };
+        std::vector<int> histogram = std::vector<int>(numValues, 0);
+    };
+    tbb::combinable<Partial> partials;
+
+    // The voxels of a mapped file are processed in chunks, and the pages of the next chunk are requested before a
+    // chunk is processed, so that the file is read while the statistics of the previous chunk are computed.
+    constexpr size_t grainSize = 1 << 16;
+    constexpr size_t chunkSize = 1 << 24;
+    const auto chunk = [&](size_t begin) { return gsl::as_bytes(data.subspan(begin, std::min(chunkSize, data.size() - begin))); };
+    if (!data.empty())
+        volume::MappedFile::prefetch(chunk(0));
+    for (size_t chunkBegin = 0; chunkBegin < data.size(); chunkBegin += chunkSize) {
+        const size_t chunkEnd = std::min(chunkBegin + chunkSize, data.size());
+        if (chunkEnd < data.size())
+            volume::MappedFile::prefetch(chunk(chunkEnd));
+        tbb::parallel_for(tbb::blocked_range<size_t>(chunkBegin, chunkEnd, grainSize), [&](const tbb::blocked_range<size_t>& range) {
+            Partial& partial = partials.local();
+            T minimum = partial.minimum, maximum = partial.maximum;
+            for (size_t i = range.begin(); i != range.end(); i++) {
+                const T v = data[i];
+                minimum = std::min(minimum, v);
+                maximum = std::max(maximum, v);
+                partial.histogram[v]++;
+            }
+            partial.minimum = minimum;
+            partial.maximum = maximum;
+        });
+    }
 
-static float computeMaximum(gsl::span<const uint16_t> data)
-{
-    return float(*std::max_element(std::begin(data), std::end(data)));
+    Partial total;
+    partials.combine_each([&](const Partial& partial) {
+        total.minimum = std::min(total.minimum, partial.minimum);
+        total.maximum = std::max(total.maximum, partial.maximum);
+        std::transform(std::begin(total.histogram), std::end(total.histogram), std::begin(partial.histogram), std::begin(total.histogram), std::plus<int>());
+    });
+    total.histogram.resize(size_t(total.maximum) + 1);
+    return volume::VolumeStatistics { float(total.minimum), float(total.maximum), std::move(total.histogram) };
 }
 
-static std::vector<int> computeHistogram(gsl::span<const uint16_t> data)
+// Copy of the voxels in a buffer that is initialized in parallel (see ExecutionPolicy::copy).
+template <typename T>
+static volume::FirstTouchVector<T> firstTouchCopy(gsl::span<const T> data)
 {
-    std::vector<int> histogram(size_t(*std::max_element(std::begin(data), std::end(data)) + 1), 0);
-    for (const auto v : data)
-        histogram[v]++;
-    return histogram;
-}
\ No newline at end of file
+    volume::FirstTouchVector<T> out(data.size());
+    volume::ExecutionPolicy::global().copy(data, gsl::span<T>(out));
+    return out;
+}
@@ -1,8 +1,22 @@
 #pragma once
+#include "execution_policy.h"
+#include "mapped_file.h"
+#include "voxel_indexer.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <glm/common.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/vector_relational.hpp>
+#include <gsl/span>
+#include <optional>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace volume {
@@ -13,45 +27,465 @@ enum class InterpolationMode {
     Cubic
 };
 
+template <typename T, InterpolationMode Mode>
+class VolumeSampler;
+
+// Positions of N samples in structure-of-arrays layout, used to sample N rays at once. The packet versions of the
+// samplers process all lanes in lock step without branches so that the compiler can vectorize them.
+template <size_t N>
+struct CoordinatePacket {
+    std::array<float, N> x, y, z;
+};
+
+// Minimum, maximum and histogram (one bin per integer value up to the maximum) of the voxels of a volume.
+struct VolumeStatistics {
+    float minimum { 0.0f }, maximum { 0.0f };
+    std::vector<int> histogram;
+};
+
 class Volume {
 public:
     // DO NOT REMOVE
     InterpolationMode interpolationMode { InterpolationMode::NearestNeighbour };
 
 public:
-    Volume(const std::filesystem::path& file);
-    Volume(std::vector<uint16_t> data, const glm::ivec3& dim);
+    // Files whose voxels are stored in the bricked layout (see write) are always loaded in that layout. Statistics that
+    // are known (see DerivedDataCache) save the pass over the voxels that computes them.
+    Volume(const std::filesystem::path& file, VoxelLayout layout = VoxelLayout::Linear, std::optional<VolumeStatistics> optStatistics = {});
+    Volume(std::vector<uint16_t> data, const glm::ivec3& dim, VoxelLayout layout = VoxelLayout::Linear);
+    Volume(std::vector<uint8_t> data, const glm::ivec3& dim, VoxelLayout layout = VoxelLayout::Linear);
+    // Views voxels that are stored elsewhere in the given layout (see storedVoxels), which must outlive the volume.
+    Volume(gsl::span<const std::byte> storedVoxels, size_t elementSize, const glm::ivec3& dim, VoxelLayout layout, VolumeStatistics statistics);
+    // The voxel pointers may point into this object's own buffers.
+    Volume(const Volume&) = delete;
+    Volume(Volume&&) = default;
 
+    // Size in bytes of a voxel in storage (1 for byte volumes, 2 for short volumes).
+    size_t elementSize() const;
     float minimum() const;
     float maximum() const;
-    std::vector<int> histogram() const;
+    const std::vector<int>& histogram() const;
     glm::ivec3 dims() const;
     std::string_view fileName() const;
+    const VoxelIndexer& indexer() const;
+    // The voxel storage if it is mapped from the file (instead of loaded into memory), otherwise an empty span.
+    gsl::span<const std::byte> mappedVoxels() const;
+    // The voxel storage in the layout of the indexer, wherever it lives.
+    gsl::span<const std::byte> storedVoxels() const;
+
+    // Writes the volume to a .fld file with the voxels in the given layout. The voxels start at a multiple of
+    // MappedFile::pageSize() in the file, so that the bricks of a bricked file can be paged in and out individually
+    // (see BrickPager). Returns false (and reports why) if the file could not be written.
+    bool write(const std::filesystem::path& file, VoxelLayout layout) const;
+
+    float getVoxelInterpolate(const glm::vec3& coord) const;
+    float getVoxel(int x, int y, int z) const;
+
+    // Calls f(sampler) with a VolumeSampler that is specialized for the voxel type and the current interpolation
+    // mode, so that code which takes many samples only has to select the sampler once.
+    template <typename F>
+    decltype(auto) visitSampler(F&& f) const;
 
+    // Versions of the samplers for a known voxel type and interpolation mode. T must match elementSize().
+    template <typename T, InterpolationMode Mode>
     float getVoxelInterpolate(const glm::vec3& coord) const;
+    template <typename T>
     float getVoxel(int x, int y, int z) const;
+    // Voxel at a position that is known to be inside the volume.
+    template <typename T>
+    float getVoxelUnchecked(int x, int y, int z) const;
+    // Packet version of getVoxelInterpolate<T, Mode>.
+    template <typename T, InterpolationMode Mode, size_t N>
+    std::array<float, N> getVoxelInterpolate(const CoordinatePacket<N>& coords) const;
+
+    // Calls f(T {}) with the voxel type T used for storage, to select the typed functions above.
+    template <typename F>
+    decltype(auto) visitVoxelType(F&& f) const;
+
+    // Interpolation kernels, also used by the samplers of other voxel storage (see CompressedSampler).
+    static float linearInterpolate(float g0, float g1, float factor);
+    // The weights of the four values of cubicInterpolate for the given factor.
+    static glm::vec4 cubicWeights(float factor);
 
 protected:
     static constexpr float a = -0.75f;
     float getVoxelNN(const glm::vec3& coord) const;
-    static float linearInterpolate(float g0, float g1, float factor);
     float getVoxelLinearInterpolate(const glm::vec3& coord) const;
     static float weight(float x);
     static float cubicInterpolate(float g0, float g1, float g2, float g3, float factor);
     float bicubicInterpolateXY(const glm::vec2& xyCoord, int z) const;
     float getVoxelTriCubicInterpolate(const glm::vec3& coord) const;
 
+    template <typename T>
+    const T* voxels() const;
+    template <typename T>
+    float getVoxelNN(const glm::vec3& coord) const;
+    template <typename T>
+    float getVoxelLinearInterpolate(const glm::vec3& coord) const;
+    template <typename T>
+    float bicubicInterpolateXY(const glm::vec2& xyCoord, int z) const;
+    template <typename T>
+    float getVoxelTriCubicInterpolate(const glm::vec3& coord) const;
+    template <typename T>
+    float getVoxelFastTriCubicInterpolate(const glm::vec3& coord) const;
+    template <typename T, size_t N>
+    std::array<float, N> getVoxelNN(const CoordinatePacket<N>& coords) const;
+    template <typename T, size_t N>
+    std::array<float, N> getVoxelLinearInterpolate(const CoordinatePacket<N>& coords) const;
+
+    template <typename T, typename F>
+    decltype(auto) visitSamplerOfType(F&& f) const;
+
 private:
-    void loadFile(const std::filesystem::path& file);
+    VoxelLayout loadFile(const std::filesystem::path& file);
+    void computeStatistics(size_t storedVoxels);
+    void setStatistics(VolumeStatistics statistics);
+    void applyLayout(VoxelLayout layout);
+    template <typename T>
+    FirstTouchVector<T> fromLinear(gsl::span<const T> linear) const;
 
 protected:
     const std::string m_fileName;
     size_t m_elementSize;
     glm::ivec3 m_dim;
+    VoxelIndexer m_indexer;
 
-    std::vector<uint16_t> m_data;
+    // Voxels are kept at their native size. Linear volumes loaded from a file point directly into the mapped
+    // file; otherwise the voxels live in the owned buffer of the matching type. Only the pointer that matches
+    // m_elementSize is set. The owned buffers are initialized in parallel, which spreads their pages over the NUMA
+    // nodes (see ExecutionPolicy::fill).
+    std::optional<MappedFile> m_mappedFile;
+    FirstTouchVector<uint8_t> m_data8;
+    FirstTouchVector<uint16_t> m_data16;
+    const uint8_t* m_pVoxels8 { nullptr };
+    const uint16_t* m_pVoxels16 { nullptr };
 
     float m_minimum, m_maximum;
     std::vector<int> m_histogram;
 };
+
+// Callable that samples a volume with a fixed voxel type and interpolation mode (see Volume::visitSampler).
+template <typename T, InterpolationMode Mode>
+class VolumeSampler {
+public:
+    static constexpr InterpolationMode interpolationMode = Mode;
+
+    explicit VolumeSampler(const Volume* pVolume)
+        : m_pVolume(pVolume)
+    {
+    }
+
+    float operator()(const glm::vec3& coord) const
+    {
+        return m_pVolume->getVoxelInterpolate<T, Mode>(coord);
+    }
+    template <size_t N>
+    std::array<float, N> operator()(const CoordinatePacket<N>& coords) const
+    {
+        return m_pVolume->getVoxelInterpolate<T, Mode, N>(coords);
+    }
+
+private:
+    const Volume* m_pVolume;
+};
+
+template <typename F>
+decltype(auto) Volume::visitVoxelType(F&& f) const
+{
+    if (m_elementSize == 1)
+        return f(uint8_t {});
+    else
+        return f(uint16_t {});
+}
+
+template <typename F>
+decltype(auto) Volume::visitSampler(F&& f) const
+{
+    if (m_elementSize == 1)
+        return visitSamplerOfType<uint8_t>(std::forward<F>(f));
+    else
+        return visitSamplerOfType<uint16_t>(std::forward<F>(f));
+}
+
+template <typename T, typename F>
+decltype(auto) Volume::visitSamplerOfType(F&& f) const
+{
+    switch (interpolationMode) {
+    case InterpolationMode::NearestNeighbour:
+        return f(VolumeSampler<T, InterpolationMode::NearestNeighbour>(this));
+    case InterpolationMode::Linear:
+        return f(VolumeSampler<T, InterpolationMode::Linear>(this));
+    default:
+        return f(VolumeSampler<T, InterpolationMode::Cubic>(this));
+    }
+}
+
+// This function linearly interpolates the value g0 and g1 given a factor
+// The result is returned. It is used for the tri-linearly interpolation the values
+inline float Volume::linearInterpolate(float g0, float g1, float factor)
+{
+    return (1 - factor) * g0 + factor * g1;
+}
+
+template <typename T, InterpolationMode Mode>
+float Volume::getVoxelInterpolate(const glm::vec3& coord) const
+{
+    if constexpr (Mode == InterpolationMode::NearestNeighbour)
+        return getVoxelNN<T>(coord);
+    else if constexpr (Mode == InterpolationMode::Linear)
+        return getVoxelLinearInterpolate<T>(coord);
+    else
+        return getVoxelFastTriCubicInterpolate<T>(coord);
+}
+
+template <typename T>
+const T* Volume::voxels() const
+{
+    if constexpr (std::is_same_v<T, uint8_t>)
+        return m_pVoxels8;
+    else
+        return m_pVoxels16;
+}
+
+template <typename T>
+float Volume::getVoxelUnchecked(int x, int y, int z) const
+{
+    return static_cast<float>(voxels<T>()[m_indexer.index(x, y, z)]);
+}
+
+// Returns the voxel value at the given integer position, or 0 outside of the volume.
+template <typename T>
+float Volume::getVoxel(int x, int y, int z) const
+{
+    if (!m_indexer.contains(x, y, z))
+        return 0.0f;
+    return getVoxelUnchecked<T>(x, y, z);
+}
+
+// This function returns the nearest neighbour given a position in the volume given by coord.
+// Notice that in this framework we assume that the distance between neighbouring voxels is 1 in all directions
+template <typename T>
+float Volume::getVoxelNN(const glm::vec3& coord) const
+{
+    if (glm::any(glm::lessThan(coord + 0.5f, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord + 0.5f, glm::vec3(m_dim))))
+        return 0.0f;
+
+    auto roundToPositiveInt = [](float f) {
+        return static_cast<int>(f + 0.5f);
+    };
+
+    return getVoxelUnchecked<T>(roundToPositiveInt(coord.x), roundToPositiveInt(coord.y), roundToPositiveInt(coord.z));
+}
+
+// This function returns the trilinear interpolated value of the position given by position coord.
+// All eight neighbours are inside the volume after the bounds test, so they are read without checks.
+template <typename T>
+float Volume::getVoxelLinearInterpolate(const glm::vec3& coord) const
+{
+    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord, glm::vec3(m_dim - 1))))
+        return 0.0f;
+
+    const int x = static_cast<int>(coord.x);
+    const int y = static_cast<int>(coord.y);
+    const int z = static_cast<int>(coord.z);
+
+    const float fac_x = coord.x - float(x);
+    const float fac_y = coord.y - float(y);
+    const float fac_z = coord.z - float(z);
+
+    const float t0 = linearInterpolate(getVoxelUnchecked<T>(x, y, z), getVoxelUnchecked<T>(x + 1, y, z), fac_x);
+    const float t1 = linearInterpolate(getVoxelUnchecked<T>(x, y + 1, z), getVoxelUnchecked<T>(x + 1, y + 1, z), fac_x);
+    const float t2 = linearInterpolate(getVoxelUnchecked<T>(x, y, z + 1), getVoxelUnchecked<T>(x + 1, y, z + 1), fac_x);
+    const float t3 = linearInterpolate(getVoxelUnchecked<T>(x, y + 1, z + 1), getVoxelUnchecked<T>(x + 1, y + 1, z + 1), fac_x);
+    const float t4 = linearInterpolate(t0, t1, fac_y);
+    const float t5 = linearInterpolate(t2, t3, fac_y);
+    const float t6 = linearInterpolate(t4, t5, fac_z);
+    return t6;
+}
+
+// This function returns the value of a bicubic interpolation
+template <typename T>
+float Volume::bicubicInterpolateXY(const glm::vec2& xyCoord, int z) const
+{
+    glm::vec4 values;
+
+    const int offset = 1;
+    const int x = static_cast<int>(xyCoord.x);
+    const int y = static_cast<int>(xyCoord.y);
+
+    const float fac_x = xyCoord.x - float(x);
+    const float fac_y = xyCoord.y - float(y);
+
+    for (int i = 0 - offset; i < 4 - offset; i++) {
+        const int xi = static_cast<int>(xyCoord.x + float(i));
+        values[i + offset] = cubicInterpolate(
+            getVoxel<T>(xi, y - offset, z),
+            getVoxel<T>(xi, y - offset + 1, z),
+            getVoxel<T>(xi, y - offset + 2, z),
+            getVoxel<T>(xi, y - offset + 3, z),
+            fac_y);
+    }
+
+    // interpolate for y
+    return cubicInterpolate(values[0], values[1], values[2], values[3], fac_x);
+}
+
+// This function computes the tricubic interpolation at coord
+template <typename T>
+float Volume::getVoxelTriCubicInterpolate(const glm::vec3& coord) const
+{
+    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord, glm::vec3(m_dim - 1))))
+        return 0.0f;
+
+    glm::vec4 values;
+    const int offset = 1;
+    const int z = static_cast<int>(coord.z);
+    const float fac_z = coord.z - float(z);
+
+    for (int i = 0 - offset; i < 4 - offset; i++) {
+        const int zi = static_cast<int>(coord.z + float(i));
+        values[i + offset] = bicubicInterpolateXY<T>(glm::vec2(coord), zi);
+    }
+
+    float value = cubicInterpolate(values[0], values[1], values[2], values[3], fac_z);
+
+    if (value < 0) {
+        return 0;
+    }
+    return value;
+}
+
+// Evaluates the polynomials of weight(1 + factor), weight(factor), weight(1 - factor) and weight(2 - factor) in
+// Horner form; for a factor in [0, 1) each argument falls into a known piece of the kernel.
+inline glm::vec4 Volume::cubicWeights(float factor)
+{
+    const auto inner = [](float x) { return ((a + 2) * x - (a + 3)) * x * x + 1; }; // |x| < 1
+    const auto outer = [](float x) { return ((a * x - 5 * a) * x + 8 * a) * x - 4 * a; }; // 1 <= |x| < 2
+    return glm::vec4(outer(1 + factor), inner(factor), inner(1 - factor), outer(2 - factor));
+}
+
+// Same result as getVoxelTriCubicInterpolate, including its handling of the border (neighbours outside of the volume
+// count as 0, except that the lower x and z neighbours are clamped to 0 by the truncation in bicubicInterpolateXY and
+// getVoxelTriCubicInterpolate). The kernel weights are computed once per axis instead of for every row, and the
+// 4x4x4 neighbourhood is read without bounds checks: a neighbour outside of the volume reads a voxel on the border
+// with a weight of 0.
+template <typename T>
+float Volume::getVoxelFastTriCubicInterpolate(const glm::vec3& coord) const
+{
+    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord, glm::vec3(m_dim - 1))))
+        return 0.0f;
+
+    const glm::ivec3 base { coord };
+    glm::vec4 wx = cubicWeights(coord.x - float(base.x));
+    glm::vec4 wy = cubicWeights(coord.y - float(base.y));
+    glm::vec4 wz = cubicWeights(coord.z - float(base.z));
+
+    // The base voxel and the one after it are always inside the volume (coord < dim - 1).
+    std::array<size_t, 4> ox, oy, oz;
+    for (size_t i = 0; i < 4; i++) {
+        const glm::ivec3 neighbour = glm::clamp(base - 1 + int(i), glm::ivec3(0), m_dim - 1);
+        ox[i] = m_indexer.offsetX(neighbour.x);
+        oy[i] = m_indexer.offsetY(neighbour.y);
+        oz[i] = m_indexer.offsetZ(neighbour.z);
+    }
+    if (base.y == 0)
+        wy[0] = 0.0f;
+    if (base.x + 2 >= m_dim.x)
+        wx[3] = 0.0f;
+    if (base.y + 2 >= m_dim.y)
+        wy[3] = 0.0f;
+    if (base.z + 2 >= m_dim.z)
+        wz[3] = 0.0f;
+
+    const T* pVoxels = voxels<T>();
+    float value = 0.0f;
+    for (size_t k = 0; k < 4; k++) {
+        float slice = 0.0f;
+        for (size_t j = 0; j < 4; j++) {
+            const T* pRow = pVoxels + oy[j] + oz[k];
+            const float row = wx[0] * float(pRow[ox[0]]) + wx[1] * float(pRow[ox[1]]) + wx[2] * float(pRow[ox[2]]) + wx[3] * float(pRow[ox[3]]);
+            slice += wy[int(j)] * row;
+        }
+        value += wz[int(k)] * slice;
+    }
+    return std::max(value, 0.0f);
+}
+
+template <typename T, InterpolationMode Mode, size_t N>
+std::array<float, N> Volume::getVoxelInterpolate(const CoordinatePacket<N>& coords) const
+{
+    if constexpr (Mode == InterpolationMode::NearestNeighbour) {
+        return getVoxelNN<T, N>(coords);
+    } else if constexpr (Mode == InterpolationMode::Linear) {
+        return getVoxelLinearInterpolate<T, N>(coords);
+    } else {
+        std::array<float, N> values;
+        for (size_t i = 0; i < N; i++)
+            values[i] = getVoxelFastTriCubicInterpolate<T>(glm::vec3(coords.x[i], coords.y[i], coords.z[i]));
+        return values;
+    }
+}
+
+// Packet version of getVoxelNN. Lanes outside of the volume read voxel (0, 0, 0) and return 0.
+template <typename T, size_t N>
+std::array<float, N> Volume::getVoxelNN(const CoordinatePacket<N>& coords) const
+{
+    const glm::vec3 dim { m_dim };
+    std::array<int, N> x, y, z;
+    std::array<bool, N> inside;
+    for (size_t i = 0; i < N; i++) {
+        const float cx = coords.x[i] + 0.5f, cy = coords.y[i] + 0.5f, cz = coords.z[i] + 0.5f;
+        inside[i] = cx >= 0.0f && cy >= 0.0f && cz >= 0.0f && cx < dim.x && cy < dim.y && cz < dim.z;
+        x[i] = inside[i] ? static_cast<int>(cx) : 0;
+        y[i] = inside[i] ? static_cast<int>(cy) : 0;
+        z[i] = inside[i] ? static_cast<int>(cz) : 0;
+    }
+
+    std::array<float, N> values;
+    for (size_t i = 0; i < N; i++)
+        values[i] = inside[i] ? getVoxelUnchecked<T>(x[i], y[i], z[i]) : 0.0f;
+    return values;
+}
+
+// Packet version of getVoxelLinearInterpolate, computing the same expressions per lane so that the results are
+// identical. Lanes outside of the volume read voxel (0, 0, 0) and return 0.
+template <typename T, size_t N>
+std::array<float, N> Volume::getVoxelLinearInterpolate(const CoordinatePacket<N>& coords) const
+{
+    std::array<float, N> values;
+    // No position is inside (and voxel (1, 1, 1) does not exist).
+    if (glm::any(glm::lessThan(m_dim, glm::ivec3(2)))) {
+        values.fill(0.0f);
+        return values;
+    }
+
+    const glm::vec3 upper { m_dim - 1 };
+    std::array<int, N> x, y, z;
+    std::array<float, N> facX, facY, facZ;
+    std::array<bool, N> inside;
+    for (size_t i = 0; i < N; i++) {
+        inside[i] = coords.x[i] >= 0.0f && coords.y[i] >= 0.0f && coords.z[i] >= 0.0f
+            && coords.x[i] < upper.x && coords.y[i] < upper.y && coords.z[i] < upper.z;
+        const float cx = inside[i] ? coords.x[i] : 0.0f;
+        const float cy = inside[i] ? coords.y[i] : 0.0f;
+        const float cz = inside[i] ? coords.z[i] : 0.0f;
+        x[i] = static_cast<int>(cx);
+        y[i] = static_cast<int>(cy);
+        z[i] = static_cast<int>(cz);
+        facX[i] = cx - float(x[i]);
+        facY[i] = cy - float(y[i]);
+        facZ[i] = cz - float(z[i]);
+    }
+
+    for (size_t i = 0; i < N; i++) {
+        const float t0 = linearInterpolate(getVoxelUnchecked<T>(x[i], y[i], z[i]), getVoxelUnchecked<T>(x[i] + 1, y[i], z[i]), facX[i]);
+        const float t1 = linearInterpolate(getVoxelUnchecked<T>(x[i], y[i] + 1, z[i]), getVoxelUnchecked<T>(x[i] + 1, y[i] + 1, z[i]), facX[i]);
+        const float t2 = linearInterpolate(getVoxelUnchecked<T>(x[i], y[i], z[i] + 1), getVoxelUnchecked<T>(x[i] + 1, y[i], z[i] + 1), facX[i]);
+        const float t3 = linearInterpolate(getVoxelUnchecked<T>(x[i], y[i] + 1, z[i] + 1), getVoxelUnchecked<T>(x[i] + 1, y[i] + 1, z[i] + 1), facX[i]);
+        const float t4 = linearInterpolate(t0, t1, facY[i]);
+        const float t5 = linearInterpolate(t2, t3, facY[i]);
+        values[i] = inside[i] ? linearInterpolate(t4, t5, facZ[i]) : 0.0f;
+    }
+    return values;
+}
 }
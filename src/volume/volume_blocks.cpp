@@ -0,0 +1,58 @@
+#include "volume_blocks.h"
+#include <cstdint>
+#include <glm/common.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace volume {
+
+static void splitBlock(const glm::ivec3& lower, const glm::ivec3& upper, size_t numBlocks, std::vector<VolumeBlock>& blocks)
+{
+    if (numBlocks == 1) {
+        blocks.push_back(VolumeBlock { lower, upper, lower, upper - lower + 1 });
+        return;
+    }
+
+    const glm::ivec3 extent = upper - lower;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    glm::ivec3 leftUpper = upper, rightLower = lower;
+    leftUpper[axis] = rightLower[axis] = lower[axis] + extent[axis] / 2;
+    splitBlock(lower, leftUpper, numBlocks / 2, blocks);
+    splitBlock(rightLower, upper, numBlocks / 2, blocks);
+}
+
+std::vector<VolumeBlock> partitionVolume(const glm::ivec3& dims, size_t numBlocks, int ghostVoxels)
+{
+    std::vector<VolumeBlock> blocks;
+    splitBlock(glm::ivec3(0), dims - 1, numBlocks, blocks);
+    for (VolumeBlock& block : blocks) {
+        block.origin = glm::max(block.lower - ghostVoxels, glm::ivec3(0));
+        block.dims = glm::min(block.upper + ghostVoxels, dims - 1) - block.origin + 1;
+    }
+    return blocks;
+}
+
+template <typename T>
+static Volume extractBlock(const Volume& volume, const VolumeBlock& block)
+{
+    const glm::ivec3 dim = block.dims;
+    std::vector<T> data(static_cast<size_t>(dim.x) * static_cast<size_t>(dim.y) * static_cast<size_t>(dim.z));
+    tbb::parallel_for(tbb::blocked_range<int>(0, dim.z), [&](const tbb::blocked_range<int>& range) {
+        for (int z = range.begin(); z != range.end(); z++) {
+            for (int y = 0; y < dim.y; y++) {
+                for (int x = 0; x < dim.x; x++) {
+                    const glm::ivec3 voxel = block.origin + glm::ivec3(x, y, z);
+                    const size_t index = static_cast<size_t>(x) + static_cast<size_t>(dim.x) * (static_cast<size_t>(y) + static_cast<size_t>(dim.y) * static_cast<size_t>(z));
+                    data[index] = static_cast<T>(volume.getVoxelUnchecked<T>(voxel.x, voxel.y, voxel.z));
+                }
+            }
+        }
+    });
+    return Volume(std::move(data), dim, volume.indexer().layout());
+}
+
+Volume extractBlock(const Volume& volume, const VolumeBlock& block)
+{
+    return volume.visitVoxelType([&]<typename T>(T) { return extractBlock<T>(volume, block); });
+}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "volume.h"
+#include <cstddef>
+#include <glm/vec3.hpp>
+#include <vector>
+
+namespace volume {
+
+// Part of a volume that one node of a sort-last renderer owns (see render/sort_last.h). The blocks of a partition
+// share their faces: a block owns the voxel positions in [lower, upper] (in voxel coordinates of the full volume). The
+// block volume holds the owned voxels plus a ghost layer of the neighbouring blocks, which the interpolation and the
+// gradients of the positions on the faces read.
+struct VolumeBlock {
+    glm::ivec3 lower, upper;
+    // First voxel and size of the block volume, in the full volume.
+    glm::ivec3 origin, dims;
+};
+
+// Cubic interpolation reads one voxel before and two voxels after the cell of a position, and the central
+// differences of the gradients one more.
+static constexpr int blockGhostVoxels = 3;
+
+// Splits the volume into numBlocks (a power of two) blocks by repeatedly halving the blocks along their longest axis.
+// The blocks are listed in the order of the splits: blocks 2i and 2i + 1 are the halves of a block of the previous
+// split, and so on up the tree, which is the pairing of binary-swap compositing.
+std::vector<VolumeBlock> partitionVolume(const glm::ivec3& dims, size_t numBlocks, int ghostVoxels = blockGhostVoxels);
+// Copies the voxels of a block volume (with the voxel type and layout of the volume).
+Volume extractBlock(const Volume& volume, const VolumeBlock& block);
+}
@@ -0,0 +1,180 @@
+#include "volume_loader.h"
+#include "brick_pager.h"
+#include <chrono>
+#include <iostream>
+#include <tbb/task_group.h>
+#include <utility>
+
+namespace volume {
+
+VolumeLoader::VolumeLoader(const std::filesystem::path& file, const VolumeLoadOptions& options)
+    : m_file(file)
+    , m_options(options)
+{
+    m_loader = std::thread([this]() { load(); });
+}
+
+VolumeLoader::~VolumeLoader()
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_stopRequested = true;
+    }
+    m_loader.join();
+}
+
+const VolumeLoadOptions& VolumeLoader::options() const
+{
+    return m_options;
+}
+
+VolumeLoader::Stage VolumeLoader::stage() const
+{
+    std::lock_guard lock { m_mutex };
+    return m_stage;
+}
+
+void VolumeLoader::waitFor(Stage stage) const
+{
+    std::unique_lock lock { m_mutex };
+    m_stageCondition.wait(lock, [&]() { return m_stage >= stage; });
+}
+
+float VolumeLoader::progress() const
+{
+    std::lock_guard lock { m_mutex };
+    return float(m_stepsDone) / float(m_numSteps);
+}
+
+std::string VolumeLoader::currentStep() const
+{
+    std::lock_guard lock { m_mutex };
+    return m_currentStep;
+}
+
+VolumeLoader::LoadedVolume& VolumeLoader::loaded()
+{
+    return m_loaded;
+}
+
+const VolumeLoader::LoadedVolume& VolumeLoader::loaded() const
+{
+    return m_loaded;
+}
+
+// The same steps as loading a volume on the UI thread used to take (see main.cpp): with a valid cache nothing but the
+// voxels that the renderer samples is read from the volume. The statistics of the volume do not depend on the gradient
+// storage, the other data only if the cache has the gradients of the storage that is used.
+void VolumeLoader::load()
+{
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    LoadedVolume& loaded = m_loaded;
+    if (m_options.cacheDerivedData) {
+        loaded.optDerivedDataCache.emplace(m_file, m_options.layout);
+        if (!loaded.optDerivedDataCache->isValid())
+            loaded.optDerivedDataCache.reset();
+    }
+    {
+        // Reading the voxels, the macro cells, the gradients, the pyramid and histogram, and the optional steps.
+        std::lock_guard lock { m_mutex };
+        m_numSteps = 4 + size_t(m_options.compressVoxels) + size_t(m_options.cacheDerivedData && !loaded.optDerivedDataCache);
+    }
+
+    if (!startStep("Reading voxels"))
+        return;
+    std::optional<VolumeStatistics> optStatistics;
+    if (loaded.optDerivedDataCache)
+        optStatistics = loaded.optDerivedDataCache->statistics();
+    loaded.optVolume.emplace(m_file, m_options.layout, std::move(optStatistics));
+    Volume& volume = loaded.optVolume.value();
+    volume.interpolationMode = m_options.interpolationMode;
+
+    if (!startStep("Computing macro cells"))
+        return;
+    if (loaded.optDerivedDataCache)
+        loaded.optMacroCellGrid = loaded.optDerivedDataCache->macroCellGrid();
+    else
+        loaded.optMacroCellGrid.emplace(volume);
+    loaded.optPreviewGradientVolume.emplace(volume, GradientStorage::OnTheFly);
+    loaded.optPreviewGradientVolume->interpolationMode = m_options.interpolationMode;
+    publish(Stage::Preview);
+
+    // A precomputed gradient volume would hold (more than) the whole volume in memory, so streamed volumes compute
+    // their gradients on the fly.
+    if (!startStep("Computing gradients"))
+        return;
+    loaded.streamBricks = m_options.optBrickStreamingBudget && BrickPager::isSupported(volume);
+    if (m_options.optBrickStreamingBudget && !loaded.streamBricks)
+        std::cerr << "Only files in the bricked layout can be streamed (see ConvertVolume); loading the whole volume" << std::endl;
+    const GradientStorage gradientStorage = loaded.streamBricks ? GradientStorage::OnTheFly : m_options.gradientStorage;
+    // The statistics and macro cells do not depend on the gradient storage, but the gradients and the pyramid do, so a
+    // cache of another storage is written again.
+    if (loaded.optDerivedDataCache && loaded.optDerivedDataCache->gradientStorage() != gradientStorage) {
+        loaded.optDerivedDataCache.reset();
+        std::lock_guard lock { m_mutex };
+        m_numSteps++;
+    }
+    const bool useCache = loaded.optDerivedDataCache.has_value();
+    if (useCache)
+        loaded.optGradientVolume.emplace(volume, gradientStorage, loaded.optDerivedDataCache->storedGradients(), loaded.optDerivedDataCache->maxMagnitude());
+    else
+        loaded.optGradientVolume.emplace(volume, gradientStorage);
+    loaded.optGradientVolume->interpolationMode = m_options.interpolationMode;
+    const GradientVolume& gradientVolume = loaded.optGradientVolume.value();
+
+    // The pyramid and the histogram only read the volume and its gradients.
+    if (!startStep("Building the volume pyramid and 2D histogram"))
+        return;
+    if (useCache) {
+        loaded.optVolumePyramid.emplace(loaded.optDerivedDataCache->pyramid(volume, gradientVolume));
+        loaded.histogram = loaded.optDerivedDataCache->histogram2D();
+    } else {
+        tbb::task_group group;
+        group.run([&]() { loaded.optVolumePyramid.emplace(volume, gradientVolume); });
+        group.run([&]() { loaded.histogram = computeHistogram2D(volume, gradientVolume); });
+        group.wait();
+    }
+    loaded.optVolumePyramid->setInterpolationMode(m_options.interpolationMode);
+
+    if (m_options.compressVoxels) {
+        if (!startStep("Compressing voxels"))
+            return;
+        loaded.optCompressedVolume.emplace(volume);
+        const size_t voxelBytes = volume.indexer().storageSize() * volume.elementSize();
+        std::cout << "Compressed voxels: " << (loaded.optCompressedVolume->compressedBytes() >> 10) << " of " << (voxelBytes >> 10) << " KiB" << std::endl;
+    }
+    std::cout << "Time to load and derive data" << (useCache ? " (cached): " : ": ")
+              << std::chrono::duration<double, std::milli>(clock::now() - start).count() << "ms" << std::endl;
+
+    if (m_options.cacheDerivedData && !useCache) {
+        if (!startStep("Writing the cache"))
+            return;
+        DerivedDataCache::write(m_file, m_options.layout, loaded.optVolumePyramid.value(), loaded.optMacroCellGrid.value(), loaded.histogram);
+    }
+    publish(Stage::Complete);
+}
+
+// Counts the previous step as done. Returns false if the loader is being destroyed.
+bool VolumeLoader::startStep(const char* description)
+{
+    std::lock_guard lock { m_mutex };
+    if (!m_currentStep.empty())
+        m_stepsDone++;
+    m_currentStep = description;
+    return !m_stopRequested;
+}
+
+void VolumeLoader::publish(Stage stage)
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_stage = stage;
+        if (stage == Stage::Complete) {
+            m_stepsDone = m_numSteps;
+            m_currentStep.clear();
+        }
+    }
+    m_stageCondition.notify_all();
+}
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "compressed_volume.h"
+#include "derived_data_cache.h"
+#include "gradient_volume.h"
+#include "histogram_2d.h"
+#include "macro_cell_grid.h"
+#include "volume.h"
+#include "volume_pyramid.h"
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace volume {
+
+// How a volume file is loaded (the load settings of the menu).
+struct VolumeLoadOptions {
+    VoxelLayout layout { VoxelLayout::Linear };
+    GradientStorage gradientStorage { GradientStorage::Full };
+    InterpolationMode interpolationMode { InterpolationMode::NearestNeighbour };
+    // Stream the bricks of the file with this memory budget (see BrickPager), if the file supports it. The gradients
+    // of streamed volumes are computed on the fly.
+    std::optional<size_t> optBrickStreamingBudget;
+    bool compressVoxels { false };
+    // Read the derived data from the cache of the file if it is valid, and write the cache otherwise.
+    bool cacheDerivedData { false };
+};
+
+// Loads a volume file and derives everything that the renderer and the menu need from it on a loader thread, so that
+// the UI keeps running (and shows the progress) meanwhile. The volume and its derived data are published in stages:
+//  - Preview: the volume with its statistics and macro cells, and gradients that are computed on the fly, which is
+//    enough to render a first image while the rest is derived.
+//  - Complete: the gradients in the requested storage, the volume pyramid, the 2D histogram and the compressed voxels.
+// The members of LoadedVolume that belong to a stage may be used once the stage is reached, and are not modified by
+// the loader afterwards. Within the Complete stage the pyramid and the 2D histogram are derived concurrently.
+class VolumeLoader {
+public:
+    enum class Stage {
+        Loading,
+        Preview,
+        Complete
+    };
+
+    struct LoadedVolume {
+        // The gradients and the pyramid view the mapping of the cache, so it is declared before them.
+        std::optional<DerivedDataCache> optDerivedDataCache;
+        // Preview.
+        std::optional<Volume> optVolume;
+        std::optional<MacroCellGrid> optMacroCellGrid;
+        std::optional<GradientVolume> optPreviewGradientVolume;
+        // Complete.
+        std::optional<GradientVolume> optGradientVolume;
+        std::optional<VolumePyramid> optVolumePyramid;
+        std::optional<CompressedVolume> optCompressedVolume;
+        Histogram2D histogram;
+        bool streamBricks { false };
+    };
+
+public:
+    VolumeLoader(const std::filesystem::path& file, const VolumeLoadOptions& options);
+    // Waits for the step that is running; the remaining steps are skipped.
+    ~VolumeLoader();
+
+    VolumeLoader(const VolumeLoader&) = delete;
+    VolumeLoader& operator=(const VolumeLoader&) = delete;
+
+    const VolumeLoadOptions& options() const;
+    Stage stage() const;
+    void waitFor(Stage stage) const;
+    // Fraction of the steps of the load that are done, and a description of the step that is running.
+    float progress() const;
+    std::string currentStep() const;
+
+    LoadedVolume& loaded();
+    const LoadedVolume& loaded() const;
+
+private:
+    void load();
+    bool startStep(const char* description);
+    void publish(Stage stage);
+
+private:
+    const std::filesystem::path m_file;
+    const VolumeLoadOptions m_options;
+    LoadedVolume m_loaded;
+
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_stageCondition;
+    Stage m_stage { Stage::Loading };
+    size_t m_stepsDone { 0 }, m_numSteps { 1 };
+    std::string m_currentStep;
+    bool m_stopRequested { false };
+
+    std::thread m_loader;
+};
+}
@@ -0,0 +1,96 @@
+#include "volume_pyramid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <utility>
+
+namespace volume {
+
+// Average the (up to) 2 x 2 x 2 voxels of volume that voxel (x, y, z) of the next level covers. Odd dimensions repeat
+// the last voxel, so the border voxels of a level average fewer distinct voxels.
+template <typename T>
+static Volume downsample(const Volume& volume)
+{
+    const glm::ivec3 dim = volume.dims();
+    const glm::ivec3 levelDim = (dim + 1) / 2;
+    std::vector<T> data(static_cast<size_t>(levelDim.x) * static_cast<size_t>(levelDim.y) * static_cast<size_t>(levelDim.z));
+    tbb::parallel_for(tbb::blocked_range<int>(0, levelDim.z), [&](const tbb::blocked_range<int>& range) {
+        for (int z = range.begin(); z != range.end(); z++) {
+            for (int y = 0; y < levelDim.y; y++) {
+                for (int x = 0; x < levelDim.x; x++) {
+                    const glm::ivec3 begin = 2 * glm::ivec3(x, y, z);
+                    const glm::ivec3 end = glm::min(begin + 1, dim - 1);
+                    float sum = 0.0f;
+                    for (const int vz : { begin.z, end.z }) {
+                        for (const int vy : { begin.y, end.y }) {
+                            for (const int vx : { begin.x, end.x })
+                                sum += volume.getVoxelUnchecked<T>(vx, vy, vz);
+                        }
+                    }
+                    const size_t index = static_cast<size_t>(x) + static_cast<size_t>(levelDim.x) * (static_cast<size_t>(y) + static_cast<size_t>(levelDim.y) * static_cast<size_t>(z));
+                    data[index] = static_cast<T>(std::lround(sum / 8.0f));
+                }
+            }
+        }
+    });
+    return Volume(std::move(data), levelDim, volume.indexer().layout());
+}
+
+// Every level is built from the previous one, the voxels of a level in parallel. The gradient volumes of the levels
+// do not depend on each other and are computed in parallel once all levels exist.
+VolumePyramid::VolumePyramid(const Volume& volume, const GradientVolume& gradientVolume)
+    : m_pVolume(&volume)
+    , m_pGradientVolume(&gradientVolume)
+{
+    const Volume* pPrevious = &volume;
+    while (m_levels.size() + 1 < maxLevels && std::min({ pPrevious->dims().x, pPrevious->dims().y, pPrevious->dims().z }) >= 2 * minLevelSize) {
+        m_levels.push_back(pPrevious->visitVoxelType([&]<typename T>(T) { return std::make_unique<Volume>(downsample<T>(*pPrevious)); }));
+        m_levels.back()->interpolationMode = volume.interpolationMode;
+        pPrevious = m_levels.back().get();
+    }
+
+    m_gradientLevels.resize(m_levels.size());
+    tbb::parallel_for(size_t(0), m_levels.size(), [&](size_t i) {
+        m_gradientLevels[i] = std::make_unique<GradientVolume>(*m_levels[i], gradientVolume.storage());
+        m_gradientLevels[i]->interpolationMode = gradientVolume.interpolationMode;
+    });
+}
+
+VolumePyramid::VolumePyramid(const Volume& volume, const GradientVolume& gradientVolume, std::vector<std::unique_ptr<Volume>> levels,
+    std::vector<std::unique_ptr<GradientVolume>> gradientLevels)
+    : m_pVolume(&volume)
+    , m_pGradientVolume(&gradientVolume)
+    , m_levels(std::move(levels))
+    , m_gradientLevels(std::move(gradientLevels))
+{
+    for (auto& pLevel : m_levels)
+        pLevel->interpolationMode = volume.interpolationMode;
+    for (auto& pGradientLevel : m_gradientLevels)
+        pGradientLevel->interpolationMode = gradientVolume.interpolationMode;
+}
+
+size_t VolumePyramid::numLevels() const
+{
+    return m_levels.size() + 1;
+}
+
+const Volume& VolumePyramid::level(size_t level) const
+{
+    return level == 0 ? *m_pVolume : *m_levels[level - 1];
+}
+
+const GradientVolume& VolumePyramid::gradientLevel(size_t level) const
+{
+    return level == 0 ? *m_pGradientVolume : *m_gradientLevels[level - 1];
+}
+
+void VolumePyramid::setInterpolationMode(InterpolationMode interpolationMode)
+{
+    for (auto& pLevel : m_levels)
+        pLevel->interpolationMode = interpolationMode;
+    for (auto& pGradientLevel : m_gradientLevels)
+        pGradientLevel->interpolationMode = interpolationMode;
+}
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include "brick_pager.h"
+#include "gradient_volume.h"
+#include "volume.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <memory>
+#include <vector>
+
+namespace volume {
+
+// Levels of detail of a volume and its gradients. Level 0 is the volume itself and every next level has half the
+// resolution of the previous one: voxel i of level k is the average of the 2^k x 2^k x 2^k voxels of level 0 that
+// start at voxel 2^k * i. Sampling a coarser level where a sample covers many voxels avoids aliasing and reads far
+// less memory than sampling the full volume.
+class VolumePyramid {
+public:
+    static constexpr size_t maxLevels = 8;
+    // Levels are added until the smallest dimension of a level would drop below minLevelSize.
+    static constexpr int minLevelSize = 8;
+
+public:
+    // The volume and gradient volume must outlive the pyramid. The coarse levels use the same voxel layout and gradient
+    // storage as the volume and gradient volume.
+    VolumePyramid(const Volume& volume, const GradientVolume& gradientVolume);
+    // Takes over coarse levels that were built before (see DerivedDataCache): levels[i] is level i + 1 and
+    // gradientLevels[i] its gradients.
+    VolumePyramid(const Volume& volume, const GradientVolume& gradientVolume, std::vector<std::unique_ptr<Volume>> levels,
+        std::vector<std::unique_ptr<GradientVolume>> gradientLevels);
+
+    size_t numLevels() const;
+    const Volume& level(size_t level) const;
+    const GradientVolume& gradientLevel(size_t level) const;
+    // Sets the interpolation mode of the coarse levels; level 0 keeps the mode of the original volume.
+    void setInterpolationMode(InterpolationMode interpolationMode);
+
+    // Position in the voxel coordinates of the given level of a position in the voxel coordinates of level 0.
+    static glm::vec3 levelCoordinate(const glm::vec3& coord, size_t level)
+    {
+        const float scale = std::ldexp(1.0f, -int(level));
+        return coord * scale - 0.5f * (1.0f - scale);
+    }
+
+private:
+    const Volume* m_pVolume;
+    const GradientVolume* m_pGradientVolume;
+    // Coarse levels 1, 2, ... (the gradient volumes keep a pointer to their level, so the levels may not move).
+    std::vector<std::unique_ptr<Volume>> m_levels;
+    std::vector<std::unique_ptr<GradientVolume>> m_gradientLevels;
+};
+
+// Callable with the interface of VolumeSampler that samples the level of a pyramid that matches the footprint of a
+// sample. The footprint grows linearly with the distance to the eye (along the rays of a perspective camera): a sample
+// at distance d covers footprintScale * d voxels of level 0, and it is taken from level floor(log2(footprint)). A ray
+// therefore samples successively coarser levels over segments whose length doubles from one level to the next.
+// gradient(coord) returns the gradient of the same level as operator()(coord).
+//
+// With a brick pager (see BrickPager) samples whose brick of level 0 is not resident are taken from level 1 instead,
+// while the brick is being loaded. A footprintScale of 0 always samples level 0 (where it is resident).
+template <typename T, InterpolationMode Mode>
+class PyramidSampler {
+public:
+    static constexpr InterpolationMode interpolationMode = Mode;
+
+    PyramidSampler(const VolumePyramid* pPyramid, const glm::vec3& eye, float footprintScale, BrickPager* pBrickPager = nullptr)
+        : m_numLevels(pPyramid->numLevels())
+        , m_maxLevel(int(m_numLevels) - 1)
+        , m_pBrickPager(pBrickPager)
+        , m_eye(eye)
+        , m_footprintScale2(footprintScale * footprintScale)
+    {
+        for (size_t level = 0; level < m_numLevels; level++) {
+            m_levels[level] = &pPyramid->level(level);
+            m_gradientLevels[level] = &pPyramid->gradientLevel(level);
+            m_upper[level] = glm::vec3(m_levels[level]->dims() - 1);
+            m_scale[level] = std::ldexp(1.0f, -int(level));
+        }
+    }
+
+    size_t level(const glm::vec3& coord) const
+    {
+        const size_t level = this->level(coord.x, coord.y, coord.z);
+        return level == 0 && !isResident(coord) ? fallbackLevel() : level;
+    }
+
+    float operator()(const glm::vec3& coord) const
+    {
+        const size_t level = this->level(coord);
+        if (level == 0)
+            return m_levels[0]->template getVoxelInterpolate<T, Mode>(coord);
+        return m_levels[level]->template getVoxelInterpolate<T, Mode>(levelCoordinate(coord, level));
+    }
+
+    // Neighbouring rays take their samples at almost the same distance, so the whole packet samples one level: the
+    // finest level of its lanes. Lanes outside of the volume (negative coordinates) are ignored. If any lane would
+    // sample a brick that is not resident, the packet samples the fallback level.
+    template <size_t N>
+    std::array<float, N> operator()(const CoordinatePacket<N>& coords) const
+    {
+        // Lanes outside of the volume count as the coarsest level.
+        std::array<size_t, N> levels;
+        for (size_t i = 0; i < N; i++)
+            levels[i] = coords.x[i] >= 0.0f ? level(coords.x[i], coords.y[i], coords.z[i]) : m_numLevels - 1;
+        size_t level = *std::min_element(std::begin(levels), std::end(levels));
+        if (level == 0 && m_pBrickPager) {
+            for (size_t i = 0; i < N; i++) {
+                if (levels[i] == 0 && !m_pBrickPager->acquire(glm::vec3(coords.x[i], coords.y[i], coords.z[i])))
+                    level = fallbackLevel();
+            }
+        }
+        if (level == 0)
+            return m_levels[0]->template getVoxelInterpolate<T, Mode, N>(coords);
+
+        const float scale = m_scale[level], offset = 0.5f * (1.0f - scale);
+        const glm::vec3& upper = m_upper[level];
+        CoordinatePacket<N> levelCoords;
+        for (size_t i = 0; i < N; i++) {
+            levelCoords.x[i] = std::clamp(coords.x[i] * scale - offset, 0.0f, upper.x);
+            levelCoords.y[i] = std::clamp(coords.y[i] * scale - offset, 0.0f, upper.y);
+            levelCoords.z[i] = std::clamp(coords.z[i] * scale - offset, 0.0f, upper.z);
+        }
+        return m_levels[level]->template getVoxelInterpolate<T, Mode, N>(levelCoords);
+    }
+
+    // The gradients of a coarse level are computed per voxel of that level; they are scaled back to level 0 voxels.
+    GradientVoxel gradient(const glm::vec3& coord) const
+    {
+        const size_t level = this->level(coord);
+        if (level == 0)
+            return m_gradientLevels[0]->getGradientVoxel(coord);
+        const GradientVoxel gradient = m_gradientLevels[level]->getGradientVoxel(levelCoordinate(coord, level));
+        return GradientVoxel { gradient.dir * m_scale[level], gradient.magnitude * m_scale[level] };
+    }
+
+private:
+    bool isResident(const glm::vec3& coord) const
+    {
+        return !m_pBrickPager || m_pBrickPager->acquire(coord);
+    }
+    // Level 1 is resident as a whole; a pyramid without it can only read the bricks of level 0 directly.
+    size_t fallbackLevel() const
+    {
+        return std::min(size_t(1), m_numLevels - 1);
+    }
+
+    size_t level(float x, float y, float z) const
+    {
+        const float dx = x - m_eye.x, dy = y - m_eye.y, dz = z - m_eye.z;
+        // floor(log2(sqrt(x))) == floor(log2(x)) / 2, which avoids the square root. floor(log2(x)) is the exponent of
+        // the (positive) float; denormals and 0 give a negative level.
+        const float footprint2 = (dx * dx + dy * dy + dz * dz) * m_footprintScale2;
+        const int level = (int(std::bit_cast<uint32_t>(footprint2) >> 23) - 127) / 2;
+        return static_cast<size_t>(std::clamp(level, 0, m_maxLevel));
+    }
+
+    // The border voxels of a coarse level are centered up to half a level 0 voxel inside of the border of level 0, so
+    // positions are clamped to the level (instead of sampling the zeros outside of it).
+    glm::vec3 levelCoordinate(const glm::vec3& coord, size_t level) const
+    {
+        // Same as VolumePyramid::levelCoordinate.
+        const float scale = m_scale[level], offset = 0.5f * (1.0f - scale);
+        const glm::vec3& upper = m_upper[level];
+        return glm::vec3(
+            std::clamp(coord.x * scale - offset, 0.0f, upper.x),
+            std::clamp(coord.y * scale - offset, 0.0f, upper.y),
+            std::clamp(coord.z * scale - offset, 0.0f, upper.z));
+    }
+
+private:
+    size_t m_numLevels;
+    int m_maxLevel;
+    BrickPager* m_pBrickPager;
+    glm::vec3 m_eye;
+    float m_footprintScale2;
+    std::array<const Volume*, VolumePyramid::maxLevels> m_levels {};
+    std::array<const GradientVolume*, VolumePyramid::maxLevels> m_gradientLevels {};
+    std::array<glm::vec3, VolumePyramid::maxLevels> m_upper {};
+    // Size of a level 0 voxel in voxels of the level.
+    std::array<float, VolumePyramid::maxLevels> m_scale {};
+};
+
+// Calls f(sampler) with a PyramidSampler for the voxel type and interpolation mode of the volume (like
+// Volume::visitSampler).
+template <typename F>
+decltype(auto) visitPyramidSampler(const VolumePyramid& pyramid, const glm::vec3& eye, float footprintScale, BrickPager* pBrickPager, F&& f)
+{
+    const Volume& volume = pyramid.level(0);
+    return volume.visitVoxelType([&]<typename T>(T) -> decltype(auto) {
+        switch (volume.interpolationMode) {
+        case InterpolationMode::NearestNeighbour:
+            return f(PyramidSampler<T, InterpolationMode::NearestNeighbour>(&pyramid, eye, footprintScale, pBrickPager));
+        case InterpolationMode::Linear:
+            return f(PyramidSampler<T, InterpolationMode::Linear>(&pyramid, eye, footprintScale, pBrickPager));
+        default:
+            return f(PyramidSampler<T, InterpolationMode::Cubic>(&pyramid, eye, footprintScale, pBrickPager));
+        }
+    });
+}
+}
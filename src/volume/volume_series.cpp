@@ -0,0 +1,185 @@
+#include "volume_series.h"
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace volume {
+
+VolumeSeries::VolumeSeries(std::vector<std::filesystem::path> files, VoxelLayout layout, GradientStorage gradientStorage,
+    InterpolationMode interpolationMode, size_t numPrefetched)
+    : m_files(std::move(files))
+    , m_layout(layout)
+    , m_gradientStorage(gradientStorage)
+    , m_numPrefetched(numPrefetched)
+    , m_interpolationMode(interpolationMode)
+    , m_slots(std::min(2 * numPrefetched + 1, m_files.size()) + 1)
+{
+    m_loader = std::thread([this]() { loaderLoop(); });
+}
+
+VolumeSeries::~VolumeSeries()
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_stopRequested = true;
+    }
+    m_requestCondition.notify_one();
+    m_loader.join();
+}
+
+std::vector<std::filesystem::path> VolumeSeries::listFiles(const std::filesystem::path& directory)
+{
+    std::vector<std::filesystem::path> files;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".fld")
+            files.push_back(entry.path());
+    }
+    std::sort(std::begin(files), std::end(files));
+    return files;
+}
+
+size_t VolumeSeries::numTimesteps() const
+{
+    return m_files.size();
+}
+
+void VolumeSeries::seek(size_t step)
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_currentStep = step;
+    }
+    m_requestCondition.notify_one();
+}
+
+bool VolumeSeries::isLoaded(size_t step) const
+{
+    std::lock_guard lock { m_mutex };
+    const Slot* pSlot = findSlot(step);
+    return pSlot && pSlot->loaded;
+}
+
+const VolumeSeries::Timestep& VolumeSeries::acquire(size_t step)
+{
+    seek(step);
+    std::unique_lock lock { m_mutex };
+    const Slot* pSlot = nullptr;
+    m_loadedCondition.wait(lock, [&]() {
+        pSlot = findSlot(step);
+        return pSlot && pSlot->loaded;
+    });
+    // The previously acquired slot may be reused from now on.
+    if (m_pAcquiredSlot != pSlot) {
+        m_pAcquiredSlot = pSlot;
+        m_requestCondition.notify_one();
+    }
+    return pSlot->timestep;
+}
+
+void VolumeSeries::setInterpolationMode(InterpolationMode interpolationMode)
+{
+    std::lock_guard lock { m_mutex };
+    m_interpolationMode = interpolationMode;
+    for (Slot& slot : m_slots) {
+        if (!slot.loaded)
+            continue;
+        slot.timestep.pVolume->interpolationMode = interpolationMode;
+        slot.timestep.pGradientVolume->interpolationMode = interpolationMode;
+    }
+}
+
+// Whether the step lies within m_numPrefetched of the current step (wrapping around). Must be called with m_mutex
+// locked.
+bool VolumeSeries::isWanted(size_t step) const
+{
+    const size_t n = m_files.size();
+    const size_t forward = (step + n - m_currentStep) % n, backward = (m_currentStep + n - step) % n;
+    return std::min(forward, backward) <= m_numPrefetched;
+}
+
+// The current step if it is not loaded, otherwise the closest neighbour that is not (alternating between the next and
+// the previous step). Must be called with m_mutex locked.
+std::optional<size_t> VolumeSeries::nextMissingStep() const
+{
+    const size_t n = m_files.size();
+    if (m_currentStep >= n)
+        return {};
+    const auto isMissing = [&](size_t step) {
+        return std::none_of(std::begin(m_slots), std::end(m_slots), [&](const Slot& slot) { return slot.optStep == step; });
+    };
+    for (size_t distance = 0; distance <= m_numPrefetched; distance++) {
+        const size_t next = (m_currentStep + distance) % n, previous = (m_currentStep + n - distance % n) % n;
+        if (isMissing(next))
+            return next;
+        if (isMissing(previous))
+            return previous;
+    }
+    return {};
+}
+
+// Must be called with m_mutex locked.
+const VolumeSeries::Slot* VolumeSeries::findSlot(size_t step) const
+{
+    const auto iter = std::find_if(std::begin(m_slots), std::end(m_slots), [&](const Slot& slot) { return slot.optStep == step; });
+    return iter != std::end(m_slots) ? &*iter : nullptr;
+}
+
+// A slot that is neither acquired nor holds a wanted step. There is always one while a wanted step is missing, since
+// there is a slot for every wanted step plus one for the acquired step. Must be called with m_mutex locked.
+VolumeSeries::Slot& VolumeSeries::freeSlot()
+{
+    Slot* pFree = nullptr;
+    for (Slot& slot : m_slots) {
+        if (&slot == m_pAcquiredSlot)
+            continue;
+        if (!slot.optStep)
+            return slot;
+        if (!isWanted(*slot.optStep))
+            pFree = &slot;
+    }
+    return *pFree;
+}
+
+void VolumeSeries::loaderLoop()
+{
+    std::unique_lock lock { m_mutex };
+    while (true) {
+        std::optional<size_t> optStep;
+        m_requestCondition.wait(lock, [&]() {
+            optStep = nextMissingStep();
+            return m_stopRequested || optStep;
+        });
+        if (m_stopRequested)
+            return;
+
+        // Nobody reads a slot that is not loaded, so it is filled without holding the lock.
+        Slot& slot = freeSlot();
+        slot.optStep = *optStep;
+        slot.loaded = false;
+        lock.unlock();
+        load(slot.timestep, *optStep);
+        lock.lock();
+
+        slot.timestep.pVolume->interpolationMode = m_interpolationMode;
+        slot.timestep.pGradientVolume->interpolationMode = m_interpolationMode;
+        slot.loaded = true;
+        m_loadedCondition.notify_all();
+    }
+}
+
+void VolumeSeries::load(Timestep& timestep, size_t step) const
+{
+    auto pVolume = std::make_unique<Volume>(m_files[step], m_layout);
+    std::unique_ptr<GradientVolume> pGradientVolume;
+    if (timestep.pGradientVolume)
+        pGradientVolume = std::make_unique<GradientVolume>(*pVolume, m_gradientStorage, std::move(*timestep.pGradientVolume));
+    else
+        pGradientVolume = std::make_unique<GradientVolume>(*pVolume, m_gradientStorage);
+    // The previous gradient volume points to the previous volume, so it goes first.
+    timestep.pGradientVolume = std::move(pGradientVolume);
+    timestep.pVolume = std::move(pVolume);
+    timestep.optMacroCellGrid.emplace(*timestep.pVolume);
+    computeHistogram2D(*timestep.pVolume, *timestep.pGradientVolume, timestep.histogram);
+    timestep.step = step;
+}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "gradient_volume.h"
+#include "histogram_2d.h"
+#include "macro_cell_grid.h"
+#include "volume.h"
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace volume {
+
+// A time-varying volume: one .fld file per timestep. A loader thread keeps the timesteps around the current one (see
+// seek) loaded in a fixed number of slots, together with everything that the renderer and the menu derive from a volume
+// (gradients, macro cells and the 2D histogram), so that playback only has to swap pointers. The slot of a timestep
+// that is no longer needed is reused for the next one, including the buffers of its gradients and histogram. Playback
+// wraps around, so the timestep after the last one is the first one.
+class VolumeSeries {
+public:
+    struct Timestep {
+        size_t step { 0 };
+        std::unique_ptr<Volume> pVolume;
+        std::unique_ptr<GradientVolume> pGradientVolume;
+        std::optional<MacroCellGrid> optMacroCellGrid;
+        Histogram2D histogram;
+    };
+
+public:
+    // Keeps numPrefetched timesteps before and after the current timestep loaded (with the layout and gradient storage
+    // of a single volume, see Volume and GradientVolume). The files are the timesteps in order.
+    VolumeSeries(std::vector<std::filesystem::path> files, VoxelLayout layout, GradientStorage gradientStorage,
+        InterpolationMode interpolationMode, size_t numPrefetched = 1);
+    ~VolumeSeries();
+
+    VolumeSeries(const VolumeSeries&) = delete;
+    VolumeSeries& operator=(const VolumeSeries&) = delete;
+
+    // The .fld files in a directory sorted by name, which is the order of the timesteps.
+    static std::vector<std::filesystem::path> listFiles(const std::filesystem::path& directory);
+
+    size_t numTimesteps() const;
+    // Makes step the current timestep: it is loaded first, followed by its neighbours.
+    void seek(size_t step);
+    bool isLoaded(size_t step) const;
+    // Seeks to the timestep and waits until it is loaded (which returns immediately if isLoaded). The timestep stays
+    // loaded (and unchanged) until another timestep is acquired, which keeps the timestep that is being rendered alive
+    // while the current timestep moves on.
+    const Timestep& acquire(size_t step);
+    // Sets the interpolation mode of all timesteps, including those that are loaded later. The acquired timestep may
+    // not be in use (by a renderer) while the mode changes.
+    void setInterpolationMode(InterpolationMode interpolationMode);
+
+private:
+    struct Slot {
+        std::optional<size_t> optStep;
+        bool loaded { false };
+        Timestep timestep;
+    };
+
+    bool isWanted(size_t step) const;
+    std::optional<size_t> nextMissingStep() const;
+    const Slot* findSlot(size_t step) const;
+    Slot& freeSlot();
+    void loaderLoop();
+    void load(Timestep& timestep, size_t step) const;
+
+private:
+    const std::vector<std::filesystem::path> m_files;
+    const VoxelLayout m_layout;
+    const GradientStorage m_gradientStorage;
+    const size_t m_numPrefetched;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_requestCondition;
+    std::condition_variable m_loadedCondition;
+    InterpolationMode m_interpolationMode;
+    size_t m_currentStep { 0 };
+    // The current timestep and its neighbours, plus one slot for the acquired timestep (which may lie elsewhere).
+    std::vector<Slot> m_slots;
+    const Slot* m_pAcquiredSlot { nullptr };
+    bool m_stopRequested { false };
+
+    std::thread m_loader;
+};
+}
@@ -0,0 +1,52 @@
+#include "voxel_indexer.h"
+
+namespace volume {
+
+// For the bricked layout a voxel (x, y, z) lives in brick (x, y, z) / brickSize at local position (x, y, z) % brickSize.
+// Its index is brickIndex * brickSize^3 + localIndex, which splits into a sum of one term per axis.
+VoxelIndexer::VoxelIndexer(const glm::ivec3& dim, VoxelLayout layout)
+    : m_dim(dim)
+    , m_layout(layout)
+    , m_offsetX(static_cast<size_t>(dim.x))
+    , m_offsetY(static_cast<size_t>(dim.y))
+    , m_offsetZ(static_cast<size_t>(dim.z))
+{
+    const auto dimX = static_cast<size_t>(dim.x);
+    const auto dimY = static_cast<size_t>(dim.y);
+    const auto dimZ = static_cast<size_t>(dim.z);
+
+    if (layout == VoxelLayout::Linear) {
+        for (size_t x = 0; x < dimX; x++)
+            m_offsetX[x] = x;
+        for (size_t y = 0; y < dimY; y++)
+            m_offsetY[y] = y * dimX;
+        for (size_t z = 0; z < dimZ; z++)
+            m_offsetZ[z] = z * dimX * dimY;
+        m_storageSize = dimX * dimY * dimZ;
+    } else {
+        constexpr auto bs = static_cast<size_t>(brickSize);
+        const size_t bricksX = (dimX + bs - 1) / bs;
+        const size_t bricksY = (dimY + bs - 1) / bs;
+        const size_t bricksZ = (dimZ + bs - 1) / bs;
+        const size_t brickVoxels = bs * bs * bs;
+
+        for (size_t x = 0; x < dimX; x++)
+            m_offsetX[x] = (x / bs) * brickVoxels + (x % bs);
+        for (size_t y = 0; y < dimY; y++)
+            m_offsetY[y] = (y / bs) * brickVoxels * bricksX + (y % bs) * bs;
+        for (size_t z = 0; z < dimZ; z++)
+            m_offsetZ[z] = (z / bs) * brickVoxels * bricksX * bricksY + (z % bs) * bs * bs;
+        m_storageSize = bricksX * bricksY * bricksZ * brickVoxels;
+    }
+}
+
+VoxelLayout VoxelIndexer::layout() const
+{
+    return m_layout;
+}
+
+size_t VoxelIndexer::storageSize() const
+{
+    return m_storageSize;
+}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <vector>
+
+namespace volume {
+
+enum class VoxelLayout {
+    Linear = 0, // Slice-major: x + dim.x * (y + dim.y * z).
+    Bricked // Bricks of brickSize^3 voxels stored contiguously, bricks in slice-major order.
+};
+
+// Maps voxel coordinates to an index into the voxel storage for a given layout. The index is the sum of three
+// per-axis offsets that are precomputed in tables, so both layouts cost three loads and two additions.
+class VoxelIndexer {
+public:
+    static constexpr int brickSize = 8;
+
+public:
+    VoxelIndexer() = default;
+    VoxelIndexer(const glm::ivec3& dim, VoxelLayout layout);
+
+    VoxelLayout layout() const;
+    // Number of elements the storage needs (bricked storage is padded to whole bricks).
+    size_t storageSize() const;
+
+    bool contains(int x, int y, int z) const
+    {
+        return static_cast<unsigned>(x) < static_cast<unsigned>(m_dim.x)
+            && static_cast<unsigned>(y) < static_cast<unsigned>(m_dim.y)
+            && static_cast<unsigned>(z) < static_cast<unsigned>(m_dim.z);
+    }
+    size_t index(int x, int y, int z) const
+    {
+        return offsetX(x) + offsetY(y) + offsetZ(z);
+    }
+    // The per-axis terms of index, so that a neighbourhood of voxels can be gathered with one addition per voxel.
+    size_t offsetX(int x) const { return m_offsetX[static_cast<size_t>(x)]; }
+    size_t offsetY(int y) const { return m_offsetY[static_cast<size_t>(y)]; }
+    size_t offsetZ(int z) const { return m_offsetZ[static_cast<size_t>(z)]; }
+
+    // Reorder voxels that are stored linearly into this layout.
+    template <typename T>
+    std::vector<T> fromLinear(gsl::span<const T> linear) const;
+
+private:
+    glm::ivec3 m_dim { 0 };
+    VoxelLayout m_layout { VoxelLayout::Linear };
+    size_t m_storageSize { 0 };
+    std::vector<size_t> m_offsetX, m_offsetY, m_offsetZ;
+};
+
+template <typename T>
+std::vector<T> VoxelIndexer::fromLinear(gsl::span<const T> linear) const
+{
+    std::vector<T> out(m_storageSize, T {});
+    size_t i = 0;
+    for (int z = 0; z < m_dim.z; z++) {
+        for (int y = 0; y < m_dim.y; y++) {
+            for (int x = 0; x < m_dim.x; x++) {
+                out[index(x, y, z)] = linear[i++];
+            }
+        }
+    }
+    return out;
+}
+}